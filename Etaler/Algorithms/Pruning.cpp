@@ -0,0 +1,177 @@
+#include "Pruning.hpp"
+
+#include <algorithm>
+
+using namespace et;
+
+static size_t countBelow(const std::vector<int32_t>& activity, size_t min_activity)
+{
+	return std::count_if(activity.begin(), activity.end(), [min_activity](auto v){ return (size_t)v < min_activity; });
+}
+
+size_t SPActivityStats::numDeadColumns(size_t min_activity) const
+{
+	return countBelow(column_activity, min_activity);
+}
+
+size_t SPActivityStats::numDeadInputs(size_t min_activity) const
+{
+	return countBelow(input_activity, min_activity);
+}
+
+static std::vector<bool> toBoolVector(const Tensor& x)
+{
+	if(x.dtype() == DType::Bool)
+		return x.toHost<bool>();
+	return x.cast(DType::Bool).toHost<bool>();
+}
+
+SPActivityStats et::collectActivityStats(const SpatialPooler& sp, const std::vector<Tensor>& samples)
+{
+	SPActivityStats stats;
+	stats.column_activity.resize(sp.output_shape_.volume(), 0);
+	stats.input_activity.resize(sp.input_shape_.volume(), 0);
+	stats.num_samples = samples.size();
+
+	for(const auto& x : samples) {
+		std::vector<bool> input = toBoolVector(x);
+		std::vector<bool> output = sp.compute(x).toHost<bool>();
+		for(size_t i=0;i<input.size();i++)
+			stats.input_activity[i] += input[i];
+		for(size_t i=0;i<output.size();i++)
+			stats.column_activity[i] += output[i];
+	}
+	return stats;
+}
+
+PrunedSpatialPooler et::pruneSpatialPooler(const SpatialPooler& sp, const SPActivityStats& stats
+	, size_t min_column_activity, size_t min_input_activity)
+{
+	size_t input_size = sp.input_shape_.volume();
+	size_t num_cells = sp.output_shape_.volume();
+	et_check(stats.input_activity.size() == input_size && stats.column_activity.size() == num_cells
+		, "The activity statistics are not collected from this SpatialPooler");
+
+	PrunedSpatialPooler res;
+	res.input_shape = sp.input_shape_;
+	res.output_shape = sp.output_shape_;
+
+	std::vector<uint8_t> input_kept(input_size, false);
+	for(size_t i=0;i<input_size;i++) {
+		if((size_t)stats.input_activity[i] < min_input_activity)
+			continue;
+		input_kept[i] = true;
+		res.input_index.push_back(i);
+	}
+	for(size_t i=0;i<num_cells;i++) {
+		if((size_t)stats.column_activity[i] >= min_column_activity)
+			res.column_index.push_back(i);
+	}
+	et_check(res.input_index.size() != 0, "All input bits are pruned");
+	et_check(res.column_index.size() != 0, "All columns are pruned");
+
+	// Keep the synapses of the remaining columns that connect to the remaining inputs. They still point at the
+	// original input bits. Rows are padded with -1s
+	size_t width = sp.permanences_.shape().back();
+	std::vector<int32_t> conns = sp.connections().toHost<int32_t>();
+	std::vector<float> perms = sp.permanences().cast(DType::Float).toHost<float>();
+	std::vector<float> average_activity = sp.average_activity_.cast(DType::Float).toHost<float>();
+
+	std::vector<std::vector<std::pair<int32_t, float>>> rows(res.column_index.size());
+	size_t new_width = 1;
+	for(size_t i=0;i<rows.size();i++) {
+		size_t cell = res.column_index[i];
+		for(size_t j=0;j<width;j++) {
+			int32_t target = conns[cell*width+j];
+			if(target == -1)
+				break;
+			if(input_kept[target])
+				rows[i].push_back({target, perms[cell*width+j]});
+		}
+		new_width = std::max(new_width, rows[i].size());
+	}
+
+	std::vector<int32_t> new_conns(rows.size()*new_width, -1);
+	std::vector<float> new_perms(rows.size()*new_width, 0);
+	std::vector<float> new_average_activity(rows.size());
+	for(size_t i=0;i<rows.size();i++) {
+		for(size_t j=0;j<rows[i].size();j++) {
+			new_conns[i*new_width+j] = rows[i][j].first;
+			new_perms[i*new_width+j] = rows[i][j].second;
+		}
+		new_average_activity[i] = average_activity[res.column_index[i]];
+	}
+
+	Backend* backend = sp.permanences_.backend();
+	Shape new_output_shape = {(intmax_t)res.column_index.size()};
+	Shape synapse_shape = {(intmax_t)rows.size(), (intmax_t)new_width};
+
+	SpatialPooler& p = res.sp;
+	p = sp;
+	p.output_shape_ = new_output_shape;
+	p.connections_ = Tensor(synapse_shape, new_conns.data(), backend);
+	p.permanences_ = Tensor(synapse_shape, new_perms.data(), backend).cast(sp.permanences_.dtype());
+	p.average_activity_ = Tensor(new_output_shape, new_average_activity.data(), backend);
+	p.procedural_ = false;
+	p.has_unconnected_synapses_ = true;
+	// Let the same number of columns win. The 0.5 guards against globalInhibition rounding down
+	size_t num_active = num_cells*sp.global_density_;
+	p.global_density_ = std::min(1.f, (num_active+0.5f)/rows.size());
+	p.permanence_offsets_ = Tensor(); // The permanences are already effective
+	p.setSparseLearning(sp.sparseLearning(), sp.renormalize_interval_);
+	p.setIncremental(sp.incremental());
+
+	res.buildLayoutMaps();
+	return res;
+}
+
+void PrunedSpatialPooler::buildLayoutMaps()
+{
+	Backend* backend = sp.permanences().backend();
+	std::vector<int32_t> expand(output_shape.volume(), -1);
+	for(size_t i=0;i<column_index.size();i++)
+		expand[column_index[i]] = i;
+
+	Shape expand_shape = output_shape + Shape{1};
+	Shape compact_shape = {(intmax_t)column_index.size(), 1};
+	expand_connections_ = Tensor(expand_shape, expand.data(), backend);
+	expand_permanences_ = ones(expand_shape, DType::Float, backend);
+	compact_connections_ = Tensor(compact_shape, column_index.data(), backend);
+	compact_permanences_ = ones(compact_shape, DType::Float, backend);
+}
+
+// Copies the values of y through the single synapse of every cell. Cells without one are off
+static Tensor selectCells(const Tensor& y, const Tensor& connections, const Tensor& permanences)
+{
+	const Tensor& x = y.dtype() == DType::Bool ? y : y.cast(DType::Bool);
+	return cellActivity(x, connections, permanences, 0.5, 1, true).cast(DType::Bool);
+}
+
+Tensor PrunedSpatialPooler::compactOutput(const Tensor& y) const
+{
+	et_check(y.shape() == output_shape, "Output tensor shape " + to_string(y.shape()) +" does not match expected shape " + to_string(output_shape));
+	return selectCells(y, compact_connections_, compact_permanences_);
+}
+
+Tensor PrunedSpatialPooler::expandOutput(const Tensor& y) const
+{
+	et_check(y.size() == column_index.size(), "Expecting " + std::to_string(column_index.size()) + " compact columns, got "
+		+ std::to_string(y.size()));
+	return selectCells(y, expand_connections_, expand_permanences_);
+}
+
+StateDict PrunedSpatialPooler::states() const
+{
+	return {{"sp", sp.states()}, {"input_index", input_index}, {"column_index", column_index}
+		, {"input_shape", input_shape}, {"output_shape", output_shape}};
+}
+
+void PrunedSpatialPooler::loadState(const StateDict& states)
+{
+	sp.loadState(std::any_cast<StateDict>(states.at("sp")));
+	input_index = std::any_cast<std::vector<int>>(states.at("input_index"));
+	column_index = std::any_cast<std::vector<int>>(states.at("column_index"));
+	input_shape = std::any_cast<Shape>(states.at("input_shape"));
+	output_shape = std::any_cast<Shape>(states.at("output_shape"));
+	buildLayoutMaps();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Etaler/Core/Tensor.hpp"
+#include "SpatialPooler.hpp"
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// How often the columns and input bits of a SpatialPooler are active over a dataset
+struct ETALER_EXPORT SPActivityStats
+{
+	std::vector<int32_t> column_activity; // Times each column (flattened) won the inhibition
+	std::vector<int32_t> input_activity; // Times each input bit (flattened) is on
+	size_t num_samples = 0;
+
+	size_t numDeadColumns(size_t min_activity=1) const;
+	size_t numDeadInputs(size_t min_activity=1) const;
+};
+
+// Runs the SP over the samples (without learning) and counts the activity
+SPActivityStats ETALER_EXPORT collectActivityStats(const SpatialPooler& sp, const std::vector<Tensor>& samples);
+
+// A SpatialPooler with the dead columns and the synapses to unused input bits removed. The synapses keep pointing
+// at the original input bits, so the input is passed to the compacted SP as is. The compacted SP outputs the kept
+// columns only. compute() expands them back to the original layout on the SP's backend so downstream consumers are
+// not affected, computeCompact() skips that. Removed columns are never active
+struct ETALER_EXPORT PrunedSpatialPooler
+{
+	Tensor compute(const Tensor& x) const { return expandOutput(sp.compute(x)); }
+	Tensor computeCompact(const Tensor& x) const { return sp.compute(x); }
+	void learn(const Tensor& x, const Tensor& y) { sp.learn(x, compactOutput(y)); }
+
+	// Conversion between the original and the compact output layouts. Runs on the SP's backend
+	Tensor compactOutput(const Tensor& y) const;
+	Tensor expandOutput(const Tensor& y) const;
+
+	StateDict states() const;
+	void loadState(const StateDict& states);
+
+	SpatialPooler sp; // The compacted SP. Takes the original input and has 1D output of the kept columns
+	std::vector<int32_t> input_index; // Original (flat) index of each input bit still connected to
+	std::vector<int32_t> column_index; // Original (flat) index of each kept column
+	Shape input_shape; // The original shapes
+	Shape output_shape;
+
+protected:
+	friend PrunedSpatialPooler pruneSpatialPooler(const SpatialPooler&, const SPActivityStats&, size_t, size_t);
+	void buildLayoutMaps();
+
+	// One synapse per cell, to the column of the other layout it takes the value of. cellActivity() over them
+	// copies the outputs between the layouts without a round trip through the host
+	Tensor expand_connections_; // Shape output_shape+{1}. -1 for the removed columns
+	Tensor expand_permanences_;
+	Tensor compact_connections_; // Shape {column_index.size(), 1}
+	Tensor compact_permanences_;
+};
+
+// Removes the columns active less than min_column_activity times and synapses to input bits on less than
+// min_input_activity times. The global density of the pruned SP is scaled so the same number of columns win
+PrunedSpatialPooler ETALER_EXPORT pruneSpatialPooler(const SpatialPooler& sp, const SPActivityStats& stats
+	, size_t min_column_activity=1, size_t min_input_activity=1);
+
+}
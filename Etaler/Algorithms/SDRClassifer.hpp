@@ -45,9 +45,7 @@ struct ETALER_EXPORT SDRClassifer
 		// Then check if new patterns have been added. If so, recalculate the mask
 		Tensor mask = mask_;
 		if(dirty_flag_ == true || density_ != density) {
-			mask_ = zeros_like(reference_.reshape({num_classes, input_shape_.volume()})).cast(DType::Bool);
-			for(intmax_t i=0;i<num_classes;i++)
-				mask_.view({i}) = globalInhibition(reference_.view({i}).flatten(), density);
+			mask_ = groupInhibition(reference_, input_shape_.volume(), density).reshape({num_classes, input_shape_.volume()});
 			mask = mask_;
 			density_ = density;
 			dirty_flag_ = false;
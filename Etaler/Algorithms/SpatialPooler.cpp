@@ -1,7 +1,13 @@
 #include "SpatialPooler.hpp"
 #include <Etaler/Core/Random.hpp>
+#include <Etaler/Core/TypedTensor.hpp>
 #include "Boost.hpp"
 
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <limits>
+
 using namespace et;
 
 template <typename T=size_t>
@@ -15,11 +21,15 @@ inline std::vector<T> vector_range(size_t start, size_t end)
 
 
 SpatialPooler::SpatialPooler(const Shape& input_shape, const Shape& output_shape, float potential_pool_pct, size_t seed
-	, float global_density, float boost_factor, Backend* b)
+	, float global_density, float boost_factor, Backend* b, bool procedural_connections)
 	: global_density_(global_density), boost_factor_(boost_factor), input_shape_(input_shape), output_shape_(output_shape)
+	, procedural_(procedural_connections), procedural_seed_(uint32_t(seed) ^ uint32_t(uint64_t(seed) >> 32))
 {
-	std::tie(connections_, permanences_) = F::gusianRandomSynapse(input_shape, output_shape, potential_pool_pct
-		, 0.11, 1, seed, b);
+	if(procedural_)
+		permanences_ = F::gusianRandomProceduralSynapse(input_shape, output_shape, potential_pool_pct, 0.11, 1, seed, b);
+	else
+		std::tie(connections_, permanences_) = F::gusianRandomSynapse(input_shape, output_shape, potential_pool_pct
+			, 0.11, 1, seed, b);
 	average_activity_ = constant(output_shape, global_density);
 }
 
@@ -27,8 +37,15 @@ Tensor SpatialPooler::compute(const Tensor& x) const
 {
 	et_check(x.shape() == input_shape_, "Input tensor shape " + to_string(x.shape()) +" does not match expected shape " + to_string(input_shape_));
 
-	Tensor activity = cellActivity(x, connections_, permanences_
-		, connected_permanence_, active_threshold_, false);
+	Tensor activity;
+	if(incremental_)
+		activity = incrementalActivity(x);
+	else if(procedural_)
+		activity = proceduralCellActivity(x, permanences_, procedural_seed_, connected_permanence_, active_threshold_);
+	else if(sparseLearning())
+		activity = cellActivityWithOffsets(x, connections_, permanences_, permanence_offsets_, connected_permanence_, active_threshold_, has_unconnected_synapses_);
+	else
+		activity = cellActivity(x, connections_, permanences_, connected_permanence_, active_threshold_, has_unconnected_synapses_);
 
 	if(boost_factor_ != 0)
 		activity = boost(activity, average_activity_, global_density_, boost_factor_);
@@ -43,12 +60,130 @@ void SpatialPooler::learn(const Tensor& x, const Tensor& y)
 {
 	et_assert(x.shape() == input_shape_);
 
-	learnCorrilation(x, y, connections_, permanences_, permanence_inc_, permanence_dec_);
+	if(procedural_)
+		proceduralLearnCorrilation(x, y, permanences_, procedural_seed_, permanence_inc_, permanence_dec_);
+	else if(sparseLearning()) {
+		learnCorrilationSparse(x, y, connections_, permanences_, permanence_offsets_, permanence_inc_, permanence_dec_, has_unconnected_synapses_);
+		if(++learn_steps_ >= renormalize_interval_)
+			renormalize();
+	}
+	else
+		learnCorrilation(x, y, connections_, permanences_, permanence_inc_, permanence_dec_, has_unconnected_synapses_);
+
+	if(incremental_ && incremental_state_.valid) {
+		std::vector<bool> learned = y.toHost<bool>();
+		for(size_t i=0;i<learned.size();i++) {
+			if(learned[i])
+				incremental_state_.learned_cells.push_back(i);
+		}
+	}
 
 	if(boost_factor_ != 0)
 		average_activity_ = average_activity_*0.9f + y * 0.1f;
 }
 
+Tensor SpatialPooler::computeApproximate(const Tensor& x, float synapse_fraction) const
+{
+	et_check(x.shape() == input_shape_, "Input tensor shape " + to_string(x.shape()) +" does not match expected shape " + to_string(input_shape_));
+	et_check(synapse_fraction > 0 && synapse_fraction <= 1, "synapse_fraction must be in range (0, 1]");
+	et_check(procedural_ || synapses_shuffled_, "computeApproximate() requires the synapses to be in random order. Call shuffleSynapses() first");
+
+	intmax_t width = permanences_.shape().back();
+	intmax_t num_synapses = std::max(intmax_t(1), (intmax_t)std::lround(width*synapse_fraction));
+	size_t threshold = std::lround(active_threshold_*(double)num_synapses/width);
+
+	// The first synapses of every cell. Still row contiguous so the kernels can read them in place
+	IndexList first_synapses(permanences_.dimensions()-1, all());
+	first_synapses.push_back(range(num_synapses));
+
+	Tensor activity;
+	if(procedural_)
+		activity = proceduralCellActivity(x, permanences_.view(first_synapses), procedural_seed_, connected_permanence_, threshold);
+	else if(sparseLearning())
+		activity = cellActivityWithOffsets(x, connections_.view(first_synapses), permanences_.view(first_synapses)
+			, permanence_offsets_, connected_permanence_, threshold, has_unconnected_synapses_);
+	else
+		activity = cellActivity(x, connections_.view(first_synapses), permanences_.view(first_synapses)
+			, connected_permanence_, threshold, has_unconnected_synapses_);
+
+	if(boost_factor_ != 0)
+		activity = boost(activity, average_activity_, global_density_, boost_factor_);
+
+	return globalInhibition(activity, global_density_);
+}
+
+ApproximationReport SpatialPooler::evaluateApproximation(const std::vector<Tensor>& samples, float synapse_fraction) const
+{
+	ApproximationReport report;
+	if(samples.size() == 0)
+		return report;
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto seconds = [](auto t0, auto t1) { return std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count(); };
+	Backend* backend = permanences_.backend();
+
+	std::vector<Tensor> exact(samples.size());
+	auto t0 = Clock::now();
+	for(size_t i=0;i<samples.size();i++)
+		exact[i] = compute(samples[i]);
+	backend->sync();
+	auto t1 = Clock::now();
+
+	std::vector<Tensor> approx(samples.size());
+	for(size_t i=0;i<samples.size();i++)
+		approx[i] = computeApproximate(samples[i], synapse_fraction);
+	backend->sync();
+	auto t2 = Clock::now();
+
+	report.exact_time = seconds(t0, t1)/samples.size();
+	report.approximate_time = seconds(t1, t2)/samples.size();
+
+	for(size_t i=0;i<samples.size();i++) {
+		int on_bits = sum(exact[i]).item<int>();
+		float overlap = on_bits == 0 ? 1.f : (float)sum(exact[i] && approx[i]).item<int>()/on_bits;
+		report.overlap += overlap;
+		report.min_overlap = std::min(report.min_overlap, overlap);
+	}
+	report.overlap /= samples.size();
+	return report;
+}
+
+void SpatialPooler::shuffleSynapses(size_t seed)
+{
+	synapses_shuffled_ = true;
+	if(procedural_)
+		return;
+	if(sparseLearning())
+		renormalize();
+
+	size_t width = connections_.shape().back();
+	std::vector<int32_t> conns = connections_.toHost<int32_t>();
+	std::vector<float> perms = permanences_.cast(DType::Float).toHost<float>();
+
+	pcg64 rng(seed);
+	std::vector<size_t> order(width);
+	std::vector<int32_t> conn_row(width);
+	std::vector<float> perm_row(width);
+	for(size_t i=0;i<conns.size()/width;i++) {
+		std::iota(order.begin(), order.end(), 0);
+		// Unused synapses (-1) have to stay at the end
+		auto used = std::find(conns.begin()+i*width, conns.begin()+(i+1)*width, -1) - (conns.begin()+i*width);
+		std::shuffle(order.begin(), order.begin()+used, rng);
+		for(size_t j=0;j<width;j++) {
+			conn_row[j] = conns[i*width+order[j]];
+			perm_row[j] = perms[i*width+order[j]];
+		}
+		std::copy(conn_row.begin(), conn_row.end(), conns.begin()+i*width);
+		std::copy(perm_row.begin(), perm_row.end(), perms.begin()+i*width);
+	}
+
+	Backend* backend = connections_.backend();
+	DType perm_type = permanences_.dtype();
+	connections_ = Tensor(connections_.shape(), conns.data(), backend);
+	permanences_ = Tensor(permanences_.shape(), perms.data(), backend).cast(perm_type);
+	incremental_state_.valid = false;
+}
+
 void SpatialPooler::loadState(const StateDict& states)
 {
 	permanence_inc_ = std::any_cast<float>(states.at("permanence_inc"));
@@ -58,17 +193,200 @@ void SpatialPooler::loadState(const StateDict& states)
 	global_density_ = std::any_cast<float>(states.at("global_density"));
 	input_shape_ = std::any_cast<Shape>(states.at("input_shape"));
 	output_shape_ = std::any_cast<Shape>(states.at("output_shape"));
-	connections_ = std::any_cast<Tensor>(states.at("connections"));
+	procedural_ = states.count("procedural_seed") != 0;
+	if(procedural_) {
+		procedural_seed_ = std::any_cast<int32_t>(states.at("procedural_seed"));
+		connections_ = Tensor();
+	}
+	else
+		connections_ = std::any_cast<Tensor>(states.at("connections"));
+	has_unconnected_synapses_ = states.count("has_unconnected_synapses") != 0;
 	permanences_ = std::any_cast<Tensor>(states.at("permanences"));
+	// The saved permanences already have the offsets applied
+	learn_steps_ = 0;
+	if(sparseLearning())
+		permanence_offsets_ = procedural_ ? Tensor() : zeros(output_shape_, DType::Float, permanences_.backend());
 	average_activity_ = std::any_cast<Tensor>(states.at("average_activity"));
 	boost_factor_ = std::any_cast<float>(states.at("boost_factor"));
+	synapses_shuffled_ = states.count("synapses_shuffled") != 0;
+	incremental_state_ = IncrementalState();
+}
+
+void SpatialPooler::setSparseLearning(bool enable, size_t renormalize_interval)
+{
+	et_check(enable == false || procedural_ == false, "Sparse learning is not supported with procedural connections");
+	et_check(renormalize_interval > 0, "renormalize_interval must be larger than 0");
+	if(sparseLearning())
+		renormalize();
+
+	renormalize_interval_ = renormalize_interval;
+	learn_steps_ = 0;
+	if(enable)
+		permanence_offsets_ = zeros(output_shape_, DType::Float, permanences_.backend());
+	else
+		permanence_offsets_ = Tensor();
+}
+
+void SpatialPooler::renormalize()
+{
+	if(sparseLearning() == false)
+		return;
+	renormalizePermanences(permanences_, permanence_offsets_);
+	learn_steps_ = 0;
+}
+
+Tensor SpatialPooler::permanences() const
+{
+	if(sparseLearning())
+		return effectivePermanences(permanences_, permanence_offsets_);
+	return permanences_;
+}
+
+Tensor SpatialPooler::connections() const
+{
+	if(procedural_)
+		return F::proceduralConnections(input_shape_, permanences_.shape(), procedural_seed_, permanences_.backend());
+	return connections_;
+}
+
+void SpatialPooler::setIncremental(bool enable)
+{
+	incremental_ = enable;
+	incremental_state_ = IncrementalState();
+}
+
+void SpatialPooler::buildIncrementalState() const
+{
+	IncrementalState& s = incremental_state_;
+	s = IncrementalState();
+
+	size_t input_size = input_shape_.volume();
+	size_t max_synapses_per_cell = permanences_.shape().back();
+	size_t num_cells = permanences_.size()/max_synapses_per_cell;
+	s.max_synapses_per_cell = max_synapses_per_cell;
+	s.connections = connections().toHost<int32_t>();
+	std::vector<float> perms = permanences().cast(DType::Float).toHost<float>();
+
+	s.connected.resize(perms.size());
+	for(size_t i=0;i<perms.size();i++)
+		s.connected[i] = perms[i] > connected_permanence_;
+
+	// Counting sort the synapses by their input bit
+	s.reverse_offsets.resize(input_size+1, 0);
+	for(auto target : s.connections) {
+		if(target != -1)
+			s.reverse_offsets[target+1]++;
+	}
+	for(size_t i=0;i<input_size;i++)
+		s.reverse_offsets[i+1] += s.reverse_offsets[i];
+	et_check(s.connections.size() <= std::numeric_limits<uint32_t>::max(), "Incremental mode supports up to 2^32-1 synapses");
+	s.reverse_synapses.resize(s.reverse_offsets.back());
+	std::vector<size_t> pos(s.reverse_offsets.begin(), s.reverse_offsets.end()-1);
+	for(size_t i=0;i<s.connections.size();i++) {
+		int32_t target = s.connections[i];
+		if(target != -1)
+			s.reverse_synapses[pos[target]++] = i;
+	}
+
+	// Start from an all zero input. The first compute() applies the whole input as the delta
+	s.input.resize(input_size, false);
+	s.overlap.resize(num_cells, 0);
+	s.valid = true;
+}
+
+void SpatialPooler::updateLearnedCells() const
+{
+	IncrementalState& s = incremental_state_;
+	if(s.learned_cells.size() == 0)
+		return;
+
+	size_t width = s.max_synapses_per_cell;
+	Tensor perms = permanences_.reshape({(intmax_t)s.overlap.size(), (intmax_t)width});
+	Tensor offsets = sparseLearning() ? permanence_offsets_.reshape({(intmax_t)s.overlap.size()}) : Tensor();
+
+	auto updateRow = [&](size_t cell, auto row, float offset) {
+		for(size_t j=0;j<width;j++) {
+			size_t synapse = cell*width+j;
+			uint8_t connected = float(row[j])+offset > connected_permanence_;
+			if(connected == s.connected[synapse])
+				continue;
+			s.connected[synapse] = connected;
+			int32_t target = s.connections[synapse];
+			if(target != -1 && s.input[target])
+				s.overlap[cell] += connected ? 1 : -1;
+		}
+	};
+
+	// On the host the learned rows are read in place
+	if(perms.data() != nullptr && (offsets.has_value() == false || offsets.data() != nullptr)) {
+		auto update = [&](auto typed_perms) {
+			TypedTensor<float, 1> typed_offsets = offsets.has_value() ? TypedTensor<float, 1>(offsets) : TypedTensor<float, 1>();
+			for(auto cell : s.learned_cells)
+				updateRow(cell, &typed_perms(cell, 0), typed_offsets.has_value() ? typed_offsets(cell) : 0.f);
+		};
+		if(perms.dtype() == DType::Half)
+			update(TypedTensor<half, 2>(perms));
+		else
+			update(TypedTensor<float, 2>(perms));
+		s.learned_cells.clear();
+		return;
+	}
+
+	// Otherwise they are gathered, so they are read back in one transfer instead of one per cell
+	svector<Tensor> perm_rows, offset_rows;
+	for(auto cell : s.learned_cells) {
+		perm_rows.push_back(perms.view({range((intmax_t)cell, (intmax_t)cell+1)}));
+		if(offsets.has_value())
+			offset_rows.push_back(offsets.view({range((intmax_t)cell, (intmax_t)cell+1)}));
+	}
+	std::vector<float> rows = cat(perm_rows).cast(DType::Float).toHost<float>();
+	std::vector<float> row_offsets = offsets.has_value() ? cat(offset_rows).toHost<float>() : std::vector<float>();
+	for(size_t i=0;i<s.learned_cells.size();i++)
+		updateRow(s.learned_cells[i], rows.data()+i*width, row_offsets.empty() ? 0.f : row_offsets[i]);
+	s.learned_cells.clear();
+}
+
+Tensor SpatialPooler::incrementalActivity(const Tensor& x) const
+{
+	et_check(x.dtype() == DType::Bool, "Incremental mode requires a boolean input");
+	IncrementalState& s = incremental_state_;
+	if(s.valid == false)
+		buildIncrementalState();
+	else {
+		// A cell may learn multiple times between computes
+		std::sort(s.learned_cells.begin(), s.learned_cells.end());
+		s.learned_cells.erase(std::unique(s.learned_cells.begin(), s.learned_cells.end()), s.learned_cells.end());
+		updateLearnedCells();
+	}
+
+	std::vector<bool> input = x.toHost<bool>();
+	size_t width = s.max_synapses_per_cell;
+	for(size_t i=0;i<input.size();i++) {
+		if(input[i] == s.input[i])
+			continue;
+		int32_t delta = input[i] ? 1 : -1;
+		for(size_t j=s.reverse_offsets[i];j<s.reverse_offsets[i+1];j++) {
+			uint32_t synapse = s.reverse_synapses[j];
+			if(s.connected[synapse])
+				s.overlap[synapse/width] += delta;
+		}
+	}
+	s.input = std::move(input);
+
+	std::vector<int32_t> activity(s.overlap.size());
+	for(size_t i=0;i<activity.size();i++)
+		activity[i] = s.overlap[i] >= (int32_t)active_threshold_ ? s.overlap[i] : 0;
+	return Tensor(output_shape_, activity.data(), permanences_.backend());
 }
 
 SpatialPooler SpatialPooler::to(Backend* b) const
 {
 	SpatialPooler sp = *this;
-	sp.connections_ = connections_.to(b);
+	if(procedural_ == false)
+		sp.connections_ = connections_.to(b);
 	sp.permanences_ = permanences_.to(b);
+	if(sparseLearning())
+		sp.permanence_offsets_ = permanence_offsets_.to(b);
 	sp.average_activity_ = average_activity_.to(b);
 
 	return sp;
@@ -17,23 +17,49 @@
 namespace et
 {
 
+// Accuracy and speed of SpatialPooler::computeApproximate() compared to compute()
+struct ApproximationReport
+{
+	float overlap = 0; // Average fraction of the on bits in the exact output that are also on in the approximation
+	float min_overlap = 1;
+	double exact_time = 0; // Seconds per compute
+	double approximate_time = 0;
+
+	double speedup() const { return approximate_time == 0 ? 0 : exact_time/approximate_time; }
+};
+
 struct ETALER_EXPORT SpatialPooler
 {
 	SpatialPooler() = default;
+	// With procedural_connections, the potential pool of each column is generated from the seed when used instead
+	// of being stored. Halving the memory used by the SP
 	SpatialPooler(const Shape& input_shape, const Shape& output_shape, float potential_pool_pct=0.75, size_t seed=42
-		, float global_density = 0.15, float boost_factor = 0, Backend* b = defaultBackend());
+		, float global_density = 0.15, float boost_factor = 0, Backend* b = defaultBackend(), bool procedural_connections=false);
 
 	Tensor compute(const Tensor& x) const;
 
 	void learn(const Tensor& x, const Tensor& y);
 
+	// Approximate inference. Only the first synapse_fraction of each column's synapses are evaluated and the active
+	// threshold is scaled accordingly. Lower fractions are faster but less accurate. Requires the synapses to be
+	// in random order. See shuffleSynapses()
+	Tensor computeApproximate(const Tensor& x, float synapse_fraction) const;
+
+	// Runs both compute() and computeApproximate() on the samples and reports how close the results are
+	ApproximationReport evaluateApproximation(const std::vector<Tensor>& samples, float synapse_fraction) const;
+
+	// Randomizes the order of the synapses within each column. compute() and learn() are not affected, but the
+	// first synapses of a column become a random sample of it's potential pool. Procedural synapses are always in
+	// random order
+	void shuffleSynapses(size_t seed=42);
+
 	void setPermanenceInc(float inc) { permanence_inc_ = inc; }
 	float permanenceInc() const {return permanence_inc_;}
 
 	void setPermanenceDec(float dec) { permanence_dec_ = dec; }
 	float permanenceDec() const {return permanence_dec_;}
 
-	void setConnectedPermanence(float thr) { connected_permanence_ = thr; }
+	void setConnectedPermanence(float thr) { connected_permanence_ = thr; incremental_state_.valid = false; }
 	float connectedPermanence() const { return connected_permanence_; }
 
 	void setActiveThreshold(size_t thr) { active_threshold_ = thr; }
@@ -45,16 +71,43 @@ struct ETALER_EXPORT SpatialPooler
 	void setBoostingFactor(float f) { boost_factor_ = f; }
 	float boostFactor() const { return boost_factor_; }
 
-	Tensor connections() const {return connections_;}
-	Tensor permanences() const {return permanences_;}
+	// In incremental mode the SP keeps the last input and overlap on the host and only applies the contribution
+	// of the input bits that changed. Useful when consecutive inputs differ by a few bits. compute() is not thread
+	// safe in this mode. Changing connections_ or permanences_ outside of learn() requires setIncremental() to be
+	// called again.
+	void setIncremental(bool enable);
+	bool incremental() const { return incremental_; }
+
+	// Materialized on each call if the connections are procedural
+	Tensor connections() const;
+	bool proceduralConnections() const { return procedural_; }
+	// Sparse learning. learn() only writes the synapses connected to on bits and keeps the decrement every other
+	// synapse gets as a per column offset. Saves memory traffic by the input sparsity. The offsets are folded back
+	// into the permanences every renormalize_interval learning steps, which is also when permanences are clamped
+	// into [0, 1]. Not supported with procedural connections.
+	void setSparseLearning(bool enable, size_t renormalize_interval=16);
+	bool sparseLearning() const { return permanence_offsets_.has_value(); }
+	void renormalize();
+
+	// The effective permanences. i.e. with the offsets of sparse learning applied
+	Tensor permanences() const;
 
 	StateDict states() const
 	{
-		return {{"input_shape", input_shape_}, {"output_shape", output_shape_}, {"connections", connections_}
-			, {"permanences", permanences_}, {"permanence_inc", permanence_inc_}, {"permanence_dec", permanence_dec_}
+		StateDict states = {{"input_shape", input_shape_}, {"output_shape", output_shape_}
+			, {"permanences", permanences()}, {"permanence_inc", permanence_inc_}, {"permanence_dec", permanence_dec_}
 			, {"connected_permanence", connected_permanence_}, {"active_threshold", (int)active_threshold_}
 			, {"global_density", global_density_}, {"average_activity", average_activity_}
 			, {"boost_factor", boost_factor_}};
+		if(procedural_)
+			states["procedural_seed"] = (int32_t)procedural_seed_;
+		else
+			states["connections"] = connections_;
+		if(synapses_shuffled_)
+			states["synapses_shuffled"] = true;
+		if(has_unconnected_synapses_)
+			states["has_unconnected_synapses"] = true;
+		return states;
 	}
 
 
@@ -65,7 +118,7 @@ struct ETALER_EXPORT SpatialPooler
 
 	SpatialPooler copy() const
 	{
-		return to(connections_.backend());
+		return to(permanences_.backend());
 	}
 //protected:
 	float permanence_inc_ = 0.1;
@@ -80,6 +133,35 @@ struct ETALER_EXPORT SpatialPooler
 	Tensor connections_;
 	Tensor average_activity_;
 	Tensor permanences_;
+	bool procedural_ = false;
+	uint32_t procedural_seed_ = 0;
+	bool synapses_shuffled_ = false;
+	bool has_unconnected_synapses_ = false; // Rows of connections_ may end with -1s. ex: after pruning
+	Tensor permanence_offsets_;
+	size_t renormalize_interval_ = 16;
+	size_t learn_steps_ = 0; // Since the last renormalization
+
+	// Host side state of the incremental mode
+	struct IncrementalState
+	{
+		bool valid = false;
+		size_t max_synapses_per_cell = 0;
+		std::vector<bool> input;
+		std::vector<int32_t> overlap; // Connected synapses to on bits of input. Before applying the active threshold
+		std::vector<int32_t> connections;
+		std::vector<uint8_t> connected;
+		// Synapses from each input bit, in CSR format
+		std::vector<size_t> reverse_offsets;
+		std::vector<uint32_t> reverse_synapses;
+		std::vector<size_t> learned_cells; // Cells learned since the last compute
+	};
+	bool incremental_ = false;
+	mutable IncrementalState incremental_state_;
+
+protected:
+	Tensor incrementalActivity(const Tensor& x) const;
+	void buildIncrementalState() const;
+	void updateLearnedCells() const;
 };
 
 
@@ -1,5 +1,6 @@
 #include "Synapse.hpp"
 #include "Etaler/Core/Random.hpp"
+#include "Etaler/Core/ProceduralSynapse.hpp"
 
 using namespace et;
 
@@ -54,6 +55,42 @@ std::pair<Tensor, Tensor> et::F::gusianRandomSynapse(const Shape& input_shape, c
         return {conn, perm};
 }
 
+Tensor et::F::gusianRandomProceduralSynapse(const Shape& input_shape, const Shape& output_shape, float potential_pool_pct
+	, float mean, float stddev , size_t seed, Backend* backend)
+{
+	if(potential_pool_pct > 1 || potential_pool_pct <= 0)
+		throw EtError("potential_pool_pct must be in range of (0, 1], but get" + std::to_string(potential_pool_pct));
+	if(mean > 1 || mean < 0)
+		throw EtError("mean must be in range [0, 1]. But get " + std::to_string(mean));
+	if(stddev <= 0)
+		throw EtError("stddev must be larger than 0 " + std::to_string(stddev));
+
+	size_t input_cell_num = input_shape.volume();
+	size_t potential_pool_size = std::max(size_t(input_cell_num*potential_pool_pct), size_t{1});
+	Shape synapse_shape = output_shape + potential_pool_size;
+
+	pcg64 rng(seed);
+	std::normal_distribution<float> dist(mean, stddev);
+	std::vector<float> permanences(synapse_shape.volume());
+	std::generate(permanences.begin(), permanences.end(), [&rng, &dist](){return std::clamp(dist(rng), 0.f, 1.f);});
+	return Tensor(synapse_shape, permanences.data(), backend);
+}
+
+Tensor et::F::proceduralConnections(const Shape& input_shape, const Shape& synapse_shape, size_t seed, Backend* backend)
+{
+	ProceduralPool pool(input_shape.volume(), seed);
+	size_t max_synapses_per_cell = synapse_shape.back();
+	et_check(max_synapses_per_cell <= pool.inputSize(), "Procedural synapses can't have more synapses per cell than inputs");
+
+	std::vector<int32_t> connections(synapse_shape.volume());
+	for(size_t i=0;i<connections.size()/max_synapses_per_cell;i++) {
+		uint32_t key = pool.cellKey(i);
+		for(size_t j=0;j<max_synapses_per_cell;j++)
+			connections[i*max_synapses_per_cell+j] = pool.connection(key, j);
+	}
+	return Tensor(synapse_shape, connections.data(), backend);
+}
+
 std::pair<Tensor, Tensor> et::F::gusianRandomSynapseND(const Shape& input_shape, size_t kernel_size, size_t stride, float potential_pool_pct
 	, float mean, float stddev, size_t seed, Backend* backend)
 {
@@ -13,6 +13,12 @@ namespace et::F
 {
 std::pair<Tensor, Tensor> ETALER_EXPORT gusianRandomSynapse(const Shape& input_shape, const Shape& output_shape, float potential_pool_pct=0.75
 	, float mean = 0.21, float stddev = 1, size_t seed = 42, Backend* backend=defaultBackend());
+// Permanences of procedural synapses. The connections are not stored but generated from the seed when used.
+// See proceduralCellActivity()
+Tensor ETALER_EXPORT gusianRandomProceduralSynapse(const Shape& input_shape, const Shape& output_shape, float potential_pool_pct=0.75
+	, float mean = 0.21, float stddev = 1, size_t seed = 42, Backend* backend=defaultBackend());
+// Materializes the connections of procedural synapses. Mostly for inspection and debugging
+Tensor ETALER_EXPORT proceduralConnections(const Shape& input_shape, const Shape& synapse_shape, size_t seed, Backend* backend=defaultBackend());
 std::pair<Tensor, Tensor> ETALER_EXPORT gusianRandomSynapseND(const Shape& input_shape, size_t kernel_size, size_t stride=1, float potential_pool_pct=0.75
 	, float mean = 0.21, float stddev = 1, size_t seed = 42, Backend* backend=defaultBackend());
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "TemporalMemory.hpp"
 
+#include <algorithm>
+
 using namespace et;
 
 TemporalMemory::TemporalMemory(const Shape& input_shape, size_t cells_per_column, size_t max_synapses_per_cell, Backend* backend)
@@ -35,6 +37,71 @@ void TemporalMemory::learn(const Tensor& active_cells, const Tensor& last_active
 
 }
 
+std::pair<Tensor, Tensor> TemporalMemory::computeBatch(const Tensor& x, const Tensor& last_state)
+{
+	Shape shape = x.shape();
+	et_check(shape.size() == input_shape_.size()+1 && Shape(shape.begin()+1, shape.end()) == input_shape_
+		, "Expecting a batch of inputs of shape " + to_string(input_shape_) + ", got " + to_string(shape));
+	Tensor active_cells;
+	if(last_state.has_value() == true)
+		active_cells = burst(x, last_state);
+	else
+		active_cells = burst(x, zeros(x.shape()+cellsPerColumn(), DType::Bool, x.backend()));
+	Tensor activity = batchCellActivity(active_cells, connections_, permanences_, connected_permanence_, active_threshold_);
+	Tensor predictive_cells = cast(activity, DType::Bool);
+
+	return {predictive_cells, active_cells};
+}
+
+void TemporalMemory::learnBatch(const Tensor& active_cells, const Tensor& last_active)
+{
+	Tensor learning_cells = reverseBurst(active_cells);
+
+	batchLearnCorrilation(last_active, learning_cells, connections_, permanences_, permanence_inc_, permanence_dec_);
+	batchGrowSynapses(last_active, learning_cells, connections_, permanences_, initial_permanence_);
+}
+
+void TemporalMemory::trainSequences(const std::vector<std::vector<Tensor>>& sequences, size_t batch_size)
+{
+	et_check(batch_size > 0, "Batch size must be at least 1");
+	Backend* backend = connections_.backend();
+	Shape state_shape = input_shape_ + cellsPerColumn();
+
+	for(size_t first=0;first<sequences.size();first+=batch_size) {
+		intmax_t n = std::min(batch_size, sequences.size()-first);
+		size_t length = 0;
+		for(intmax_t i=0;i<n;i++)
+			length = std::max(length, sequences[first+i].size());
+
+		Tensor last_pred = zeros(Shape({n})+state_shape, DType::Bool, backend);
+		Tensor last_active = zeros(Shape({n})+state_shape, DType::Bool, backend);
+		for(size_t t=0;t<length;t++) {
+			Tensor x = zeros(Shape({n})+input_shape_, DType::Bool, backend);
+			for(intmax_t i=0;i<n;i++) {
+				const auto& sequence = sequences[first+i];
+				if(t < sequence.size())
+					x.view({i}) = sequence[t].cast(DType::Bool);
+			}
+
+			auto [pred, active] = computeBatch(x, last_pred);
+			learnBatch(active, last_active);
+			last_pred = pred;
+			last_active = active;
+		}
+	}
+}
+
+Tensor TemporalMemory::rollout(const Tensor& active_cells, size_t steps) const
+{
+	Shape cell_shape = input_shape_ + cellsPerColumn();
+	Shape shape = active_cells.shape();
+	et_check(shape.size() >= cell_shape.size() && Shape(shape.end()-cell_shape.size(), shape.end()) == cell_shape
+		, "Active cells of shape " + to_string(shape) + " does not end with " + to_string(cell_shape));
+	// Feeding the predicted columns back never bursts, the next active cells are exactly the predictive cells.
+	// So the backend can run every step on device without going through burst()
+	return et::rollout(active_cells, connections_, permanences_, connected_permanence_, active_threshold_, steps);
+}
+
 void TemporalMemory::loadState(const StateDict& states)
 {
 	permanence_inc_ = std::any_cast<float>(states.at("permanence_inc"));
@@ -7,6 +7,8 @@
 #include "Etaler/Core/Serialize.hpp"
 #include "Etaler/Core/DefaultBackend.hpp"
 
+#include <vector>
+
 #include "Etaler_export.h"
 
 namespace et
@@ -18,6 +20,19 @@ struct ETALER_EXPORT TemporalMemory
 	TemporalMemory(const Shape& input_shape, size_t cells_per_column, size_t max_synapses_per_cell=64, Backend* backend=defaultBackend());
 	std::pair<Tensor, Tensor> compute(const Tensor& x, const Tensor& last_state);
 	void learn(const Tensor& active_cells, const Tensor& last_active);
+	// Batched compute() and learn(). x is {batch}+input_shape and the states have the same leading batch dimension.
+	// Every entry is an independent sequence and all of them learn into the same synapses. Updates are summed over the
+	// batch before clamping, so the result is deterministic regardless of the number of threads
+	std::pair<Tensor, Tensor> computeBatch(const Tensor& x, const Tensor& last_state);
+	void learnBatch(const Tensor& active_cells, const Tensor& last_active);
+	// Trains on many independent sequences, batch_size of them at a time. Shorter sequences are padded with empty
+	// inputs, which do not learn
+	void trainSequences(const std::vector<std::vector<Tensor>>& sequences, size_t batch_size=64);
+
+	// Forecasts `steps` steps ahead by feeding the predictions back as inputs, without learning. active_cells is
+	// input_shape+cells_per_column, or has leading dimensions to roll out many streams/hypotheses at once.
+	// Returns the predicted columns of each step, shaped {steps}+active_cells.shape() without the cells axis
+	Tensor rollout(const Tensor& active_cells, size_t steps) const;
 
 	void setPermanenceInc(float inc) { permanence_inc_ = inc; }
 	float permanenceInc() const {return permanence_inc_;}
@@ -31,7 +46,7 @@ struct ETALER_EXPORT TemporalMemory
 	void setActiveThreshold(size_t thr) { active_threshold_ = thr; }
 	size_t activeThreshold() const { return active_threshold_; }
 
-	size_t cellsPerColumn() const {return connections_.shape()[connections_.size()-2];}
+	size_t cellsPerColumn() const {return connections_.shape()[connections_.dimensions()-2];}
 	size_t maxSynapsesPerCell() const {return connections_.shape().back();}
 
 	float initialPermanence() const {return initial_permanence_;}
@@ -1,15 +1,26 @@
 #include "CPUBackend.hpp"
 #include "Etaler/Core/Views.hpp"
 #include "Etaler/Core/Random.hpp"
-#include "Etaler/Core/TypeList.hpp"
+#include "Etaler/Core/TypeDispatch.hpp"
+#include "Etaler/Core/MemoryPlanner.hpp"
+#include "Etaler/Core/ProceduralSynapse.hpp"
+#include "Etaler/Core/Priority.hpp"
+#include "CPUParallel.hpp"
 
 #include <numeric>
 #include <cmath>
+#include <bitset>
+#include <algorithm>
+#include <limits>
+#include <functional>
+#include <chrono>
 
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
 #include <tbb/parallel_sort.h>
 #include <tbb/parallel_reduce.h>
+#include <tbb/task_arena.h>
 
 using namespace et;
 
@@ -58,127 +69,439 @@ void* CPUBuffer::data() const
 	return std::visit([](const auto& v){return (void*)v;}, storage_);
 }
 
-using DefaultTypeList = type_list_t<int32_t, float, bool, half>;
+CPUBuffer::~CPUBuffer()
+{
+	std::visit([](auto& ptr){delete [] ptr;}, storage_);
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::createTensor(const Shape& shape, DType dtype, const void* data)
+{
+	if(memory_planner_ != nullptr && data == nullptr)
+		return memory_planner_->allocate(shape, dtype);
+
+	auto buf = std::make_shared<CPUBuffer>(shape, dtype, shared_from_this(), data);
+	return std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype)
+{
+	requireProperties(arena, this, IsPlain());
+	size_t arena_bytes = arena->size()*dtypeToSize(arena->dtype());
+	et_check(offset+shape.volume()*dtypeToSize(dtype) <= arena_bytes, "Alias tensor is out of the arena's bound");
+
+	void* ptr = (char*)arena->buffer()->data()+offset;
+	auto buf = std::make_shared<CPUAliasBuffer>(shape, dtype, shared_from_this(), arena->buffer(), ptr);
+	return std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
+}
 
-template <typename TypeList = DefaultTypeList, typename Func = void>
-inline void dispatch(DType dtype, Func f)
+//Synapse counts per cell that have their own compiled kernels. Other counts uses the generic kernel
+using SynapseWidthList = type_list_t<std::integral_constant<size_t, 16>, std::integral_constant<size_t, 32>
+	, std::integral_constant<size_t, 64>, std::integral_constant<size_t, 128>, std::integral_constant<size_t, 256>
+	, std::integral_constant<size_t, 1024>>;
+using GenericWidth = std::integral_constant<size_t, 0>;
+
+template <typename TypeList = SynapseWidthList, typename Func = void>
+inline void dispatchWidth(size_t width, Func f)
 {
 	static_assert(std::is_same_v<Func, void> == false); //void is just a dummy value
 	if constexpr(std::is_same_v<TypeList, null_t> == false) {
 		using T = typename TypeList::head;
-		if(typeToDType<T>() == dtype) {
+		if(T::value == width) {
 			f(T());
 			return;
 		}
-		dispatch<typename TypeList::tail, Func>(dtype, f);
+		dispatchWidth<typename TypeList::tail, Func>(width, f);
 	}
 	else
-		throw EtError("Cannot dispatch such dtype: " + to_ctype_string(dtype));
+		f(GenericWidth());
 }
 
-template <typename TL1 = DefaultTypeList, typename TL2 = DefaultTypeList, typename Func = void>
-inline void dispatch2d(DType t1, DType t2, Func f)
+//Pointer to the first element of a (possibly offsetted) contiguous tensor
+template <typename T>
+inline T* offsetData(const TensorImpl* t)
 {
-	dispatch<TL1>(t1, [&](auto v1){
-		using T1 = decltype(v1);
-		dispatch<TL2>(t2, [&](auto v2){
-			using T2 = decltype(v2);
-			f(T1(), T2());
-		});
-	});
+	return (T*)t->data() + t->offset();
 }
 
-CPUBuffer::~CPUBuffer()
+//x itself if it is contiguous, otherwise a contiguous copy of it. Lets ops accept any view and read it through offsetData()
+static std::shared_ptr<const TensorImpl> contiguous(const TensorImpl* x)
 {
-	std::visit([](auto& ptr){delete [] ptr;}, storage_);
+	if(x->iscontiguous())
+		return x->shared_from_this();
+	return x->backend()->realize(x);
 }
 
+//Rows of a tensor whose rows are contiguous (see TensorImpl::isrowcontiguous()). Row i starts at ptr+i*stride
+template <typename T>
+struct RowView
+{
+	RowView(const TensorImpl* t) : ptr(offsetData<T>(t)), stride(t->rowstride()) {}
+	template <typename U>
+	RowView(const TypedTensor<U, 2>& t) : ptr(t.data()), stride(t.stride()[0]) {}
+	T* operator[] (size_t i) const {return ptr+i*stride;}
+
+	T* ptr;
+	size_t stride;
+};
+
 namespace et::detail
 {
+//Width is the number of synapses per cell known at compile time. 0 means it is only known at runtime
+template <size_t Width, bool HasUnconnected, typename PermType>
+//offsets are the per cell permanence offsets (see learnCorrilationSparse). Can be nullptr
+static void cellActivityKernel(const bool* input, RowView<const int32_t> synapses, RowView<const PermType> synapse_strengths, int32_t* result
+	, size_t num_cells, size_t max_connections_per_cell, float connected_permeance, size_t active_threshold, size_t input_size
+	, const float* offsets)
+{
+	const size_t width = Width != 0 ? Width : max_connections_per_cell;
+	size_t block_size = std::min(size_t(128), (size_t)num_cells);
+	parallelFor(tbb::blocked_range<size_t>(size_t(0), num_cells, block_size), [&](const auto& r) {
+		for(size_t i=r.begin();i!=r.end();i++) {
+			const int32_t* conns = synapses[i];
+			const PermType* strengths = synapse_strengths[i];
+			//perm + offset > connected_permeance is the same as perm > connected_permeance - offset
+			const float threshold = offsets == nullptr ? connected_permeance : connected_permeance - offsets[i];
+			size_t sum = 0;
+			for(size_t j=0;j<width;j++) {
+				int32_t target = conns[j];
+				if constexpr(HasUnconnected) {
+					if(target == -1)
+						break;
+				}
+
+				assert((size_t)target < input_size);
+				//Branchless so the compiler can unroll and vectorize the loop
+				sum += input[target] & (strengths[j] > threshold);
+			}
+			if(sum >= active_threshold)
+				result[i] = sum;
+			else
+				result[i] = 0;
+		}
+	});
+}
+
 template <typename PermType>
 static std::shared_ptr<TensorImpl> cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
-	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse, CPUBackend* backend)
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse, CPUBackend* backend
+	, const TensorImpl* permeance_offsets=nullptr)
 {
 	//Checks the input are sane
-	requireProperties(x, backend, DType::Bool, IsPlain());
-	requireProperties(connections, backend, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, backend, typeToDType<PermType>(), IsPlain());
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
 	et_check(connections->dimensions() >= 2);
 
 	Shape s = connections->shape();
 	s.pop_back();
 	auto y = backend->createTensor(s, DType::Int32);
 
+	std::shared_ptr<const TensorImpl> offsets_data;
+	if(permeance_offsets != nullptr) {
+		requireProperties(permeance_offsets, backend, DType::Float);
+		et_check(permeance_offsets->size() == y->size(), "There must be one permanence offset per cell");
+		offsets_data = contiguous(permeance_offsets);
+	}
+	const float* offsets = offsets_data ? offsetData<const float>(offsets_data.get()) : nullptr;
+
 
-	const bool* input = (const bool*)x->data();
-	const int32_t* synapses = (const int32_t*)connections->data();
-	const PermType* synapse_strengths = (PermType*)permeances->data();
+	auto x_data = contiguous(x);
+	const bool* input = offsetData<const bool>(x_data.get());
+	RowView<const int32_t> synapses(connections);
+	RowView<const PermType> synapse_strengths(permeances);
 	int32_t* result = (int32_t*)y->data();
 
 	size_t max_connections_per_cell = connections->shape().back();
 	size_t num_cells = connections->size()/max_connections_per_cell;
 
+	auto run = [&](auto width) {
+		constexpr size_t Width = decltype(width)::value;
+		if(has_unconnected_synapse)
+			cellActivityKernel<Width, true>(input, synapses, synapse_strengths, result, num_cells, max_connections_per_cell
+				, connected_permeance, active_threshold, x->size(), offsets);
+		else
+			cellActivityKernel<Width, false>(input, synapses, synapse_strengths, result, num_cells, max_connections_per_cell
+				, connected_permeance, active_threshold, x->size(), offsets);
+	};
 
-	size_t block_size = std::min(size_t(128), (size_t)num_cells);
-	tbb::parallel_for(tbb::blocked_range<size_t>(size_t(0), num_cells, block_size), [&](const auto& r) {
-		for(size_t i=r.begin();i!=r.end();i++) {
-			size_t sum = 0;
-			for(size_t j=0;j<max_connections_per_cell;j++) {
-				size_t index = i*max_connections_per_cell+j;
-				int32_t target = synapses[index];
-
-				if(target == -1)
-					break;
+	if(backend->specializedKernels())
+		dispatchWidth(max_connections_per_cell, run);
+	else
+		run(GenericWidth());
 
-				assert(target < (int32_t)x->size());
+	return y;
+}
 
-				if(input[target] == false)
-					continue;
+template <size_t Width, bool HasUnconnected, typename PermType>
+static void learnCorrilationKernel(const bool* input, const bool* learning, RowView<const int32_t> synapses, RowView<PermType> synapse_strengths
+	, size_t num_cells, size_t max_connections_per_cell, float perm_inc, float perm_dec, size_t input_size)
+{
+	const size_t width = Width != 0 ? Width : max_connections_per_cell;
+	parallelFor(size_t(0), num_cells, [&](size_t i) {
+		if(learning[i] == false)
+			return;
 
-				PermType strength = synapse_strengths[index];
-				if(strength > connected_permeance)
-					sum += 1;
+		const int32_t* conns = synapses[i];
+		PermType* strengths = synapse_strengths[i];
+		for(size_t j=0; j<width;j++) {
+			auto connection = conns[j];
+			if constexpr(HasUnconnected) {
+				if(connection == -1)
+					break;
 			}
-			if(sum >= active_threshold)
-				result[i] = sum;
+			ASSERT((size_t)connection < input_size);
+
+			PermType& perm = strengths[j];
+			if(input[connection] == true)
+				perm += perm_inc;
 			else
-				result[i] = 0;
+				perm -= perm_dec;
+
+			perm = std::clamp(perm, PermType(0), PermType(1));
 		}
 	});
-
-	return y;
 }
 
 template <typename PermType>
 void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
 	, float perm_inc, float perm_dec, bool has_unconnected_synapse, CPUBackend* backend)
 {
-	requireProperties(x, backend, DType::Bool, IsPlain());
-	requireProperties(learn, backend, DType::Bool, IsPlain());
-	requireProperties(connections, backend, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, backend, typeToDType<PermType>(), IsPlain());
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(learn, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+
+	auto x_data = contiguous(x);
+	auto learn_data = contiguous(learn);
+	const bool* input = offsetData<const bool>(x_data.get());
+	const bool* learning = offsetData<const bool>(learn_data.get());
+	RowView<const int32_t> synapses(connections);
+	RowView<PermType> synapse_strengths(permeances);
+
+	size_t max_connections_per_cell = connections->shape().back();
+	size_t num_cells = connections->size()/max_connections_per_cell;
+	et_check(learn->size() == num_cells, "The learning mask must have one value per cell");
+
+	auto run = [&](auto width) {
+		constexpr size_t Width = decltype(width)::value;
+		if(has_unconnected_synapse)
+			learnCorrilationKernel<Width, true>(input, learning, synapses, synapse_strengths, num_cells, max_connections_per_cell
+				, perm_inc, perm_dec, x->size());
+		else
+			learnCorrilationKernel<Width, false>(input, learning, synapses, synapse_strengths, num_cells, max_connections_per_cell
+				, perm_inc, perm_dec, x->size());
+	};
 
-	const bool* input = (const bool*)x->data();
-	const bool* learning = (const bool*)learn->data();
-	const int32_t* synapses = (const int32_t*)connections->data();
-	PermType* synapse_strengths = (PermType*)permeances->data();
+	if(backend->specializedKernels())
+		dispatchWidth(max_connections_per_cell, run);
+	else
+		run(GenericWidth());
+}
+
+//The typed entry points. They check the layout once and run the same kernels
+template <typename PermType>
+static CPUBackend* checkTypedSynapses(const TypedTensor<int32_t, 2>& connections, const TypedTensor<PermType, 2>& permeances)
+{
+	auto backend = dynamic_cast<CPUBackend*>(connections.tensor().backend());
+	et_check(backend != nullptr, "The typed kernels require tensors on a CPUBackend");
+	et_check(permeances.tensor().backend() == backend, "The connections and permanences must be on the same backend");
+	et_check(connections.shape() == permeances.shape(), "The connections and permanences must have the same shape");
+	et_check(connections.stride()[1] == 1 && permeances.stride()[1] == 1, "The synapses must be row contiguous");
+	return backend;
+}
+
+template <typename PermType>
+static void typedCellActivity(const TypedTensor<bool, 1>& x, const TypedTensor<int32_t, 2>& connections, const TypedTensor<PermType, 2>& permeances
+	, const TypedTensor<int32_t, 1>& result, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	CPUBackend* backend = checkTypedSynapses(connections, permeances);
+	et_check(x.iscontiguous() && result.iscontiguous(), "The input and the result must be contiguous");
+	et_check(result.shape(0) == connections.shape(0), "There must be one result per cell");
+
+	RowView<const int32_t> synapses(connections);
+	RowView<const PermType> synapse_strengths(permeances);
+	size_t max_connections_per_cell = connections.shape(1);
+	size_t num_cells = connections.shape(0);
+
+	auto run = [&](auto width) {
+		constexpr size_t Width = decltype(width)::value;
+		if(has_unconnected_synapse)
+			cellActivityKernel<Width, true>(x.data(), synapses, synapse_strengths, result.data(), num_cells, max_connections_per_cell
+				, connected_permeance, active_threshold, x.size(), nullptr);
+		else
+			cellActivityKernel<Width, false>(x.data(), synapses, synapse_strengths, result.data(), num_cells, max_connections_per_cell
+				, connected_permeance, active_threshold, x.size(), nullptr);
+	};
+
+	if(backend->specializedKernels())
+		dispatchWidth(max_connections_per_cell, run);
+	else
+		run(GenericWidth());
+}
+
+template <typename PermType>
+static void typedLearnCorrilation(const TypedTensor<bool, 1>& x, const TypedTensor<bool, 1>& learn, const TypedTensor<int32_t, 2>& connections
+	, const TypedTensor<PermType, 2>& permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	CPUBackend* backend = checkTypedSynapses(connections, permeances);
+	et_check(x.iscontiguous() && learn.iscontiguous(), "The input and the learning mask must be contiguous");
+	et_check(learn.shape(0) == connections.shape(0), "The learning mask must have one value per cell");
+
+	RowView<const int32_t> synapses(connections);
+	RowView<PermType> synapse_strengths(permeances);
+	size_t max_connections_per_cell = connections.shape(1);
+	size_t num_cells = connections.shape(0);
+
+	auto run = [&](auto width) {
+		constexpr size_t Width = decltype(width)::value;
+		if(has_unconnected_synapse)
+			learnCorrilationKernel<Width, true>(x.data(), learn.data(), synapses, synapse_strengths, num_cells, max_connections_per_cell
+				, perm_inc, perm_dec, x.size());
+		else
+			learnCorrilationKernel<Width, false>(x.data(), learn.data(), synapses, synapse_strengths, num_cells, max_connections_per_cell
+				, perm_inc, perm_dec, x.size());
+	};
+
+	if(backend->specializedKernels())
+		dispatchWidth(max_connections_per_cell, run);
+	else
+		run(GenericWidth());
+}
+
+void cellActivity(const TypedTensor<bool, 1>& x, const TypedTensor<int32_t, 2>& connections, const TypedTensor<float, 2>& permeances
+	, const TypedTensor<int32_t, 1>& result, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	typedCellActivity(x, connections, permeances, result, connected_permeance, active_threshold, has_unconnected_synapse);
+}
+
+void cellActivity(const TypedTensor<bool, 1>& x, const TypedTensor<int32_t, 2>& connections, const TypedTensor<half, 2>& permeances
+	, const TypedTensor<int32_t, 1>& result, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	typedCellActivity(x, connections, permeances, result, connected_permeance, active_threshold, has_unconnected_synapse);
+}
+
+void learnCorrilation(const TypedTensor<bool, 1>& x, const TypedTensor<bool, 1>& learn, const TypedTensor<int32_t, 2>& connections
+	, const TypedTensor<float, 2>& permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	typedLearnCorrilation(x, learn, connections, permeances, perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+void learnCorrilation(const TypedTensor<bool, 1>& x, const TypedTensor<bool, 1>& learn, const TypedTensor<int32_t, 2>& connections
+	, const TypedTensor<half, 2>& permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	typedLearnCorrilation(x, learn, connections, permeances, perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+template <typename PermType>
+static void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(learn, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+	requireProperties(permeance_offsets, backend, DType::Float, IsContingous());
+
+	auto x_data = contiguous(x);
+	auto learn_data = contiguous(learn);
+	const bool* input = offsetData<const bool>(x_data.get());
+	const bool* learning = offsetData<const bool>(learn_data.get());
+	float* offsets = offsetData<float>(permeance_offsets);
+	RowView<const int32_t> synapses(connections);
+	RowView<PermType> synapse_strengths(permeances);
 
 	size_t max_connections_per_cell = connections->shape().back();
 	size_t num_cells = connections->size()/max_connections_per_cell;
+	et_check(learn->size() == num_cells, "The learning mask must have one value per cell");
+	et_check(permeance_offsets->size() == num_cells, "There must be one permanence offset per cell");
 
-	tbb::parallel_for(size_t(0), learn->size(), [&](size_t i) {
+	const PermType step = PermType(perm_inc+perm_dec);
+	parallelFor(size_t(0), num_cells, [&](size_t i) {
 		if(learning[i] == false)
 			return;
 
-		for(size_t j=0; j<max_connections_per_cell;j++) {
-			size_t idx = i*max_connections_per_cell+j;
-			auto connection = synapses[idx];
-			if(connection == -1)
+		// The decrement every synapse gets
+		offsets[i] -= perm_dec;
+		const int32_t* conns = synapses[i];
+		PermType* strengths = synapse_strengths[i];
+		for(size_t j=0;j<max_connections_per_cell;j++) {
+			int32_t connection = conns[j];
+			if(has_unconnected_synapse && connection == -1)
 				break;
-			ASSERT((size_t)connection < num_cells);
-
-			PermType& perm = synapse_strengths[idx];
+			ASSERT((size_t)connection < x->size());
 			if(input[connection] == true)
+				strengths[j] += step;
+		}
+	});
+}
+
+template <typename PermType>
+static std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+	et_check(permeances->dimensions() >= 2);
+
+	Shape s = permeances->shape();
+	s.pop_back();
+	auto y = backend->createTensor(s, DType::Int32);
+
+	auto x_data = contiguous(x);
+	const bool* input = offsetData<const bool>(x_data.get());
+	RowView<const PermType> synapse_strengths(permeances);
+	int32_t* result = (int32_t*)y->data();
+
+	size_t max_synapses_per_cell = permeances->shape().back();
+	size_t num_cells = permeances->size()/max_synapses_per_cell;
+	et_check(max_synapses_per_cell <= x->size(), "Procedural synapses can't have more synapses per cell than inputs");
+	ProceduralPool pool(x->size(), seed);
+
+	size_t block_size = std::min(size_t(128), num_cells);
+	parallelFor(tbb::blocked_range<size_t>(size_t(0), num_cells, block_size), [&](const auto& r) {
+		for(size_t i=r.begin();i!=r.end();i++) {
+			const PermType* strengths = synapse_strengths[i];
+			uint32_t key = pool.cellKey(i);
+			size_t sum = 0;
+			for(size_t j=0;j<max_synapses_per_cell;j++) {
+				if(strengths[j] > connected_permeance)
+					sum += input[pool.connection(key, j)];
+			}
+			result[i] = sum >= active_threshold ? sum : 0;
+		}
+	});
+	return y;
+}
+
+template <typename PermType>
+static void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+	, float perm_inc, float perm_dec, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(learn, backend, DType::Bool);
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+
+	auto x_data = contiguous(x);
+	auto learn_data = contiguous(learn);
+	const bool* input = offsetData<const bool>(x_data.get());
+	const bool* learning = offsetData<const bool>(learn_data.get());
+	RowView<PermType> synapse_strengths(permeances);
+
+	size_t max_synapses_per_cell = permeances->shape().back();
+	size_t num_cells = permeances->size()/max_synapses_per_cell;
+	et_check(learn->size() == num_cells, "The learning mask must have one value per cell");
+	et_check(max_synapses_per_cell <= x->size(), "Procedural synapses can't have more synapses per cell than inputs");
+	ProceduralPool pool(x->size(), seed);
+
+	parallelFor(size_t(0), num_cells, [&](size_t i) {
+		if(learning[i] == false)
+			return;
+
+		PermType* strengths = synapse_strengths[i];
+		uint32_t key = pool.cellKey(i);
+		for(size_t j=0;j<max_synapses_per_cell;j++) {
+			PermType& perm = strengths[j];
+			if(input[pool.connection(key, j)] == true)
 				perm += perm_inc;
 			else
 				perm -= perm_dec;
@@ -188,42 +511,260 @@ void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const Tensor
 	});
 }
 
+template <typename PermType>
+static std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, size_t steps, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+	et_check(connections->dimensions() >= 2);
+
+	Shape cell_shape = connections->shape();
+	cell_shape.pop_back();
+	size_t num_cells = cell_shape.volume();
+	size_t cells_per_column = cell_shape.back();
+	size_t num_columns = num_cells/cells_per_column;
+	Shape x_shape = x->shape();
+	et_check(x_shape.size() >= cell_shape.size() && Shape(x_shape.end()-cell_shape.size(), x_shape.end()) == cell_shape
+		, "Active cells of shape " + to_string(x_shape) + " does not end with the cell shape " + to_string(cell_shape));
+	size_t num_streams = x->size()/num_cells;
+
+	Shape result_shape = x_shape;
+	result_shape.pop_back();
+	auto y = backend->createTensor(Shape({(intmax_t)steps}) + result_shape, DType::Bool);
+
+	auto x_data = contiguous(x);
+	RowView<const int32_t> synapses(connections);
+	RowView<const PermType> synapse_strengths(permeances);
+	size_t max_synapses_per_cell = connections->shape().back();
+	// A cell is predictive when its activity is non zero
+	size_t threshold = std::max(active_threshold, size_t(1));
+
+	// Ping-pong between two state buffers instead of allocating a tensor every step
+	std::vector<uint8_t> current(offsetData<const uint8_t>(x_data.get()), offsetData<const uint8_t>(x_data.get())+x->size());
+	std::vector<uint8_t> next(x->size());
+	bool* out = (bool*)y->data();
+
+	for(size_t step=0;step<steps;step++) {
+		parallelFor(size_t(0), num_streams*num_columns, [&](size_t idx) {
+			size_t stream = idx / num_columns;
+			size_t column = idx % num_columns;
+			const uint8_t* input = current.data() + stream*num_cells;
+			uint8_t* state = next.data() + stream*num_cells;
+			bool predicted = false;
+			for(size_t cell=column*cells_per_column;cell<(column+1)*cells_per_column;cell++) {
+				const int32_t* conns = synapses[cell];
+				const PermType* strengths = synapse_strengths[cell];
+				size_t sum = 0;
+				for(size_t j=0;j<max_synapses_per_cell;j++) {
+					int32_t target = conns[j];
+					if(target == -1)
+						break;
+					sum += input[target] & (strengths[j] > connected_permeance);
+				}
+				state[cell] = sum >= threshold;
+				predicted |= sum >= threshold;
+			}
+			out[step*num_streams*num_columns+idx] = predicted;
+		});
+		std::swap(current, next);
+	}
+	return y;
+}
+
+//Number of batch entries in x[batch, ...] given the size of a single entry
+static size_t batchSize(const TensorImpl* x, size_t entry_size)
+{
+	et_check(x->dimensions() >= 2 && x->size() == (size_t)x->shape()[0]*entry_size
+		, "Expecting a batch of shape [batch, ...] with " + std::to_string(entry_size) + " elements per entry, got " + to_string(x->shape()));
+	return x->shape()[0];
+}
+
+template <typename PermType>
+static std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+	et_check(connections->dimensions() >= 2);
+
+	size_t max_synapses_per_cell = connections->shape().back();
+	size_t num_cells = connections->size()/max_synapses_per_cell;
+	et_check(x->dimensions() >= 2, "Expecting a batch of shape [batch, ...], got " + to_string(x->shape()));
+	size_t batch_size = x->shape()[0];
+	size_t input_size = x->size()/std::max(batch_size, size_t(1));
+
+	Shape s = connections->shape();
+	s.pop_back();
+	auto y = backend->createTensor(Shape({(intmax_t)batch_size}) + s, DType::Int32);
+
+	auto x_data = contiguous(x);
+	const bool* input = offsetData<const bool>(x_data.get());
+	RowView<const int32_t> synapses(connections);
+	RowView<const PermType> synapse_strengths(permeances);
+	int32_t* result = (int32_t*)y->data();
+
+	//Parallel over both the entries and the cells so small models with large batches still use every core
+	parallelFor(tbb::blocked_range<size_t>(size_t(0), batch_size*num_cells, 128), [&](const auto& r) {
+		for(size_t idx=r.begin();idx!=r.end();idx++) {
+			size_t i = idx % num_cells;
+			const bool* in = input + (idx/num_cells)*input_size;
+			const int32_t* conns = synapses[i];
+			const PermType* strengths = synapse_strengths[i];
+			size_t sum = 0;
+			for(size_t j=0;j<max_synapses_per_cell;j++) {
+				int32_t target = conns[j];
+				if(has_unconnected_synapse && target == -1)
+					break;
+				assert((size_t)target < input_size);
+				sum += in[target] & (strengths[j] > connected_permeance);
+			}
+			result[idx] = sum >= active_threshold ? sum : 0;
+		}
+	});
+	return y;
+}
+
+template <typename PermType>
+static void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, float perm_inc, float perm_dec, bool has_unconnected_synapse, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(learn, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
+
+	size_t max_synapses_per_cell = connections->shape().back();
+	size_t num_cells = connections->size()/max_synapses_per_cell;
+	size_t batch_size = batchSize(learn, num_cells);
+	et_check(x->dimensions() >= 2 && x->shape()[0] == (intmax_t)batch_size, "Input and learning mask have different batch sizes");
+	size_t input_size = x->size()/batch_size;
+
+	auto x_data = contiguous(x);
+	auto learn_data = contiguous(learn);
+	const bool* input = offsetData<const bool>(x_data.get());
+	const bool* learning = offsetData<const bool>(learn_data.get());
+	RowView<const int32_t> synapses(connections);
+	RowView<PermType> synapse_strengths(permeances);
+
+	//Each cell sums the updates from all entries before clamping. Cells are owned by a single thread, so no
+	//atomics are needed and the result does not depend on the scheduling
+	parallelFor(size_t(0), num_cells, [&](size_t i) {
+		svector<size_t, 16> learners;
+		for(size_t b=0;b<batch_size;b++) {
+			if(learning[b*num_cells+i] == true)
+				learners.push_back(b);
+		}
+		if(learners.size() == 0)
+			return;
+
+		const int32_t* conns = synapses[i];
+		PermType* strengths = synapse_strengths[i];
+		for(size_t j=0;j<max_synapses_per_cell;j++) {
+			int32_t target = conns[j];
+			if(has_unconnected_synapse && target == -1)
+				break;
+			float delta = 0;
+			for(size_t b : learners)
+				delta += input[b*input_size+target] ? perm_inc : -perm_dec;
+			strengths[j] = std::clamp(float(strengths[j])+delta, 0.f, 1.f);
+		}
+	});
+}
+
 template <typename PermType>
 void sortSynapse(TensorImpl* connections, TensorImpl* permeances, CPUBackend* backend)
 {
-	requireProperties(connections, backend, DType::Int32, IsPlain());
-	requireProperties(permeances, backend, typeToDType<PermType>(), IsPlain());
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
 	et_assert(connections->shape() == permeances->shape());
 
 	size_t max_synapse_per_cell = connections->shape().back();
 	size_t num_cells = connections->size()/max_synapse_per_cell;
 
-	uint32_t* conns = (uint32_t*)connections->data(); //HACK: -1s should be at the end of the arrays.
-	PermType* perms = (PermType*)permeances->data();
+	RowView<uint32_t> conns(connections); //HACK: -1s should be at the end of the arrays.
+	RowView<PermType> perms(permeances);
 
-	tbb::parallel_for(size_t(0), num_cells, [&](size_t i) {
-		size_t start_index = i*max_synapse_per_cell;
-		size_t end_index = (i+1)*max_synapse_per_cell;
+	parallelFor(size_t(0), num_cells, [&](size_t i) {
+		uint32_t* synapses = conns[i];
+		PermType* strengths = perms[i];
 
 		std::vector<size_t> sort_indices(max_synapse_per_cell);
 		std::iota(sort_indices.begin(), sort_indices.end(), 0);
 		std::sort(sort_indices.begin(), sort_indices.end(),
 			[&](size_t i, size_t j)->bool {
-				return conns[i+start_index] < conns[j+start_index];
+				return synapses[i] < synapses[j];
 			});
-		apply_permutation_in_place(conns+start_index, conns+end_index, sort_indices);
-		apply_permutation_in_place(perms+start_index, perms+end_index, sort_indices);
+		apply_permutation_in_place(synapses, synapses+max_synapse_per_cell, sort_indices);
+		apply_permutation_in_place(strengths, strengths+max_synapse_per_cell, sort_indices);
 	});
 }
 
+//Connects a cell to the on bits it isn't connected to yet, until its synapses are full. Keeps the synapses sorted
+template <typename PermType>
+static void growCell(uint32_t* synapses, PermType* strengths, size_t max_synapses_per_cell, const std::vector<uint32_t>& on_bits
+	, float initial_perm)
+{
+	uint32_t* end = synapses+max_synapses_per_cell;
+
+	if(synapses[max_synapses_per_cell-1] != uint32_t(-1)) //If there is no space for new synapse. Ignore
+		return;
+
+	uint32_t* it = std::lower_bound(synapses, end, uint32_t(-1));
+	size_t used_space = it - synapses;
+
+	size_t write_idx = it - synapses;
+	size_t read_idx = 0;
+
+	for(size_t j=0;write_idx!=max_synapses_per_cell && j < on_bits.size();j++) {
+		bool connected = false;
+		for(;read_idx<used_space;read_idx++) {
+			if(synapses[read_idx] == on_bits[j]) {
+				connected = true;
+				break;
+			}
+			if(synapses[read_idx] > on_bits[j])
+				break;
+		}
+
+		if(connected == false) {
+			synapses[write_idx] = on_bits[j];
+			strengths[write_idx] = initial_perm;
+			write_idx++;
+		}
+	}
+
+	std::vector<size_t> sort_indices(write_idx);
+	std::iota(sort_indices.begin(), sort_indices.begin()+write_idx, 0);
+	std::sort(sort_indices.begin(), sort_indices.begin()+write_idx,
+		[&](size_t i, size_t j)->bool {
+			return ((uint32_t*)synapses)[i] < ((uint32_t*)synapses)[j];
+		});
+	apply_permutation_in_place(synapses, synapses+write_idx, sort_indices);
+	apply_permutation_in_place(strengths, strengths+write_idx, sort_indices);
+}
+
+static std::vector<uint32_t> onBits(const bool* x, size_t size)
+{
+	std::vector<uint32_t> on_bits;
+	on_bits.reserve(size*0.1);
+	for(size_t i=0;i<size;i++) {
+		if(x[i] == true)
+			on_bits.push_back(i);
+	}
+	return on_bits;
+}
+
 template <typename PermType>
 void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
 	, TensorImpl* permeances, float initial_perm, CPUBackend* backend)
 {
-	requireProperties(x, backend, DType::Bool, IsPlain());
-	requireProperties(y, backend, DType::Bool, IsPlain());
-	requireProperties(connections, backend, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, backend, typeToDType<PermType>(), IsPlain());
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(y, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
 
 	Shape s = connections->shape();
 	s.pop_back();
@@ -231,64 +772,65 @@ void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connecti
 
 	size_t max_synapses_per_cell = connections->shape().back();
 	size_t input_cell_count = x->size();
+	// Synapses store their target as a 32 bit index
+	et_check(input_cell_count <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
 
-	const bool* in = (const bool*) x->data();
-	const bool* out = (const bool*) y->data();
-	int32_t* conns = (int32_t*)connections->data();
-	PermType* perms = (PermType*)permeances->data();
-
-	std::vector<uint32_t> on_bits;
-	on_bits.reserve(input_cell_count*0.1);
-	for(size_t i=0;i<input_cell_count;i++) {
-		if(in[i] == true)
-			on_bits.push_back(i);
-	}
+	auto x_data = contiguous(x);
+	auto y_data = contiguous(y);
+	const bool* out = offsetData<const bool>(y_data.get());
+	RowView<uint32_t> conns(connections);
+	RowView<PermType> perms(permeances);
+	std::vector<uint32_t> on_bits = onBits(offsetData<const bool>(x_data.get()), input_cell_count);
 
 	size_t block_size = std::min(size_t(16), (size_t)y->shape().back());
-	tbb::parallel_for(tbb::blocked_range<size_t>(size_t(0), y->size(), block_size), [&](const auto& r) {
+	parallelFor(tbb::blocked_range<size_t>(size_t(0), y->size(), block_size), [&](const auto& r) {
 		for(size_t i=r.begin();i!=r.end();i++) {
 			if(out[i] == 0)
 				continue;
+			growCell(conns[i], perms[i], max_synapses_per_cell, on_bits, initial_perm);
+		}
+	});
+}
 
-			uint32_t* synapses = (uint32_t*)conns+i*max_synapses_per_cell;
-			PermType* strengths = perms+i*max_synapses_per_cell;
-			uint32_t* end = synapses+max_synapses_per_cell;
-
-			if(synapses[max_synapses_per_cell-1] != uint32_t(-1)) //If there is no space for new synapse. Ignore
-				continue;
-
-			uint32_t* it = std::lower_bound(synapses, end, uint32_t(-1));
-			size_t used_space = it - synapses;
-
-			size_t write_idx = it - synapses;
-			size_t read_idx = 0;
+template <typename PermType>
+void batchGrowSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+	, TensorImpl* permeances, float initial_perm, CPUBackend* backend)
+{
+	requireProperties(x, backend, DType::Bool);
+	requireProperties(y, backend, DType::Bool);
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
 
-			for(size_t j=0;write_idx!=max_synapses_per_cell && j < on_bits.size();j++) {
-				bool connected = false;
-				for(;read_idx<used_space;read_idx++) {
-					if(synapses[read_idx] == on_bits[j]) {
-						connected = true;
-						break;
-					}
-					if(synapses[read_idx] > on_bits[j])
-						break;
-				}
+	Shape s = connections->shape();
+	s.pop_back();
+	et_check(x->dimensions() >= 2 && y->dimensions() >= 2 && x->shape()[0] == y->shape()[0]
+		&& y->size() == (size_t)(y->shape()[0]*s.volume()), "Expecting inputs and learning cells of shape [batch, ...]");
+	size_t batch_size = x->shape()[0];
+	size_t num_cells = s.volume();
+	size_t max_synapses_per_cell = connections->shape().back();
+	size_t input_cell_count = x->size()/std::max(batch_size, size_t(1));
+	et_check(input_cell_count <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
+
+	auto x_data = contiguous(x);
+	auto y_data = contiguous(y);
+	const bool* in = offsetData<const bool>(x_data.get());
+	const bool* out = offsetData<const bool>(y_data.get());
+	RowView<uint32_t> conns(connections);
+	RowView<PermType> perms(permeances);
+
+	std::vector<std::vector<uint32_t>> on_bits(batch_size);
+	parallelFor(size_t(0), batch_size, [&](size_t b) {
+		on_bits[b] = onBits(in+b*input_cell_count, input_cell_count);
+	});
 
-				if(connected == false) {
-					synapses[write_idx] = on_bits[j];
-					strengths[write_idx] = initial_perm;
-					write_idx++;
-				}
+	//Each cell is grown by a single thread, going through the entries in batch order. So the result is the same as
+	//growing the entries one after another
+	parallelFor(tbb::blocked_range<size_t>(size_t(0), num_cells, 16), [&](const auto& r) {
+		for(size_t i=r.begin();i!=r.end();i++) {
+			for(size_t b=0;b<batch_size;b++) {
+				if(out[b*num_cells+i] == true)
+					growCell(conns[i], perms[i], max_synapses_per_cell, on_bits[b], initial_perm);
 			}
-
-			std::vector<size_t> sort_indices(write_idx);
-			std::iota(sort_indices.begin(), sort_indices.begin()+write_idx, 0);
-			std::sort(sort_indices.begin(), sort_indices.begin()+write_idx,
-				[&](size_t i, size_t j)->bool {
-					return ((uint32_t*)synapses)[i] < ((uint32_t*)synapses)[j];
-				});
-			apply_permutation_in_place(synapses, synapses+write_idx, sort_indices);
-			apply_permutation_in_place(strengths, strengths+write_idx, sort_indices);
 		}
 	});
 }
@@ -296,18 +838,18 @@ void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connecti
 template <typename PermType>
 void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold, CPUBackend* backend)
 {
-	requireProperties(connections, backend, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, backend, typeToDType<PermType>(), IsPlain());
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, typeToDType<PermType>(), IsRowContiguous());
 
-	PermType* perms = (PermType*)permeances->data();
-	uint32_t* conns = (uint32_t*)connections->data();
+	RowView<PermType> perms(permeances);
+	RowView<uint32_t> conns(connections);
 
 	size_t max_synapses_per_cell = connections->shape().back();
 	size_t input_cell_count = connections->size()/max_synapses_per_cell;
 
-	tbb::parallel_for(size_t(0), input_cell_count, [&](size_t i) {
-		uint32_t* synapses = (uint32_t*)conns+i*max_synapses_per_cell;
-		PermType* strengths = perms+i*max_synapses_per_cell;
+	parallelFor(size_t(0), input_cell_count, [&](size_t i) {
+		uint32_t* synapses = conns[i];
+		PermType* strengths = perms[i];
 		uint32_t* end = synapses+max_synapses_per_cell;
 
 		uint32_t* it = std::lower_bound(synapses, end, uint32_t(-1));
@@ -349,13 +891,81 @@ void CPUBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* learn,
 	});
 }
 
+std::shared_ptr<TensorImpl> CPUBackend::cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	std::shared_ptr<TensorImpl> res;
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		res = detail::cellActivity<decltype(v)>(x, connections, permeances, connected_permeance, active_threshold, has_unconnected_synapse
+			, this, permeance_offsets);
+	});
+	return res;
+}
+
+void CPUBackend::learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		detail::learnCorrilationSparse<decltype(v)>(x, learn, connections, permeances, permeance_offsets, perm_inc, perm_dec
+			, has_unconnected_synapse, this);
+	});
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold)
+{
+	std::shared_ptr<TensorImpl> res;
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		res = detail::proceduralCellActivity<decltype(v)>(x, permeances, seed, connected_permeance, active_threshold, this);
+	});
+	return res;
+}
+
+void CPUBackend::proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+	, float perm_inc, float perm_dec)
+{
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		detail::proceduralLearnCorrilation<decltype(v)>(x, learn, permeances, seed, perm_inc, perm_dec, this);
+	});
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, size_t steps)
+{
+	std::shared_ptr<TensorImpl> res;
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		res = detail::rollout<decltype(v)>(x, connections, permeances, connected_permeance, active_threshold, steps, this);
+	});
+	return res;
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	std::shared_ptr<TensorImpl> res;
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		res = detail::batchCellActivity<decltype(v)>(x, connections, permeances, connected_permeance, active_threshold
+			, has_unconnected_synapse, this);
+	});
+	return res;
+}
+
+void CPUBackend::batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v){
+		detail::batchLearnCorrilation<decltype(v)>(x, learn, connections, permeances, perm_inc, perm_dec, has_unconnected_synapse, this);
+	});
+}
+
 std::shared_ptr<TensorImpl> CPUBackend::globalInhibition(const TensorImpl* x, float fraction)
 {
-	requireProperties(x, this, DType::Int32, IsPlain());
+	requireProperties(x, this, DType::Int32);
 
 	auto y = createTensor(x->shape(), DType::Bool);
 
-	const int32_t* input = (const int32_t*)x->data();
+	auto x_data = contiguous(x);
+	const int32_t* input = offsetData<const int32_t>(x_data.get());
 	bool* output = (bool*)y->data();
 
 	std::vector<std::pair<int32_t, size_t>> v;
@@ -366,14 +976,15 @@ std::shared_ptr<TensorImpl> CPUBackend::globalInhibition(const TensorImpl* x, fl
 			v.push_back({input[i], i});
 	}
 
+	for(size_t i=0;i<y->size();i++)
+		output[i] = false;
+
 	//If we have a empty input
 	if(v.size() == 0)
 		return y;
 
-	tbb::parallel_sort(v.begin(), v.end(), [](const auto& a, const auto&b){return a.first > b.first;});
+	prioritized([&](){ tbb::parallel_sort(v.begin(), v.end(), [](const auto& a, const auto&b){return a.first > b.first;}); });
 
-	for(size_t i=0;i<y->size();i++)
-		output[i] = false;
 	size_t accept_index = std::min((target_size==0? 0 : target_size-1), v.size()-1);
 	int32_t min_accept_val = v[accept_index].first;
 	auto bound_end = std::upper_bound(v.begin()+accept_index, v.end(), min_accept_val, [](const auto& a, const auto& b){return a > b.first;});
@@ -383,6 +994,49 @@ std::shared_ptr<TensorImpl> CPUBackend::globalInhibition(const TensorImpl* x, fl
 	return y;
 }
 
+std::shared_ptr<TensorImpl> CPUBackend::groupInhibition(const TensorImpl* x, size_t group_size, float fraction)
+{
+	requireProperties(x, this, DType::Int32);
+	et_check(group_size > 0 && x->size() % group_size == 0, "The size of the tensor " + std::to_string(x->size())
+		+ " is not a multiple of the group size " + std::to_string(group_size));
+
+	auto y = createTensor(x->shape(), DType::Bool);
+
+	auto x_data = contiguous(x);
+	const int32_t* input = offsetData<const int32_t>(x_data.get());
+	bool* output = (bool*)y->data();
+
+	size_t target_size = group_size*fraction;
+	size_t num_groups = x->size()/group_size;
+	parallelFor(tbb::blocked_range<size_t>(0, num_groups), [&](const auto& r) {
+		std::vector<int32_t> v;
+		v.reserve(group_size);
+		for(size_t g=r.begin();g!=r.end();g++) {
+			const int32_t* in = input+g*group_size;
+			bool* out = output+g*group_size;
+
+			// Same rule as globalInhibition. Only the value of the k-th largest non zero element is needed, so
+			// partially sort the values instead of sorting (value, index) pairs
+			v.clear();
+			for(size_t i=0;i<group_size;i++) {
+				if(in[i] != 0)
+					v.push_back(in[i]);
+			}
+
+			int32_t min_accept_val = std::numeric_limits<int32_t>::max();
+			if(v.size() != 0) {
+				size_t accept_index = std::min((target_size==0? 0 : target_size-1), v.size()-1);
+				std::nth_element(v.begin(), v.begin()+accept_index, v.end(), std::greater<int32_t>());
+				min_accept_val = v[accept_index];
+			}
+
+			for(size_t i=0;i<group_size;i++)
+				out[i] = in[i] != 0 && in[i] >= min_accept_val;
+		}
+	});
+	return y;
+}
+
 
 template <typename To, typename From>
 static auto castData(const From* ptr, size_t n)
@@ -399,13 +1053,14 @@ static auto castData(const From* ptr, size_t n)
 
 std::shared_ptr<TensorImpl> CPUBackend::cast(const TensorImpl* x, DType toType)
 {
-	requireProperties(x, this, IsPlain());
+	requireProperties(x, this);
 	auto res = createTensor(x->shape(), toType);
+	auto x_data = contiguous(x);
 	dispatch(toType, [&](auto v0){
 		using ToType = decltype(v0);
 		dispatch(x->dtype(), [&](auto v1){
 			using FromType = decltype(v1);
-			auto casted_data = castData<ToType>((FromType*)x->data(), x->size());
+			auto casted_data = castData<ToType>(offsetData<const FromType>(x_data.get()), x->size());
 			static_assert(sizeof(typename decltype(casted_data)::value_type) == sizeof(ToType));
 			memcpy(res->data(), casted_data.data(), casted_data.size()*sizeof(ToType));
 		});
@@ -436,8 +1091,8 @@ void CPUBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
 
 std::shared_ptr<TensorImpl> CPUBackend::burst(const TensorImpl* x, const TensorImpl* s)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
-	requireProperties(s, this, DType::Bool, IsPlain());
+	requireProperties(x, this, DType::Bool);
+	requireProperties(s, this, DType::Bool);
 
 	Shape shape = s->shape();
 	shape.pop_back();
@@ -445,12 +1100,14 @@ std::shared_ptr<TensorImpl> CPUBackend::burst(const TensorImpl* x, const TensorI
 
 	auto y = createTensor(s->shape(), DType::Bool);
 
-	const bool* in = (const bool*)x->data();
-	const bool* state = (const bool*)s->data();
+	auto x_data = contiguous(x);
+	auto s_data = contiguous(s);
+	const bool* in = offsetData<const bool>(x_data.get());
+	const bool* state = offsetData<const bool>(s_data.get());
 	bool* out = (bool*)y->data();
 
 	size_t column_size = y->shape().back();
-	tbb::parallel_for(size_t(0), x->size(), [&](size_t i) {
+	parallelFor(size_t(0), x->size(), [&](size_t i) {
 		if(in[i] == false)
 			std::generate(out+i*column_size, out+(i+1)*column_size, [](){return 0;});
 		else {
@@ -465,7 +1122,7 @@ std::shared_ptr<TensorImpl> CPUBackend::burst(const TensorImpl* x, const TensorI
 
 std::shared_ptr<TensorImpl> CPUBackend::reverseBurst(const TensorImpl* x)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
+	requireProperties(x, this, DType::Bool);
 
 	size_t cells_per_column = x->shape().back();
 	size_t num_columns = x->size()/cells_per_column;
@@ -474,10 +1131,11 @@ std::shared_ptr<TensorImpl> CPUBackend::reverseBurst(const TensorImpl* x)
 
 	auto y = createTensor(x->shape(), DType::Bool);
 
-	const bool* in = (const bool*) x->data();
+	auto x_data = contiguous(x);
+	const bool* in = offsetData<const bool>(x_data.get());
 	bool* out = (bool*) y->data();
 
-	tbb::parallel_for(size_t(0), num_columns, [&](size_t i) {
+	parallelFor(size_t(0), num_columns, [&](size_t i) {
 		if(std::accumulate(in+i*cells_per_column, in+(i+1)*cells_per_column, size_t(0)) == cells_per_column) {
 			std::generate(out+i*cells_per_column, out+(i+1)*cells_per_column, [](){return 0;});
 			out[i*cells_per_column+dist(rng)] = 1;
@@ -497,6 +1155,14 @@ void CPUBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, TensorIm
 	});
 }
 
+void CPUBackend::batchGrowSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+	, TensorImpl* permeances, float initial_perm)
+{
+	dispatch<type_list_t<float, half>>(permeances->dtype(), [&](auto v) {
+		detail::batchGrowSynapses<decltype(v)>(x, y, connections, permeances, initial_perm, this);
+	});
+}
+
 template <typename T>
 const T* getPtrToValue(size_t parent_idx, const TensorImpl* t)
 {
@@ -522,13 +1188,9 @@ static std::shared_ptr<TensorImpl> uniaryOp(const TensorImpl* src, Op op)
 	std::shared_ptr<TensorImpl> dest;
 	dispatch(src->dtype(), [&](auto v){
 		using T = decltype(v);
-		using ResType = std::invoke_result_t<Op, T>;
-		//We don't have support to double percition now. Cast it to float
-		using StoreType = typename std::conditional_t<std::is_same_v<ResType, bool>, bool
-			, typename std::conditional_t<std::is_same_v<T, half>, half
-			, typename std::conditional_t<std::is_same_v<ResType, double>, float, ResType>>>;
+		using StoreType = UnaryStoreType<T, std::invoke_result_t<Op, T>>;
 		dest = src->backend()->createTensor(src->shape(), typeToDType<StoreType>());
-		tbb::parallel_for(size_t(0), src->size(), [&](size_t i) {
+		parallelFor(size_t(0), src->size(), [&](size_t i) {
 			auto ptr = getPtrToValue<T>(i, src);
 			auto res = op(*ptr);
 
@@ -550,12 +1212,10 @@ static std::shared_ptr<TensorImpl> binaryOp(const TensorImpl* src, const TensorI
 		using T1 = decltype(v);
 		dispatch(src2->dtype(), [&](auto v){
 			using T2 = decltype(v);
-			using ResType = std::invoke_result_t<Op, T1, T2>;
-			//We don't have support to double percition now. Cast it to float
-			using StoreType = typename std::conditional<std::is_same<ResType, double>::value, float, ResType>::type;
+			using StoreType = BinaryStoreType<std::invoke_result_t<Op, T1, T2>>;
 			dest = src->backend()->createTensor(src->shape(), typeToDType<StoreType>());
 
-			tbb::parallel_for(size_t(0), src->size(), [&](size_t i) {
+			parallelFor(size_t(0), src->size(), [&](size_t i) {
 				auto ptr = getPtrToValue<T1>(i, src);
 				auto ptr2 = getPtrToValue<T2>(i, src2);
 				auto res = op(*ptr, *ptr2);
@@ -569,6 +1229,42 @@ static std::shared_ptr<TensorImpl> binaryOp(const TensorImpl* src, const TensorI
 	return dest;
 }
 
+template <typename Op>
+static std::shared_ptr<TensorImpl> ternaryOp(const TensorImpl* src, const TensorImpl* src2, const TensorImpl* src3, Op op)
+{
+	std::shared_ptr<TensorImpl> dest;
+	et_assert(src->shape() == src2->shape() && src->shape() == src3->shape());
+
+	dispatch(src->dtype(), [&](auto v){
+		using T1 = decltype(v);
+		dispatch(src2->dtype(), [&](auto v){
+			using T2 = decltype(v);
+			dispatch(src3->dtype(), [&](auto v){
+				using T3 = decltype(v);
+				using ResType = std::invoke_result_t<Op, T1, T2, T3>;
+				dest = src->backend()->createTensor(src->shape(), typeToDType<ResType>());
+
+				parallelFor(size_t(0), src->size(), [&](size_t i) {
+					auto res = op(*getPtrToValue<T1>(i, src), *getPtrToValue<T2>(i, src2), *getPtrToValue<T3>(i, src3));
+					reinterpret_cast<ResType*>(dest->data())[i] = res;
+				});
+			});
+		});
+	});
+
+	et_assert((bool)dest);
+	return dest;
+}
+
+template <typename To, typename From>
+static To castValue(From v)
+{
+	if constexpr(std::is_same_v<To, half> || std::is_same_v<From, half>)
+		return To(float(v));
+	else
+		return static_cast<To>(v);
+}
+
 std::shared_ptr<TensorImpl> CPUBackend::realize(const TensorImpl* x)
 {
 	requireProperties(x, this);
@@ -603,7 +1299,7 @@ void CPUBackend::assign(TensorImpl* dest, const TensorImpl* src)
 
 		//Parallelize if the problem is big enought
 		if(dest->size() > 2000) {
-			tbb::parallel_for(size_t(0), dest->size(), [&](size_t i) {
+			parallelFor(size_t(0), dest->size(), [&](size_t i) {
 				auto s = (T*)getPtrToValue<T>(i, src);
 				auto ptr = (T*)getPtrToValue<T>(i, dest);
 				*ptr = *s;
@@ -621,7 +1317,7 @@ void CPUBackend::assign(TensorImpl* dest, const TensorImpl* src)
 
 std::shared_ptr<TensorImpl> CPUBackend::sum(const TensorImpl* x, size_t chunk_size, DType dtype)
 {
-	requireProperties(x, this, IsPlain());
+	requireProperties(x, this);
 	et_check(x->size() % chunk_size == 0);
 
 	DType result_dtype = dtype;
@@ -637,6 +1333,11 @@ std::shared_ptr<TensorImpl> CPUBackend::sum(const TensorImpl* x, size_t chunk_si
 				return DType::Float;
 		}();
 	}
+	// Bools and ints are summed as Int32, which holds the sum of at most INT32_MAX of them
+	et_check(result_dtype != DType::Int32 || (x->dtype() != DType::Bool && x->dtype() != DType::Int32)
+		|| chunk_size <= (size_t)std::numeric_limits<int32_t>::max()
+		, "Summing " + std::to_string(chunk_size) + " elements overflows Int32. Sum as Float instead");
+	auto x_data = contiguous(x);
 
 	size_t result_size = x->size()/chunk_size;
 	auto res = createTensor({intmax_t(result_size)}, result_dtype);
@@ -645,25 +1346,27 @@ std::shared_ptr<TensorImpl> CPUBackend::sum(const TensorImpl* x, size_t chunk_si
 	if(result_size == 1) {
 		dispatch2d(x->dtype(), result_dtype, [&](auto v1, auto v2) {
 			using T = decltype(v1);
-			auto in = (const T*)x->data();
+			auto in = offsetData<const T>(x_data.get());
 			using ResType = decltype(v2);
 			auto ptr = (ResType*) res->data();
-			*ptr = tbb::parallel_reduce(tbb::blocked_range(in, in+x->size()), ResType(0)
-				, [](const auto& r, ResType init){
-					return std::accumulate(r.begin(), r.end(), init);
-				},
-				[](auto x, auto y) {
-					return x + y;
-				});
+			*ptr = prioritized([&](){
+				return tbb::parallel_reduce(tbb::blocked_range(in, in+x->size()), ResType(0)
+					, [](const auto& r, ResType init){
+						return std::accumulate(r.begin(), r.end(), init);
+					},
+					[](auto x, auto y) {
+						return x + y;
+					});
+			});
 		});
 	}
 	else {
 		dispatch2d(x->dtype(), result_dtype, [&](auto v1, auto v2) {
 			using T = decltype(v1);
-			auto in = (const T*)x->data();
+			auto in = offsetData<const T>(x_data.get());
 			using ResType = decltype(v2);
 			auto ptr = (ResType*) res->data();
-			tbb::parallel_for(size_t(0), size_t(x->size()/chunk_size), [&](size_t i) {
+			parallelFor(size_t(0), size_t(x->size()/chunk_size), [&](size_t i) {
 				size_t offset = i*chunk_size;
 				ResType s = std::accumulate(in+offset, in+offset+chunk_size, ResType(0));
 				ptr[i] = s;
@@ -748,6 +1451,54 @@ std::shared_ptr<TensorImpl> CPUBackend::logical_or(const TensorImpl* x1, const T
 {
 	return binaryOp(x1, x2, [](auto a, auto b) {return a||b;});
 }
+std::shared_ptr<TensorImpl> CPUBackend::lesser_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {return a<=b;});
+}
+std::shared_ptr<TensorImpl> CPUBackend::greater_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {return a>=b;});
+}
+std::shared_ptr<TensorImpl> CPUBackend::not_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {return a!=b;});
+}
+std::shared_ptr<TensorImpl> CPUBackend::logical_xor(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {return (bool)a!=(bool)b;});
+}
+std::shared_ptr<TensorImpl> CPUBackend::minimum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {
+		using T = SelectType<decltype(a), decltype(b)>;
+		return std::min(castValue<T>(a), castValue<T>(b));
+	});
+}
+std::shared_ptr<TensorImpl> CPUBackend::maximum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(x1, x2, [](auto a, auto b) {
+		using T = SelectType<decltype(a), decltype(b)>;
+		return std::max(castValue<T>(a), castValue<T>(b));
+	});
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y)
+{
+	return ternaryOp(condition, x, y, [](auto c, auto a, auto b) {
+		using T = SelectType<decltype(a), decltype(b)>;
+		return (bool)c ? castValue<T>(a) : castValue<T>(b);
+	});
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max)
+{
+	return ternaryOp(x, min, max, [](auto v, auto lo, auto hi) {
+		using T = SelectType<SelectType<decltype(v), decltype(lo)>, decltype(hi)>;
+		// Spelled out like the OpenCL backend. std::clamp is undefined when lo > hi
+		T val = castValue<T>(v), l = castValue<T>(lo), h = castValue<T>(hi);
+		return val < l ? l : (h < val ? h : val);
+	});
+}
 
 std::shared_ptr<TensorImpl> CPUBackend::from(const TensorImpl* x)
 {
@@ -761,3 +1512,122 @@ std::shared_ptr<TensorImpl> CPUBackend::from(const TensorImpl* x)
 	free(buffer);
 	return res;
 }
+
+static inline int popcount64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(v);
+#else
+	return (int)std::bitset<64>(v).count();
+#endif
+}
+
+//Packs each row of a Bool tensor into 64 bit words. Bit j of a row is bit j%64 of word j/64
+static std::vector<uint64_t> packRows(const TensorImpl* x, size_t num_bits, size_t words_per_row)
+{
+	auto x_data = contiguous(x);
+	const bool* ptr = offsetData<const bool>(x_data.get());
+	size_t num_rows = x->size()/num_bits;
+	std::vector<uint64_t> res(num_rows*words_per_row, 0);
+	parallelFor(size_t(0), num_rows, [&](size_t i) {
+		const bool* row = ptr+i*num_bits;
+		uint64_t* words = res.data()+i*words_per_row;
+		for(size_t j=0;j<num_bits;j++)
+			words[j/64] |= uint64_t(row[j]) << (j%64);
+	});
+	return res;
+}
+
+//Checks a and b are sets of SDRs of the same size. Returns the shape of the pairwise result
+static Shape overlapShape(const TensorImpl* a, const TensorImpl* b, Backend* backend)
+{
+	requireProperties(a, backend, DType::Bool);
+	requireProperties(b, backend, DType::Bool);
+	et_check(a->dimensions() >= 1 && b->dimensions() >= 1);
+	et_check(a->shape().back() == b->shape().back(), "SDRs in a and b must have the same size. Got "
+		+ std::to_string(a->shape().back()) + " and " + std::to_string(b->shape().back()));
+	Shape s = a->shape();
+	Shape t = b->shape();
+	s.pop_back();
+	t.pop_back();
+	return s + t;
+}
+
+std::shared_ptr<TensorImpl> CPUBackend::overlap(const TensorImpl* a, const TensorImpl* b)
+{
+	Shape s = overlapShape(a, b, this);
+	size_t num_bits = a->shape().back();
+	size_t num_a = a->size()/num_bits;
+	size_t num_b = b->size()/num_bits;
+	size_t words = (num_bits+63)/64;
+
+	auto packed_a = packRows(a, num_bits, words);
+	auto packed_b = packRows(b, num_bits, words);
+	auto res = createTensor(s.size() == 0 ? Shape{1} : s, DType::Int32);
+	int32_t* out = (int32_t*)res->data();
+
+	//Work on blocks of SDRs so the rows of b stay in cache while they are compared against a block of a
+	const size_t block_size = 64;
+	parallelFor(tbb::blocked_range2d<size_t>(0, num_a, block_size, 0, num_b, block_size), [&](const auto& r) {
+		for(size_t i=r.rows().begin();i!=r.rows().end();i++) {
+			const uint64_t* row_a = packed_a.data()+i*words;
+			for(size_t j=r.cols().begin();j!=r.cols().end();j++) {
+				const uint64_t* row_b = packed_b.data()+j*words;
+				int32_t sum = 0;
+				for(size_t w=0;w<words;w++)
+					sum += popcount64(row_a[w] & row_b[w]);
+				out[i*num_b+j] = sum;
+			}
+		}
+	});
+	return res;
+}
+
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> CPUBackend::topKOverlap(const TensorImpl* a, const TensorImpl* b
+	, size_t k, size_t min_overlap)
+{
+	overlapShape(a, b, this);
+	et_check(k > 0, "k must be larger than 0");
+	size_t num_bits = a->shape().back();
+	size_t num_a = a->size()/num_bits;
+	size_t num_b = b->size()/num_bits;
+	size_t words = (num_bits+63)/64;
+
+	auto packed_a = packRows(a, num_bits, words);
+	auto packed_b = packRows(b, num_bits, words);
+	Shape s = a->shape();
+	s.back() = k;
+	auto indices = createTensor(s, DType::Int32);
+	auto overlaps = createTensor(s, DType::Int32);
+	int32_t* idx_ptr = (int32_t*)indices->data();
+	int32_t* val_ptr = (int32_t*)overlaps->data();
+
+	parallelFor(size_t(0), num_a, [&](size_t i) {
+		const uint64_t* row_a = packed_a.data()+i*words;
+		int32_t* idx = idx_ptr+i*k;
+		int32_t* val = val_ptr+i*k;
+		std::fill(idx, idx+k, -1);
+		std::fill(val, val+k, 0);
+
+		//Insertion into a sorted list of k elements. SDRs with the same overlap are ordered by their index
+		size_t found = 0;
+		for(size_t j=0;j<num_b;j++) {
+			const uint64_t* row_b = packed_b.data()+j*words;
+			int32_t v = 0;
+			for(size_t w=0;w<words;w++)
+				v += popcount64(row_a[w] & row_b[w]);
+			if(size_t(v) < min_overlap || (found == k && v <= val[k-1]))
+				continue;
+
+			size_t pos = std::min(found, k-1);
+			for(;pos>0 && val[pos-1]<v;pos--) {
+				idx[pos] = idx[pos-1];
+				val[pos] = val[pos-1];
+			}
+			idx[pos] = j;
+			val[pos] = v;
+			found = std::min(found+1, k);
+		}
+	});
+	return {indices, overlaps};
+}
@@ -2,6 +2,7 @@
 
 #include <Etaler/Core/TensorImpl.hpp>
 #include <Etaler/Core/TypeHelpers.hpp>
+#include <Etaler/Core/TypedTensor.hpp>
 
 #include <memory>
 #include <variant>
@@ -47,29 +48,59 @@ protected:
 	std::variant<bool*, int32_t*, float*, half*> storage_;
 };
 
+// A buffer living in the memory of another buffer. Keeps the parent buffer alive
+struct ETALER_EXPORT CPUAliasBuffer : public BufferImpl
+{
+	CPUAliasBuffer(const Shape& shape, DType dtype, std::shared_ptr<Backend> backend, std::shared_ptr<BufferImpl> parent, void* ptr)
+		: BufferImpl(shape.volume(), dtype, std::move(backend)), parent_(std::move(parent)), ptr_(ptr) {}
+
+	virtual void* data() const override {return ptr_;}
+
+protected:
+	std::shared_ptr<BufferImpl> parent_;
+	void* ptr_;
+};
+
 struct ETALER_EXPORT CPUBackend : public Backend
 {
-	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data=nullptr) override
-	{
-		auto buf = std::make_shared<CPUBuffer>(shape, dtype, shared_from_this(), data);
-		return std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
-	}
+	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data=nullptr) override;
+	virtual std::shared_ptr<TensorImpl> aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype) override;
 
 	virtual std::shared_ptr<TensorImpl> cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances,
 		float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
 	virtual void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
 		TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+		, float connected_permeance, size_t active_threshold) override;
+	virtual void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+		, float perm_inc, float perm_dec) override;
+	virtual std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual void batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+		, float initial_perm) override;
 	virtual std::shared_ptr<TensorImpl> globalInhibition(const TensorImpl* x, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> groupInhibition(const TensorImpl* x, size_t group_size, float fraction) override;
 	virtual std::shared_ptr<TensorImpl> cast(const TensorImpl* x, DType toType) override;
 	virtual void copyToHost(const TensorImpl* pimpl, void* dest) override;
 	virtual std::shared_ptr<TensorImpl> copy(const TensorImpl* x) override;
 	virtual void sortSynapse(TensorImpl* connections, TensorImpl* permeances) override;
 	virtual std::shared_ptr<TensorImpl> burst(const TensorImpl* x, const TensorImpl* s) override;
 	virtual std::shared_ptr<TensorImpl> reverseBurst(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, size_t steps) override;
 	virtual void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
 		, TensorImpl* permeances, float initial_perm) override;
 	virtual void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold) override;
 	virtual std::shared_ptr<TensorImpl> from(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> overlap(const TensorImpl* a, const TensorImpl* b) override;
+	virtual std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> topKOverlap(const TensorImpl* a, const TensorImpl* b
+		, size_t k, size_t min_overlap) override;
 
 	virtual std::shared_ptr<TensorImpl> realize(const TensorImpl* x) override;
 	virtual void assign(TensorImpl* dest, const TensorImpl* src) override;
@@ -93,8 +124,44 @@ struct ETALER_EXPORT CPUBackend : public Backend
 	virtual std::shared_ptr<TensorImpl> lesser(const TensorImpl* x1, const TensorImpl* x2) override;
 	virtual std::shared_ptr<TensorImpl> logical_and(const TensorImpl* x1, const TensorImpl* x2) override;
 	virtual std::shared_ptr<TensorImpl> logical_or(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> not_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_xor(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> minimum(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> maximum(const TensorImpl* x1, const TensorImpl* x2) override;
+
+	//Ternary Operations
+	virtual std::shared_ptr<TensorImpl> where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y) override;
+	virtual std::shared_ptr<TensorImpl> clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max) override;
 
 	virtual std::string name() const override {return "CPU";}
+
+	//Use the synapse kernels compiled for common synapse counts (16, 32, 64, 128, 256 and 1024). Enabled by default
+	void setSpecializedKernels(bool enable) {specialized_kernels_ = enable;}
+	bool specializedKernels() const {return specialized_kernels_;}
+
+protected:
+	bool specialized_kernels_ = true;
 };
 
+namespace detail
+{
+// Typed entry points of the synapse kernels for callers that know the types at compile time (see TypedTensor).
+// They run the same kernels as CPUBackend::cellActivity() and learnCorrilation() without dispatching on the DType.
+// The tensors must be on a CPUBackend, x, learn and result contiguous and the synapses row contiguous
+ETALER_EXPORT void cellActivity(const TypedTensor<bool, 1>& x, const TypedTensor<int32_t, 2>& connections
+	, const TypedTensor<float, 2>& permeances, const TypedTensor<int32_t, 1>& result, float connected_permeance
+	, size_t active_threshold, bool has_unconnected_synapse=true);
+ETALER_EXPORT void cellActivity(const TypedTensor<bool, 1>& x, const TypedTensor<int32_t, 2>& connections
+	, const TypedTensor<half, 2>& permeances, const TypedTensor<int32_t, 1>& result, float connected_permeance
+	, size_t active_threshold, bool has_unconnected_synapse=true);
+ETALER_EXPORT void learnCorrilation(const TypedTensor<bool, 1>& x, const TypedTensor<bool, 1>& learn
+	, const TypedTensor<int32_t, 2>& connections, const TypedTensor<float, 2>& permeances, float perm_inc, float perm_dec
+	, bool has_unconnected_synapse=true);
+ETALER_EXPORT void learnCorrilation(const TypedTensor<bool, 1>& x, const TypedTensor<bool, 1>& learn
+	, const TypedTensor<int32_t, 2>& connections, const TypedTensor<half, 2>& permeances, float perm_inc, float perm_dec
+	, bool has_unconnected_synapse=true);
+}
+
 } // et
@@ -0,0 +1,127 @@
+#pragma once
+
+// The parallel loops of the CPU kernels. Internal to Etaler. Code running on the host outside of the CPUBackend
+// (ex: the compression of idle models) uses them too, so it follows the priority and the real-time mode of the
+// calling thread like the kernels do
+
+#include <Etaler/Core/Priority.hpp>
+#include "RealtimePool.hpp"
+
+#include <chrono>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/task_arena.h>
+
+namespace et
+{
+
+// Latency and Batch kernels run in their own arenas so TBB's workers serve the higher priority ones first.
+// Normal kernels run in the implicit arena of the calling thread like before
+inline tbb::task_arena& priorityArena(Priority priority)
+{
+#if TBB_INTERFACE_VERSION >= 12000
+	static tbb::task_arena batch(tbb::task_arena::automatic, 1, tbb::task_arena::priority::low);
+	static tbb::task_arena latency(tbb::task_arena::automatic, 1, tbb::task_arena::priority::high);
+#else
+	// Old TBB has no arena priorities. The arenas still keep batch kernels from queuing up in front of the others
+	static tbb::task_arena batch;
+	static tbb::task_arena latency;
+#endif
+	return priority == Priority::Batch ? batch : latency;
+}
+
+inline thread_local bool g_in_kernel = false;
+
+// Marks the calling thread as running a kernel and records the kernel's latency
+template <typename Func>
+inline auto timed(Func f) -> decltype(f())
+{
+	Priority priority = currentPriority();
+	auto start = std::chrono::steady_clock::now();
+	struct Finish
+	{
+		~Finish()
+		{
+			g_in_kernel = false;
+			recordLatency(priority, std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+		}
+		Priority priority;
+		std::chrono::steady_clock::time_point start;
+	} finish{priority, start};
+
+	g_in_kernel = true;
+	return f();
+}
+
+// Runs a TBB algorithm in the arena of the calling thread's priority and records its latency. Nested calls run
+// directly in the enclosing kernel's arena. Under a RealtimeScope it runs on the calling thread only, so it
+// doesn't wait for TBB's workers
+template <typename Func>
+inline auto prioritized(Func f) -> decltype(f())
+{
+	if(g_in_kernel)
+		return f();
+
+	return timed([&]() {
+		Priority priority = currentPriority();
+		if(currentRealtimePool() != nullptr) {
+			static thread_local tbb::task_arena serial(1, 1);
+			return serial.execute(f);
+		}
+		if(priority == Priority::Normal)
+			return f();
+		return priorityArena(priority).execute(f);
+	});
+}
+
+// Splits [first, last) evenly between the threads of the pool and calls f(begin, end) on every non-empty part
+template <typename Func>
+inline void realtimeFor(RealtimePool* pool, size_t first, size_t last, const Func& f)
+{
+	timed([&]() {
+		pool->run([&](size_t i, size_t n) {
+			size_t size = last - first;
+			size_t begin = first + size*i/n;
+			size_t end = first + size*(i+1)/n;
+			g_in_kernel = true; // The workers run nested kernels directly too
+			if(begin < end)
+				f(begin, end);
+		});
+	});
+}
+
+template <typename Func>
+inline void parallelFor(size_t first, size_t last, const Func& f)
+{
+	if(RealtimePool* pool = currentRealtimePool(); pool != nullptr && g_in_kernel == false && first < last)
+		return realtimeFor(pool, first, last, [&](size_t begin, size_t end) {
+			for(size_t i=begin;i<end;i++)
+				f(i);
+		});
+	prioritized([&](){ tbb::parallel_for(first, last, f); });
+}
+
+template <typename Func>
+inline void parallelFor(const tbb::blocked_range<size_t>& r, const Func& f)
+{
+	if(RealtimePool* pool = currentRealtimePool(); pool != nullptr && g_in_kernel == false && r.empty() == false)
+		return realtimeFor(pool, r.begin(), r.end(), [&](size_t begin, size_t end) {
+			f(tbb::blocked_range<size_t>(begin, end, r.grainsize()));
+		});
+	prioritized([&](){ tbb::parallel_for(r, f); });
+}
+
+template <typename Func>
+inline void parallelFor(const tbb::blocked_range2d<size_t>& r, const Func& f)
+{
+	// Split the rows only
+	if(RealtimePool* pool = currentRealtimePool(); pool != nullptr && g_in_kernel == false && r.empty() == false)
+		return realtimeFor(pool, r.rows().begin(), r.rows().end(), [&](size_t begin, size_t end) {
+			f(tbb::blocked_range2d<size_t>(begin, end, r.rows().grainsize(), r.cols().begin(), r.cols().end(), r.cols().grainsize()));
+		});
+	prioritized([&](){ tbb::parallel_for(r, f); });
+}
+
+}
@@ -0,0 +1,327 @@
+#include "HybridBackend.hpp"
+
+using namespace et;
+
+// Holds the data of a tensor as a flat, plain tensor of the host or the device backend covering the whole buffer.
+// Moving the buffer replaces it with a copy on the other backend
+struct HybridBuffer : public BufferImpl
+{
+	HybridBuffer(std::shared_ptr<TensorImpl> resident, std::shared_ptr<Backend> backend)
+		: BufferImpl(resident->size(), resident->dtype(), std::move(backend)), resident_(std::move(resident)) {}
+
+	virtual void* data() const override {return resident_->data();}
+
+	std::shared_ptr<TensorImpl> resident_;
+};
+
+static size_t bytes(const BufferImpl* buf)
+{
+	return buf->size()*dtypeToSize(buf->dtype());
+}
+
+HybridBackend::HybridBackend(std::shared_ptr<Backend> host, std::shared_ptr<Backend> device, PlacementCost cost)
+	: host_(std::move(host)), device_(std::move(device)), cost_(cost)
+{
+	et_check(host_ != nullptr, "HybridBackend needs a host backend");
+	et_check(host_ != device_, "The host and the device of a HybridBackend must be different backends");
+}
+
+HybridBackend::Placement HybridBackend::placementOf(const TensorImpl* x) const
+{
+	requireProperties(x, this);
+	auto buf = static_cast<const HybridBuffer*>(x->buffer().get());
+	return buf->resident_->backend() == host_.get() ? Placement::Host : Placement::Device;
+}
+
+HybridStats HybridBackend::stats() const
+{
+	std::lock_guard lock(mutex_);
+	return stats_;
+}
+
+void HybridBackend::resetStats()
+{
+	std::lock_guard lock(mutex_);
+	stats_ = HybridStats();
+}
+
+HybridBackend::Placement HybridBackend::place(std::initializer_list<const TensorImpl*> inputs)
+{
+	double work = 0;
+	double host_cost = 0;
+	double device_cost = cost_.device_launch;
+	for(auto x : inputs) {
+		// Moving an input moves its whole buffer
+		double transfer = cost_.transfer_latency + bytes(x->buffer().get())*cost_.transfer_per_byte;
+		(placementOf(x) == Placement::Host ? device_cost : host_cost) += transfer;
+		work += x->size();
+	}
+	host_cost += work*cost_.host_per_element;
+	device_cost += work*cost_.device_per_element;
+
+	Placement p = (device_ != nullptr && device_cost < host_cost) ? Placement::Device : Placement::Host;
+	std::lock_guard lock(mutex_);
+	(p == Placement::Host ? stats_.host_ops : stats_.device_ops) += 1;
+	return p;
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::on(const TensorImpl* x, Placement p)
+{
+	if(placementOf(x) != p) {
+		auto buf = static_cast<HybridBuffer*>(x->buffer().get());
+		buf->resident_ = backend(p)->from(buf->resident_.get());
+		std::lock_guard lock(mutex_);
+		stats_.migrations += 1;
+		stats_.bytes_migrated += bytes(buf);
+	}
+	auto buf = static_cast<const HybridBuffer*>(x->buffer().get());
+	return std::make_shared<TensorImpl>(buf->resident_->buffer(), x->shape(), x->stride(), x->offset());
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::wrap(const std::shared_ptr<TensorImpl>& x)
+{
+	auto inner = x->buffer();
+	auto resident = std::make_shared<TensorImpl>(inner, Shape({(intmax_t)inner->size()}), Shape({1}));
+	auto buf = std::make_shared<HybridBuffer>(std::move(resident), shared_from_this());
+	return std::make_shared<TensorImpl>(buf, x->shape(), x->stride(), x->offset());
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::unary(UnaryOp op, const TensorImpl* x)
+{
+	Placement p = place({x});
+	return wrap((backend(p)->*op)(on(x, p).get()));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::binary(BinaryOp op, const TensorImpl* x1, const TensorImpl* x2)
+{
+	Placement p = place({x1, x2});
+	return wrap((backend(p)->*op)(on(x1, p).get(), on(x2, p).get()));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::createTensor(const Shape& shape, DType dtype, const void* data)
+{
+	return wrap(host_->createTensor(shape, dtype, data));
+}
+
+void HybridBackend::sync() const
+{
+	host_->sync();
+	if(device_ != nullptr)
+		device_->sync();
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances,
+	float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	Placement p = place({x, connections, permeances});
+	return wrap(backend(p)->cellActivity(on(x, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, connected_permeance, active_threshold, has_unconnected_synapse));
+}
+
+void HybridBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
+	TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	Placement p = place({x, learn, connections, permeances});
+	backend(p)->learnCorrilation(on(x, p).get(), on(learn, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	Placement p = place({x, connections, permeances, permeance_offsets});
+	return wrap(backend(p)->cellActivityWithOffsets(on(x, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, on(permeance_offsets, p).get(), connected_permeance, active_threshold, has_unconnected_synapse));
+}
+
+void HybridBackend::learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	Placement p = place({x, learn, connections, permeances, permeance_offsets});
+	backend(p)->learnCorrilationSparse(on(x, p).get(), on(learn, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, on(permeance_offsets, p).get(), perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold)
+{
+	Placement p = place({x, permeances});
+	return wrap(backend(p)->proceduralCellActivity(on(x, p).get(), on(permeances, p).get(), seed, connected_permeance, active_threshold));
+}
+
+void HybridBackend::proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+	, float perm_inc, float perm_dec)
+{
+	Placement p = place({x, learn, permeances});
+	backend(p)->proceduralLearnCorrilation(on(x, p).get(), on(learn, p).get(), on(permeances, p).get(), seed, perm_inc, perm_dec);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	Placement p = place({x, connections, permeances});
+	return wrap(backend(p)->batchCellActivity(on(x, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, connected_permeance, active_threshold, has_unconnected_synapse));
+}
+
+void HybridBackend::batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	Placement p = place({x, learn, connections, permeances});
+	backend(p)->batchLearnCorrilation(on(x, p).get(), on(learn, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+void HybridBackend::batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+	, float initial_perm)
+{
+	Placement p = place({x, learn, connections, permeances});
+	backend(p)->batchGrowSynapses(on(x, p).get(), on(learn, p).get(), on(connections, p).get(), on(permeances, p).get(), initial_perm);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::globalInhibition(const TensorImpl* x, float fraction)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->globalInhibition(on(x, p).get(), fraction));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::groupInhibition(const TensorImpl* x, size_t group_size, float fraction)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->groupInhibition(on(x, p).get(), group_size, fraction));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::cast(const TensorImpl* x, DType toType)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->cast(on(x, p).get(), toType));
+}
+
+void HybridBackend::copyToHost(const TensorImpl* pimpl, void* dest)
+{
+	// Reading doesn't move the tensor
+	Placement p = placementOf(pimpl);
+	backend(p)->copyToHost(on(pimpl, p).get(), dest);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::copy(const TensorImpl* x)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->copy(on(x, p).get()));
+}
+
+void HybridBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
+{
+	Placement p = place({connections, permeances});
+	backend(p)->sortSynapse(on(connections, p).get(), on(permeances, p).get());
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::burst(const TensorImpl* x, const TensorImpl* s)
+{
+	Placement p = place({x, s});
+	return wrap(backend(p)->burst(on(x, p).get(), on(s, p).get()));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::reverseBurst(const TensorImpl* x)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->reverseBurst(on(x, p).get()));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, size_t steps)
+{
+	Placement p = place({x, connections, permeances});
+	return wrap(backend(p)->rollout(on(x, p).get(), on(connections, p).get(), on(permeances, p).get()
+		, connected_permeance, active_threshold, steps));
+}
+
+void HybridBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+	, TensorImpl* permeances, float initial_perm)
+{
+	Placement p = place({x, y, connections, permeances});
+	backend(p)->growSynapses(on(x, p).get(), on(y, p).get(), on(connections, p).get(), on(permeances, p).get(), initial_perm);
+}
+
+void HybridBackend::decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold)
+{
+	Placement p = place({connections, permeances});
+	backend(p)->decaySynapses(on(connections, p).get(), on(permeances, p).get(), threshold);
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::from(const TensorImpl* x)
+{
+	if(x->backend() == this)
+		return copy(x);
+	// A tensor of the device can start on the device
+	if(device_ != nullptr && x->backend() == device_.get())
+		return wrap(device_->copy(x));
+	return wrap(host_->from(x));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::overlap(const TensorImpl* a, const TensorImpl* b)
+{
+	Placement p = place({a, b});
+	return wrap(backend(p)->overlap(on(a, p).get(), on(b, p).get()));
+}
+
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> HybridBackend::topKOverlap(const TensorImpl* a, const TensorImpl* b
+	, size_t k, size_t min_overlap)
+{
+	Placement p = place({a, b});
+	auto [indices, overlaps] = backend(p)->topKOverlap(on(a, p).get(), on(b, p).get(), k, min_overlap);
+	return {wrap(indices), wrap(overlaps)};
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::realize(const TensorImpl* x)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->realize(on(x, p).get()));
+}
+
+void HybridBackend::assign(TensorImpl* dest, const TensorImpl* src)
+{
+	Placement p = place({dest, src});
+	backend(p)->assign(on(dest, p).get(), on(src, p).get());
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::sum(const TensorImpl* x, size_t chunk_size, DType dtype)
+{
+	Placement p = place({x});
+	return wrap(backend(p)->sum(on(x, p).get(), chunk_size, dtype));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::abs(const TensorImpl* x) {return unary(&Backend::abs, x);}
+std::shared_ptr<TensorImpl> HybridBackend::exp(const TensorImpl* x) {return unary(&Backend::exp, x);}
+std::shared_ptr<TensorImpl> HybridBackend::negate(const TensorImpl* x) {return unary(&Backend::negate, x);}
+std::shared_ptr<TensorImpl> HybridBackend::inverse(const TensorImpl* x) {return unary(&Backend::inverse, x);}
+std::shared_ptr<TensorImpl> HybridBackend::log(const TensorImpl* x) {return unary(&Backend::log, x);}
+std::shared_ptr<TensorImpl> HybridBackend::logical_not(const TensorImpl* x) {return unary(&Backend::logical_not, x);}
+
+std::shared_ptr<TensorImpl> HybridBackend::add(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::add, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::subtract(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::subtract, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::mul(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::mul, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::div(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::div, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::equal(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::equal, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::greater(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::greater, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::lesser(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::lesser, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::logical_and(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::logical_and, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::logical_or(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::logical_or, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::lesser_equal(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::lesser_equal, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::greater_equal(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::greater_equal, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::not_equal(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::not_equal, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::logical_xor(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::logical_xor, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::minimum(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::minimum, x1, x2);}
+std::shared_ptr<TensorImpl> HybridBackend::maximum(const TensorImpl* x1, const TensorImpl* x2) {return binary(&Backend::maximum, x1, x2);}
+
+std::shared_ptr<TensorImpl> HybridBackend::where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y)
+{
+	Placement p = place({condition, x, y});
+	return wrap(backend(p)->where(on(condition, p).get(), on(x, p).get(), on(y, p).get()));
+}
+
+std::shared_ptr<TensorImpl> HybridBackend::clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max)
+{
+	Placement p = place({x, min, max});
+	return wrap(backend(p)->clamp(on(x, p).get(), on(min, p).get(), on(max, p).get()));
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <Etaler/Core/TensorImpl.hpp>
+
+#include <initializer_list>
+#include <mutex>
+
+namespace et
+{
+
+// Rough costs, in seconds, of running an op on the host and on the device. An op costs work*per_element, plus
+// device_launch on the device, plus transfer_latency + bytes*transfer_per_byte for every input that has to be moved
+// to where it runs. The work of an op is the number of elements of its inputs. The defaults are in the range of a
+// discrete GPU on PCIe
+struct PlacementCost
+{
+	double host_per_element = 1e-9;
+	double device_per_element = 0.05e-9;
+	double device_launch = 20e-6;
+	double transfer_per_byte = 0.1e-9;
+	double transfer_latency = 20e-6;
+};
+
+struct HybridStats
+{
+	size_t host_ops = 0;
+	size_t device_ops = 0;
+	size_t migrations = 0; // Buffers moved between the host and the device
+	size_t bytes_migrated = 0;
+};
+
+// A backend that runs every op on either a host backend (ex: CPU) or a device backend (ex: OpenCL), whichever the
+// PlacementCost says is cheaper. Small ops like anomaly sums and argmax stay on the host while large synapse ops run
+// on the device. A tensor stays where it was last used and is only moved when an op on the other side needs it. New
+// tensors start on the host. Everything runs on the host if there is no device.
+//
+// Usage:
+//	auto hybrid = std::make_shared<HybridBackend>(std::make_shared<CPUBackend>(), std::make_shared<OpenCLBackend>());
+//	SpatialPooler sp({1024}, {2048}, 0.75, 42, 0.1, 0, hybrid.get());
+//
+// Views share the buffer of their tensor, so moving one moves them all. Using the same tensor from multiple threads
+// at once is not supported. MemoryPlanner is not supported.
+struct ETALER_EXPORT HybridBackend : public Backend
+{
+	enum class Placement {Host, Device};
+
+	HybridBackend(std::shared_ptr<Backend> host, std::shared_ptr<Backend> device, PlacementCost cost=PlacementCost());
+
+	Backend* host() const {return host_.get();}
+	Backend* device() const {return device_.get();}
+	const PlacementCost& placementCost() const {return cost_;}
+	// Where the data of x is at the moment
+	Placement placementOf(const TensorImpl* x) const;
+	HybridStats stats() const;
+	void resetStats();
+
+	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data=nullptr) override;
+	virtual void sync() const override;
+
+	virtual std::shared_ptr<TensorImpl> cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances,
+		float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
+		TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+		, float connected_permeance, size_t active_threshold) override;
+	virtual void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+		, float perm_inc, float perm_dec) override;
+	virtual std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual void batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+		, float initial_perm) override;
+	virtual std::shared_ptr<TensorImpl> globalInhibition(const TensorImpl* x, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> groupInhibition(const TensorImpl* x, size_t group_size, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> cast(const TensorImpl* x, DType toType) override;
+	virtual void copyToHost(const TensorImpl* pimpl, void* dest) override;
+	virtual std::string name() const override {return "Hybrid";}
+	virtual std::shared_ptr<TensorImpl> copy(const TensorImpl* x) override;
+	virtual void sortSynapse(TensorImpl* connections, TensorImpl* permeances) override;
+	virtual std::shared_ptr<TensorImpl> burst(const TensorImpl* x, const TensorImpl* s) override;
+	virtual std::shared_ptr<TensorImpl> reverseBurst(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, size_t steps) override;
+	virtual void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+		, TensorImpl* permeances, float initial_perm) override;
+	virtual void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold) override;
+	virtual std::shared_ptr<TensorImpl> from(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> overlap(const TensorImpl* a, const TensorImpl* b) override;
+	virtual std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> topKOverlap(const TensorImpl* a, const TensorImpl* b
+		, size_t k, size_t min_overlap) override;
+
+	virtual std::shared_ptr<TensorImpl> realize(const TensorImpl* x) override;
+	virtual void assign(TensorImpl* dest, const TensorImpl* src) override;
+	virtual std::shared_ptr<TensorImpl> sum(const TensorImpl* x, size_t chunk_size, DType dtype=DType::Unknown) override;
+
+	virtual std::shared_ptr<TensorImpl> abs(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> exp(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> negate(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> inverse(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> log(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> logical_not(const TensorImpl* x) override;
+
+	virtual std::shared_ptr<TensorImpl> add(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> subtract(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> mul(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> div(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_and(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_or(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> not_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_xor(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> minimum(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> maximum(const TensorImpl* x1, const TensorImpl* x2) override;
+
+	virtual std::shared_ptr<TensorImpl> where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y) override;
+	virtual std::shared_ptr<TensorImpl> clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max) override;
+
+protected:
+	using UnaryOp = std::shared_ptr<TensorImpl> (Backend::*)(const TensorImpl*);
+	using BinaryOp = std::shared_ptr<TensorImpl> (Backend::*)(const TensorImpl*, const TensorImpl*);
+
+	Backend* backend(Placement p) const {return p == Placement::Host ? host_.get() : device_.get();}
+	// Picks where an op on the inputs runs and counts it
+	Placement place(std::initializer_list<const TensorImpl*> inputs);
+	// The view of x on the host or the device backend. Moves the buffer of x there if it is on the other side
+	std::shared_ptr<TensorImpl> on(const TensorImpl* x, Placement p);
+	// Wraps the result of the host or the device backend into a tensor of this backend
+	std::shared_ptr<TensorImpl> wrap(const std::shared_ptr<TensorImpl>& x);
+	std::shared_ptr<TensorImpl> unary(UnaryOp op, const TensorImpl* x);
+	std::shared_ptr<TensorImpl> binary(BinaryOp op, const TensorImpl* x1, const TensorImpl* x2);
+
+	std::shared_ptr<Backend> host_;
+	std::shared_ptr<Backend> device_;
+	PlacementCost cost_;
+	HybridStats stats_;
+	mutable std::mutex mutex_;
+};
+
+}
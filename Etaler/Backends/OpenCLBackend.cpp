@@ -3,10 +3,13 @@
 #include "Etaler/Core/Random.hpp"
 #include "Etaler/Core/Views.hpp"
 #include "Etaler/Core/String.hpp"
+#include "Etaler/Core/MemoryPlanner.hpp"
+#include "Etaler/Core/ProceduralSynapse.hpp"
 
 #include <map>
 #include <sstream>
 #include <fstream>
+#include <limits>
 
 #include <stdlib.h>
 
@@ -30,23 +33,49 @@ inline intmax_t selectWorkSize(intmax_t max, intmax_t mul_of, intmax_t size)
 	return std::min((intmax_t)max, round(size));
 }
 
-#define OPENCL_TENSOR_MAX_DIMS 32
+// Views are passed to the kernels by value. Kernels take up to 2 views and 10 other arguments, which must fit in
+// CL_DEVICE_MAX_PARAMETER_SIZE (at least 1024 bytes). Contiguous dimensions are merged (see makeOpenCLView()) so
+// 8 dimensions is plenty
+#define OPENCL_TENSOR_MAX_DIMS 8
 typedef struct __attribute__ ((packed)) _OpenCLView
 {
-        int stride[OPENCL_TENSOR_MAX_DIMS];
-        int shape_stride[OPENCL_TENSOR_MAX_DIMS];
-        int offset;
-        int dims;
+        cl_long stride[OPENCL_TENSOR_MAX_DIMS];
+        cl_long shape_stride[OPENCL_TENSOR_MAX_DIMS];
+        cl_long offset;
+        cl_int dims;
 } OpenCLView;
+static const size_t max_kernel_arguments_size = 2*sizeof(OpenCLView) + 10*sizeof(cl_long);
 
 static void makeOpenCLView(const TensorImpl* x, OpenCLView* v)
 {
-	int dims = int(x->dimensions());
+	// Merge the dimensions that are contiguous to each other. So contiguous tensors (and views of a range of rows)
+	// are described as 1D and the kernels spend less time locating elements
+	Shape shape;
+	Shape stride;
+	for(size_t i=0;i<x->dimensions();i++) {
+		intmax_t n = x->shape()[i];
+		intmax_t s = x->stride()[i];
+		if(n == 1)
+			continue;
+		if(shape.size() != 0 && stride.back() == s*n) {
+			shape.back() *= n;
+			stride.back() = s;
+		}
+		else {
+			shape.push_back(n);
+			stride.push_back(s);
+		}
+	}
+	if(shape.size() == 0) {
+		shape.push_back(1);
+		stride.push_back(1);
+	}
+
+	int dims = int(shape.size());
 	et_check(dims <= OPENCL_TENSOR_MAX_DIMS
 		, "The OpenCL backend can only handle up to" + std::to_string(OPENCL_TENSOR_MAX_DIMS) + "D view"
 		"got " + std::to_string(dims) + "D");
-	auto stride = x->stride();
-	auto shape_stride = shapeToStride(x->shape());
+	auto shape_stride = shapeToStride(shape);
 	for(int i=0;i<dims;i++) {
 		v->stride[i] = stride[i];
 		v->shape_stride[i] = shape_stride[i];
@@ -55,6 +84,14 @@ static void makeOpenCLView(const TensorImpl* x, OpenCLView* v)
 	v->dims = dims;
 }
 
+//The view descriptor passed to kernels reading a tensor through view.cl
+static OpenCLView makeOpenCLView(const TensorImpl* x)
+{
+	OpenCLView v;
+	makeOpenCLView(x, &v);
+	return v;
+}
+
 
 
 template <typename T>
@@ -117,6 +154,12 @@ void OpenCLBackend::init(cl::Context context, cl::Platform platform, cl::Device
 	local_mem_size_ = device_.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
 	local_mem_type_ = device_.getInfo<CL_DEVICE_LOCAL_MEM_TYPE>();
 	num_compute_units_ = device_.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+	mem_base_addr_align_ = device_.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>()/8; // The value is in bits
+
+	size_t max_parameter_size = device_.getInfo<CL_DEVICE_MAX_PARAMETER_SIZE>();
+	if(max_parameter_size < max_kernel_arguments_size)
+		throw EtError("OpenCL device " + device_.getInfo<CL_DEVICE_NAME>() + " only accepts " + std::to_string(max_parameter_size)
+			+ " bytes of kernel arguments. Etaler needs " + std::to_string(max_kernel_arguments_size));
 
 	cl_int err = 0;
 	//Get the list of extention suuported
@@ -142,6 +185,9 @@ void OpenCLBackend::init(cl::Context context, cl::Platform platform, cl::Device
 std::shared_ptr<TensorImpl> OpenCLBackend::createTensor(const Shape& shape, DType dtype, const void* data)
 {
 	et_assert(dtype != DType::Unknown);
+	if(memory_planner_ != nullptr && data == nullptr)
+		return memory_planner_->allocate(shape, dtype);
+
 	size_t buf_size = shape.volume()*dtypeToSize(dtype);
 	cl::Buffer buf = allocBuffer(buf_size);
 
@@ -167,6 +213,29 @@ std::shared_ptr<TensorImpl> OpenCLBackend::createTensor(const Shape& shape, DTyp
 	return std::make_shared<TensorImpl>(ptr, shape, shapeToStride(shape));
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype)
+{
+	requireProperties(arena, this, IsPlain());
+	size_t size = shape.volume()*dtypeToSize(dtype);
+	size_t arena_bytes = arena->size()*dtypeToSize(arena->dtype());
+	et_check(offset+size <= arena_bytes, "Alias tensor is out of the arena's bound");
+	et_check(offset % mem_base_addr_align_ == 0, "Offset " + std::to_string(offset) + " is not aligned to "
+		+ std::to_string(mem_base_addr_align_) + " bytes. Which is required by the device");
+
+	// OpenCL does not allow 0 sized sub-buffers
+	if(size == 0)
+		return createTensor(shape, dtype, allocBuffer(1));
+
+	// Sub-buffers keeps the parent buffer alive
+	cl::Buffer buf = std::static_pointer_cast<const OpenCLBuffer>(arena->buffer())->buffer();
+	cl_buffer_region region = {offset, size};
+	cl_int err;
+	cl::Buffer sub_buffer = buf.createSubBuffer(CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL sub-buffer creation failed. Error: " + std::to_string(err));
+	return createTensor(shape, dtype, sub_buffer);
+}
+
 void OpenCLBackend::releaseTensor(OpenCLBuffer* buf)
 {
 	delete buf;
@@ -292,24 +361,34 @@ void KernelManager::addSearchPath(const std::string& path)
 	search_paths_.push_front(path);
 }
 
+//The synapse kernels accept connections and permeances with contiguous rows (ex: a range of cells). Both are
+//indexed using the same row stride
+static size_t synapseRowStride(const TensorImpl* connections, const TensorImpl* permeances)
+{
+	et_check(connections->rowstride() == permeances->rowstride(), "connections and permeances must have the same row stride. Got "
+		+ str(connections->rowstride()) + " and " + str(permeances->rowstride()));
+	return connections->rowstride();
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::cellActivity(const TensorImpl* x, const TensorImpl* connections,
 	const TensorImpl* permeances, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
-	requireProperties(connections, this, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsPlain());
+	requireProperties(x, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
 	et_check(connections->dimensions() >= 2);
+	size_t row_stride = synapseRowStride(connections, permeances);
 
 	Shape s = connections->shape();
 	s.pop_back();
 	auto y = createTensor(s, DType::Int32);
 
-	auto param_hash = hashify(x->size(), connections->shape().back(), !has_unconnected_synapse, permeances->dtype());
+	auto param_hash = hashify(x->size(), connections->shape().back(), !has_unconnected_synapse, permeances->dtype(), row_stride);
 	auto program_name = "cellActivity"+param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 
 		auto args = "-DINPUT_SIZE="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back())+" -DNO_UNUSED_SYNAPSE=" +
-			str(!has_unconnected_synapse) + " -DPERM_TYPE="+to_ctype_string(permeances->dtype());
+			str(!has_unconnected_synapse) + " -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
 		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
 
 		std::string kernel_file = "";
@@ -320,7 +399,7 @@ std::shared_ptr<TensorImpl> OpenCLBackend::cellActivity(const TensorImpl* x, con
 		else
 			kernel_file = "cellActivity_global.cl";
 		assert(kernel_file != "");
-		kernel_manager_.compileFromFile(kernel_file, program_name, {"cellActivity"}, false, args, prepend);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", kernel_file}, program_name, {"cellActivity"}, false, args, prepend);
 	}
 	cl::Kernel k = kernel_manager_.kernel(program_name, "cellActivity");
 
@@ -330,7 +409,10 @@ std::shared_ptr<TensorImpl> OpenCLBackend::cellActivity(const TensorImpl* x, con
 	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
 	k.setArg(4, (float)connected_permeance);
 	k.setArg(5, (int)active_threshold);
-	k.setArg(6, (int)y->size());
+	k.setArg(6, (cl_long)y->size());
+	k.setArg(7, (cl_long)connections->offset());
+	k.setArg(8, (cl_long)permeances->offset());
+	k.setArg(9, makeOpenCLView(x));
 
 	size_t local_size = 64;
 	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, x->size())), cl::NDRange(local_size));
@@ -341,9 +423,170 @@ std::shared_ptr<TensorImpl> OpenCLBackend::cellActivity(const TensorImpl* x, con
 	return y;
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	requireProperties(permeance_offsets, this, DType::Float);
+	et_check(connections->dimensions() >= 2);
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	Shape s = connections->shape();
+	s.pop_back();
+	auto y = createTensor(s, DType::Int32);
+	et_check(permeance_offsets->size() == y->size(), "There must be one permanence offset per cell");
+
+	auto args = "-DINPUT_SIZE="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back())+" -DNO_UNUSED_SYNAPSE=" +
+		str(!has_unconnected_synapse) + " -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "cellActivityWithOffsets"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "permanenceOffsets.cl"}, program_name, {"cellActivity"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "cellActivity");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<const OpenCLBuffer>(permeance_offsets->buffer())->buffer());
+	k.setArg(4, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
+	k.setArg(5, (float)connected_permeance);
+	k.setArg(6, (int)active_threshold);
+	k.setArg(7, (cl_long)y->size());
+	k.setArg(8, (cl_long)connections->offset());
+	k.setArg(9, (cl_long)permeances->offset());
+	k.setArg(10, makeOpenCLView(x));
+	k.setArg(11, makeOpenCLView(permeance_offsets));
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, y->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel cellActivityWithOffsets execution failed. Code " + str(err));
+
+	return y;
+}
+
+void OpenCLBackend::learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	requireProperties(permeance_offsets, this, DType::Float, IsContingous());
+	et_check(permeance_offsets->size() == learn->size(), "There must be one permanence offset per cell");
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	auto args = "-DINPUT_SIZE="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back()) +
+		" -DNO_UNUSED_SYNAPSE="+str(!has_unconnected_synapse)+" -DOUTPUT_SIZE="+str(learn->size()) +
+		" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "learnCorrilationSparse"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "permanenceOffsets.cl"}, program_name, {"learnCorrilation"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "learnCorrilation");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(learn->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(4, std::static_pointer_cast<OpenCLBuffer>(permeance_offsets->buffer())->buffer());
+	k.setArg(5, (float)perm_inc);
+	k.setArg(6, (float)perm_dec);
+	k.setArg(7, (cl_long)connections->offset());
+	k.setArg(8, (cl_long)permeances->offset());
+	k.setArg(9, (cl_long)permeance_offsets->offset());
+	k.setArg(10, makeOpenCLView(x));
+	k.setArg(11, makeOpenCLView(learn));
+
+	size_t local_size = 128;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, learn->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel learnCorrilationSparse execution failed. Code " + str(err));
+}
+
+static std::string proceduralArgs(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed)
+{
+	et_check(permeances->shape().back() <= (intmax_t)x->size(), "Procedural synapses can't have more synapses per cell than inputs");
+	ProceduralPool pool(x->size(), seed);
+	return "-DINPUT_SIZE="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(permeances->shape().back())
+		+ " -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(permeances->rowstride())
+		+ " -DHALF_BITS="+str(pool.halfBits()) + " -DSEED="+str(pool.seed())+"u";
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(permeances->dimensions() >= 2);
+
+	Shape s = permeances->shape();
+	s.pop_back();
+	auto y = createTensor(s, DType::Int32);
+
+	auto args = proceduralArgs(x, permeances, seed);
+	auto program_name = "proceduralCellActivity"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "procedural.cl"}, program_name, {"cellActivity"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "cellActivity");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
+	k.setArg(3, (float)connected_permeance);
+	k.setArg(4, (int)active_threshold);
+	k.setArg(5, (cl_long)y->size());
+	k.setArg(6, (cl_long)permeances->offset());
+	k.setArg(7, makeOpenCLView(x));
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, y->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel proceduralCellActivity execution failed. Code " + str(err));
+
+	return y;
+}
+
+void OpenCLBackend::proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+	, float perm_inc, float perm_dec)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(learn->size()*permeances->shape().back() == permeances->size(), "The learning mask must have one value per cell");
+
+	auto args = proceduralArgs(x, permeances, seed) + " -DOUTPUT_SIZE="+str(learn->size());
+	auto program_name = "proceduralLearnCorrilation"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "procedural.cl"}, program_name, {"learnCorrilation"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "learnCorrilation");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(learn->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(3, (float)perm_inc);
+	k.setArg(4, (float)perm_dec);
+	k.setArg(5, (cl_long)permeances->offset());
+	k.setArg(6, makeOpenCLView(x));
+	k.setArg(7, makeOpenCLView(learn));
+
+	size_t local_size = 128;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, learn->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel proceduralLearnCorrilation execution failed. Code " + str(err));
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::globalInhibition(const TensorImpl* x, float fraction)
 {
-	requireProperties(x, this, DType::Int32, IsPlain());
+	requireProperties(x, this, DType::Int32);
 
 	auto y = createTensor(x->shape(), DType::Bool);
 
@@ -351,7 +594,7 @@ std::shared_ptr<TensorImpl> OpenCLBackend::globalInhibition(const TensorImpl* x,
 	auto program_name = "globalInhibition"+param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DINPUT_SIZE="+str(x->size())+" -DMAX_INPUT_VALUE="+str(2000);
-		kernel_manager_.compileFromFile("globalInhibition.cl", program_name, {"fastTopK", "threshold"}, false, args);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "globalInhibition.cl"}, program_name, {"fastTopK", "threshold"}, false, args);
 	}
 
 	cl::Kernel topKKernel, thresholdKernel;
@@ -362,27 +605,60 @@ std::shared_ptr<TensorImpl> OpenCLBackend::globalInhibition(const TensorImpl* x,
 
 	topKKernel.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
 	topKKernel.setArg(1, threshold);
-	topKKernel.setArg(2, (int)(x->size()*fraction));
+	topKKernel.setArg(2, (cl_long)(x->size()*fraction));
+	topKKernel.setArg(3, makeOpenCLView(x));
 
 	queue_.enqueueNDRangeKernel(topKKernel, cl::NullRange, cl::NDRange(256), cl::NDRange(256));
 
 	thresholdKernel.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
 	thresholdKernel.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(y->buffer())->buffer());
 	thresholdKernel.setArg(2, threshold);
+	thresholdKernel.setArg(3, makeOpenCLView(x));
 	queue_.enqueueNDRangeKernel(thresholdKernel, cl::NullRange, cl::NDRange(1024), cl::NDRange(32));
 
 	return y;
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::groupInhibition(const TensorImpl* x, size_t group_size, float fraction)
+{
+	requireProperties(x, this, DType::Int32);
+	et_check(group_size > 0 && x->size() % group_size == 0, "The size of the tensor " + std::to_string(x->size())
+		+ " is not a multiple of the group size " + std::to_string(group_size));
+
+	auto y = createTensor(x->shape(), DType::Bool);
+
+	auto param_hash = hashify(group_size, 2000);
+	auto program_name = "groupInhibition"+param_hash;
+	if(kernel_manager_.exists(program_name) == false) {
+		auto args = "-DGROUP_SIZE="+str(group_size)+" -DMAX_INPUT_VALUE="+str(2000);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "groupInhibition.cl"}, program_name, {"groupTopK"}, false, args);
+	}
+
+	cl::Kernel k = kernel_manager_.kernel(program_name, "groupTopK");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
+	k.setArg(2, (cl_long)(group_size*fraction));
+	k.setArg(3, makeOpenCLView(x));
+
+	size_t local_size = 64;
+	size_t num_groups = x->size()/group_size;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(num_groups*local_size), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel groupTopK execution failed. Code " + str(err));
+
+	return y;
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::cast(const TensorImpl* x, DType toType)
 {
-	requireProperties(x, this, IsPlain());
+	requireProperties(x, this);
 	auto param_hash = hashify(x->dtype(), toType, x->dtype() == DType::Half || toType == DType::Half);
 	auto program_name = "cast"+param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DInType="+to_ctype_string(x->dtype())+" -DOutType="+to_ctype_string(toType)
 			+ (x->dtype() == DType::Half || toType == DType::Half ? " -DHalfSupport" : "");
-		kernel_manager_.compileFromFile("cast.cl", program_name, {"cast"}, false, args);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "cast.cl"}, program_name, {"cast"}, false, args);
 	}
 
 	cl::Kernel k = kernel_manager_.kernel(program_name, "cast");
@@ -390,7 +666,8 @@ std::shared_ptr<TensorImpl> OpenCLBackend::cast(const TensorImpl* x, DType toTyp
 	auto res = createTensor(x->shape(), toType);
 	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
 	k.setArg(1, std::static_pointer_cast<OpenCLBuffer>(res->buffer())->buffer());
-	k.setArg(2, (int)x->size());
+	k.setArg(2, (cl_long)x->size());
+	k.setArg(3, makeOpenCLView(x));
 	queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(1024), cl::NDRange(32));
 
 	return res;
@@ -420,18 +697,19 @@ std::shared_ptr<TensorImpl> OpenCLBackend::copy(const TensorImpl* x)
 void OpenCLBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
 	TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
-	requireProperties(learn, this, DType::Bool, IsPlain());
-	requireProperties(connections, this, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsPlain());
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
 
-	auto param_hash = hashify(x->size(), connections->shape().back(), !has_unconnected_synapse, learn->size(), permeances->dtype());
+	auto param_hash = hashify(x->size(), connections->shape().back(), !has_unconnected_synapse, learn->size(), permeances->dtype(), row_stride);
 	auto program_name = "learnCorrilation"+param_hash;
 
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DINPUT_SIZE="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back()) +
 			" -DNO_UNUSED_SYNAPSE="+str(!has_unconnected_synapse)+" -DOUTPUT_SIZE="+str(learn->size()) +
-			" -DPERM_TYPE="+to_ctype_string(permeances->dtype());
+			" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
 		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
 
 		std::string kernel_file = "";
@@ -442,7 +720,7 @@ void OpenCLBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* lear
 		else
 			kernel_file = "learnCorrilation_global.cl";
 		assert(kernel_file != "");
-		kernel_manager_.compileFromFile(kernel_file, program_name, {"learnCorrilation"}, false, args, prepend);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", kernel_file}, program_name, {"learnCorrilation"}, false, args, prepend);
 		
 	}
 	cl::Kernel k = kernel_manager_.kernel(program_name, "learnCorrilation");
@@ -453,6 +731,10 @@ void OpenCLBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* lear
 	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(permeances->buffer())->buffer());
 	k.setArg(4, (float)perm_inc);
 	k.setArg(5, (float)perm_dec);
+	k.setArg(6, (cl_long)connections->offset());
+	k.setArg(7, (cl_long)permeances->offset());
+	k.setArg(8, makeOpenCLView(x));
+	k.setArg(9, makeOpenCLView(learn));
 
 	size_t local_size = 128;
 
@@ -464,20 +746,22 @@ void OpenCLBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* lear
 
 void OpenCLBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
 {
-	requireProperties(connections, this, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, this, IsDType{DType::Float, DType::Int32}, IsPlain());
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Int32}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
 
-	auto param_hash = hashify(connections->shape().back(), permeances->dtype(), permeances->dtype()==DType::Half);
+	auto param_hash = hashify(connections->shape().back(), permeances->dtype(), permeances->dtype()==DType::Half, row_stride);
 	auto program_name = "sortSynapse"+param_hash;
 	if(kernel_manager_.exists(param_hash) == false) {
-		auto args = "-DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back()) + " -DPERM_TYPE="+to_ctype_string(permeances->dtype());
+		auto args = "-DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back()) + " -DPERM_TYPE="+to_ctype_string(permeances->dtype())
+			+ " -DROW_STRIDE="+str(row_stride);
 		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
 		kernel_manager_.compileFromFile("sort.cl", program_name, {"sortSynapse"}, false, args, prepend);
 	}
 
 	cl::Kernel k = kernel_manager_.kernel(program_name, "sortSynapse");
 
-	int num_cells = connections->size()/connections->shape().back();
+	cl_long num_cells = connections->size()/connections->shape().back();
 
 	cl::Buffer aux_buffer1 = allocBuffer(connections->size()*sizeof(int));
 	cl::Buffer aux_buffer2 = allocBuffer(permeances->size()*sizeof(float));
@@ -487,6 +771,8 @@ void OpenCLBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
 	k.setArg(2, num_cells);
 	k.setArg(3, aux_buffer1);
 	k.setArg(4, aux_buffer2);
+	k.setArg(5, (cl_long)connections->offset());
+	k.setArg(6, (cl_long)permeances->offset());
 	size_t local_size = 128;
 
 	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, num_cells)), cl::NDRange(local_size));
@@ -496,14 +782,14 @@ void OpenCLBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
 
 std::shared_ptr<TensorImpl> OpenCLBackend::burst(const TensorImpl* x, const TensorImpl* s)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
-	requireProperties(s, this, DType::Bool, IsPlain());
+	requireProperties(x, this, DType::Bool);
+	requireProperties(s, this, DType::Bool);
 
 	Shape shape = s->shape();
 	shape.pop_back();
 	requireProperties(x, shape);
 
-	auto res = copy(s);
+	auto res = realize(s);
 
 	size_t num_columns = shape.volume();
 
@@ -511,13 +797,14 @@ std::shared_ptr<TensorImpl> OpenCLBackend::burst(const TensorImpl* x, const Tens
 	auto program_name = "applyBurst"+param_hash;
 	if(kernel_manager_.exists(param_hash) == false) {
 		auto args = "-DCELLS_PER_COLUMN="+str(s->shape().back())+" -DNUM_COLUMNS="+str(num_columns);
-		kernel_manager_.compileFromFile("applyBurst.cl", program_name, {"applyBurst"}, false, args);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "applyBurst.cl"}, program_name, {"applyBurst"}, false, args);
 	}
 
 	cl::Kernel k = kernel_manager_.kernel(program_name, "applyBurst");
 
 	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
 	k.setArg(1, std::static_pointer_cast<OpenCLBuffer>(res->buffer())->buffer());
+	k.setArg(2, makeOpenCLView(x));
 
 	size_t local_size = 128;
 	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, num_columns)), cl::NDRange(local_size));
@@ -528,14 +815,14 @@ std::shared_ptr<TensorImpl> OpenCLBackend::burst(const TensorImpl* x, const Tens
 
 std::shared_ptr<TensorImpl> OpenCLBackend::reverseBurst(const TensorImpl* x)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
+	requireProperties(x, this, DType::Bool);
 
 	size_t cells_per_column = x->shape().back();
 	size_t num_columns = x->size()/cells_per_column;
 	static pcg32 rng(42); //Static so the behavor hangees every time, breaking symmetry
 	std::uniform_int_distribution<size_t> dist(0, cells_per_column-1);
 
-	auto res = copy(x);
+	auto res = realize(x);
 
 	intmax_t local_size = 128;
 	intmax_t global_size = selectWorkSize(4096, local_size, num_columns);
@@ -565,13 +852,206 @@ std::shared_ptr<TensorImpl> OpenCLBackend::reverseBurst(const TensorImpl* x)
 	return res;
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, size_t steps)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(connections->dimensions() >= 2);
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	Shape cell_shape = connections->shape();
+	cell_shape.pop_back();
+	size_t num_cells = cell_shape.volume();
+	size_t cells_per_column = cell_shape.back();
+	Shape x_shape = x->shape();
+	et_check(x_shape.size() >= cell_shape.size() && Shape(x_shape.end()-cell_shape.size(), x_shape.end()) == cell_shape
+		, "Active cells of shape " + to_string(x_shape) + " does not end with the cell shape " + to_string(cell_shape));
+	size_t total_columns = x->size()/cells_per_column;
+
+	Shape result_shape = x_shape;
+	result_shape.pop_back();
+	auto y = createTensor(Shape({(intmax_t)steps}) + result_shape, DType::Bool);
+	// realize() always makes a copy, so the input is never written
+	auto current = realize(x);
+	auto next = createTensor(x->shape(), DType::Bool);
+
+	auto args = "-DNUM_CELLS="+str(num_cells)+" -DCELLS_PER_COLUMN="+str(cells_per_column)+" -DMAX_SYNAPSE_PER_CELL="
+		+str(connections->shape().back())+" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "rollout"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile("rollout.cl", program_name, {"rolloutStep"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "rolloutStep");
+
+	size_t local_size = 64;
+	for(size_t step=0;step<steps;step++) {
+		k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(current->buffer())->buffer());
+		k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
+		k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(permeances->buffer())->buffer());
+		k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(next->buffer())->buffer());
+		k.setArg(4, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
+		k.setArg(5, (float)connected_permeance);
+		k.setArg(6, (int)std::max(active_threshold, size_t(1)));
+		k.setArg(7, (cl_long)total_columns);
+		k.setArg(8, (cl_long)connections->offset());
+		k.setArg(9, (cl_long)permeances->offset());
+		k.setArg(10, (cl_long)(step*total_columns));
+
+		cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, total_columns)), cl::NDRange(local_size));
+		if(err != CL_SUCCESS)
+			throw EtError("OpenCL kernel rolloutStep execution failed. Code " + str(err));
+		std::swap(current, next);
+	}
+	return y;
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(connections->dimensions() >= 2);
+	et_check(x->dimensions() >= 2, "Expecting a batch of shape [batch, ...], got " + to_string(x->shape()));
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	Shape s = connections->shape();
+	s.pop_back();
+	size_t batch_size = x->shape()[0];
+	auto y = createTensor(Shape({(intmax_t)batch_size}) + s, DType::Int32);
+	// Contiguous views (ex: a RingBuffer window) are read in place
+	std::shared_ptr<const TensorImpl> input = x->iscontiguous() ? x->shared_from_this() : realize(x);
+
+	auto args = "-DINPUT_SIZE="+str(x->size()/std::max(batch_size, size_t(1)))+" -DNUM_CELLS="+str(s.volume())
+		+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back())+" -DNO_UNUSED_SYNAPSE="+str(!has_unconnected_synapse)
+		+" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "batch"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile("batch.cl", program_name, {"batchCellActivity", "batchLearnCorrilation", "batchGrowSynapses"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "batchCellActivity");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(input->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(y->buffer())->buffer());
+	k.setArg(4, (float)connected_permeance);
+	k.setArg(5, (int)active_threshold);
+	k.setArg(6, (int)batch_size);
+	k.setArg(7, (cl_long)connections->offset());
+	k.setArg(8, (cl_long)permeances->offset());
+	k.setArg(9, (cl_long)input->offset());
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, y->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel batchCellActivity execution failed. Code " + str(err));
+	return y;
+}
+
+void OpenCLBackend::batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	Shape s = connections->shape();
+	s.pop_back();
+	et_check(x->dimensions() >= 2 && learn->dimensions() >= 2 && x->shape()[0] == learn->shape()[0]
+		&& learn->size() == (size_t)(x->shape()[0]*s.volume()), "Expecting input and learning masks of shape [batch, ...]");
+	size_t batch_size = x->shape()[0];
+	std::shared_ptr<const TensorImpl> input = x->iscontiguous() ? x->shared_from_this() : realize(x);
+	std::shared_ptr<const TensorImpl> learning = learn->iscontiguous() ? learn->shared_from_this() : realize(learn);
+
+	auto args = "-DINPUT_SIZE="+str(x->size()/std::max(batch_size, size_t(1)))+" -DNUM_CELLS="+str(s.volume())
+		+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back())+" -DNO_UNUSED_SYNAPSE="+str(!has_unconnected_synapse)
+		+" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "batch"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile("batch.cl", program_name, {"batchCellActivity", "batchLearnCorrilation", "batchGrowSynapses"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "batchLearnCorrilation");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(input->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(learning->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(4, (float)perm_inc);
+	k.setArg(5, (float)perm_dec);
+	k.setArg(6, (int)batch_size);
+	k.setArg(7, (cl_long)connections->offset());
+	k.setArg(8, (cl_long)permeances->offset());
+	k.setArg(9, (cl_long)input->offset());
+	k.setArg(10, (cl_long)learning->offset());
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, s.volume())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel batchLearnCorrilation execution failed. Code " + str(err));
+}
+
+void OpenCLBackend::batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+	, float initial_perm)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
+
+	Shape s = connections->shape();
+	s.pop_back();
+	et_check(x->dimensions() >= 2 && learn->dimensions() >= 2 && x->shape()[0] == learn->shape()[0]
+		&& learn->size() == (size_t)(x->shape()[0]*s.volume()), "Expecting inputs and learning cells of shape [batch, ...]");
+	size_t batch_size = x->shape()[0];
+	size_t input_size = x->size()/std::max(batch_size, size_t(1));
+	et_check(input_size <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
+	std::shared_ptr<const TensorImpl> input = x->iscontiguous() ? x->shared_from_this() : realize(x);
+	std::shared_ptr<const TensorImpl> learning = learn->iscontiguous() ? learn->shared_from_this() : realize(learn);
+
+	auto args = "-DINPUT_SIZE="+str(input_size)+" -DNUM_CELLS="+str(s.volume())
+		+" -DMAX_SYNAPSE_PER_CELL="+str(connections->shape().back())+" -DNO_UNUSED_SYNAPSE="+str(false)
+		+" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
+	auto program_name = "batch"+hashify(args);
+	if(kernel_manager_.exists(program_name) == false) {
+		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
+		kernel_manager_.compileFromFile("batch.cl", program_name, {"batchCellActivity", "batchLearnCorrilation", "batchGrowSynapses"}, false, args, prepend);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "batchGrowSynapses");
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(input->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(learning->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<OpenCLBuffer>(connections->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(permeances->buffer())->buffer());
+	k.setArg(4, (float)initial_perm);
+	k.setArg(5, (int)batch_size);
+	k.setArg(6, (cl_long)connections->offset());
+	k.setArg(7, (cl_long)permeances->offset());
+	k.setArg(8, (cl_long)input->offset());
+	k.setArg(9, (cl_long)learning->offset());
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, s.volume())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel batchGrowSynapses execution failed. Code " + str(err));
+}
+
 void OpenCLBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
 		, TensorImpl* permeances, float initial_perm)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
-	requireProperties(y, this, DType::Bool, IsPlain());
-	requireProperties(connections, this, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, this, IsDType{DType::Float, DType::Int32}, IsPlain());
+	requireProperties(x, this, DType::Bool);
+	requireProperties(y, this, DType::Bool);
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Int32}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
 
 	Shape s = connections->shape();
 	s.pop_back();
@@ -579,16 +1059,18 @@ void OpenCLBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, Tenso
 
 	size_t max_synapses_per_cell = connections->shape().back();
 	size_t input_cell_count = x->size();
+	// Synapses store their target as a 32 bit index
+	et_check(input_cell_count <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
 
-	auto param_hash = hashify(y->size(), x->size(), max_synapses_per_cell, permeances->dtype());
+	auto param_hash = hashify(y->size(), x->size(), max_synapses_per_cell, permeances->dtype(), row_stride);
 	auto program_name = "growSynapses"+param_hash;
 
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DNUM_CELLS="+str(y->size())+" -DNUM_INPUT_BITS="+str(x->size())+" -DMAX_SYNAPSE_PER_CELL="+str(max_synapses_per_cell)
-			+" -DPERM_TYPE="+to_ctype_string(permeances->dtype());
+			+" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
 		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
 		
-		kernel_manager_.compileFromFile("growSynapses.cl", program_name, {"growSynapses"}, false, args, prepend);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "growSynapses.cl"}, program_name, {"growSynapses"}, false, args, prepend);
 	}
 
 	cl::Kernel k = kernel_manager_.kernel(program_name, "growSynapses");
@@ -616,6 +1098,9 @@ void OpenCLBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, Tenso
 	k.setArg(4, initial_perm);
 	k.setArg(5, sparse_size);
 	k.setArg(6, aux);
+	k.setArg(7, (cl_long)connections->offset());
+	k.setArg(8, (cl_long)permeances->offset());
+	k.setArg(9, makeOpenCLView(y));
 
 	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(work_size), cl::NDRange(local_size));
 	if(err != CL_SUCCESS)
@@ -624,13 +1109,13 @@ void OpenCLBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, Tenso
 
 std::optional<cl::Buffer> OpenCLBackend::toSparse(const TensorImpl* x)
 {
-	requireProperties(x, this, DType::Bool, IsPlain());
+	requireProperties(x, this, DType::Bool);
 
 	auto param_hash = hashify(x->size());
 	auto program_name = "toSparse"+param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DINPUT_SIZE="+str(x->size());
-		kernel_manager_.compileFromFile("toSparse.cl", program_name, {"toSparse", "onBits"}, false, args);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "toSparse.cl"}, program_name, {"toSparse", "onBits"}, false, args);
 	}
 
 	cl::Kernel on_bits = kernel_manager_.kernel(program_name, "onBits");
@@ -641,6 +1126,7 @@ std::optional<cl::Buffer> OpenCLBackend::toSparse(const TensorImpl* x)
 
 	on_bits.setArg(0, x_buf);
 	on_bits.setArg(1, num);
+	on_bits.setArg(2, makeOpenCLView(x));
 	cl_int err = queue_.enqueueNDRangeKernel(on_bits, cl::NullRange, cl::NDRange(256), cl::NDRange(256));
 	if(err != CL_SUCCESS)
 		throw EtError("OpenCL kernel onBits execution failed. Code " + str(err));
@@ -655,6 +1141,7 @@ std::optional<cl::Buffer> OpenCLBackend::toSparse(const TensorImpl* x)
 	cl::Buffer buf = allocBuffer(num_elements*sizeof(int));
 	k.setArg(0, x_buf);
 	k.setArg(1, buf);
+	k.setArg(2, makeOpenCLView(x));
 	err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(256), cl::NDRange(256));
 	if(err != CL_SUCCESS)
 		throw EtError("OpenCL kernel toSparse execution failed. Code " + str(err));
@@ -666,7 +1153,7 @@ static std::string jitStridedView(const TensorImpl* x, size_t id)
 	// If possible, do the easy route
 	if(x->iscontiguous()) {
 		std::string func = R"(
-		int location_func$ID(int index) {
+		long location_func$ID(long index) {
 			return index + $OFFSET;	
 		}
 		)";
@@ -677,16 +1164,16 @@ static std::string jitStridedView(const TensorImpl* x, size_t id)
 
 	// Otherwise go the complex one
 	std::string func = R"(
-int location_func$ID(int index)
+long location_func$ID(long index)
 {
-	int shape_stride[] = $SHAPE_STRIDE;
-	int stride[] = $STRIDE;
-	int offset = $OFFSET;
-	int curr_idx = index;
-	int sum = 0;
+	long shape_stride[] = $SHAPE_STRIDE;
+	long stride[] = $STRIDE;
+	long offset = $OFFSET;
+	long curr_idx = index;
+	long sum = 0;
 	for(int i=0;i<$DIMS;i++) {
-		int s = shape_stride[i];
-		int ndpos = curr_idx / s;
+		long s = shape_stride[i];
+		long ndpos = curr_idx / s;
 		sum += ndpos * stride[i];
 		curr_idx %= s;
 	}
@@ -728,7 +1215,7 @@ void OpenCLBackend::assign(TensorImpl* dest, const TensorImpl* src)
 	auto program_name = "copy"+param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DINPUT_TYPE="+to_ctype_string(src->dtype())+" -DOUTPUT_TYPE="+to_ctype_string(dest->dtype());
-		kernel_manager_.compileFromFile("copy.cl", program_name, {"copy"}, false, args);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "copy.cl"}, program_name, {"copy"}, false, args);
 	}
 	cl::Kernel k = kernel_manager_.kernel(program_name, "copy");
 
@@ -741,7 +1228,7 @@ void OpenCLBackend::assign(TensorImpl* dest, const TensorImpl* src)
 	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(src->buffer())->buffer());
 	k.setArg(2, output_view);
 	k.setArg(3, input_view);
-	k.setArg(4, int(src->size()));
+	k.setArg(4, (cl_long)src->size());
 
 
 	size_t local_size = 128;
@@ -752,7 +1239,7 @@ void OpenCLBackend::assign(TensorImpl* dest, const TensorImpl* src)
 
 std::shared_ptr<TensorImpl> OpenCLBackend::sum(const TensorImpl* x, size_t chunk_size, DType dtype)
 {
-	requireProperties(x, this, IsPlain());
+	requireProperties(x, this);
 	et_check(x->size() % chunk_size == 0);
 
 	DType result_dtype = dtype;
@@ -767,6 +1254,10 @@ std::shared_ptr<TensorImpl> OpenCLBackend::sum(const TensorImpl* x, size_t chunk
 				return DType::Float;
 		}();
 	}
+	// Bools and ints are summed as Int32, which holds the sum of at most INT32_MAX of them
+	et_check(result_dtype != DType::Int32 || (x->dtype() != DType::Bool && x->dtype() != DType::Int32)
+		|| chunk_size <= (size_t)std::numeric_limits<int32_t>::max()
+		, "Summing " + std::to_string(chunk_size) + " elements overflows Int32. Sum as Float instead");
 
 	DType intermid_type = [](DType in, DType out) {
 		if(in == DType::Float)
@@ -785,9 +1276,9 @@ std::shared_ptr<TensorImpl> OpenCLBackend::sum(const TensorImpl* x, size_t chunk
 		+ (intermid_type==DType::Half? " -DIntermidIsHalf" : "");
 
 		if(use_local_kernel)
-			kernel_manager_.compileFromFile("sum_local.cl", program_name, {"sum"}, false, args);
+			kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "sum_local.cl"}, program_name, {"sum"}, false, args);
 		else
-			kernel_manager_.compileFromFile("sum.cl", program_name, {"sum"}, false, args);
+			kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "sum.cl"}, program_name, {"sum"}, false, args);
 	}
 
 	cl::Kernel k = kernel_manager_.kernel(program_name, "sum");
@@ -795,8 +1286,9 @@ std::shared_ptr<TensorImpl> OpenCLBackend::sum(const TensorImpl* x, size_t chunk
 
 	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x->buffer())->buffer());
 	k.setArg(1, std::static_pointer_cast<OpenCLBuffer>(res->buffer())->buffer());
-	k.setArg(2, int(x->size()));
-	k.setArg(3, int(chunk_size));
+	k.setArg(2, (cl_long)x->size());
+	k.setArg(3, (cl_long)chunk_size);
+	k.setArg(4, makeOpenCLView(x));
 
 	cl_int err = CL_SUCCESS;
 	if(use_local_kernel) {
@@ -815,17 +1307,18 @@ std::shared_ptr<TensorImpl> OpenCLBackend::sum(const TensorImpl* x, size_t chunk
 
 void OpenCLBackend::decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold)
 {
-	requireProperties(connections, this, DType::Int32, IsPlain(), permeances->shape());
-	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsPlain());
+	requireProperties(connections, this, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	size_t row_stride = synapseRowStride(connections, permeances);
 
 	size_t max_synapses_per_cell = connections->shape().back();
 	size_t input_cell_count = connections->size()/max_synapses_per_cell;
 
-	auto param_hash = hashify(input_cell_count, max_synapses_per_cell, permeances->dtype());
+	auto param_hash = hashify(input_cell_count, max_synapses_per_cell, permeances->dtype(), row_stride);
 	std::string program_name = "decaySynapses" + param_hash;
 	if(kernel_manager_.exists(program_name) == false) {
 		auto args = "-DNUM_CELLS="+str(input_cell_count) + " -DMAX_SYNAPSE_PER_CELL="+str(max_synapses_per_cell) + 
-			" -DPERM_TYPE="+to_ctype_string(permeances->dtype());
+			" -DPERM_TYPE="+to_ctype_string(permeances->dtype()) + " -DROW_STRIDE="+str(row_stride);
 		auto prepend = (permeances->dtype()==DType::Half?"#pragma OPENCL EXTENSION cl_khr_fp16 : enable":"");
 		kernel_manager_.compileFromFile("decaySynapses.cl", program_name, {"decaySynapses"}, false, args, prepend);
 	}
@@ -835,6 +1328,8 @@ void OpenCLBackend::decaySynapses(TensorImpl* connections, TensorImpl* permeance
 	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(connections->buffer())->buffer());
 	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(permeances->buffer())->buffer());
 	k.setArg(2, threshold);
+	k.setArg(3, (cl_long)connections->offset());
+	k.setArg(4, (cl_long)permeances->offset());
 
 	size_t local_size = 128;
 
@@ -849,10 +1344,10 @@ static std::string jitUniaryOperation(const TensorImpl* x, std::string f)
 
 kernel void op(global T0* restrict x, global ResType* restrict y)
 {
-	int global_id = get_global_id(0);
-	int global_size = get_global_size(0);
-	for(int i=global_id;i<$SIZE;i+=global_size) {
-		int position = location_func0(i);
+	long global_id = get_global_id(0);
+	long global_size = get_global_size(0);
+	for(long i=global_id;i<$SIZE;i+=global_size) {
+		long position = location_func0(i);
 		y[i] = f(x[position]);
 	}
 }
@@ -874,11 +1369,11 @@ static std::string jitBinaryOperation(const TensorImpl* x1,const TensorImpl* x2
 
 kernel void op(global T0* restrict x1, global T1* restrict x2, global ResType* restrict y)
 {
-	int global_id = get_global_id(0);
-	int global_size = get_global_size(0);
-	for(int i=global_id;i<$SIZE;i+=global_size) {
-		int p1 = location_func0(i);
-		int p2 = location_func1(i);
+	long global_id = get_global_id(0);
+	long global_size = get_global_size(0);
+	for(long i=global_id;i<$SIZE;i+=global_size) {
+		long p1 = location_func0(i);
+		long p2 = location_func1(i);
 		y[i] = f(x1[p1], x2[p2]);
 	}
 }
@@ -893,6 +1388,33 @@ kernel void op(global T0* restrict x1, global T1* restrict x2, global ResType* r
 	return res;
 }
 
+static std::string jitTernaryOperation(const TensorImpl* x1, const TensorImpl* x2, const TensorImpl* x3, std::string f)
+{
+	std::string kernel = R"(
+
+kernel void op(global T0* restrict x1, global T1* restrict x2, global T2* restrict x3, global ResType* restrict y)
+{
+	long global_id = get_global_id(0);
+	long global_size = get_global_size(0);
+	for(long i=global_id;i<$SIZE;i+=global_size) {
+		long p1 = location_func0(i);
+		long p2 = location_func1(i);
+		long p3 = location_func2(i);
+		y[i] = f(x1[p1], x2[p2], x3[p3]);
+	}
+}
+)";
+
+	std::string extention_decl;
+	if(x1->dtype() == DType::Half || x2->dtype() == DType::Half || x3->dtype() == DType::Half)
+		extention_decl = "#pragma OPENCL EXTENSION cl_khr_fp16 : enable";
+
+	std::string res = extention_decl + "\n" + f + "\n" + jitStridedView(x1, 0) + "\n"  + jitStridedView(x2, 1) + "\n"
+		+ jitStridedView(x3, 2) + "\n" + kernel;
+	replaceAll(res, "$SIZE", std::to_string(x1->size()));
+	return res;
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::applyUnaryOp(const TensorImpl* x, std::string f, DType resType)
 {
 	requireProperties(x, this);
@@ -953,6 +1475,42 @@ std::shared_ptr<TensorImpl> OpenCLBackend::applyBinaryOp(const TensorImpl* x1, c
 	return res;
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::applyTernaryOp(const TensorImpl* x1, const TensorImpl* x2, const TensorImpl* x3, std::string f, DType resType)
+{
+	requireProperties(x1, this, x2->shape());
+	requireProperties(x2, this, x3->shape());
+	requireProperties(x3, this);
+
+	auto to_str = [](auto x){
+		return std::to_string(x->offset())+to_string(x->shape())+to_string(x->stride())+to_string(x->dtype());
+	};
+
+	auto param_hash = hashify(resType, to_str(x1), to_str(x2), to_str(x3));
+	std::string program_name = f+param_hash;
+	if(kernel_manager_.exists(program_name) == false) {
+		std::string args = "-DT0="+to_ctype_string(x1->dtype())+" -DT1="+to_ctype_string(x2->dtype())
+			+ " -DT2="+to_ctype_string(x3->dtype()) + " -DResType="+to_ctype_string(resType);
+		std::string source = jitTernaryOperation(x1, x2, x3, f);
+		kernel_manager_.compileKernel(source, program_name, "op", false, args);
+	}
+
+	cl::Kernel k = kernel_manager_.kernel(program_name, "op");
+
+	auto res = createTensor(x1->shape(), resType);
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(x1->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(x2->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<const OpenCLBuffer>(x3->buffer())->buffer());
+	k.setArg(3, std::static_pointer_cast<OpenCLBuffer>(res->buffer())->buffer());
+
+	size_t local_size = 128;
+
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, x1->size())), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel execution failed. Code " + str(err));
+
+	return res;
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::abs(const TensorImpl* x)
 {
 	DType result_type = [&x](){
@@ -1052,6 +1610,60 @@ std::shared_ptr<TensorImpl> OpenCLBackend::logical_or(const TensorImpl* x1, cons
 	return applyBinaryOp(x1, x2, "#define f(x1, x2) (x1||x2)", DType::Bool);
 }
 
+std::shared_ptr<TensorImpl> OpenCLBackend::lesser_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) (x1<=x2)", DType::Bool);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::greater_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) (x1>=x2)", DType::Bool);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::not_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) (x1!=x2)", DType::Bool);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::logical_xor(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) ((bool)x1!=(bool)x2)", DType::Bool);
+}
+
+// The type values are selected into. Same as the arithmetic ops except that bool stays bool
+static DType solveSelectDType(DType t1, DType t2)
+{
+	if(t1 == t2)
+		return t1;
+	return solveBinaryOpDType(t1, t2);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::minimum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	DType resType = solveSelectDType(x1->dtype(), x2->dtype());
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) ((ResType)x2<(ResType)x1 ? (ResType)x2 : (ResType)x1)", resType);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::maximum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	DType resType = solveSelectDType(x1->dtype(), x2->dtype());
+	return applyBinaryOp(x1, x2, "#define f(x1, x2) ((ResType)x1<(ResType)x2 ? (ResType)x2 : (ResType)x1)", resType);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y)
+{
+	DType resType = solveSelectDType(x->dtype(), y->dtype());
+	return applyTernaryOp(condition, x, y, "#define f(c, x1, x2) ((bool)c ? (ResType)x1 : (ResType)x2)", resType);
+}
+
+std::shared_ptr<TensorImpl> OpenCLBackend::clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max)
+{
+	DType resType = solveSelectDType(solveSelectDType(x->dtype(), min->dtype()), max->dtype());
+	// The builtin clamp() does not work on all types. Spelled out instead
+	return applyTernaryOp(x, min, max, "#define f(v, l, h) ((ResType)v<(ResType)l ? (ResType)l : ((ResType)h<(ResType)v ? (ResType)h : (ResType)v))"
+		, resType);
+}
+
 std::shared_ptr<TensorImpl> OpenCLBackend::from(const TensorImpl* x)
 {
 	const void* ptr = x->data();
@@ -1074,3 +1686,75 @@ std::shared_ptr<TensorImpl> OpenCLBackend::from(const TensorImpl* x)
 	free(buffer);
 	return res;
 }
+
+std::shared_ptr<TensorImpl> OpenCLBackend::overlap(const TensorImpl* a, const TensorImpl* b)
+{
+	requireProperties(a, this, DType::Bool);
+	requireProperties(b, this, DType::Bool);
+	et_check(a->dimensions() >= 1 && b->dimensions() >= 1);
+	et_check(a->shape().back() == b->shape().back(), "SDRs in a and b must have the same size. Got "
+		+ str(a->shape().back()) + " and " + str(b->shape().back()));
+
+	size_t num_bits = a->shape().back();
+	size_t num_a = a->size()/num_bits;
+	size_t num_b = b->size()/num_bits;
+
+	auto param_hash = hashify(num_bits, num_a, num_b);
+	auto program_name = "overlap"+param_hash;
+	if(kernel_manager_.exists(program_name) == false) {
+		auto args = "-DNUM_BITS="+str(num_bits)+" -DNUM_A="+str(num_a)+" -DNUM_B="+str(num_b);
+		kernel_manager_.compileFromFile(std::vector<std::string>{"view.cl", "overlap.cl"}, program_name, {"overlap", "topK"}, false, args);
+	}
+	cl::Kernel k = kernel_manager_.kernel(program_name, "overlap");
+
+	Shape s = a->shape();
+	Shape t = b->shape();
+	s.pop_back();
+	t.pop_back();
+	s = s + t;
+	auto res = createTensor(s.size() == 0 ? Shape{1} : s, DType::Int32);
+
+	k.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(a->buffer())->buffer());
+	k.setArg(1, std::static_pointer_cast<const OpenCLBuffer>(b->buffer())->buffer());
+	k.setArg(2, std::static_pointer_cast<OpenCLBuffer>(res->buffer())->buffer());
+	k.setArg(3, makeOpenCLView(a));
+	k.setArg(4, makeOpenCLView(b));
+
+	const size_t tile_size = 16; // the same value set in overlap.cl
+	auto round_up = [tile_size](size_t v) {return (v+tile_size-1)/tile_size*tile_size;};
+	cl_int err = queue_.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(round_up(num_b), round_up(num_a))
+		, cl::NDRange(tile_size, tile_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel overlap execution failed. Code " + str(err));
+	return res;
+}
+
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> OpenCLBackend::topKOverlap(const TensorImpl* a, const TensorImpl* b
+	, size_t k, size_t min_overlap)
+{
+	et_check(k > 0, "k must be larger than 0");
+	auto overlaps = overlap(a, b);
+
+	size_t num_bits = a->shape().back();
+	size_t num_a = a->size()/num_bits;
+	size_t num_b = b->size()/num_bits;
+	auto program_name = "overlap"+hashify(num_bits, num_a, num_b);
+	cl::Kernel kernel = kernel_manager_.kernel(program_name, "topK");
+
+	Shape s = a->shape();
+	s.back() = k;
+	auto indices = createTensor(s, DType::Int32);
+	auto values = createTensor(s, DType::Int32);
+
+	kernel.setArg(0, std::static_pointer_cast<const OpenCLBuffer>(overlaps->buffer())->buffer());
+	kernel.setArg(1, std::static_pointer_cast<OpenCLBuffer>(indices->buffer())->buffer());
+	kernel.setArg(2, std::static_pointer_cast<OpenCLBuffer>(values->buffer())->buffer());
+	kernel.setArg(3, (int)k);
+	kernel.setArg(4, (int)min_overlap);
+
+	size_t local_size = 64;
+	cl_int err = queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(selectWorkSize(4096, local_size, num_a)), cl::NDRange(local_size));
+	if(err != CL_SUCCESS)
+		throw EtError("OpenCL kernel topK execution failed. Code " + str(err));
+	return {indices, values};
+}
@@ -95,6 +95,7 @@ struct ETALER_EXPORT OpenCLBackend : public Backend
 	OpenCLBackend(cl::Context context, cl::Platform platform, cl::Device device);
 	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data=nullptr) override;
 	std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, cl::Buffer buf);
+	virtual std::shared_ptr<TensorImpl> aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype) override;
 	void releaseTensor(OpenCLBuffer* pimpl);
 	virtual void copyToHost(const TensorImpl* pimpl, void* dest) override;
 
@@ -108,16 +109,36 @@ struct ETALER_EXPORT OpenCLBackend : public Backend
 		const TensorImpl* permeances, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
 	virtual void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
 		TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+		, float connected_permeance, size_t active_threshold) override;
+	virtual void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+		, float perm_inc, float perm_dec) override;
+	virtual std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual void batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+		, float initial_perm) override;
 	virtual std::shared_ptr<TensorImpl> globalInhibition(const TensorImpl* x, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> groupInhibition(const TensorImpl* x, size_t group_size, float fraction) override;
 	virtual std::shared_ptr<TensorImpl> cast(const TensorImpl* x, DType toType) override;
 	virtual std::shared_ptr<TensorImpl> copy(const TensorImpl* x) override;
 	virtual void sortSynapse(TensorImpl* connections, TensorImpl* permeances) override;
 	virtual std::shared_ptr<TensorImpl> burst(const TensorImpl* x, const TensorImpl* s) override;
 	virtual std::shared_ptr<TensorImpl> reverseBurst(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, size_t steps) override;
 	virtual void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
 		, TensorImpl* permeances, float initial_perm) override;
 	virtual void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold) override;
 	virtual std::shared_ptr<TensorImpl> from(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> overlap(const TensorImpl* a, const TensorImpl* b) override;
+	virtual std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> topKOverlap(const TensorImpl* a, const TensorImpl* b
+		, size_t k, size_t min_overlap) override;
 
 	virtual std::shared_ptr<TensorImpl> realize(const TensorImpl* x) override;
 	virtual void assign(TensorImpl* dest, const TensorImpl* src) override;
@@ -139,6 +160,15 @@ struct ETALER_EXPORT OpenCLBackend : public Backend
 	virtual std::shared_ptr<TensorImpl> lesser(const TensorImpl* x1, const TensorImpl* x2) override;
 	virtual std::shared_ptr<TensorImpl> logical_and(const TensorImpl* x1, const TensorImpl* x2) override;
 	virtual std::shared_ptr<TensorImpl> logical_or(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> not_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_xor(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> minimum(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> maximum(const TensorImpl* x1, const TensorImpl* x2) override;
+
+	virtual std::shared_ptr<TensorImpl> where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y) override;
+	virtual std::shared_ptr<TensorImpl> clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max) override;
 
 	std::optional<cl::Buffer> toSparse(const TensorImpl* x);
 
@@ -179,6 +209,7 @@ protected:
 
 	std::shared_ptr<TensorImpl> applyUnaryOp(const TensorImpl* x, std::string f, DType resType);
 	std::shared_ptr<TensorImpl> applyBinaryOp(const TensorImpl* x1, const TensorImpl* x2, std::string f, DType resType);
+	std::shared_ptr<TensorImpl> applyTernaryOp(const TensorImpl* x1, const TensorImpl* x2, const TensorImpl* x3, std::string f, DType resType);
 
 
 	KernelManager kernel_manager_;
@@ -191,6 +222,7 @@ protected:
 	cl_device_local_mem_type local_mem_type_;
 	cl_ulong local_mem_size_;
 	cl_uint num_compute_units_;
+	cl_uint mem_base_addr_align_;
 
 	std::vector<std::string> supported_extentions_;
 	bool have_fp16_ = false;
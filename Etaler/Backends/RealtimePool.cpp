@@ -0,0 +1,193 @@
+#include "RealtimePool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace et;
+
+static thread_local RealtimePool* g_realtime_pool = nullptr;
+
+// Spins for a while, then yields so oversubscribed cores still make progress
+static inline void cpuRelax(size_t& spins)
+{
+	if(spins++ < 16384) {
+#if defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#endif
+		return;
+	}
+	std::this_thread::yield();
+}
+
+#if defined(__linux__)
+static int trySetAffinity(pthread_t thread, const std::vector<int>& cpus)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int cpu : cpus)
+		CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+static void setAffinity(pthread_t thread, const std::vector<int>& cpus)
+{
+	int err = trySetAffinity(thread, cpus);
+	if(err != 0)
+		throw EtError("Failed to pin a real-time thread to CPU " + std::to_string(cpus[0]) + ": " + std::string(strerror(err)));
+}
+
+static std::vector<int> getAffinity(pthread_t thread)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	int err = pthread_getaffinity_np(thread, sizeof(set), &set);
+	if(err != 0)
+		throw EtError("Failed to get the affinity of a thread: " + std::string(strerror(err)));
+	std::vector<int> cpus;
+	for(int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+		if(CPU_ISSET(cpu, &set))
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+#endif
+
+static void pinThread(std::thread& thread, int cpu)
+{
+#if defined(__linux__)
+	setAffinity(thread.native_handle(), {cpu});
+#endif
+}
+
+RealtimePool::RealtimePool(RealtimeOptions options)
+{
+	size_t num_threads = options.num_threads;
+	if(num_threads == 0)
+		num_threads = options.cpus.empty() ? std::max(std::thread::hardware_concurrency(), 1u) : options.cpus.size();
+	et_check(options.cpus.empty() || options.cpus.size() >= num_threads, "Pinning " + std::to_string(num_threads)
+		+ " real-time threads needs as many cpus, got " + std::to_string(options.cpus.size()));
+	cpus_ = options.cpus;
+	if(options.lock_memory)
+		lockMemory();
+
+	try {
+		for(size_t i=1;i<num_threads;i++) {
+			threads_.emplace_back([this, i](){ work(i); });
+			if(cpus_.empty() == false)
+				pinThread(threads_.back(), cpus_[i]);
+		}
+	}
+	catch(...) {
+		stop_ = true;
+		for(auto& t : threads_)
+			t.join();
+		throw;
+	}
+}
+
+RealtimePool::~RealtimePool()
+{
+	stop_ = true;
+	for(auto& t : threads_)
+		t.join();
+}
+
+void RealtimePool::work(size_t id)
+{
+	uint64_t seen = 0;
+	while(true) {
+		uint64_t epoch;
+		size_t spins = 0;
+		while((epoch = epoch_.load(std::memory_order_acquire)) == seen) {
+			if(stop_.load(std::memory_order_relaxed))
+				return;
+			cpuRelax(spins);
+		}
+		seen = epoch;
+
+		try {
+			func_(ctx_, id, size());
+		}
+		catch(...) {
+			std::lock_guard lock(error_mutex_);
+			if(error_ == nullptr)
+				error_ = std::current_exception();
+		}
+		pending_.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+void RealtimePool::run(void (*func)(const void*, size_t, size_t), const void* ctx)
+{
+	std::lock_guard lock(run_mutex_);
+	func_ = func;
+	ctx_ = ctx;
+	error_ = nullptr;
+	pending_.store(threads_.size(), std::memory_order_relaxed);
+	epoch_.fetch_add(1, std::memory_order_release);
+
+	std::exception_ptr error;
+	try {
+		func(ctx, 0, size());
+	}
+	catch(...) {
+		error = std::current_exception();
+	}
+	size_t spins = 0;
+	while(pending_.load(std::memory_order_acquire) != 0)
+		cpuRelax(spins);
+
+	if(error == nullptr)
+		error = error_;
+	if(error != nullptr)
+		std::rethrow_exception(error);
+}
+
+RealtimeScope::RealtimeScope(RealtimePool& pool)
+	: previous_(g_realtime_pool)
+{
+#if defined(__linux__)
+	if(pool.cpus().empty() == false) {
+		previous_cpus_ = getAffinity(pthread_self());
+		setAffinity(pthread_self(), {pool.cpus()[0]});
+	}
+#endif
+	g_realtime_pool = &pool;
+}
+
+RealtimeScope::~RealtimeScope()
+{
+	g_realtime_pool = previous_;
+#if defined(__linux__)
+	if(previous_cpus_.empty() == false)
+		trySetAffinity(pthread_self(), previous_cpus_); // Best effort, destructors can't throw
+#endif
+}
+
+RealtimePool* et::currentRealtimePool()
+{
+	return g_realtime_pool;
+}
+
+void et::lockMemory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	if(mlockall(MCL_CURRENT|MCL_FUTURE) != 0)
+		throw EtError("Failed to lock the memory of the process: " + std::string(strerror(errno)));
+#else
+	throw EtError("Locking the memory of the process is not supported on this platform");
+#endif
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Etaler/Core/Error.hpp>
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+struct RealtimeOptions
+{
+	size_t num_threads = 0; // Including the calling thread. 0 uses one per entry of cpus, or every core
+	// Thread i is pinned to cpus[i]. Thread 0 is the one running the kernels, pinned while in a RealtimeScope, and
+	// 1 to num_threads-1 are the workers. Needs at least num_threads entries. Empty leaves them unpinned. Linux only
+	std::vector<int> cpus;
+	bool lock_memory = false; // Calls lockMemory() when the pool is created
+};
+
+// A fixed set of threads running the CPU kernels of real-time steps (ex: a control loop), for a bounded step latency
+// instead of the best throughput. The threads are started and pinned up front and spin between kernels instead of
+// sleeping (they yield their core after a while if it is needed by another thread). Kernels are split statically
+// between the threads and the calling thread. Dispatching a kernel doesn't allocate. Use a MemoryPlanner so the
+// tensors of a step don't allocate either.
+//
+// Usage:
+//	RealtimePool pool({4, {2, 3, 4, 5}, true}); // The calling thread on core 2, the workers on 3, 4 and 5
+//	RealtimeScope scope(pool);
+//	MemoryPlanner planner(backend);
+//	while(running) {
+//		planner.beginStep();
+//		Tensor y = sp.compute(x);
+//		planner.endStep();
+//	}
+//
+// The workers keep their cores busy while the pool exists. Only one thread can run kernels on a pool at a time, the
+// others wait
+struct ETALER_EXPORT RealtimePool
+{
+	RealtimePool(RealtimeOptions options=RealtimeOptions());
+	~RealtimePool();
+	RealtimePool(const RealtimePool&) = delete;
+	RealtimePool& operator=(const RealtimePool&) = delete;
+
+	// Number of threads running a kernel, the calling thread included
+	size_t size() const {return threads_.size()+1;}
+	// The cores the threads are pinned to. Empty if they are not
+	const std::vector<int>& cpus() const {return cpus_;}
+
+	// Calls f(i, size()) for every i in [0, size()) on a different thread. f(0, size()) runs on the calling thread.
+	// Returns when all of them are done. Rethrows the first exception thrown by f
+	template <typename Func>
+	void run(const Func& f)
+	{
+		run([](const void* ctx, size_t i, size_t n){ (*(const Func*)ctx)(i, n); }, &f);
+	}
+	void run(void (*func)(const void*, size_t, size_t), const void* ctx);
+
+protected:
+	void work(size_t id);
+
+	std::vector<std::thread> threads_;
+	std::vector<int> cpus_;
+	std::atomic<uint64_t> epoch_{0};
+	std::atomic<size_t> pending_{0};
+	std::atomic<bool> stop_{false};
+	void (*func_)(const void*, size_t, size_t) = nullptr;
+	const void* ctx_ = nullptr;
+	std::exception_ptr error_;
+	std::mutex error_mutex_;
+	std::mutex run_mutex_;
+};
+
+// Runs the CPU kernels launched by the calling thread on a RealtimePool until the scope ends. If the pool's threads
+// are pinned, the calling thread is pinned to pool.cpus()[0] too, and its previous affinity restored afterwards
+struct ETALER_EXPORT RealtimeScope
+{
+	RealtimeScope(RealtimePool& pool);
+	~RealtimeScope();
+	RealtimeScope(const RealtimeScope&) = delete;
+	RealtimeScope& operator=(const RealtimeScope&) = delete;
+
+protected:
+	RealtimePool* previous_;
+	std::vector<int> previous_cpus_; // The affinity of the thread before the scope. Empty if it wasn't changed
+};
+
+// The pool of the calling thread. nullptr if there is none
+ETALER_EXPORT RealtimePool* currentRealtimePool();
+
+// Locks the current and future memory of the process into RAM (mlockall) so steps never page fault on swapped out
+// model memory. Usually needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK. Unix only
+ETALER_EXPORT void lockMemory();
+
+}
@@ -0,0 +1,865 @@
+#include "SimulationBackend.hpp"
+#include "Etaler/Core/Tensor.hpp"
+#include "Etaler/Core/TypeDispatch.hpp"
+#include "Etaler/Core/MemoryPlanner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+
+using namespace et;
+
+// A buffer without storage. Tells the backend when it's allocated and released so the memory use can be tracked
+struct SimulationBuffer : public BufferImpl
+{
+	SimulationBuffer(const Shape& shape, DType dtype, std::shared_ptr<Backend> backend)
+		: BufferImpl(shape.volume(), dtype, std::move(backend)), bytes_(shape.volume()*dtypeToSize(dtype))
+	{
+		static_cast<SimulationBackend*>(backend_.get())->allocated(bytes_);
+	}
+
+	virtual ~SimulationBuffer()
+	{
+		static_cast<SimulationBackend*>(backend_.get())->released(bytes_);
+	}
+
+	size_t bytes_;
+};
+
+// A buffer living in the memory of another buffer. Allocates nothing
+struct SimulationAliasBuffer : public BufferImpl
+{
+	SimulationAliasBuffer(const Shape& shape, DType dtype, std::shared_ptr<Backend> backend, std::shared_ptr<BufferImpl> parent)
+		: BufferImpl(shape.volume(), dtype, std::move(backend)), parent_(std::move(parent)) {}
+
+	std::shared_ptr<BufferImpl> parent_;
+};
+
+static size_t bytes(const TensorImpl* x)
+{
+	return x->size()*dtypeToSize(x->dtype());
+}
+
+OpCost CostTable::cost(const std::string& op) const
+{
+	auto it = ops.find(op);
+	if(it == ops.end())
+		return fallback;
+	return it->second;
+}
+
+OpStats SimulationReport::total() const
+{
+	OpStats res;
+	for(const auto& [name, s] : ops) {
+		res.calls += s.calls;
+		res.bytes_read += s.bytes_read;
+		res.bytes_written += s.bytes_written;
+		res.synapses += s.synapses;
+		res.time += s.time;
+	}
+	return res;
+}
+
+SimulationBackend::SimulationBackend(CostTable costs, float activity, float synapse_usage)
+	: costs_(std::move(costs)), activity_(activity), synapse_usage_(synapse_usage)
+{
+	et_check(activity >= 0 && activity <= 1, "activity must be in range [0, 1]");
+	et_check(synapse_usage >= 0 && synapse_usage <= 1, "synapse_usage must be in range [0, 1]");
+}
+
+SimulationReport SimulationBackend::report() const
+{
+	std::lock_guard lock(mutex_);
+	return report_;
+}
+
+void SimulationBackend::resetReport()
+{
+	std::lock_guard lock(mutex_);
+	report_.ops.clear();
+	report_.allocations = 0;
+	report_.peak_memory = report_.memory;
+}
+
+void SimulationBackend::allocated(size_t n)
+{
+	std::lock_guard lock(mutex_);
+	report_.memory += n;
+	report_.peak_memory = std::max(report_.peak_memory, report_.memory);
+	report_.allocations++;
+}
+
+void SimulationBackend::released(size_t n)
+{
+	std::lock_guard lock(mutex_);
+	report_.memory -= n;
+}
+
+void SimulationBackend::record(const std::string& op, size_t bytes_read, size_t bytes_written, size_t synapses)
+{
+	OpCost c = costs_.cost(op);
+	std::lock_guard lock(mutex_);
+	OpStats& s = report_.ops[op];
+	s.calls++;
+	s.bytes_read += bytes_read;
+	s.bytes_written += bytes_written;
+	s.synapses += synapses;
+	s.time += c.overhead + c.per_byte*(bytes_read+bytes_written) + c.per_synapse*synapses;
+}
+
+size_t SimulationBackend::activeCount(size_t n) const
+{
+	return std::min(n, (size_t)std::ceil(n*(double)activity_));
+}
+
+//The kernels stop at the first unused slot of a row
+size_t SimulationBackend::usedSynapses(size_t n, bool has_unconnected_synapse) const
+{
+	if(has_unconnected_synapse == false)
+		return n;
+	return std::min(n, (size_t)std::ceil(n*(double)synapse_usage_));
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::createTensor(const Shape& shape, DType dtype, const void* data)
+{
+	if(memory_planner_ != nullptr && data == nullptr)
+		return memory_planner_->allocate(shape, dtype);
+
+	auto buf = std::make_shared<SimulationBuffer>(shape, dtype, shared_from_this());
+	// Uploading the initial values
+	if(data != nullptr)
+		record("createTensor", 0, buf->bytes_);
+	return std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype)
+{
+	requireProperties(arena, this, IsPlain());
+	et_check(offset+shape.volume()*dtypeToSize(dtype) <= bytes(arena), "Alias tensor is out of the arena's bound");
+
+	auto buf = std::make_shared<SimulationAliasBuffer>(shape, dtype, shared_from_this(), arena->buffer());
+	return std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
+}
+
+void SimulationBackend::copyToHost(const TensorImpl* t, void* ptr)
+{
+	requireProperties(t, this, IsPlain());
+	memset(ptr, 0, bytes(t));
+	record("copyToHost", bytes(t), bytes(t));
+}
+
+//Checks the synapses like the real backends do. Returns the number of cells
+static size_t checkSynapses(const TensorImpl* connections, const TensorImpl* permeances, Backend* backend)
+{
+	requireProperties(connections, backend, DType::Int32, IsRowContiguous(), permeances->shape());
+	requireProperties(permeances, backend, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(connections->dimensions() >= 2);
+	return connections->size()/connections->shape().back();
+}
+
+static Shape cellShape(const TensorImpl* synapses)
+{
+	Shape s = synapses->shape();
+	s.pop_back();
+	return s;
+}
+
+//Bytes of the synapse tensors touched when visiting n synapses
+static size_t synapseBytes(const TensorImpl* connections, const TensorImpl* permeances, size_t n)
+{
+	return n*(dtypeToSize(connections->dtype()) + dtypeToSize(permeances->dtype()));
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances,
+	float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	checkSynapses(connections, permeances, this);
+	auto y = createTensor(cellShape(connections), DType::Int32);
+	size_t n = usedSynapses(connections->size(), has_unconnected_synapse);
+	record("cellActivity", bytes(x)+synapseBytes(connections, permeances, n), bytes(y.get()), n);
+	return y;
+}
+
+void SimulationBackend::learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
+	TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	size_t num_cells = checkSynapses(connections, permeances, this);
+	et_check(learn->size() == num_cells);
+	size_t n = usedSynapses(activeCount(num_cells)*connections->shape().back(), has_unconnected_synapse);
+	record("learnCorrilation", bytes(x)+bytes(learn)+synapseBytes(connections, permeances, n), n*dtypeToSize(permeances->dtype()), n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(permeance_offsets, this, DType::Float);
+	size_t num_cells = checkSynapses(connections, permeances, this);
+	et_check(permeance_offsets->size() == num_cells, "There must be one permanence offset per cell");
+	auto y = createTensor(cellShape(connections), DType::Int32);
+	size_t n = usedSynapses(connections->size(), has_unconnected_synapse);
+	record("cellActivityWithOffsets", bytes(x)+bytes(permeance_offsets)+synapseBytes(connections, permeances, n), bytes(y.get()), n);
+	return y;
+}
+
+void SimulationBackend::learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(permeance_offsets, this, DType::Float);
+	size_t num_cells = checkSynapses(connections, permeances, this);
+	et_check(learn->size() == num_cells && permeance_offsets->size() == num_cells);
+	size_t learning = activeCount(num_cells);
+	size_t n = usedSynapses(learning*connections->shape().back(), has_unconnected_synapse);
+	// Only the synapses connected to on bits are written
+	size_t written = activeCount(n)*dtypeToSize(permeances->dtype()) + learning*sizeof(float);
+	record("learnCorrilationSparse", bytes(x)+bytes(learn)+learning*sizeof(float)+synapseBytes(connections, permeances, n), written, n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	et_check(permeances->dimensions() >= 2);
+	auto y = createTensor(cellShape(permeances), DType::Int32);
+	size_t n = permeances->size();
+	record("proceduralCellActivity", bytes(x)+n*dtypeToSize(permeances->dtype()), bytes(y.get()), n);
+	return y;
+}
+
+void SimulationBackend::proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+	, float perm_inc, float perm_dec)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	requireProperties(permeances, this, IsDType{DType::Float, DType::Half}, IsRowContiguous());
+	size_t n = activeCount(learn->size())*permeances->shape().back();
+	size_t perm_bytes = n*dtypeToSize(permeances->dtype());
+	record("proceduralLearnCorrilation", bytes(x)+bytes(learn)+perm_bytes, perm_bytes, n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	checkSynapses(connections, permeances, this);
+	et_check(x->dimensions() >= 2, "Expecting a batch of shape [batch, ...], got " + to_string(x->shape()));
+	size_t batch_size = x->shape()[0];
+	auto y = createTensor(Shape({(intmax_t)batch_size}) + cellShape(connections), DType::Int32);
+	// Each row of synapses is read once for the entire batch
+	size_t n = usedSynapses(connections->size(), has_unconnected_synapse);
+	record("batchCellActivity", bytes(x)+synapseBytes(connections, permeances, n), bytes(y.get()), n*batch_size);
+	return y;
+}
+
+void SimulationBackend::batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+	, float perm_inc, float perm_dec, bool has_unconnected_synapse)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	size_t num_cells = checkSynapses(connections, permeances, this);
+	et_check(learn->dimensions() >= 2 && learn->size() == (size_t)learn->shape()[0]*num_cells
+		, "Expecting a batch of shape [batch, ...] with " + std::to_string(num_cells) + " elements per entry, got " + to_string(learn->shape()));
+	size_t width = connections->shape().back();
+	size_t n = usedSynapses(activeCount(learn->size())*width, has_unconnected_synapse);
+	size_t synapses_written = usedSynapses(std::min(activeCount(learn->size()), num_cells)*width, has_unconnected_synapse);
+	record("batchLearnCorrilation", bytes(x)+bytes(learn)+synapseBytes(connections, permeances, synapses_written)
+		, synapses_written*dtypeToSize(permeances->dtype()), n);
+}
+
+void SimulationBackend::batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+	, float initial_perm)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(learn, this, DType::Bool);
+	size_t num_cells = checkSynapses(connections, permeances, this);
+	et_check(x->dimensions() >= 2 && learn->dimensions() >= 2 && learn->size() == (size_t)learn->shape()[0]*num_cells
+		, "Expecting a batch of shape [batch, ...] with " + std::to_string(num_cells) + " elements per entry, got " + to_string(learn->shape()));
+	et_check(x->size()/x->shape()[0] <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
+	// Every learning cell of every entry scans its row. Each row is written once
+	size_t width = connections->shape().back();
+	size_t n = activeCount(learn->size())*width;
+	size_t synapses_written = std::min(activeCount(learn->size()), num_cells)*width;
+	record("batchGrowSynapses", bytes(x)+bytes(learn)+synapseBytes(connections, permeances, synapses_written)
+		, synapseBytes(connections, permeances, synapses_written), n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::globalInhibition(const TensorImpl* x, float fraction)
+{
+	requireProperties(x, this, DType::Int32);
+	auto y = createTensor(x->shape(), DType::Bool);
+	record("globalInhibition", bytes(x), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::groupInhibition(const TensorImpl* x, size_t group_size, float fraction)
+{
+	requireProperties(x, this, DType::Int32);
+	et_check(group_size > 0 && x->size() % group_size == 0, "The size of the tensor " + std::to_string(x->size())
+		+ " is not a multiple of the group size " + std::to_string(group_size));
+	auto y = createTensor(x->shape(), DType::Bool);
+	record("groupInhibition", bytes(x), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::cast(const TensorImpl* x, DType toType)
+{
+	requireProperties(x, this);
+	auto y = createTensor(x->shape(), toType);
+	record("cast", bytes(x), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::copy(const TensorImpl* x)
+{
+	requireProperties(x, this, IsContingous());
+	auto y = createTensor(x->shape(), x->dtype());
+	record("copy", bytes(x), bytes(y.get()));
+	return y;
+}
+
+void SimulationBackend::sortSynapse(TensorImpl* connections, TensorImpl* permeances)
+{
+	checkSynapses(connections, permeances, this);
+	size_t n = connections->size();
+	record("sortSynapse", synapseBytes(connections, permeances, n), synapseBytes(connections, permeances, n), n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::burst(const TensorImpl* x, const TensorImpl* s)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(s, this, DType::Bool);
+	requireProperties(x, cellShape(s));
+	auto y = createTensor(s->shape(), DType::Bool);
+	record("burst", bytes(x)+bytes(s), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::reverseBurst(const TensorImpl* x)
+{
+	requireProperties(x, this, DType::Bool);
+	auto y = createTensor(x->shape(), DType::Bool);
+	record("reverseBurst", bytes(x), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+	, float connected_permeance, size_t active_threshold, size_t steps)
+{
+	requireProperties(x, this, DType::Bool);
+	checkSynapses(connections, permeances, this);
+	Shape cell_shape = cellShape(connections);
+	Shape x_shape = x->shape();
+	et_check(x_shape.size() >= cell_shape.size() && Shape(x_shape.end()-cell_shape.size(), x_shape.end()) == cell_shape
+		, "Active cells of shape " + to_string(x_shape) + " does not end with " + to_string(cell_shape));
+	Shape result_shape = x_shape;
+	result_shape.pop_back();
+	auto y = createTensor(Shape({(intmax_t)steps}) + result_shape, DType::Bool);
+	size_t num_streams = x->size()/cell_shape.volume();
+	size_t n = steps*num_streams*usedSynapses(connections->size());
+	record("rollout", bytes(x)+synapseBytes(connections, permeances, n), bytes(y.get()), n);
+	return y;
+}
+
+void SimulationBackend::growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+	, TensorImpl* permeances, float initial_perm)
+{
+	requireProperties(x, this, DType::Bool);
+	requireProperties(y, this, DType::Bool);
+	checkSynapses(connections, permeances, this);
+	requireProperties(y, cellShape(connections));
+	et_check(x->size() <= (size_t)std::numeric_limits<int32_t>::max(), "Synapses can only connect to the first 2^31-1 input cells");
+	// Learning cells scan their row and fill the free slots
+	size_t n = activeCount(y->size())*connections->shape().back();
+	record("growSynapses", bytes(x)+bytes(y)+synapseBytes(connections, permeances, n), synapseBytes(connections, permeances, n), n);
+}
+
+void SimulationBackend::decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold)
+{
+	checkSynapses(connections, permeances, this);
+	size_t n = connections->size();
+	record("decaySynapses", synapseBytes(connections, permeances, n), synapseBytes(connections, permeances, n), n);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::from(const TensorImpl* x)
+{
+	auto y = createTensor(x->shape(), x->dtype());
+	record("from", bytes(x), bytes(y.get()));
+	return y;
+}
+
+static Shape overlapShape(const TensorImpl* a, const TensorImpl* b, Backend* backend)
+{
+	requireProperties(a, backend, DType::Bool);
+	requireProperties(b, backend, DType::Bool);
+	et_check(a->dimensions() >= 1 && b->dimensions() >= 1);
+	et_check(a->shape().back() == b->shape().back(), "SDRs in a and b must have the same size. Got "
+		+ std::to_string(a->shape().back()) + " and " + std::to_string(b->shape().back()));
+	return cellShape(a) + cellShape(b);
+}
+
+//Every pair of SDRs reads both packed rows
+static size_t overlapBytes(const TensorImpl* a, const TensorImpl* b)
+{
+	size_t num_bits = a->shape().back();
+	size_t words = (num_bits+63)/64;
+	return bytes(a) + bytes(b) + (a->size()/num_bits)*(b->size()/num_bits)*words*2*sizeof(uint64_t);
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::overlap(const TensorImpl* a, const TensorImpl* b)
+{
+	Shape s = overlapShape(a, b, this);
+	auto y = createTensor(s.size() == 0 ? Shape{1} : s, DType::Int32);
+	record("overlap", overlapBytes(a, b), bytes(y.get()));
+	return y;
+}
+
+std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> SimulationBackend::topKOverlap(const TensorImpl* a, const TensorImpl* b
+	, size_t k, size_t min_overlap)
+{
+	overlapShape(a, b, this);
+	et_check(k > 0, "k must be larger than 0");
+	Shape s = a->shape();
+	s.back() = k;
+	auto indices = createTensor(s, DType::Int32);
+	auto overlaps = createTensor(s, DType::Int32);
+	record("topKOverlap", overlapBytes(a, b), bytes(indices.get())+bytes(overlaps.get()));
+	return {indices, overlaps};
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::realize(const TensorImpl* x)
+{
+	requireProperties(x, this);
+	auto y = createTensor(x->shape(), x->dtype());
+	record("realize", bytes(x), bytes(y.get()));
+	return y;
+}
+
+void SimulationBackend::assign(TensorImpl* dest, const TensorImpl* src)
+{
+	requireProperties(dest, this);
+	requireProperties(src, this);
+
+	if(dest->shape() != src->shape())
+		throw EtError("Shape mismatch in tensor assignment. Shape "
+			+ to_string(dest->shape()) + " and " + to_string(src->shape()));
+	record("assign", bytes(src), bytes(dest));
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::sum(const TensorImpl* x, size_t chunk_size, DType dtype)
+{
+	requireProperties(x, this);
+	et_check(x->size() % chunk_size == 0);
+
+	DType result_dtype = dtype;
+	if(dtype == DType::Unknown) {
+		if(x->dtype() == DType::Bool || x->dtype() == DType::Int32)
+			result_dtype = DType::Int32;
+		else if(x->dtype() == DType::Half)
+			result_dtype = DType::Half;
+		else
+			result_dtype = DType::Float;
+	}
+	// Bools and ints are summed as Int32, which holds the sum of at most INT32_MAX of them
+	et_check(result_dtype != DType::Int32 || (x->dtype() != DType::Bool && x->dtype() != DType::Int32)
+		|| chunk_size <= (size_t)std::numeric_limits<int32_t>::max()
+		, "Summing " + std::to_string(chunk_size) + " elements overflows Int32. Sum as Float instead");
+
+	auto y = createTensor({intmax_t(x->size()/chunk_size)}, result_dtype);
+	record("sum", bytes(x), bytes(y.get()));
+	return y;
+}
+
+// The element-wise ops return the same types as the CPU backend. The types are worked out from the C++ types the
+// ops return with the rules the CPU backend uses (see TypeDispatch.hpp), so they can't diverge
+template <typename Op>
+static DType uniaryType(const TensorImpl* x, Op op)
+{
+	DType res = DType::Unknown;
+	dispatch(x->dtype(), [&](auto v){
+		using T = decltype(v);
+		res = typeToDType<UnaryStoreType<T, std::invoke_result_t<Op, T>>>();
+	});
+	return res;
+}
+
+template <typename Op>
+static DType binaryType(const TensorImpl* x1, const TensorImpl* x2, Op op)
+{
+	DType res = DType::Unknown;
+	dispatch(x1->dtype(), [&](auto v1){
+		dispatch(x2->dtype(), [&](auto v2){
+			res = typeToDType<BinaryStoreType<std::invoke_result_t<Op, decltype(v1), decltype(v2)>>>();
+		});
+	});
+	return res;
+}
+
+template <typename Op>
+static DType ternaryType(const TensorImpl* x1, const TensorImpl* x2, const TensorImpl* x3, Op op)
+{
+	DType res = DType::Unknown;
+	dispatch(x1->dtype(), [&](auto v1){
+		dispatch(x2->dtype(), [&](auto v2){
+			dispatch(x3->dtype(), [&](auto v3){
+				res = typeToDType<std::invoke_result_t<Op, decltype(v1), decltype(v2), decltype(v3)>>();
+			});
+		});
+	});
+	return res;
+}
+
+template <typename Op>
+static std::shared_ptr<TensorImpl> uniaryOp(SimulationBackend* backend, const std::string& name, const TensorImpl* x, Op op)
+{
+	requireProperties(x, backend);
+	auto y = backend->createTensor(x->shape(), uniaryType(x, op));
+	backend->record(name, bytes(x), bytes(y.get()));
+	return y;
+}
+
+template <typename Op>
+static std::shared_ptr<TensorImpl> binaryOp(SimulationBackend* backend, const std::string& name, const TensorImpl* x1, const TensorImpl* x2, Op op)
+{
+	requireProperties(x1, backend);
+	requireProperties(x2, backend);
+	et_assert(x1->shape() == x2->shape());
+	auto y = backend->createTensor(x1->shape(), binaryType(x1, x2, op));
+	backend->record(name, bytes(x1)+bytes(x2), bytes(y.get()));
+	return y;
+}
+
+template <typename Op>
+static std::shared_ptr<TensorImpl> ternaryOp(SimulationBackend* backend, const std::string& name, const TensorImpl* x1, const TensorImpl* x2
+	, const TensorImpl* x3, Op op)
+{
+	requireProperties(x1, backend);
+	requireProperties(x2, backend);
+	requireProperties(x3, backend);
+	et_assert(x1->shape() == x2->shape() && x1->shape() == x3->shape());
+	auto y = backend->createTensor(x1->shape(), ternaryType(x1, x2, x3, op));
+	backend->record(name, bytes(x1)+bytes(x2)+bytes(x3), bytes(y.get()));
+	return y;
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::abs(const TensorImpl* x)
+{
+	return uniaryOp(this, "abs", x, [](auto v){return std::abs(v);});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::exp(const TensorImpl* x)
+{
+	return uniaryOp(this, "exp", x, [](auto v){return std::exp(v);});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::negate(const TensorImpl* x)
+{
+	return uniaryOp(this, "negate", x, [](auto v){return -v;});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::inverse(const TensorImpl* x)
+{
+	return uniaryOp(this, "inverse", x, [](auto v){return 1.f/v;});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::log(const TensorImpl* x)
+{
+	return uniaryOp(this, "log", x, [](auto v){return std::log(v);});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::logical_not(const TensorImpl* x)
+{
+	return uniaryOp(this, "logical_not", x, [](auto v){return !((bool)v);});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::add(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "add", x1, x2, [](auto a, auto b) {return a+b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::subtract(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "subtract", x1, x2, [](auto a, auto b) {return a-b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::mul(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "mul", x1, x2, [](auto a, auto b) {return a*b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::div(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "div", x1, x2, [](auto a, auto b) {return a/b;});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "equal", x1, x2, [](auto a, auto b) {return a==b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::greater(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "greater", x1, x2, [](auto a, auto b) {return a>b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::lesser(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "lesser", x1, x2, [](auto a, auto b) {return a<b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::logical_and(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "logical_and", x1, x2, [](auto a, auto b) {return a&&b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::logical_or(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "logical_or", x1, x2, [](auto a, auto b) {return a||b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::lesser_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "lesser_equal", x1, x2, [](auto a, auto b) {return a<=b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::greater_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "greater_equal", x1, x2, [](auto a, auto b) {return a>=b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::not_equal(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "not_equal", x1, x2, [](auto a, auto b) {return a!=b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::logical_xor(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "logical_xor", x1, x2, [](auto a, auto b) {return (bool)a!=(bool)b;});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::minimum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "minimum", x1, x2, [](auto a, auto b) {return SelectType<decltype(a), decltype(b)>();});
+}
+std::shared_ptr<TensorImpl> SimulationBackend::maximum(const TensorImpl* x1, const TensorImpl* x2)
+{
+	return binaryOp(this, "maximum", x1, x2, [](auto a, auto b) {return SelectType<decltype(a), decltype(b)>();});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y)
+{
+	return ternaryOp(this, "where", condition, x, y, [](auto c, auto a, auto b) {return SelectType<decltype(a), decltype(b)>();});
+}
+
+std::shared_ptr<TensorImpl> SimulationBackend::clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max)
+{
+	return ternaryOp(this, "clamp", x, min, max, [](auto v, auto lo, auto hi) {
+		return SelectType<SelectType<decltype(v), decltype(lo)>, decltype(hi)>();
+	});
+}
+
+// Sets up the inputs of an op of size n (cells or elements) on a backend and returns a function running the op
+using Benchmark = std::function<std::function<void()>(Backend*, size_t)>;
+
+static Tensor randomSDR(const Shape& shape, float density, std::mt19937& rng, Backend* backend)
+{
+	std::bernoulli_distribution dist(density);
+	std::vector<uint8_t> v(shape.volume());
+	for(auto& b : v)
+		b = dist(rng);
+	return Tensor(shape, (const bool*)v.data(), backend);
+}
+
+// Exactly ceil(n*activity) cells learn, the count SimulationBackend assumes
+static Tensor learningCells(const Shape& shape, float activity, Backend* backend)
+{
+	size_t n = shape.volume();
+	size_t num_on = std::min(n, (size_t)std::ceil(n*(double)activity));
+	std::vector<uint8_t> v(n, 0);
+	for(size_t i=0;i<num_on;i++)
+		v[i*n/num_on] = 1;
+	return Tensor(shape, (const bool*)v.data(), backend);
+}
+
+static std::pair<Tensor, Tensor> randomSynapses(size_t num_cells, size_t width, size_t input_size, std::mt19937& rng, Backend* backend)
+{
+	std::uniform_int_distribution<int32_t> target(0, input_size-1);
+	std::uniform_real_distribution<float> perm(0, 1);
+	std::vector<int32_t> conns(num_cells*width);
+	std::vector<float> perms(num_cells*width);
+	for(size_t i=0;i<conns.size();i++) {
+		conns[i] = target(rng);
+		perms[i] = perm(rng);
+	}
+	Shape s = {(intmax_t)num_cells, (intmax_t)width};
+	return {Tensor(s, conns.data(), backend), Tensor(s, perms.data(), backend)};
+}
+
+CostTable CostTable::calibrate(Backend* backend)
+{
+	const size_t input_size = 1024;
+	const size_t width = 64;
+	const float activity = 0.02f;
+
+	std::map<std::string, Benchmark> benchmarks;
+	benchmarks["cellActivity"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)input_size}, 0.1, rng, b);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=](){ cellActivity(x, c, p, 0.21, 1); };
+	};
+	benchmarks["learnCorrilation"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)input_size}, 0.1, rng, b);
+		Tensor y = learningCells({(intmax_t)n}, activity, b);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=]() mutable { learnCorrilation(x, y, c, p, 0.1, 0.1); };
+	};
+	benchmarks["batchCellActivity"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({8, (intmax_t)input_size}, 0.1, rng, b);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=](){ batchCellActivity(x, c, p, 0.21, 1); };
+	};
+	benchmarks["batchLearnCorrilation"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({8, (intmax_t)input_size}, 0.1, rng, b);
+		Tensor y = learningCells({8, (intmax_t)n}, activity, b);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=]() mutable { batchLearnCorrilation(x, y, c, p, 0.1, 0.1); };
+	};
+	benchmarks["growSynapses"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)input_size}, 0.1, rng, b);
+		Tensor y = learningCells({(intmax_t)n}, activity, b);
+		Tensor c = constant<int32_t>({(intmax_t)n, (intmax_t)width}, -1, b);
+		Tensor p = zeros({(intmax_t)n, (intmax_t)width}, DType::Float, b);
+		return [=]() mutable { growSynapses(x, y, c, p, 0.21); };
+	};
+	benchmarks["batchGrowSynapses"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({8, (intmax_t)input_size}, 0.1, rng, b);
+		Tensor y = learningCells({8, (intmax_t)n}, activity, b);
+		Tensor c = constant<int32_t>({(intmax_t)n, (intmax_t)width}, -1, b);
+		Tensor p = zeros({(intmax_t)n, (intmax_t)width}, DType::Float, b);
+		return [=]() mutable { batchGrowSynapses(x, y, c, p, 0.21); };
+	};
+	benchmarks["sortSynapse"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=]() mutable { sortSynapse(c, p); };
+	};
+	benchmarks["decaySynapses"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, input_size, rng, b);
+		return [=]() mutable { decaySynapses(c, p, 0); };
+	};
+	benchmarks["rollout"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)n/16, 16}, 0.02, rng, b);
+		Tensor c, p;
+		std::tie(c, p) = randomSynapses(n, width, n, rng, b);
+		Tensor conns = c.reshape({(intmax_t)n/16, 16, (intmax_t)width});
+		Tensor perms = p.reshape({(intmax_t)n/16, 16, (intmax_t)width});
+		return [=](){ rollout(x, conns, perms, 0.21, 1, 2); };
+	};
+	benchmarks["globalInhibition"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<int32_t> dist(0, 100);
+		std::vector<int32_t> v(n*16);
+		for(auto& e : v)
+			e = dist(rng);
+		Tensor x = Tensor({(intmax_t)v.size()}, v.data(), b);
+		return [=](){ globalInhibition(x, 0.02); };
+	};
+	benchmarks["burst"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)n}, 0.1, rng, b);
+		Tensor s = randomSDR({(intmax_t)n, 16}, 0.02, rng, b);
+		return [=](){ burst(x, s); };
+	};
+	benchmarks["reverseBurst"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)n, 16}, 0.1, rng, b);
+		return [=](){ reverseBurst(x); };
+	};
+	benchmarks["overlap"] = [=](Backend* b, size_t n) {
+		std::mt19937 rng(42);
+		Tensor x = randomSDR({(intmax_t)n/16, (intmax_t)input_size}, 0.02, rng, b);
+		Tensor y = randomSDR({16, (intmax_t)input_size}, 0.02, rng, b);
+		return [=](){ overlap(x, y); };
+	};
+	benchmarks["cast"] = [=](Backend* b, size_t n) {
+		Tensor x = zeros({(intmax_t)(n*width)}, DType::Int32, b);
+		return [=](){ x.cast(DType::Float); };
+	};
+	benchmarks["sum"] = [=](Backend* b, size_t n) {
+		Tensor x = zeros({(intmax_t)n, (intmax_t)width}, DType::Int32, b);
+		return [=](){ x.sum(1); };
+	};
+	benchmarks["realize"] = [=](Backend* b, size_t n) {
+		Tensor x = zeros({(intmax_t)n, (intmax_t)(width*2)}, DType::Int32, b).view({all(), range(width)});
+		return [=](){ x.realize(); };
+	};
+	benchmarks["assign"] = [=](Backend* b, size_t n) {
+		Tensor x = zeros({(intmax_t)(n*width)}, DType::Int32, b);
+		Tensor y = zeros({(intmax_t)(n*width)}, DType::Int32, b);
+		return [=]() mutable { x.assign(y); };
+	};
+	benchmarks["add"] = [=](Backend* b, size_t n) {
+		Tensor x = zeros({(intmax_t)(n*width)}, DType::Float, b);
+		return [=](){ Tensor y = x+x; };
+	};
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto sim = std::make_shared<SimulationBackend>(CostTable(), activity);
+	const size_t sizes[2] = {1024, 8192};
+	CostTable table;
+	for(const auto& [name, benchmark] : benchmarks) {
+		double time[2];
+		double units[2];
+		bool per_synapse = false;
+		for(size_t i=0;i<2;i++) {
+			auto op = benchmark(backend, sizes[i]);
+			op(); // Warm up. Also compiles the kernels on backends that need it
+			backend->sync();
+			time[i] = std::numeric_limits<double>::max();
+			for(size_t j=0;j<5;j++) {
+				auto t0 = Clock::now();
+				op();
+				backend->sync();
+				auto t1 = Clock::now();
+				time[i] = std::min(time[i], std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count());
+			}
+
+			// Count the work the simulation would record for the same op
+			auto sim_op = benchmark(sim.get(), sizes[i]);
+			sim->resetReport();
+			sim_op();
+			OpStats s = sim->report().ops[name];
+			per_synapse = s.synapses != 0;
+			units[i] = per_synapse ? s.synapses : s.bytes_read+s.bytes_written;
+		}
+
+		double slope = std::max(0.0, (time[1]-time[0])/(units[1]-units[0]));
+		OpCost cost;
+		cost.overhead = std::max(0.0, time[0]-slope*units[0]);
+		(per_synapse ? cost.per_synapse : cost.per_byte) = slope;
+		table.ops[name] = cost;
+	}
+
+	// Ops that run about the same loops as a timed op
+	table.ops["cellActivityWithOffsets"] = table.ops["cellActivity"];
+	table.ops["proceduralCellActivity"] = table.ops["cellActivity"];
+	table.ops["learnCorrilationSparse"] = table.ops["learnCorrilation"];
+	table.ops["proceduralLearnCorrilation"] = table.ops["learnCorrilation"];
+	table.ops["groupInhibition"] = table.ops["globalInhibition"];
+	table.ops["topKOverlap"] = table.ops["overlap"];
+	table.ops["copy"] = table.ops["assign"];
+	table.fallback = table.ops["add"];
+	return table;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <Etaler/Core/TensorImpl.hpp>
+#include <Etaler/Core/DefaultBackend.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace et
+{
+
+// Estimated run time of a backend op in seconds: overhead + per_byte*bytes + per_synapse*synapses
+struct OpCost
+{
+	double overhead = 0;
+	double per_byte = 0;
+	double per_synapse = 0;
+};
+
+// The costs of the backend ops on a machine. Ops not in the table use `fallback`
+struct ETALER_EXPORT CostTable
+{
+	OpCost cost(const std::string& op) const;
+
+	// Times the ops of a real backend (ex: the CPU backend) at a few problem sizes and fits the costs.
+	// Takes a few seconds. Save the result if you plan to simulate more than once
+	static CostTable calibrate(Backend* backend=defaultBackend());
+
+	std::map<std::string, OpCost> ops;
+	OpCost fallback;
+};
+
+// The work done by all calls of an op
+struct OpStats
+{
+	size_t calls = 0;
+	size_t bytes_read = 0;
+	size_t bytes_written = 0;
+	size_t synapses = 0; // Synapses visited
+	double time = 0; // Estimated time in seconds
+};
+
+struct ETALER_EXPORT SimulationReport
+{
+	OpStats total() const;
+
+	std::map<std::string, OpStats> ops; // Keyed by the name of the backend method
+	size_t memory = 0; // Bytes allocated at the moment
+	size_t peak_memory = 0;
+	size_t allocations = 0;
+};
+
+// A backend that only pretends to compute, for capacity planning. Tensors have no storage. Ops check their
+// arguments, return tensors of the right shape and type and record the work they would have done along with the
+// time the CostTable estimates for it. So SpatialPooler/TemporalMemory configs that don't fit the machine can be
+// sized in milliseconds. Reading a tensor back always gives zeros.
+//
+// The data is not known, so ops whose work depends on it assume a fraction `activity` of the cells learn (ex:
+// learnCorrilation, growSynapses) and a fraction `synapse_usage` of the synapse slots are in use. A SpatialPooler
+// uses all of its slots. A TemporalMemory starts with none and fills them up as it learns.
+//
+// Usage:
+//	auto sim = std::make_shared<SimulationBackend>(CostTable::calibrate(cpu));
+//	TemporalMemory tm({2048}, 32, 128, sim.get());
+//	tm.compute(x.to(sim), last_state);
+//	std::cout << sim->report().total().time << "s, " << sim->report().peak_memory << " bytes\n";
+struct ETALER_EXPORT SimulationBackend : public Backend
+{
+	SimulationBackend(CostTable costs=CostTable(), float activity=0.02f, float synapse_usage=1.f);
+
+	SimulationReport report() const;
+	// Clears the op stats and sets the peak memory to the current memory use
+	void resetReport();
+	const CostTable& costTable() const {return costs_;}
+	float activity() const {return activity_;}
+	float synapseUsage() const {return synapse_usage_;}
+
+	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data=nullptr) override;
+	virtual std::shared_ptr<TensorImpl> aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype) override;
+
+	virtual std::shared_ptr<TensorImpl> cellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances,
+		float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections,
+		TensorImpl* permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+		, float connected_permeance, size_t active_threshold) override;
+	virtual void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+		, float perm_inc, float perm_dec) override;
+	virtual std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) override;
+	virtual void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) override;
+	virtual void batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+		, float initial_perm) override;
+	virtual std::shared_ptr<TensorImpl> globalInhibition(const TensorImpl* x, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> groupInhibition(const TensorImpl* x, size_t group_size, float fraction) override;
+	virtual std::shared_ptr<TensorImpl> cast(const TensorImpl* x, DType toType) override;
+	virtual void copyToHost(const TensorImpl* pimpl, void* dest) override;
+	virtual std::string name() const override {return "Simulation";}
+	virtual std::shared_ptr<TensorImpl> copy(const TensorImpl* x) override;
+	virtual void sortSynapse(TensorImpl* connections, TensorImpl* permeances) override;
+	virtual std::shared_ptr<TensorImpl> burst(const TensorImpl* x, const TensorImpl* s) override;
+	virtual std::shared_ptr<TensorImpl> reverseBurst(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, size_t steps) override;
+	virtual void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
+		, TensorImpl* permeances, float initial_perm) override;
+	virtual void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold) override;
+	virtual std::shared_ptr<TensorImpl> from(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> overlap(const TensorImpl* a, const TensorImpl* b) override;
+	virtual std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> topKOverlap(const TensorImpl* a, const TensorImpl* b
+		, size_t k, size_t min_overlap) override;
+
+	virtual std::shared_ptr<TensorImpl> realize(const TensorImpl* x) override;
+	virtual void assign(TensorImpl* dest, const TensorImpl* src) override;
+	virtual std::shared_ptr<TensorImpl> sum(const TensorImpl* x, size_t chunk_size, DType dtype=DType::Unknown) override;
+
+	virtual std::shared_ptr<TensorImpl> abs(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> exp(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> negate(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> inverse(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> log(const TensorImpl* x) override;
+	virtual std::shared_ptr<TensorImpl> logical_not(const TensorImpl* x) override;
+
+	virtual std::shared_ptr<TensorImpl> add(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> subtract(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> mul(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> div(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_and(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_or(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> lesser_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> greater_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> not_equal(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> logical_xor(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> minimum(const TensorImpl* x1, const TensorImpl* x2) override;
+	virtual std::shared_ptr<TensorImpl> maximum(const TensorImpl* x1, const TensorImpl* x2) override;
+
+	virtual std::shared_ptr<TensorImpl> where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y) override;
+	virtual std::shared_ptr<TensorImpl> clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max) override;
+
+	// Adds a call of op to the report and estimates its time
+	void record(const std::string& op, size_t bytes_read, size_t bytes_written, size_t synapses=0);
+	// Used by the buffers to report their lifetime
+	void allocated(size_t bytes);
+	void released(size_t bytes);
+
+protected:
+	size_t activeCount(size_t n) const;
+	size_t usedSynapses(size_t n, bool has_unconnected_synapse=true) const;
+
+	CostTable costs_;
+	float activity_;
+	float synapse_usage_;
+	SimulationReport report_;
+	mutable std::mutex mutex_;
+};
+
+}
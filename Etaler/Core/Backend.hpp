@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <cstdint>
 
 #include "Shape.hpp"
 #include "DType.hpp"
@@ -16,6 +18,7 @@ namespace et
 
 struct TensorImpl;
 struct Backend;
+struct MemoryPlanner;
 
 struct ETALER_EXPORT Backend : public std::enable_shared_from_this<Backend>
 {
@@ -25,6 +28,8 @@ struct ETALER_EXPORT Backend : public std::enable_shared_from_this<Backend>
 	Backend(const Backend&) = delete;
 	Backend& operator=(const Backend&) = delete;
 	virtual std::shared_ptr<TensorImpl> createTensor(const Shape& shape, DType dtype, const void* data = nullptr) {throw notImplemented("createTensor");};
+	// Creates a tensor that shares the memory of `arena` starting from `offset` bytes
+	virtual std::shared_ptr<TensorImpl> aliasTensor(const TensorImpl* arena, size_t offset, const Shape& shape, DType dtype) {throw notImplemented("aliasTensor");}
 
 	virtual void sync() const {} //Default empty implemention. For async backends
 	virtual std::shared_ptr<TensorImpl> cellActivity(const TensorImpl* x, const TensorImpl* connections,
@@ -32,7 +37,33 @@ struct ETALER_EXPORT Backend : public std::enable_shared_from_this<Backend>
 	virtual void learnCorrilation(const TensorImpl* x, const TensorImpl* learn,
 		const TensorImpl* connections, TensorImpl* permeances, float perm_inc, float perm_dec
 		, bool has_unconnected_synapse=true) {throw notImplemented("learnCorrilation");}
+	// Sparse learning. learnCorrilationSparse adds perm_inc+perm_dec to synapses connected to on bits and subtracts
+	// perm_dec from the cell's offset instead of writing every synapse. The effective permanence is
+	// permeance + offset and clamping only happens when the offsets are folded back by renormalizePermanences()
+	virtual std::shared_ptr<TensorImpl> cellActivityWithOffsets(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, const TensorImpl* permeance_offsets, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true)
+		{throw notImplemented("cellActivityWithOffsets");}
+	virtual void learnCorrilationSparse(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, TensorImpl* permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true)
+		{throw notImplemented("learnCorrilationSparse");}
+	// Same as cellActivity and learnCorrilation, but the connections are generated from the seed by ProceduralPool
+	// instead of being stored
+	virtual std::shared_ptr<TensorImpl> proceduralCellActivity(const TensorImpl* x, const TensorImpl* permeances, uint64_t seed
+		, float connected_permeance, size_t active_threshold) {throw notImplemented("proceduralCellActivity");}
+	virtual void proceduralLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, TensorImpl* permeances, uint64_t seed
+		, float perm_inc, float perm_dec) {throw notImplemented("proceduralLearnCorrilation");}
+	// Batched cellActivity, learnCorrilation and growSynapses. x[batch, ...] and learn[batch, ...] hold one input/learning
+	// mask per entry and all entries share the synapses. The updates of all entries are summed before clamping, so the
+	// result does not depend on the order the entries are processed in. Growing is not additive, the entries are grown
+	// in batch order
+	virtual std::shared_ptr<TensorImpl> batchCellActivity(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true) {throw notImplemented("batchCellActivity");}
+	virtual void batchLearnCorrilation(const TensorImpl* x, const TensorImpl* learn, const TensorImpl* connections, TensorImpl* permeances
+		, float perm_inc, float perm_dec, bool has_unconnected_synapse=true) {throw notImplemented("batchLearnCorrilation");}
+	virtual void batchGrowSynapses(const TensorImpl* x, const TensorImpl* learn, TensorImpl* connections, TensorImpl* permeances
+		, float initial_perm) {throw notImplemented("batchGrowSynapses");}
 	virtual std::shared_ptr<TensorImpl> globalInhibition(const TensorImpl* x, float fraction) {throw notImplemented("globalInhibition");}
+	virtual std::shared_ptr<TensorImpl> groupInhibition(const TensorImpl* x, size_t group_size, float fraction) {throw notImplemented("groupInhibition");}
 	virtual std::shared_ptr<TensorImpl> cast(const TensorImpl* x, DType toType) {throw notImplemented("cast");}
 	virtual void copyToHost(const TensorImpl* pimpl, void* dest) {throw notImplemented("copyToHost");}
 	virtual std::string name() const {return "BaseBackend";}
@@ -40,10 +71,20 @@ struct ETALER_EXPORT Backend : public std::enable_shared_from_this<Backend>
 	virtual void sortSynapse(TensorImpl* connections, TensorImpl* permeances) {throw notImplemented("sortSynapse");}
 	virtual std::shared_ptr<TensorImpl> burst(const TensorImpl* x, const TensorImpl* s) {throw notImplemented("burst");}
 	virtual std::shared_ptr<TensorImpl> reverseBurst(const TensorImpl* x) {throw notImplemented("reverseBurst");}
+	// Runs `steps` TemporalMemory inference steps, feeding the predictive cells back as the next active cells.
+	// x[..., columns, cells] are the active cells of one or more independent streams sharing the synapses. Returns the
+	// predicted columns of every step in a Bool tensor of shape {steps}+x.shape() without the cells axis
+	virtual std::shared_ptr<TensorImpl> rollout(const TensorImpl* x, const TensorImpl* connections, const TensorImpl* permeances
+		, float connected_permeance, size_t active_threshold, size_t steps) {throw notImplemented("rollout");}
 	virtual void growSynapses(const TensorImpl* x, const TensorImpl* y, TensorImpl* connections
 		, TensorImpl* permeances, float initial_perm) {throw notImplemented("growSynapses");}
 	virtual void decaySynapses(TensorImpl* connections, TensorImpl* permeances, float threshold) {throw notImplemented("decaySynapses");}
 	virtual std::shared_ptr<TensorImpl> from(const TensorImpl* x) {throw notImplemented("from");}
+	// Number of on bits shared by each pair of SDRs in a[..., bits] and b[..., bits]
+	virtual std::shared_ptr<TensorImpl> overlap(const TensorImpl* a, const TensorImpl* b) {throw notImplemented("overlap");}
+	// The indices of and the overlaps with the k SDRs in b overlapping the most with each SDR in a
+	virtual std::pair<std::shared_ptr<TensorImpl>, std::shared_ptr<TensorImpl>> topKOverlap(const TensorImpl* a, const TensorImpl* b
+		, size_t k, size_t min_overlap) {throw notImplemented("topKOverlap");}
 
 	virtual std::shared_ptr<TensorImpl> realize(const TensorImpl* x) {throw notImplemented("realize");}
 	virtual void assign(TensorImpl* dest, const TensorImpl* src) {throw notImplemented("assign");}
@@ -67,8 +108,22 @@ struct ETALER_EXPORT Backend : public std::enable_shared_from_this<Backend>
 	virtual std::shared_ptr<TensorImpl> lesser(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("lesster");}
 	virtual std::shared_ptr<TensorImpl> logical_and(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("and");}
 	virtual std::shared_ptr<TensorImpl> logical_or(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("or");}
+	virtual std::shared_ptr<TensorImpl> lesser_equal(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("lesser_equal");}
+	virtual std::shared_ptr<TensorImpl> greater_equal(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("greater_equal");}
+	virtual std::shared_ptr<TensorImpl> not_equal(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("not_equal");}
+	virtual std::shared_ptr<TensorImpl> logical_xor(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("xor");}
+	virtual std::shared_ptr<TensorImpl> minimum(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("minimum");}
+	virtual std::shared_ptr<TensorImpl> maximum(const TensorImpl* x1, const TensorImpl* x2) { throw notImplemented("maximum");}
+
+	//Ternary operations
+	virtual std::shared_ptr<TensorImpl> where(const TensorImpl* condition, const TensorImpl* x, const TensorImpl* y) { throw notImplemented("where");}
+	virtual std::shared_ptr<TensorImpl> clamp(const TensorImpl* x, const TensorImpl* min, const TensorImpl* max) { throw notImplemented("clamp");}
 
 	inline EtError notImplemented(std::string func) const { return EtError(func + " not implemented on backend: " + name()); }
+
+	// Set by MemoryPlanner while a planned step is running. Backends should
+	// let the planner allocate the tensors when this is not null
+	MemoryPlanner* memory_planner_ = nullptr;
 };
 
 }
@@ -0,0 +1,265 @@
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <Etaler/Backends/CPUParallel.hpp>
+
+using namespace et;
+
+using Codec = CompressedTensor::Codec;
+
+// Values per chunk. Big enough to amortize the per chunk work, small enough to spread over the threads
+static const size_t target_chunk_size = 1<<16;
+
+static void writeVarint(std::vector<uint8_t>& out, uint64_t v)
+{
+	while(v >= 0x80) {
+		out.push_back(uint8_t(v) | 0x80);
+		v >>= 7;
+	}
+	out.push_back(uint8_t(v));
+}
+
+static uint64_t readVarint(const uint8_t*& ptr, const uint8_t* end)
+{
+	uint64_t v = 0;
+	for(int shift=0;ptr!=end && shift<64;shift+=7) {
+		uint8_t b = *ptr++;
+		v |= uint64_t(b&0x7f) << shift;
+		if((b&0x80) == 0)
+			return v;
+	}
+	throw EtError("Corrupted compressed tensor");
+}
+
+// The value a quantized level decodes to. Rounded to half if that is what the tensor is decompressed to
+static float dequantize(const CompressedTensor& t, uint32_t q)
+{
+	float v = t.min + q*((t.max-t.min)/float((1u<<t.bits)-1));
+	if(t.dtype == DType::Half)
+		return float(half(v));
+	return v;
+}
+
+static void encodeChunk(const CompressedTensor& t, const uint8_t* src, size_t begin, size_t end, std::vector<uint8_t>& out)
+{
+	if(t.codec == Codec::Delta) {
+		auto values = (const int32_t*)src;
+		out.reserve((end-begin)*2);
+		for(size_t row=begin;row<end;row+=t.row_size) {
+			int64_t prev = 0;
+			for(size_t i=row;i<std::min(row+t.row_size, end);i++) {
+				int64_t d = int64_t(values[i]) - prev;
+				writeVarint(out, (uint64_t(d) << 1) ^ uint64_t(d >> 63));
+				prev = values[i];
+			}
+		}
+	}
+	else if(t.codec == Codec::Bits) {
+		auto values = (const bool*)src;
+		out.resize((end-begin+7)/8);
+		for(size_t i=begin;i<end;i++)
+			out[(i-begin)/8] |= uint8_t(values[i]) << ((i-begin)%8);
+	}
+	else if(t.codec == Codec::Quantized) {
+		auto values = (const float*)src;
+		uint32_t levels = (1u<<t.bits)-1;
+		float scale = t.max == t.min ? 0 : float(levels)/(t.max-t.min);
+		size_t value_size = t.bits/8;
+		out.resize((end-begin)*value_size);
+		for(size_t i=begin;i<end;i++) {
+			uint32_t q = (uint32_t)std::lround(std::clamp((values[i]-t.min)*scale, 0.f, float(levels)));
+			// Rounding to the nearest level can cross the threshold. The next level towards the value is on its side
+			if(t.threshold.has_value()) {
+				bool above = values[i] > *t.threshold;
+				while(above == false && q != 0 && dequantize(t, q) > *t.threshold)
+					q--;
+				while(above && q != levels && dequantize(t, q) <= *t.threshold)
+					q++;
+			}
+			memcpy(out.data()+(i-begin)*value_size, &q, value_size); // Little endian
+		}
+	}
+	else {
+		size_t value_size = dtypeToSize(t.dtype);
+		out.assign(src+begin*value_size, src+end*value_size);
+	}
+}
+
+static void decodeChunk(const CompressedTensor& t, const uint8_t* ptr, const uint8_t* ptr_end, size_t begin, size_t end, uint8_t* dest)
+{
+	if(t.codec == Codec::Delta) {
+		auto values = (int32_t*)dest;
+		for(size_t row=begin;row<end;row+=t.row_size) {
+			int64_t prev = 0;
+			for(size_t i=row;i<std::min(row+t.row_size, end);i++) {
+				uint64_t z = readVarint(ptr, ptr_end);
+				prev += int64_t(z >> 1) ^ -int64_t(z & 1);
+				values[i] = int32_t(prev);
+			}
+		}
+	}
+	else if(t.codec == Codec::Bits) {
+		et_check(size_t(ptr_end-ptr) == (end-begin+7)/8, "Corrupted compressed tensor");
+		auto values = (bool*)dest;
+		for(size_t i=begin;i<end;i++)
+			values[i] = (ptr[(i-begin)/8] >> ((i-begin)%8)) & 1;
+	}
+	else if(t.codec == Codec::Quantized) {
+		size_t value_size = t.bits/8;
+		et_check(size_t(ptr_end-ptr) == (end-begin)*value_size, "Corrupted compressed tensor");
+		auto values = (float*)dest;
+		for(size_t i=begin;i<end;i++) {
+			uint32_t q = 0;
+			memcpy(&q, ptr+(i-begin)*value_size, value_size);
+			values[i] = dequantize(t, q);
+		}
+	}
+	else {
+		size_t value_size = dtypeToSize(t.dtype);
+		et_check(size_t(ptr_end-ptr) == (end-begin)*value_size, "Corrupted compressed tensor");
+		memcpy(dest+begin*value_size, ptr, ptr_end-ptr);
+	}
+}
+
+CompressedTensor et::compressTensor(const Tensor& t, int bits, std::optional<float> threshold)
+{
+	et_check(bits == 8 || bits == 16 || bits == 32, "Can only quantize to 8, 16 or 32 bits");
+	CompressedTensor res;
+	if(t.has_value() == false)
+		return res;
+
+	res.shape = t.shape();
+	res.dtype = t.dtype();
+	res.bits = bits;
+	res.threshold = threshold;
+	Tensor src = t.pimpl()->isplain() ? t : t.realize();
+	if(res.dtype == DType::Int32)
+		res.codec = Codec::Delta;
+	else if(res.dtype == DType::Bool)
+		res.codec = Codec::Bits;
+	else if((res.dtype == DType::Float || res.dtype == DType::Half) && bits < 32) {
+		res.codec = Codec::Quantized;
+		src = src.cast(DType::Float);
+	}
+	else
+		res.codec = Codec::Raw;
+
+	size_t n = src.size();
+	std::vector<uint8_t> raw(n*dtypeToSize(src.dtype()));
+	src.backend()->copyToHost(src.pimpl(), raw.data());
+
+	if(res.codec == Codec::Quantized && n != 0) {
+		auto values = (const float*)raw.data();
+		auto [min, max] = std::minmax_element(values, values+n);
+		res.min = *min;
+		res.max = *max;
+	}
+
+	// Chunks hold whole rows unless the rows are longer than a chunk. The delta coding restarts at every row and
+	// every chunk. Bools are packed a byte at a time
+	res.row_size = std::max<size_t>(res.shape.size() == 0 ? 1 : res.shape.back(), 1);
+	res.chunk_size = res.row_size >= target_chunk_size ? target_chunk_size : target_chunk_size/res.row_size*res.row_size;
+	if(res.codec == Codec::Bits)
+		res.chunk_size = (res.chunk_size+7)/8*8;
+	size_t num_chunks = (n+res.chunk_size-1)/res.chunk_size;
+
+	std::vector<std::vector<uint8_t>> chunks(num_chunks);
+	parallelFor(size_t(0), num_chunks, [&](size_t i) {
+		encodeChunk(res, raw.data(), i*res.chunk_size, std::min((i+1)*res.chunk_size, n), chunks[i]);
+	});
+
+	res.chunk_offsets.push_back(0);
+	for(const auto& c : chunks)
+		res.chunk_offsets.push_back(res.chunk_offsets.back()+c.size());
+	res.data.resize(res.chunk_offsets.back());
+	for(size_t i=0;i<num_chunks;i++)
+		std::copy(chunks[i].begin(), chunks[i].end(), res.data.begin()+res.chunk_offsets[i]);
+	return res;
+}
+
+Tensor et::decompressTensor(const CompressedTensor& t, Backend* backend)
+{
+	if(t.dtype == DType::Unknown)
+		return Tensor();
+
+	size_t n = t.shape.volume();
+	DType decoded_type = t.codec == Codec::Quantized ? DType::Float : t.dtype;
+	size_t num_chunks = t.chunk_offsets.size()-1;
+	et_check(t.chunk_offsets.size() >= 1 && num_chunks == (n+t.chunk_size-1)/t.chunk_size, "Corrupted compressed tensor");
+
+	std::vector<uint8_t> raw(n*dtypeToSize(decoded_type));
+	parallelFor(size_t(0), num_chunks, [&](size_t i) {
+		decodeChunk(t, t.data.data()+t.chunk_offsets[i], t.data.data()+t.chunk_offsets[i+1]
+			, i*t.chunk_size, std::min((i+1)*t.chunk_size, n), raw.data());
+	});
+
+	Tensor res = backend->createTensor(t.shape, decoded_type, raw.data());
+	if(res.dtype() != t.dtype)
+		return res.cast(t.dtype);
+	return res;
+}
+
+StateDict et::compressState(const StateDict& states, CompressionOptions options)
+{
+	StateDict res;
+	// Quantized permanences stay on the same side of the connected permanence, so the connected synapses don't change
+	std::optional<float> threshold;
+	if(auto it = states.find("connected_permanence"); it != states.end() && it->second.type() == typeid(float))
+		threshold = std::any_cast<float>(it->second);
+
+	for(const auto& [key, value] : states) {
+		int bits = key == "permanences" ? options.permanence_bits : 32;
+		if(value.type() == typeid(Tensor))
+			res[key] = compressTensor(std::any_cast<const Tensor&>(value), bits, threshold);
+		else if(value.type() == typeid(std::vector<Tensor>)) {
+			std::vector<CompressedTensor> tensors;
+			for(const auto& t : std::any_cast<const std::vector<Tensor>&>(value))
+				tensors.push_back(compressTensor(t, bits, threshold));
+			res[key] = std::move(tensors);
+		}
+		else if(value.type() == typeid(StateDict))
+			res[key] = compressState(std::any_cast<const StateDict&>(value), options);
+		else
+			res[key] = value;
+	}
+	return res;
+}
+
+StateDict et::decompressState(const StateDict& states, Backend* backend)
+{
+	StateDict res;
+	for(const auto& [key, value] : states) {
+		if(value.type() == typeid(CompressedTensor))
+			res[key] = decompressTensor(std::any_cast<const CompressedTensor&>(value), backend);
+		else if(value.type() == typeid(std::vector<CompressedTensor>)) {
+			std::vector<Tensor> tensors;
+			for(const auto& t : std::any_cast<const std::vector<CompressedTensor>&>(value))
+				tensors.push_back(decompressTensor(t, backend));
+			res[key] = std::move(tensors);
+		}
+		else if(value.type() == typeid(StateDict))
+			res[key] = decompressState(std::any_cast<const StateDict&>(value), backend);
+		else
+			res[key] = value;
+	}
+	return res;
+}
+
+size_t et::compressedMemoryUsage(const StateDict& states)
+{
+	size_t bytes = 0;
+	for(const auto& [key, value] : states) {
+		if(value.type() == typeid(CompressedTensor))
+			bytes += std::any_cast<const CompressedTensor&>(value).bytes();
+		else if(value.type() == typeid(std::vector<CompressedTensor>)) {
+			for(const auto& t : std::any_cast<const std::vector<CompressedTensor>&>(value))
+				bytes += t.bytes();
+		}
+		else if(value.type() == typeid(StateDict))
+			bytes += compressedMemoryUsage(std::any_cast<const StateDict&>(value));
+	}
+	return bytes;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Tensor.hpp"
+#include "Serialize.hpp"
+#include "DefaultBackend.hpp"
+
+#include <vector>
+#include <optional>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// A tensor compressed in host memory. The tensor is split into chunks (of whole rows if they fit) that are coded
+// independently, so they can be decoded in parallel.
+//	Int32: each row is delta coded, then zigzag and varint coded. Sorted synapse indices take 1-2 bytes each
+//	Bool: 8 values per byte
+//	Float/Half with bits < 32: uniformly quantized between the min and the max of the tensor
+//	Otherwise the raw bytes
+struct ETALER_EXPORT CompressedTensor
+{
+	enum class Codec {Raw, Delta, Bits, Quantized};
+
+	size_t bytes() const {return data.size() + chunk_offsets.size()*sizeof(size_t);}
+
+	Shape shape;
+	DType dtype = DType::Unknown;
+	Codec codec = Codec::Raw;
+	int bits = 32; // Bits per value of quantized tensors
+	float min = 0;
+	float max = 0;
+	std::optional<float> threshold; // Quantized values are kept on the same side of it
+	size_t row_size = 1;
+	size_t chunk_size = 0; // Values per chunk. A multiple of row_size
+	std::vector<size_t> chunk_offsets; // Where each chunk starts in data, and the end of the last one
+	std::vector<uint8_t> data;
+};
+
+struct CompressionOptions
+{
+	// Bits per permanence: 8, 16 or 32 (lossless). Only the tensors stored as "permanences" are quantized. 8 bits
+	// keeps them within 1/255 of their range, well below a typical permanence increment. They stay on the same side
+	// of "connected_permanence", so the outputs of the decompressed model don't change
+	int permanence_bits = 8;
+};
+
+// Quantized values are kept on the same side of threshold, if given (ex: the connected permanence)
+ETALER_EXPORT CompressedTensor compressTensor(const Tensor& t, int bits=32, std::optional<float> threshold=std::nullopt);
+ETALER_EXPORT Tensor decompressTensor(const CompressedTensor& t, Backend* backend=defaultBackend());
+
+// Compresses the tensors of a StateDict (ex: from SpatialPooler::states()). Other values are kept as they are
+ETALER_EXPORT StateDict compressState(const StateDict& states, CompressionOptions options=CompressionOptions());
+ETALER_EXPORT StateDict decompressState(const StateDict& states, Backend* backend=defaultBackend());
+// Bytes used by the compressed tensors in a StateDict
+ETALER_EXPORT size_t compressedMemoryUsage(const StateDict& states);
+
+}
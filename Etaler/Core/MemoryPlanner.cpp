@@ -0,0 +1,217 @@
+#include "MemoryPlanner.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace et;
+
+static size_t alignTo(size_t v, size_t alignment)
+{
+	return (v+alignment-1)/alignment*alignment;
+}
+
+static bool isLifetimeOverlapping(const MemoryBlock& a, const MemoryBlock& b)
+{
+	return a.alloc_time < b.free_time && b.alloc_time < a.free_time;
+}
+
+size_t et::planMemoryLayout(std::vector<MemoryBlock>& blocks, size_t alignment)
+{
+	et_check(alignment != 0, "Alignment cannot be 0");
+
+	// Greedy by size. Placing the large blocks first leaves the small gaps to the small blocks
+	std::vector<size_t> order(blocks.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return blocks[a].size > blocks[b].size;
+	});
+
+	size_t total = 0;
+	std::vector<size_t> placed;
+	placed.reserve(blocks.size());
+	for(size_t idx : order) {
+		MemoryBlock& block = blocks[idx];
+
+		// Collect the already placed blocks that are alive at the same time
+		std::vector<const MemoryBlock*> conflicts;
+		for(size_t p : placed) {
+			if(isLifetimeOverlapping(blocks[p], block))
+				conflicts.push_back(&blocks[p]);
+		}
+		std::sort(conflicts.begin(), conflicts.end(), [](auto a, auto b){return a->offset < b->offset;});
+
+		// Find the lowest gap that fits
+		size_t offset = 0;
+		for(const MemoryBlock* c : conflicts) {
+			if(offset + block.size <= c->offset)
+				break;
+			offset = std::max(offset, alignTo(c->offset+c->size, alignment));
+		}
+
+		block.offset = offset;
+		total = std::max(total, offset+block.size);
+		placed.push_back(idx);
+	}
+	return total;
+}
+
+MemoryPlanner::MemoryPlanner(Backend* backend, size_t alignment)
+	: backend_(backend), alignment_(alignment)
+{
+	et_check(backend != nullptr);
+	et_check(alignment != 0, "Alignment cannot be 0");
+}
+
+MemoryPlanner::~MemoryPlanner()
+{
+	if(backend_->memory_planner_ == this)
+		backend_->memory_planner_ = nullptr;
+}
+
+void MemoryPlanner::beginStep()
+{
+	et_check(in_step_ == false, "beginStep() called twice without calling endStep()");
+	et_check(backend_->memory_planner_ == nullptr, "Another MemoryPlanner is already running on backend " + backend_->name());
+
+	cursor_ = 0;
+	diverged_ = false;
+	recording_ = !planned();
+	if(recording_)
+		requests_.clear();
+
+	in_step_ = true;
+	backend_->memory_planner_ = this;
+}
+
+void MemoryPlanner::endStep()
+{
+	et_check(in_step_ == true, "endStep() called without calling beginStep()");
+	backend_->memory_planner_ = nullptr;
+	in_step_ = false;
+
+	if(recording_) {
+		updateLifetimes(cursor_);
+		makePlan();
+		recording_ = false;
+	}
+	// The step did not do what we recorded. Record again in the next step
+	else if(diverged_ || cursor_ != requests_.size())
+		reset();
+}
+
+void MemoryPlanner::reset()
+{
+	// Tensors still using the arena keeps it alive
+	arena_ = nullptr;
+	requests_.clear();
+	planned_memory_ = 0;
+	requested_memory_ = 0;
+}
+
+size_t MemoryPlanner::numPlannedTensors() const
+{
+	return std::count_if(requests_.begin(), requests_.end(), [](const auto& r){return r.planned;});
+}
+
+std::shared_ptr<TensorImpl> MemoryPlanner::createUnplanned(const Shape& shape, DType dtype)
+{
+	// Detach from the backend so it allocates normally
+	MemoryPlanner* planner = backend_->memory_planner_;
+	backend_->memory_planner_ = nullptr;
+	std::shared_ptr<TensorImpl> res;
+	try {
+		res = backend_->createTensor(shape, dtype);
+	}
+	catch(...) {
+		backend_->memory_planner_ = planner;
+		throw;
+	}
+	backend_->memory_planner_ = planner;
+	return res;
+}
+
+void MemoryPlanner::updateLifetimes(size_t time)
+{
+	for(auto& r : requests_) {
+		if(r.block.free_time == std::numeric_limits<size_t>::max() && r.buffer.expired())
+			r.block.free_time = time;
+	}
+}
+
+void MemoryPlanner::makePlan()
+{
+	std::vector<MemoryBlock> blocks;
+	std::vector<size_t> index;
+	for(size_t i=0;i<requests_.size();i++) {
+		auto& r = requests_[i];
+		// Tensors outliving the step cannot share memory with the next step
+		r.planned = r.block.free_time != std::numeric_limits<size_t>::max();
+		if(r.planned == false)
+			continue;
+		blocks.push_back(r.block);
+		index.push_back(i);
+	}
+
+	if(blocks.size() == 0)
+		return;
+
+	planned_memory_ = planMemoryLayout(blocks, alignment_);
+	requested_memory_ = std::accumulate(blocks.begin(), blocks.end(), size_t(0), [](size_t a, const auto& b){return a+b.size;});
+	for(size_t i=0;i<blocks.size();i++)
+		requests_[index[i]].block = blocks[i];
+
+	arena_ = createUnplanned({intmax_t(planned_memory_)}, DType::Bool);
+}
+
+bool MemoryPlanner::isMemoryInUse(size_t index) const
+{
+	const MemoryBlock& block = requests_[index].block;
+	for(size_t i=0;i<requests_.size();i++) {
+		const auto& r = requests_[i];
+		if(r.planned == false || r.buffer.expired())
+			continue;
+		if(r.block.offset < block.offset+block.size && block.offset < r.block.offset+r.block.size)
+			return true;
+	}
+	return false;
+}
+
+std::shared_ptr<TensorImpl> MemoryPlanner::allocate(const Shape& shape, DType dtype)
+{
+	et_assert(in_step_);
+	size_t index = cursor_++;
+
+	if(recording_) {
+		// Tensors released before this point can share memory with the new one
+		updateLifetimes(index);
+		auto res = createUnplanned(shape, dtype);
+		Request r;
+		r.shape = shape;
+		r.dtype = dtype;
+		r.buffer = res->buffer();
+		r.block.size = shape.volume()*dtypeToSize(dtype);
+		r.block.alloc_time = index;
+		requests_.push_back(std::move(r));
+		return res;
+	}
+
+	if(index >= requests_.size() || requests_[index].shape != shape || requests_[index].dtype != dtype) {
+		diverged_ = true;
+		num_fallbacks_ += 1;
+		return createUnplanned(shape, dtype);
+	}
+
+	auto& r = requests_[index];
+	if(r.planned == false)
+		return createUnplanned(shape, dtype);
+
+	// Someone is still holding a tensor that lives in the same memory. Don't overwrite it
+	if(isMemoryInUse(index)) {
+		num_fallbacks_ += 1;
+		return createUnplanned(shape, dtype);
+	}
+
+	auto res = backend_->aliasTensor(arena_.get(), r.block.offset, shape, dtype);
+	r.buffer = res->buffer();
+	return res;
+}
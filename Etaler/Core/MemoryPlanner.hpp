@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Shape.hpp"
+#include "DType.hpp"
+#include "Backend.hpp"
+#include "TensorImpl.hpp"
+#include "DefaultBackend.hpp"
+
+#include <memory>
+#include <vector>
+#include <limits>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// A chunk of memory that is alive in the time range [alloc_time, free_time)
+struct MemoryBlock
+{
+	size_t size = 0;
+	size_t offset = 0;
+	size_t alloc_time = 0;
+	size_t free_time = std::numeric_limits<size_t>::max();
+};
+
+// Assigns an offset to each block so blocks that are alive at the same time never overlap.
+// Returns the total amount of memory needed to hold all the blocks.
+size_t ETALER_EXPORT planMemoryLayout(std::vector<MemoryBlock>& blocks, size_t alignment=1);
+
+// MemoryPlanner records the tensors allocated during a step (ex: SpatialPooler::compute + learn), works out
+// how long each of them lives and then packs all the temporary tensors into a single arena. The following
+// steps are then served from the arena instead of allocating new buffers.
+// Tensors that are still alive at the end of the recorded step (results and states) are allocated normally.
+//
+// Usage:
+//	MemoryPlanner planner(backend);
+//	for(...) {
+//		planner.beginStep();
+//		Tensor y = sp.compute(x);
+//		sp.learn(x, y);
+//		planner.endStep();
+//	}
+struct ETALER_EXPORT MemoryPlanner
+{
+	MemoryPlanner(Backend* backend=defaultBackend(), size_t alignment=512);
+	~MemoryPlanner();
+	MemoryPlanner(const MemoryPlanner&) = delete;
+	MemoryPlanner& operator=(const MemoryPlanner&) = delete;
+
+	void beginStep();
+	void endStep();
+
+	// Called by the backend when a tensor is requested while a step is running
+	std::shared_ptr<TensorImpl> allocate(const Shape& shape, DType dtype);
+
+	// Drops the current plan. The next step will be recorded again
+	void reset();
+
+	bool planned() const {return arena_ != nullptr;}
+	// Size of the arena. i.e. the peak memory used by the planned tensors
+	size_t plannedMemory() const {return planned_memory_;}
+	// Memory needed by the planned tensors if they don't share memory
+	size_t requestedMemory() const {return requested_memory_;}
+	size_t numPlannedTensors() const;
+	// Number of times a planned tensor is allocated normally because the step diverged from the recording
+	size_t numFallbacks() const {return num_fallbacks_;}
+
+protected:
+	struct Request
+	{
+		Shape shape;
+		DType dtype;
+		std::weak_ptr<BufferImpl> buffer;
+		MemoryBlock block;
+		bool planned = false;
+	};
+
+	std::shared_ptr<TensorImpl> createUnplanned(const Shape& shape, DType dtype);
+	void updateLifetimes(size_t time);
+	void makePlan();
+	bool isMemoryInUse(size_t index) const;
+
+	Backend* backend_;
+	size_t alignment_;
+	std::vector<Request> requests_;
+	std::shared_ptr<TensorImpl> arena_;
+	size_t cursor_ = 0;
+	bool in_step_ = false;
+	bool recording_ = false;
+	bool diverged_ = false;
+	size_t planned_memory_ = 0;
+	size_t requested_memory_ = 0;
+	size_t num_fallbacks_ = 0;
+};
+
+}
@@ -0,0 +1,157 @@
+#include "Priority.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace et;
+
+static thread_local Priority g_priority = Priority::Normal;
+
+// The latency stats are recorded per thread so kernels finishing together don't contend on a lock or a cache line.
+// latencyStats() merges the shards of the live threads and of the ones that exited
+static const size_t num_buckets = std::tuple_size_v<decltype(LatencyStats::histogram)>;
+
+struct LatencyShard
+{
+	std::atomic<uint64_t> count{0};
+	std::atomic<uint64_t> total_ns{0};
+	std::atomic<uint64_t> max_ns{0};
+	std::array<std::atomic<uint64_t>, num_buckets> histogram{};
+
+	// Only called by the owning thread. The counters are atomic so they can be read and reset by others
+	void record(uint64_t ns, size_t bucket)
+	{
+		count.fetch_add(1, std::memory_order_relaxed);
+		total_ns.fetch_add(ns, std::memory_order_relaxed);
+		if(ns > max_ns.load(std::memory_order_relaxed))
+			max_ns.store(ns, std::memory_order_relaxed);
+		histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void reset()
+	{
+		count.store(0, std::memory_order_relaxed);
+		total_ns.store(0, std::memory_order_relaxed);
+		max_ns.store(0, std::memory_order_relaxed);
+		for(auto& h : histogram)
+			h.store(0, std::memory_order_relaxed);
+	}
+};
+
+using ThreadShards = std::array<LatencyShard, 3>; // One per priority
+
+struct ShardRegistry
+{
+	std::mutex mutex;
+	std::vector<ThreadShards*> live;
+	ThreadShards retired; // Stats of the threads that exited
+};
+
+static ShardRegistry& registry()
+{
+	// Never destroyed, threads may exit after the static destructors ran
+	static ShardRegistry* r = new ShardRegistry;
+	return *r;
+}
+
+struct ThreadShardsHandle
+{
+	ThreadShardsHandle()
+	{
+		std::lock_guard lock(registry().mutex);
+		registry().live.push_back(&shards);
+	}
+
+	~ThreadShardsHandle()
+	{
+		ShardRegistry& r = registry();
+		std::lock_guard lock(r.mutex);
+		for(size_t p=0;p<shards.size();p++) {
+			const LatencyShard& s = shards[p];
+			LatencyShard& dest = r.retired[p];
+			dest.count.fetch_add(s.count.load(), std::memory_order_relaxed);
+			dest.total_ns.fetch_add(s.total_ns.load(), std::memory_order_relaxed);
+			dest.max_ns.store(std::max(dest.max_ns.load(), s.max_ns.load()), std::memory_order_relaxed);
+			for(size_t i=0;i<num_buckets;i++)
+				dest.histogram[i].fetch_add(s.histogram[i].load(), std::memory_order_relaxed);
+		}
+		r.live.erase(std::find(r.live.begin(), r.live.end(), &shards));
+	}
+
+	ThreadShards shards;
+};
+
+static thread_local ThreadShardsHandle g_shards;
+
+Priority et::currentPriority()
+{
+	return g_priority;
+}
+
+PriorityScope::PriorityScope(Priority priority)
+	: previous_(g_priority)
+{
+	g_priority = priority;
+}
+
+PriorityScope::~PriorityScope()
+{
+	g_priority = previous_;
+}
+
+double LatencyStats::percentile(double q) const
+{
+	size_t target = (size_t)std::ceil(q*count);
+	size_t seen = 0;
+	for(size_t i=0;i<histogram.size();i++) {
+		seen += histogram[i];
+		if(seen >= target && seen != 0)
+			return std::min(std::ldexp(1e-6, i+1), max);
+	}
+	return max;
+}
+
+LatencyStats et::latencyStats(Priority priority)
+{
+	LatencyStats res;
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+	auto merge = [&](const LatencyShard& s) {
+		res.count += s.count.load(std::memory_order_relaxed);
+		total_ns += s.total_ns.load(std::memory_order_relaxed);
+		max_ns = std::max(max_ns, s.max_ns.load(std::memory_order_relaxed));
+		for(size_t i=0;i<num_buckets;i++)
+			res.histogram[i] += s.histogram[i].load(std::memory_order_relaxed);
+	};
+
+	ShardRegistry& r = registry();
+	std::lock_guard lock(r.mutex);
+	for(const auto* shards : r.live)
+		merge((*shards)[(size_t)priority]);
+	merge(r.retired[(size_t)priority]);
+	res.total = total_ns*1e-9;
+	res.max = max_ns*1e-9;
+	return res;
+}
+
+void et::resetLatencyStats()
+{
+	ShardRegistry& r = registry();
+	std::lock_guard lock(r.mutex);
+	for(auto* shards : r.live) {
+		for(auto& s : *shards)
+			s.reset();
+	}
+	for(auto& s : r.retired)
+		s.reset();
+}
+
+void et::recordLatency(Priority priority, double seconds)
+{
+	double us = seconds*1e6;
+	size_t bucket = us < 2 ? 0 : std::min((size_t)std::log2(us), num_buckets-1);
+	g_shards.shards[(size_t)priority].record((uint64_t)std::max(seconds*1e9, 0.0), bucket);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// Priority class of the kernels launched by a thread. On the CPU backend, Latency kernels run in a high priority TBB
+// arena and Batch kernels in a low priority one, so idle worker threads pick up latency critical work before batch
+// work (ex: inference vs. background learning or checkpointing). Running tasks are not interrupted.
+enum class Priority {Batch, Normal, Latency};
+
+// The priority of the calling thread. Normal unless set by a PriorityScope
+ETALER_EXPORT Priority currentPriority();
+
+// Sets the priority of the calling thread until the scope ends.
+//
+// Usage:
+//	std::thread learner([&](){
+//		PriorityScope scope(Priority::Batch);
+//		sp.learn(x, y);
+//	});
+struct ETALER_EXPORT PriorityScope
+{
+	PriorityScope(Priority priority);
+	~PriorityScope();
+	PriorityScope(const PriorityScope&) = delete;
+	PriorityScope& operator=(const PriorityScope&) = delete;
+
+protected:
+	Priority previous_;
+};
+
+// Time in seconds the kernels of a priority class took from being launched to finishing, waiting for worker threads
+// included
+struct ETALER_EXPORT LatencyStats
+{
+	double mean() const {return count == 0 ? 0 : total/count;}
+	// Upper bound of the q-th quantile (ex: 0.99), within a factor of 2
+	double percentile(double q) const;
+
+	size_t count = 0;
+	double total = 0;
+	double max = 0;
+	std::array<size_t, 32> histogram = {}; // histogram[i] counts the kernels taking [2^i, 2^(i+1)) microseconds. 0 goes to the first bucket
+};
+
+ETALER_EXPORT LatencyStats latencyStats(Priority priority);
+ETALER_EXPORT void resetLatencyStats();
+// Used by the backends to report the latency of a kernel
+ETALER_EXPORT void recordLatency(Priority priority, double seconds);
+
+}
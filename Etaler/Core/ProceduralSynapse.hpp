@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "Error.hpp"
+
+namespace et
+{
+
+// Generates the connections of procedural synapses on the fly instead of storing them. For a given seed and cell,
+// synapse j connects to permute(j) where permute is a seeded permutation of [0, input_size) (a 4 round Feistel
+// network with cycle walking). So the synapses of a cell never connect to the same input twice.
+// The same function is implemented in kernels/procedural.cl. Keep them in sync.
+struct ProceduralPool
+{
+	ProceduralPool(size_t input_size, uint64_t seed)
+		: input_size_(input_size), seed_(uint32_t(seed) ^ uint32_t(seed >> 32))
+	{
+		et_check(input_size > 0 && input_size < (size_t(1) << 31), "Input size of procedural synapses must be in (0, 2^31)");
+		uint32_t bits = 0;
+		while((uint32_t(1) << bits) < input_size_)
+			bits++;
+		half_bits_ = (bits+1)/2;
+		mask_ = (uint32_t(1) << half_bits_) - 1;
+	}
+
+	static uint32_t mix(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	uint32_t cellKey(size_t cell) const { return mix(seed_ ^ mix(uint32_t(cell))); }
+
+	// The input the synapse is connected to. synapse must be smaller than input_size
+	uint32_t connection(uint32_t cell_key, uint32_t synapse) const
+	{
+		uint32_t v = synapse;
+		do {
+			uint32_t l = v >> half_bits_;
+			uint32_t r = v & mask_;
+			for(uint32_t i=0;i<4;i++) {
+				uint32_t t = l ^ (mix(r ^ cell_key ^ ((i+1)*0x9e3779b9u)) & mask_);
+				l = r;
+				r = t;
+			}
+			v = (l << half_bits_) | r;
+		} while(v >= input_size_);
+		return v;
+	}
+
+	uint32_t inputSize() const { return input_size_; }
+	uint32_t halfBits() const { return half_bits_; }
+	uint32_t mask() const { return mask_; }
+	uint32_t seed() const { return seed_; }
+
+protected:
+	uint32_t input_size_;
+	uint32_t seed_;
+	uint32_t half_bits_;
+	uint32_t mask_;
+};
+
+}
@@ -0,0 +1,39 @@
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+
+using namespace et;
+
+RingBuffer::RingBuffer(size_t capacity, const Shape& shape, DType dtype, Backend* backend)
+	: capacity_(capacity), shape_(shape)
+{
+	et_check(capacity != 0, "A RingBuffer must have a capacity of at least 1");
+	buffer_ = zeros(Shape({intmax_t(2*capacity)}) + shape, dtype, backend);
+}
+
+void RingBuffer::push(const Tensor& x)
+{
+	et_check(x.shape() == shape_, "Expecting a tensor of shape " + to_string(shape_) + ", got " + to_string(x.shape()));
+	et_check(x.backend() == backend(), "Expecting a tensor on backend " + backend()->name() + ", got " + x.backend()->name());
+	const Tensor& value = x.dtype() == dtype() ? x : x.cast(dtype());
+
+	// Entry i lives in rows i%capacity and i%capacity+capacity. So the last n entries are the rows
+	// [head+capacity-n, head+capacity) whatever head is
+	buffer_.view({head_}).assign(value);
+	buffer_.view({head_+capacity_}).assign(value);
+	head_ = (head_+1)%capacity_;
+	size_ = std::min(size_+1, capacity_);
+}
+
+Tensor RingBuffer::window(size_t n) const
+{
+	n = std::min(n, size_);
+	size_t end = head_+capacity_;
+	return buffer_.view({range(end-n, end)});
+}
+
+Tensor RingBuffer::latest(size_t i) const
+{
+	et_check(i < size_, "Cannot get entry " + std::to_string(i) + " of a RingBuffer holding " + std::to_string(size_));
+	return buffer_.view({head_+capacity_-1-i});
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Tensor.hpp"
+#include "DefaultBackend.hpp"
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// A fixed capacity history of tensors (ex: the last N SDRs for a multi step classifier, an anomaly window or the
+// past states of a TM). Pushing is O(1) and copies only the new tensor. The history is stored twice in a buffer
+// of shape [2*capacity, shape...] and each push writes both copies, so the last n entries are always a contiguous
+// range of rows. window() returns them oldest first as a view of the buffer, without copying. The window can be
+// passed as the batch to ops like batchCellActivity() and overlap().
+//
+// Usage:
+//	RingBuffer history(16, {2048});
+//	for(...) {
+//		history.push(sp.compute(x));
+//		Tensor overlaps = overlap(history.window(), y); // [history.size()]
+//	}
+//
+// The views share the buffer. A push overwrites the oldest entry of the views returned before it, copy() the
+// window to keep it
+struct ETALER_EXPORT RingBuffer
+{
+	RingBuffer(size_t capacity, const Shape& shape, DType dtype=DType::Bool, Backend* backend=defaultBackend());
+
+	// Appends x, dropping the oldest entry when full. x is casted to dtype() if needed
+	void push(const Tensor& x);
+	void clear() {size_ = 0; head_ = 0;}
+
+	// The last n entries (all if n is larger than size()), oldest first. Shape [n, shape()...]
+	Tensor window(size_t n) const;
+	Tensor window() const {return window(size_);}
+	// The i-th most recent entry. latest(0) is the last pushed one
+	Tensor latest(size_t i=0) const;
+
+	size_t size() const {return size_;}
+	size_t capacity() const {return capacity_;}
+	bool empty() const {return size_ == 0;}
+	bool full() const {return size_ == capacity_;}
+	Shape shape() const {return shape_;}
+	DType dtype() const {return buffer_.dtype();}
+	Backend* backend() const {return buffer_.backend();}
+
+protected:
+	size_t capacity_;
+	Shape shape_;
+	Tensor buffer_;
+	size_t head_ = 0; // Where the next entry goes. In [0, capacity)
+	size_t size_ = 0;
+};
+
+}
@@ -283,11 +283,23 @@ void et::save(const StateDict& dict, const std::string& path)
 		cereal::JSONOutputArchive ar(out);
 		ar(dict);
 	}
-	else {
-		cereal::PortableBinaryOutputArchive ar(out);
-		ar(dict);
-	}
+	else
+		save(dict, out);
+
+}
+
+void et::save(const StateDict& dict, std::ostream& out)
+{
+	cereal::PortableBinaryOutputArchive ar(out);
+	ar(dict);
+}
 
+StateDict et::load(std::istream& in)
+{
+	StateDict dict;
+	cereal::PortableBinaryInputArchive ar(in);
+	ar(dict);
+	return dict;
 }
 
 StateDict et::load(const std::string& path)
@@ -300,9 +312,7 @@ StateDict et::load(const std::string& path)
 		cereal::JSONInputArchive ar(in);
 		ar(dict);
 	}
-	else {
-		cereal::PortableBinaryInputArchive ar(in);
-		ar(dict);
-	}
+	else
+		dict = load(in);
 	return dict;
 }
@@ -3,6 +3,7 @@
 #include <map>
 #include <any>
 #include <string>
+#include <iosfwd>
 
 #include "Etaler_export.h"
 
@@ -14,4 +15,8 @@ using StateDict = std::map<std::string, std::any>;
 void ETALER_EXPORT save(const StateDict& dict, const std::string& path);
 StateDict ETALER_EXPORT load(const std::string& path);
 
+//Serialize to/from a stream in the binary format
+void ETALER_EXPORT save(const StateDict& dict, std::ostream& out);
+StateDict ETALER_EXPORT load(std::istream& in);
+
 }
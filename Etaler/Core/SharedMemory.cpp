@@ -0,0 +1,332 @@
+#include "SharedMemory.hpp"
+
+#include "Etaler/Core/Tensor.hpp"
+#include "Etaler/Backends/CPUBackend.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+using namespace et;
+
+// Layout of a generation: SegmentHeader, a TensorEntry per tensor, the serialized StateDict (with the
+// tensors replaced by descriptors and their shapes stored under __shared_layout) and then the tensor
+// data. Each tensor is aligned to 64 bytes.
+static const char segment_magic[8] = "EtShm01";
+static const size_t tensor_alignment = 64;
+
+struct SegmentHeader
+{
+	char magic[8];
+	uint64_t generation;
+	uint64_t num_tensors;
+	uint64_t meta_offset;
+	uint64_t meta_size;
+};
+
+struct TensorEntry
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+// The control object stores the latest generation
+struct ControlBlock
+{
+	std::atomic<uint64_t> generation;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The generation counter must be lock free to live in shared memory");
+
+static size_t alignTo(size_t v, size_t alignment)
+{
+	return (v+alignment-1)/alignment*alignment;
+}
+
+static std::string controlName(const std::string& name)
+{
+	et_check(name.empty() == false && name.find('/') == std::string::npos, "Invalid shared memory name: " + name);
+	return "/" + name;
+}
+
+static std::string segmentName(const std::string& name, uint64_t generation)
+{
+	return controlName(name) + "." + std::to_string(generation);
+}
+
+static std::string errorString()
+{
+	return std::string(strerror(errno));
+}
+
+namespace
+{
+// Closes the file descriptor when going out of scope
+struct FileHandle
+{
+	FileHandle(int fd) : fd(fd) {}
+	~FileHandle() {if(fd != -1) close(fd);}
+	int fd;
+};
+
+// Unmaps the memory when going out of scope
+struct Mapping
+{
+	Mapping(void* ptr, size_t size) : ptr(ptr), size(size) {}
+	~Mapping() {if(ptr != MAP_FAILED) munmap(ptr, size);}
+	void* ptr;
+	size_t size;
+};
+}
+
+SharedMemoryBuffer::~SharedMemoryBuffer()
+{
+	munmap(ptr_, size());
+}
+
+std::shared_ptr<SharedMemoryBuffer> SharedMemoryBuffer::attach(const std::string& name, std::shared_ptr<Backend> backend)
+{
+	FileHandle file(shm_open(name.c_str(), O_RDONLY, 0));
+	if(file.fd == -1)
+		throw EtError("Failed to open shared memory " + name + ": " + errorString());
+
+	struct stat st;
+	if(fstat(file.fd, &st) == -1)
+		throw EtError("Failed to get the size of shared memory " + name + ": " + errorString());
+	size_t size = st.st_size;
+	et_check(size != 0, "Shared memory " + name + " is empty");
+
+	void* ptr = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, file.fd, 0);
+	if(ptr == MAP_FAILED)
+		throw EtError("Failed to map shared memory " + name + ": " + errorString());
+	return std::make_shared<SharedMemoryBuffer>(ptr, size, std::move(backend));
+}
+
+static StateDict tensorDescriptor(const Tensor& t, std::vector<Tensor>& tensors)
+{
+	StateDict desc;
+	desc["__shared_tensor"] = int32_t(t.has_value() ? tensors.size() : -1);
+	if(t.has_value())
+		tensors.push_back(t);
+	return desc;
+}
+
+// Replaces all the tensors in the StateDict with descriptors pointing into the tensor list
+static StateDict extractTensors(const StateDict& states, std::vector<Tensor>& tensors)
+{
+	StateDict res;
+	for(const auto& [key, value] : states) {
+		if(value.type() == typeid(Tensor))
+			res[key] = tensorDescriptor(std::any_cast<Tensor>(value), tensors);
+		else if(value.type() == typeid(std::vector<Tensor>)) {
+			const auto& vec = std::any_cast<const std::vector<Tensor>&>(value);
+			StateDict list;
+			list["__shared_tensor_list"] = int32_t(vec.size());
+			for(size_t i=0;i<vec.size();i++)
+				list[std::to_string(i)] = tensorDescriptor(vec[i], tensors);
+			res[key] = list;
+		}
+		else if(value.type() == typeid(StateDict))
+			res[key] = extractTensors(std::any_cast<const StateDict&>(value), tensors);
+		else
+			res[key] = value;
+	}
+	return res;
+}
+
+static Tensor restoreTensor(const StateDict& desc, const std::vector<Tensor>& tensors)
+{
+	int32_t index = std::any_cast<int32_t>(desc.at("__shared_tensor"));
+	if(index == -1)
+		return Tensor();
+	et_check((size_t)index < tensors.size(), "Corrupted shared memory. Tensor index out of range");
+	return tensors[index];
+}
+
+static StateDict restoreTensors(const StateDict& states, const std::vector<Tensor>& tensors)
+{
+	StateDict res;
+	for(const auto& [key, value] : states) {
+		if(value.type() != typeid(StateDict)) {
+			res[key] = value;
+			continue;
+		}
+
+		const auto& dict = std::any_cast<const StateDict&>(value);
+		if(dict.count("__shared_tensor") != 0)
+			res[key] = restoreTensor(dict, tensors);
+		else if(dict.count("__shared_tensor_list") != 0) {
+			std::vector<Tensor> vec(std::any_cast<int32_t>(dict.at("__shared_tensor_list")));
+			for(size_t i=0;i<vec.size();i++)
+				vec[i] = restoreTensor(std::any_cast<const StateDict&>(dict.at(std::to_string(i))), tensors);
+			res[key] = vec;
+		}
+		else
+			res[key] = restoreTensors(dict, tensors);
+	}
+	return res;
+}
+
+uint64_t et::publishShared(const StateDict& states, const std::string& name)
+{
+	std::vector<Tensor> tensors;
+	StateDict meta_dict = extractTensors(states, tensors);
+	StateDict layout;
+	for(size_t i=0;i<tensors.size();i++)
+		layout[std::to_string(i)] = StateDict{{"shape", tensors[i].shape()}, {"dtype", int32_t(tensors[i].dtype())}};
+	meta_dict["__shared_layout"] = layout;
+	std::ostringstream meta_stream;
+	save(meta_dict, meta_stream);
+	std::string meta = meta_stream.str();
+
+	// Work out the layout
+	std::vector<TensorEntry> entries(tensors.size());
+	size_t meta_offset = sizeof(SegmentHeader) + sizeof(TensorEntry)*entries.size();
+	size_t total_size = meta_offset + meta.size();
+	for(size_t i=0;i<tensors.size();i++) {
+		entries[i].offset = alignTo(total_size, tensor_alignment);
+		entries[i].size = tensors[i].size()*dtypeToSize(tensors[i].dtype());
+		total_size = entries[i].offset + entries[i].size;
+	}
+
+	// Open (or create) the control object to find the next generation
+	std::string control_name = controlName(name);
+	FileHandle control_file(shm_open(control_name.c_str(), O_RDWR|O_CREAT, 0644));
+	if(control_file.fd == -1)
+		throw EtError("Failed to open shared memory " + control_name + ": " + errorString());
+	if(ftruncate(control_file.fd, sizeof(ControlBlock)) == -1)
+		throw EtError("Failed to resize shared memory " + control_name + ": " + errorString());
+	Mapping control(mmap(nullptr, sizeof(ControlBlock), PROT_READ|PROT_WRITE, MAP_SHARED, control_file.fd, 0), sizeof(ControlBlock));
+	if(control.ptr == MAP_FAILED)
+		throw EtError("Failed to map shared memory " + control_name + ": " + errorString());
+	ControlBlock* block = (ControlBlock*)control.ptr;
+	uint64_t generation = block->generation.load(std::memory_order_acquire) + 1;
+
+	// Write the new generation. A segment already there is left by a publisher that crashed before making it
+	// visible. No one can be attached to it, so it is removed
+	std::string segment_name = segmentName(name, generation);
+	FileHandle file(shm_open(segment_name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644));
+	if(file.fd == -1 && errno == EEXIST) {
+		shm_unlink(segment_name.c_str());
+		file.fd = shm_open(segment_name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+	}
+	if(file.fd == -1)
+		throw EtError("Failed to create shared memory " + segment_name + ": " + errorString());
+	try {
+		if(ftruncate(file.fd, total_size) == -1)
+			throw EtError("Failed to resize shared memory " + segment_name + ": " + errorString());
+		Mapping segment(mmap(nullptr, total_size, PROT_READ|PROT_WRITE, MAP_SHARED, file.fd, 0), total_size);
+		if(segment.ptr == MAP_FAILED)
+			throw EtError("Failed to map shared memory " + segment_name + ": " + errorString());
+
+		char* base = (char*)segment.ptr;
+		SegmentHeader header;
+		memcpy(header.magic, segment_magic, sizeof(segment_magic));
+		header.generation = generation;
+		header.num_tensors = tensors.size();
+		header.meta_offset = meta_offset;
+		header.meta_size = meta.size();
+		memcpy(base, &header, sizeof(header));
+		memcpy(base+sizeof(header), entries.data(), sizeof(TensorEntry)*entries.size());
+		memcpy(base+meta_offset, meta.data(), meta.size());
+
+		for(size_t i=0;i<tensors.size();i++) {
+			Tensor t = tensors[i].isplain() ? tensors[i] : tensors[i].realize();
+			t.backend()->copyToHost(t.pimpl(), base+entries[i].offset);
+		}
+	}
+	catch(...) {
+		shm_unlink(segment_name.c_str());
+		throw;
+	}
+
+	// Make the new generation visible. Keep the previous one around for processes in the middle of attaching
+	block->generation.store(generation, std::memory_order_release);
+	if(generation > 2)
+		shm_unlink(segmentName(name, generation-2).c_str());
+	return generation;
+}
+
+uint64_t et::latestSharedGeneration(const std::string& name)
+{
+	std::string control_name = controlName(name);
+	FileHandle control_file(shm_open(control_name.c_str(), O_RDONLY, 0));
+	if(control_file.fd == -1) {
+		if(errno == ENOENT)
+			return 0;
+		throw EtError("Failed to open shared memory " + control_name + ": " + errorString());
+	}
+
+	Mapping control(mmap(nullptr, sizeof(ControlBlock), PROT_READ, MAP_SHARED, control_file.fd, 0), sizeof(ControlBlock));
+	if(control.ptr == MAP_FAILED)
+		throw EtError("Failed to map shared memory " + control_name + ": " + errorString());
+	return ((const ControlBlock*)control.ptr)->generation.load(std::memory_order_acquire);
+}
+
+StateDict et::attachShared(const std::string& name, uint64_t* generation, Backend* backend)
+{
+	et_check(dynamic_cast<CPUBackend*>(backend) != nullptr, "Shared states can only be attached to a CPUBackend. Got " + backend->name());
+
+	// The generation might be removed between reading it and opening it. Retry with the newer one
+	std::shared_ptr<SharedMemoryBuffer> buffer;
+	uint64_t gen = 0;
+	for(int retry=0;buffer == nullptr;retry++) {
+		gen = latestSharedGeneration(name);
+		if(gen == 0)
+			throw EtError("Nothing is published under shared memory name " + name);
+		try {
+			buffer = SharedMemoryBuffer::attach(segmentName(name, gen), backend->shared_from_this());
+		}
+		catch(const EtError&) {
+			if(retry == 8 || latestSharedGeneration(name) == gen)
+				throw;
+		}
+	}
+
+	const char* base = (const char*)buffer->data();
+	et_check(buffer->size() >= sizeof(SegmentHeader), "Corrupted shared memory. Too small to hold a header");
+	SegmentHeader header;
+	memcpy(&header, base, sizeof(header));
+	et_check(memcmp(header.magic, segment_magic, sizeof(segment_magic)) == 0, "Shared memory " + name + " does not hold Etaler states");
+	et_check(header.generation == gen, "Corrupted shared memory. Generation mismatch");
+	et_check(header.meta_offset+header.meta_size <= buffer->size(), "Corrupted shared memory. Out of bound states");
+
+	std::istringstream meta_stream(std::string(base+header.meta_offset, header.meta_size));
+	StateDict meta_dict = load(meta_stream);
+
+	// The shape and dtype of each tensor is stored in the serialized StateDict
+	std::vector<TensorEntry> entries(header.num_tensors);
+	memcpy(entries.data(), base+sizeof(header), sizeof(TensorEntry)*entries.size());
+	std::vector<Tensor> tensors(entries.size());
+	StateDict layout = std::any_cast<StateDict>(meta_dict.at("__shared_layout"));
+	meta_dict.erase("__shared_layout");
+	for(size_t i=0;i<entries.size();i++) {
+		const auto& desc = std::any_cast<const StateDict&>(layout.at(std::to_string(i)));
+		Shape shape = std::any_cast<Shape>(desc.at("shape"));
+		DType dtype = (DType)std::any_cast<int32_t>(desc.at("dtype"));
+		et_check(entries[i].offset+entries[i].size <= buffer->size(), "Corrupted shared memory. Out of bound tensor");
+		et_check(entries[i].size == shape.volume()*dtypeToSize(dtype), "Corrupted shared memory. Tensor size mismatch");
+
+		void* ptr = (char*)buffer->data()+entries[i].offset;
+		auto buf = std::make_shared<CPUAliasBuffer>(shape, dtype, backend->shared_from_this(), buffer, ptr);
+		tensors[i] = std::make_shared<TensorImpl>(buf, shape, shapeToStride(shape));
+	}
+
+	if(generation != nullptr)
+		*generation = gen;
+	return restoreTensors(meta_dict, tensors);
+}
+
+void et::removeShared(const std::string& name)
+{
+	uint64_t gen = latestSharedGeneration(name);
+	for(uint64_t g=(gen>1?gen-1:1);g<=gen;g++)
+		shm_unlink(segmentName(name, g).c_str());
+	shm_unlink(controlName(name).c_str());
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Serialize.hpp"
+#include "TensorImpl.hpp"
+#include "DefaultBackend.hpp"
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// A block of POSIX shared memory mapped into the process. Unmapped when destructed.
+// Tensors attached from shared memory are CPUAliasBuffers keeping this buffer alive.
+struct ETALER_EXPORT SharedMemoryBuffer : public BufferImpl
+{
+	SharedMemoryBuffer(void* ptr, size_t size, std::shared_ptr<Backend> backend)
+		: BufferImpl(size, DType::Bool, std::move(backend)), ptr_(ptr) {}
+	virtual ~SharedMemoryBuffer();
+
+	// Maps the shared memory object with the given name. The mapping is copy-on-write. Writes made
+	// by this process are private to it and the pages not written stay shared with other processes
+	static std::shared_ptr<SharedMemoryBuffer> attach(const std::string& name, std::shared_ptr<Backend> backend);
+
+	virtual void* data() const override {return ptr_;}
+
+protected:
+	void* ptr_;
+};
+
+// Places the states (ex: from SpatialPooler::states()) in shared memory under the given name so other
+// processes on the same host can use them without loading a copy each. Every call publishes a new
+// generation of the states and returns its number. Processes attached to an older generation keep using
+// it until they attach again. Only one process should publish under a name at a time. A generation left
+// half written by a publisher that crashed is replaced by the next publish.
+uint64_t ETALER_EXPORT publishShared(const StateDict& states, const std::string& name);
+
+// Attaches to the latest generation published under name. The tensors in the returned StateDict live in
+// the shared memory on the given backend, which must be a CPUBackend. The generation attached to is
+// written to generation if not null.
+StateDict ETALER_EXPORT attachShared(const std::string& name, uint64_t* generation=nullptr, Backend* backend=defaultBackend());
+
+// The latest generation published under name. 0 if nothing is published. Workers can compare it
+// against the generation they attached to in order to find out if they are using stale states.
+uint64_t ETALER_EXPORT latestSharedGeneration(const std::string& name);
+
+// Removes the shared states from the system. Processes already attached are not affected
+void ETALER_EXPORT removeShared(const std::string& name);
+
+}
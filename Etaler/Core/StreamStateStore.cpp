@@ -0,0 +1,250 @@
+#include "StreamStateStore.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+using namespace et;
+
+// Layout: StoreHeader, padded to a page, followed by num_streams slots. A slot is a SlotHeader followed by
+// max_active_cells indices of active cells and the same number of indices of predictive cells
+static const char store_magic[8] = "EtSss01";
+static const size_t max_state_dims = 8;
+
+struct StoreHeader
+{
+	char magic[8];
+	uint64_t num_streams;
+	uint64_t max_active_cells;
+	uint64_t num_dims;
+	int64_t shape[max_state_dims];
+};
+
+struct SlotHeader
+{
+	uint32_t num_active;
+	uint32_t num_predictive;
+};
+
+static std::string errorString()
+{
+	return std::string(strerror(errno));
+}
+
+static size_t headerSize()
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (sizeof(StoreHeader)+page-1)/page*page;
+}
+
+StreamStateStore::StreamStateStore(const std::string& path, size_t num_streams, const Shape& state_shape, size_t max_active_cells)
+	: path_(path), num_streams_(num_streams), state_shape_(state_shape), max_active_cells_(max_active_cells)
+{
+	et_check(num_streams > 0 && max_active_cells > 0, "A stream state store needs at least one stream and one active cell");
+	et_check(state_shape.size() > 0 && state_shape.size() <= max_state_dims, "States can have 1 to " + std::to_string(max_state_dims) + " dimensions");
+	et_check(state_shape.volume() <= UINT32_MAX, "States can have at most 2^32-1 cells");
+	max_active_cells_ = std::min(max_active_cells, (size_t)state_shape.volume());
+	slot_size_ = sizeof(SlotHeader) + 2*max_active_cells_*sizeof(uint32_t);
+	file_size_ = headerSize() + num_streams_*slot_size_;
+
+	fd_ = open(path.c_str(), O_RDWR|O_CREAT, 0644);
+	if(fd_ == -1)
+		throw EtError("Failed to open stream state store " + path + ": " + errorString());
+
+	StoreHeader expected = {};
+	memcpy(expected.magic, store_magic, sizeof(store_magic));
+	expected.num_streams = num_streams_;
+	expected.max_active_cells = max_active_cells_;
+	expected.num_dims = state_shape.size();
+	std::copy(state_shape.begin(), state_shape.end(), expected.shape);
+
+	try {
+		struct stat st;
+		if(fstat(fd_, &st) == -1)
+			throw EtError("Failed to get the size of " + path + ": " + errorString());
+
+		if(st.st_size == 0) {
+			// The file is sparse. Slots never written read as zero, which are empty states
+			if(ftruncate(fd_, file_size_) == -1)
+				throw EtError("Failed to resize " + path + ": " + errorString());
+			if(pwrite(fd_, &expected, sizeof(expected), 0) != sizeof(expected))
+				throw EtError("Failed to write the header of " + path + ": " + errorString());
+		}
+		else {
+			StoreHeader header;
+			if(pread(fd_, &header, sizeof(header), 0) != sizeof(header))
+				throw EtError("Failed to read the header of " + path + ": " + errorString());
+			et_check(memcmp(header.magic, store_magic, sizeof(store_magic)) == 0, path + " is not a stream state store");
+			et_check(memcmp(&header, &expected, sizeof(header)) == 0, "Stream state store " + path + " is created with different parameters");
+			et_check((size_t)st.st_size == file_size_, "Stream state store " + path + " is truncated");
+		}
+
+		void* ptr = mmap(nullptr, file_size_, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+		if(ptr == MAP_FAILED)
+			throw EtError("Failed to map " + path + ": " + errorString());
+		data_ = (char*)ptr;
+	}
+	catch(...) {
+		close(fd_);
+		throw;
+	}
+
+	writer_ = std::thread([this](){ writeBack(); });
+}
+
+StreamStateStore::~StreamStateStore()
+{
+	{
+		std::lock_guard lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+	writer_.join();
+	msync(data_, file_size_, MS_SYNC);
+	munmap(data_, file_size_);
+	close(fd_);
+}
+
+char* StreamStateStore::slot(uint64_t id) const
+{
+	et_check(id < num_streams_, "Stream " + std::to_string(id) + " out of range. The store holds " + std::to_string(num_streams_) + " streams");
+	return data_ + headerSize() + id*slot_size_;
+}
+
+static void scatter(const uint32_t* indices, size_t n, size_t num_cells, uint8_t* dest)
+{
+	for(size_t i=0;i<n;i++) {
+		et_check(indices[i] < num_cells, "Corrupted stream state store. Cell index out of range");
+		dest[indices[i]] = 1;
+	}
+}
+
+std::pair<Tensor, Tensor> StreamStateStore::load(const std::vector<uint64_t>& ids, Backend* backend)
+{
+	size_t num_cells = state_shape_.volume();
+	std::vector<uint8_t> active(ids.size()*num_cells, 0);
+	std::vector<uint8_t> predictive(ids.size()*num_cells, 0);
+
+	// Holding the lock keeps the background thread from picking up new states. The slots it is writing are
+	// read from writing_ instead
+	std::lock_guard lock(mutex_);
+	for(size_t i=0;i<ids.size();i++) {
+		uint8_t* a = active.data() + i*num_cells;
+		uint8_t* p = predictive.data() + i*num_cells;
+		const SparseState* state = nullptr;
+		if(auto it = pending_.find(ids[i]); it != pending_.end())
+			state = &it->second;
+		else if(auto it = writing_.find(ids[i]); it != writing_.end())
+			state = &it->second;
+
+		if(state != nullptr) {
+			scatter(state->active.data(), state->active.size(), num_cells, a);
+			scatter(state->predictive.data(), state->predictive.size(), num_cells, p);
+			continue;
+		}
+
+		const char* s = slot(ids[i]);
+		SlotHeader header;
+		memcpy(&header, s, sizeof(header));
+		et_check(header.num_active <= max_active_cells_ && header.num_predictive <= max_active_cells_, "Corrupted stream state store. Too many cells");
+		const uint32_t* indices = (const uint32_t*)(s+sizeof(SlotHeader));
+		scatter(indices, header.num_active, num_cells, a);
+		scatter(indices+max_active_cells_, header.num_predictive, num_cells, p);
+	}
+
+	Shape shape = Shape({(intmax_t)ids.size()}) + state_shape_;
+	return {Tensor(shape, (const bool*)active.data(), backend), Tensor(shape, (const bool*)predictive.data(), backend)};
+}
+
+static std::vector<uint32_t> onCells(const std::vector<bool>& state, size_t begin, size_t end)
+{
+	std::vector<uint32_t> res;
+	for(size_t i=begin;i<end;i++) {
+		if(state[i])
+			res.push_back(i-begin);
+	}
+	return res;
+}
+
+void StreamStateStore::store(const std::vector<uint64_t>& ids, const Tensor& active, const Tensor& predictive)
+{
+	Shape shape = Shape({(intmax_t)ids.size()}) + state_shape_;
+	et_check(active.shape() == shape && predictive.shape() == shape, "Expecting states of shape " + to_string(shape)
+		+ ", got " + to_string(active.shape()) + " and " + to_string(predictive.shape()));
+
+	// Convert to the sparse form on the caller's thread so the tensors can be reused right away
+	size_t num_cells = state_shape_.volume();
+	std::vector<bool> a = active.cast(DType::Bool).toHost<bool>();
+	std::vector<bool> p = predictive.cast(DType::Bool).toHost<bool>();
+	std::vector<SparseState> states(ids.size());
+	for(size_t i=0;i<ids.size();i++) {
+		et_check(ids[i] < num_streams_, "Stream " + std::to_string(ids[i]) + " out of range. The store holds " + std::to_string(num_streams_) + " streams");
+		states[i].active = onCells(a, i*num_cells, (i+1)*num_cells);
+		states[i].predictive = onCells(p, i*num_cells, (i+1)*num_cells);
+		et_check(states[i].active.size() <= max_active_cells_ && states[i].predictive.size() <= max_active_cells_
+			, "Stream " + std::to_string(ids[i]) + " has more than " + std::to_string(max_active_cells_) + " on cells");
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		for(size_t i=0;i<ids.size();i++)
+			pending_[ids[i]] = std::move(states[i]);
+	}
+	cv_.notify_all();
+}
+
+void StreamStateStore::writeBack()
+{
+	std::unique_lock lock(mutex_);
+	while(true) {
+		cv_.wait(lock, [this](){ return stop_ || pending_.empty() == false; });
+		if(pending_.empty() && stop_)
+			return;
+
+		std::swap(pending_, writing_);
+		lock.unlock();
+		for(const auto& [id, state] : writing_) {
+			char* s = slot(id);
+			SlotHeader header = {(uint32_t)state.active.size(), (uint32_t)state.predictive.size()};
+			uint32_t* indices = (uint32_t*)(s+sizeof(SlotHeader));
+			std::copy(state.active.begin(), state.active.end(), indices);
+			std::copy(state.predictive.begin(), state.predictive.end(), indices+max_active_cells_);
+			memcpy(s, &header, sizeof(header));
+		}
+		// Start writing the dirty pages to the file without waiting for it
+		msync(data_, file_size_, MS_ASYNC);
+		lock.lock();
+		writing_.clear();
+		cv_.notify_all();
+	}
+}
+
+void StreamStateStore::prefetch(const std::vector<uint64_t>& ids) const
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	for(auto id : ids) {
+		uintptr_t begin = (uintptr_t)slot(id)/page*page;
+		madvise((void*)begin, (uintptr_t)slot(id)+slot_size_-begin, MADV_WILLNEED);
+	}
+}
+
+void StreamStateStore::flush()
+{
+	{
+		std::unique_lock lock(mutex_);
+		cv_.wait(lock, [this](){ return pending_.empty() && writing_.empty(); });
+	}
+	if(msync(data_, file_size_, MS_SYNC) == -1)
+		throw EtError("Failed to sync " + path_ + ": " + errorString());
+}
+
+size_t StreamStateStore::pendingWrites() const
+{
+	std::lock_guard lock(mutex_);
+	return pending_.size() + writing_.size();
+}
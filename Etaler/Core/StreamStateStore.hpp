@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Shape.hpp"
+#include "Tensor.hpp"
+#include "DefaultBackend.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+#include "Etaler_export.h"
+
+namespace et
+{
+
+// Keeps the TemporalMemory states (active and predictive cells) of a large number of streams in a memory mapped
+// file. Each stream has a fixed size slot holding the indices of the on cells, so a state costs
+// 8*max_active_cells+8 bytes on disk no matter the number of cells. The OS pages the slots in and out on demand.
+//
+// store() returns immediately. The states are written back by a background thread and load() sees the pending
+// writes, so a stream always reads what was last stored for it. Streams that are never stored are all zero.
+// All methods are thread safe.
+//
+// Usage:
+//	StreamStateStore store("states.bin", num_streams, {2048, 16}, 1024);
+//	auto [last_active, last_pred] = store.load(ids);
+//	auto [pred, active] = tm.computeBatch(x, last_pred);
+//	store.store(ids, active, pred);
+struct ETALER_EXPORT StreamStateStore
+{
+	// Opens the store at path, or creates it if the file doesn't exist. An existing store must have been created
+	// with the same parameters
+	StreamStateStore(const std::string& path, size_t num_streams, const Shape& state_shape, size_t max_active_cells);
+	~StreamStateStore();
+
+	StreamStateStore(const StreamStateStore&) = delete;
+	StreamStateStore& operator= (const StreamStateStore&) = delete;
+
+	// The {active, predictive} cells of the streams. Both are Bool tensors of shape {ids.size()}+state_shape
+	std::pair<Tensor, Tensor> load(const std::vector<uint64_t>& ids, Backend* backend=defaultBackend());
+	// Queues the states for writing. active and predictive are of shape {ids.size()}+state_shape. Throws if a
+	// state has more than max_active_cells on cells
+	void store(const std::vector<uint64_t>& ids, const Tensor& active, const Tensor& predictive);
+
+	// Hints the OS to page in the slots of the streams. Useful before loading the next batch
+	void prefetch(const std::vector<uint64_t>& ids) const;
+	// Waits until all pending states are written and synced to the file
+	void flush();
+
+	size_t numStreams() const {return num_streams_;}
+	Shape stateShape() const {return state_shape_;}
+	size_t maxActiveCells() const {return max_active_cells_;}
+	size_t pendingWrites() const;
+
+protected:
+	struct SparseState
+	{
+		std::vector<uint32_t> active;
+		std::vector<uint32_t> predictive;
+	};
+
+	char* slot(uint64_t id) const;
+	void writeBack();
+
+	std::string path_;
+	size_t num_streams_;
+	Shape state_shape_;
+	size_t max_active_cells_;
+	size_t slot_size_;
+	size_t file_size_;
+	int fd_ = -1;
+	char* data_ = nullptr;
+
+	// States queued by store() and the ones currently being written by the background thread
+	std::unordered_map<uint64_t, SparseState> pending_;
+	std::unordered_map<uint64_t, SparseState> writing_;
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stop_ = false;
+	std::thread writer_;
+};
+
+}
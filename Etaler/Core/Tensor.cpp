@@ -1,6 +1,7 @@
 #include "Tensor.hpp"
 
 #include <sstream>
+#include <tuple>
 
 using namespace et;
 using std::size_t; //Surpress VSCode warnings
@@ -172,8 +173,7 @@ bool Tensor::isSame(const Tensor& other) const
 	if(shape() != other.shape())
 		return false;
 
-	//A hacky comparsion
-	return (*this == other).sum().item<int32_t>() == (int32_t)size();
+	return (*this != other).any() == false;
 }
 
 Tensor Tensor::view(const IndexList& rgs) const
@@ -280,8 +280,11 @@ Tensor et::ones(const Shape& shape, DType dtype, Backend* backend)
 Tensor Tensor::sum(std::optional<intmax_t> dim_id, DType dtype) const
 {
 	// HACK: Special case for 0D tensor
-	if(dimensions() == 0)
+	if(dimensions() == 0) {
+		if(dtype != DType::Unknown)
+			return this->cast(dtype);
 		return this->cast(this->dtype() == DType::Bool ? DType::Int : this->dtype());
+	}
 
 	et_check(dim_id.value_or(0) < (intmax_t)dimensions()
 		, "Dim " + std::to_string(dim_id.value_or(0)) + " is out of range");
@@ -309,7 +312,7 @@ Tensor Tensor::sum(std::optional<intmax_t> dim_id, DType dtype) const
 		return res;
 	}
 
-	Tensor res = backend()->sum(swapaxis(dimensions()-1, dim).realize().pimpl(), sum_size, dtype);
+	Tensor res = backend()->sum(swapaxis(dimensions()-1, dim).pimpl(), sum_size, dtype);
 	res.resize(result_shape);
 	return res.swapaxis(res.shape().size()-1, dim).reshape(final_shape);
 }
@@ -428,3 +431,22 @@ std::pair<Tensor, Tensor> Tensor::brodcast(const Tensor& other) const
 {
 	return brodcast_tensors(*this, other);
 }
+
+static std::tuple<Tensor, Tensor, Tensor> brodcast_ternary(const Tensor& a, const Tensor& b, const Tensor& c)
+{
+	auto [x, y] = brodcast_tensors(a, b);
+	auto [s, z] = brodcast_tensors(x, c);
+	return {s, brodcast_to(y, s.shape()), z};
+}
+
+Tensor et::where(const Tensor& condition, const Tensor& x, const Tensor& y)
+{
+	auto [c, a, b] = brodcast_ternary(condition, x, y);
+	return x.backend()->where(c.pimpl(), a.pimpl(), b.pimpl());
+}
+
+Tensor et::clamp(const Tensor& x, const Tensor& min, const Tensor& max)
+{
+	auto [v, l, h] = brodcast_ternary(x, min, max);
+	return x.backend()->clamp(v.pimpl(), l.pimpl(), h.pimpl());
+}
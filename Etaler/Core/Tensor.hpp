@@ -225,12 +225,7 @@ struct ETALER_EXPORT Tensor
 	}
 
 	// Common Tensor operators
-	Tensor cast(DType dtype) const
-	{
-		if(iscontiguous() == false)
-			return realize().cast(dtype);
-		return backend()->cast(pimpl(), dtype);
-	}
+	Tensor cast(DType dtype) const { return backend()->cast(pimpl(), dtype); }
 
 	Tensor exp() const { return backend()->exp(pimpl()); }
 	Tensor negate() const { return backend()->negate(pimpl()); }
@@ -247,9 +242,15 @@ struct ETALER_EXPORT Tensor
 	Tensor lesser(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->lesser(a.pimpl(), b.pimpl()); }
 	Tensor logical_and(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->logical_and(a.pimpl(), b.pimpl()); }
 	Tensor logical_or(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->logical_or(a.pimpl(), b.pimpl()); }
+	Tensor lesser_equal(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->lesser_equal(a.pimpl(), b.pimpl()); }
+	Tensor greater_equal(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->greater_equal(a.pimpl(), b.pimpl()); }
+	Tensor not_equal(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->not_equal(a.pimpl(), b.pimpl()); }
+	Tensor logical_xor(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->logical_xor(a.pimpl(), b.pimpl()); }
+	Tensor minimum(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->minimum(a.pimpl(), b.pimpl()); }
+	Tensor maximum(const Tensor& other) const { auto [a, b] = brodcast(other); return backend()->maximum(a.pimpl(), b.pimpl()); }
 
 	inline bool any() const { return cast(DType::Bool).sum(std::nullopt, DType::Bool).item<uint8_t>(); }
-	inline bool all() const { return cast(DType::Bool).sum(std::nullopt).item<int32_t>() == int32_t(size()); }
+	inline bool all() const { return !cast(DType::Bool).logical_not().any(); }
 
 	// Neumeric operations
 	Tensor operator+= (const Tensor& other) { *this = *this + other; return *this; }
@@ -271,11 +272,9 @@ struct ETALER_EXPORT Tensor
 	Tensor operator> (const Tensor& other) const {return greater(other);}
 	Tensor operator&& (const Tensor& other) const {return logical_and(other);}
 	Tensor operator|| (const Tensor& other) const {return logical_or(other);}
-
-	//Operators can the optimized
-	Tensor operator<= (const Tensor& other) const {return lesser(other) || equal(other);}
-	Tensor operator>= (const Tensor& other) const {return greater(other) || equal(other);}
-	Tensor operator!= (const Tensor& other) const {return !equal(other);}
+	Tensor operator<= (const Tensor& other) const {return lesser_equal(other);}
+	Tensor operator>= (const Tensor& other) const {return greater_equal(other);}
+	Tensor operator!= (const Tensor& other) const {return not_equal(other);}
 
 	//Subscription operator
 	Tensor operator [] (const IndexList& r) { return view(r); }
@@ -372,11 +371,53 @@ inline void learnCorrilation(const Tensor& x, const Tensor& learn, const Tensor&
 	x.backend()->learnCorrilation(x.pimpl(), learn.pimpl(), connection.pimpl(), permeances.pimpl(), perm_inc, perm_dec, has_unconnected_synapse);
 }
 
+inline Tensor cellActivityWithOffsets(const Tensor& x, const Tensor& connections, const Tensor& permeances, const Tensor& permeance_offsets
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true)
+{
+	const Tensor& input = [&](){
+		if(x.dtype() == DType::Bool)
+			return x;
+		return x.cast(DType::Bool);
+	}();
+	return x.backend()->cellActivityWithOffsets(input.pimpl(), connections.pimpl(), permeances.pimpl(), permeance_offsets.pimpl()
+		, connected_permeance, active_threshold, has_unconnected_synapse);
+}
+
+inline void learnCorrilationSparse(const Tensor& x, const Tensor& learn, const Tensor& connection, Tensor& permeances
+	, Tensor& permeance_offsets, float perm_inc, float perm_dec, bool has_unconnected_synapse=true)
+{
+	x.backend()->learnCorrilationSparse(x.pimpl(), learn.pimpl(), connection.pimpl(), permeances.pimpl(), permeance_offsets.pimpl()
+		, perm_inc, perm_dec, has_unconnected_synapse);
+}
+
+inline Tensor proceduralCellActivity(const Tensor& x, const Tensor& permeances, uint64_t seed
+	, float connected_permeance, size_t active_threshold)
+{
+	const Tensor& input = [&](){
+		if(x.dtype() == DType::Bool)
+			return x;
+		return x.cast(DType::Bool);
+	}();
+	return x.backend()->proceduralCellActivity(input.pimpl(), permeances.pimpl(), seed, connected_permeance, active_threshold);
+}
+
+inline void proceduralLearnCorrilation(const Tensor& x, const Tensor& learn, Tensor& permeances, uint64_t seed
+	, float perm_inc, float perm_dec)
+{
+	x.backend()->proceduralLearnCorrilation(x.pimpl(), learn.pimpl(), permeances.pimpl(), seed, perm_inc, perm_dec);
+}
+
 inline Tensor globalInhibition(const Tensor& x, float fraction)
 {
 	return x.backend()->globalInhibition(x.pimpl(), fraction);
 }
 
+// globalInhibition applied to every group_size consecutive elements of x independently
+inline Tensor groupInhibition(const Tensor& x, size_t group_size, float fraction)
+{
+	return x.backend()->groupInhibition(x.pimpl(), group_size, fraction);
+}
+
 Tensor inline cast(const Tensor& x, DType dtype)
 {
 	return x.cast(dtype);
@@ -402,6 +443,36 @@ inline Tensor reverseBurst(const Tensor& x)
 	return x.backend()->reverseBurst(x.pimpl());
 }
 
+inline Tensor batchCellActivity(const Tensor& x, const Tensor& connections, const Tensor& permeances
+	, float connected_permeance, size_t active_threshold, bool has_unconnected_synapse=true)
+{
+	const Tensor& input = [&](){
+		if(x.dtype() == DType::Bool)
+			return x;
+		return x.cast(DType::Bool);
+	}();
+	return x.backend()->batchCellActivity(input.pimpl(), connections.pimpl(), permeances.pimpl(), connected_permeance, active_threshold
+		, has_unconnected_synapse);
+}
+
+inline void batchLearnCorrilation(const Tensor& x, const Tensor& learn, const Tensor& connection
+	, Tensor& permeances, float perm_inc, float perm_dec, bool has_unconnected_synapse=true)
+{
+	x.backend()->batchLearnCorrilation(x.pimpl(), learn.pimpl(), connection.pimpl(), permeances.pimpl(), perm_inc, perm_dec
+		, has_unconnected_synapse);
+}
+
+inline void batchGrowSynapses(const Tensor& x, const Tensor& learn, Tensor& connections, Tensor& permeances, float initial_perm)
+{
+	x.backend()->batchGrowSynapses(x.pimpl(), learn.pimpl(), connections.pimpl(), permeances.pimpl(), initial_perm);
+}
+
+inline Tensor rollout(const Tensor& x, const Tensor& connections, const Tensor& permeances
+	, float connected_permeance, size_t active_threshold, size_t steps)
+{
+	return x.backend()->rollout(x.pimpl(), connections.pimpl(), permeances.pimpl(), connected_permeance, active_threshold, steps);
+}
+
 inline void growSynapses(const Tensor& x, const Tensor& y, Tensor& connections, Tensor& permeances, float init_perm)
 {
 	x.backend()->growSynapses(x.pimpl(), y.pimpl(), connections.pimpl(), permeances.pimpl(), init_perm);
@@ -412,6 +483,22 @@ inline void decaySynapses(Tensor& connections, Tensor& permeances, float thresho
 	connections.backend()->decaySynapses(connections.pimpl(), permeances.pimpl(), threshold);
 }
 
+// Number of on bits shared by each pair of SDRs in a[N..., bits] and b[M..., bits]. Returns a Int32 tensor of shape [N..., M...]
+inline Tensor overlap(const Tensor& a, const Tensor& b)
+{
+	auto as_sdr = [](const Tensor& t) {return t.dtype() == DType::Bool ? t : t.cast(DType::Bool);};
+	return a.backend()->overlap(as_sdr(a).pimpl(), as_sdr(b).pimpl());
+}
+
+// Nearest neighbour search. For each SDR in a, returns the indices of the k SDRs in b overlapping with it the most
+// and their overlaps, largest first. SDRs sharing less than min_overlap bits are skipped and empty slots are set to -1
+inline std::pair<Tensor, Tensor> topKOverlap(const Tensor& a, const Tensor& b, size_t k, size_t min_overlap=1)
+{
+	auto as_sdr = [](const Tensor& t) {return t.dtype() == DType::Bool ? t : t.cast(DType::Bool);};
+	auto [indices, overlaps] = a.backend()->topKOverlap(as_sdr(a).pimpl(), as_sdr(b).pimpl(), k, min_overlap);
+	return {indices, overlaps};
+}
+
 inline void assign(Tensor& x, const Tensor& y)
 {
 	x.assign(y);
@@ -447,6 +534,16 @@ inline Tensor greater(const Tensor& x1, const Tensor& x2) { return x1.greater(x2
 inline Tensor lesser(const Tensor& x1, const Tensor& x2) { return x1.lesser(x2); }
 inline Tensor logical_and(const Tensor& x1, const Tensor& x2) { return x1.logical_and(x2); }
 inline Tensor logical_or(const Tensor& x1, const Tensor& x2) { return x1.logical_or(x2); }
+inline Tensor lesser_equal(const Tensor& x1, const Tensor& x2) { return x1.lesser_equal(x2); }
+inline Tensor greater_equal(const Tensor& x1, const Tensor& x2) { return x1.greater_equal(x2); }
+inline Tensor not_equal(const Tensor& x1, const Tensor& x2) { return x1.not_equal(x2); }
+inline Tensor logical_xor(const Tensor& x1, const Tensor& x2) { return x1.logical_xor(x2); }
+inline Tensor minimum(const Tensor& x1, const Tensor& x2) { return x1.minimum(x2); }
+inline Tensor maximum(const Tensor& x1, const Tensor& x2) { return x1.maximum(x2); }
+
+// Element-wise condition ? x : y
+Tensor ETALER_EXPORT where(const Tensor& condition, const Tensor& x, const Tensor& y);
+Tensor ETALER_EXPORT clamp(const Tensor& x, const Tensor& min, const Tensor& max);
 
 inline bool all(const Tensor& t) { return t.all(); }
 inline bool any(const Tensor& t) { return t.any(); }
@@ -457,6 +554,22 @@ inline Tensor dynamic_view(const Tensor& t, const IndexList& indices) { return t
 
 inline Tensor zeros_like(const Tensor& x) { return zeros(x.shape(), x.dtype(), x.backend()); }
 inline Tensor ones_like(const Tensor& x) { return ones(x.shape(), x.dtype(), x.backend()); }
+
+// The permanences with the per cell offsets applied and clamped into [0, 1]
+inline Tensor effectivePermanences(const Tensor& permeances, const Tensor& permeance_offsets)
+{
+	Tensor p = permeances + permeance_offsets.reshape(permeance_offsets.shape() + 1);
+	Tensor zero = zeros({1}, DType::Float, permeances.backend());
+	Tensor one = ones({1}, DType::Float, permeances.backend());
+	return clamp(p, zero, one).cast(permeances.dtype());
+}
+
+// Folds the offsets left by learnCorrilationSparse back into the permanences
+inline void renormalizePermanences(Tensor& permeances, Tensor& permeance_offsets)
+{
+	permeances.assign(effectivePermanences(permeances, permeance_offsets));
+	permeance_offsets.assign(zeros_like(permeance_offsets));
+}
 }
 
 #include <sstream>
@@ -47,6 +47,33 @@ struct ETALER_EXPORT TensorImpl : public std::enable_shared_from_this<TensorImpl
 	std::shared_ptr<Backend> backend_ptr() const {return buffer_->backend();}
 	bool iscontiguous() const {return shapeToStride(shape_) == stride_;}
 	bool isplain() const {return shapeToStride(shape_) == stride() && offset() == 0;}
+	//The last dimension is contiguous and the rows are evenly spaced without overlapping.
+	//i.e. Row i starts at offset()+i*rowstride(). Ex: a view of a range of rows
+	bool isrowcontiguous() const
+	{
+		if(dimensions() == 0)
+			return true;
+		if(shape_.back() != 1 && stride_.back() != 1)
+			return false;
+		intmax_t expected = -1;
+		for(intmax_t i=dimensions()-2;i>=0;i--) {
+			if(shape_[i] == 1)
+				continue;
+			if((expected == -1 && stride_[i] < shape_.back()) || (expected != -1 && stride_[i] != expected))
+				return false;
+			expected = stride_[i]*shape_[i];
+		}
+		return true;
+	}
+	//Distance between the start of the rows. Only meaningful if isrowcontiguous()
+	size_t rowstride() const
+	{
+		for(intmax_t i=dimensions()-2;i>=0;i--) {
+			if(shape_[i] != 1)
+				return stride_[i];
+		}
+		return dimensions() == 0 ? 1 : shape_.back();
+	}
 
 protected:
 	std::shared_ptr<BufferImpl> buffer_;
@@ -57,6 +84,7 @@ protected:
 
 struct IsContingous {};
 struct IsPlain {};
+struct IsRowContiguous {};
 
 template <typename Storage>
 struct IsDType
@@ -81,6 +109,8 @@ bool checkProperty(const TensorImpl* x, const T& value)
 		return x->iscontiguous();
 	else if constexpr(std::is_same_v<T, IsPlain>)
 		return x->iscontiguous();
+	else if constexpr(std::is_same_v<T, IsRowContiguous>)
+		return x->isrowcontiguous();
 	else if constexpr(std::is_same_v<T, Shape>)
 		return x->shape() == value;
 	else if constexpr(is_specialization<std::remove_pointer_t<std::decay_t<T>>, IsDType>::value)
@@ -107,6 +137,8 @@ void requireProperty(const TensorImpl* x, const T& value, const std::string_view
 		throw EtError(msg + ".iscontiguous() == true");
 	else if constexpr(std::is_same_v<T, IsPlain>)
 		throw EtError(msg + ".isplain() == true");
+	else if constexpr(std::is_same_v<T, IsRowContiguous>)
+		throw EtError(msg + ".isrowcontiguous() == true");
 	else if constexpr(std::is_same_v<T, Shape>)
 		throw EtError(msg + " is expected to have shape " + to_string(value));
 	else if constexpr(is_specialization<std::remove_pointer_t<std::decay_t<T>>, IsDType>::value) {
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "DType.hpp"
+#include "Error.hpp"
+#include "TypeList.hpp"
+
+#include <type_traits>
+
+namespace et
+{
+
+// The C++ types the backends run the element-wise ops on, and the rules the types of their results follow. Shared
+// by the backends so they agree on the result types
+
+using DefaultTypeList = type_list_t<int32_t, float, bool, half>;
+
+// Calls f with a value of the C++ type of dtype
+template <typename TypeList = DefaultTypeList, typename Func = void>
+inline void dispatch(DType dtype, Func f)
+{
+	static_assert(std::is_same_v<Func, void> == false); //void is just a dummy value
+	if constexpr(std::is_same_v<TypeList, null_t> == false) {
+		using T = typename TypeList::head;
+		if(typeToDType<T>() == dtype) {
+			f(T());
+			return;
+		}
+		dispatch<typename TypeList::tail, Func>(dtype, f);
+	}
+	else
+		throw EtError("Cannot dispatch such dtype: " + to_ctype_string(dtype));
+}
+
+template <typename TL1 = DefaultTypeList, typename TL2 = DefaultTypeList, typename Func = void>
+inline void dispatch2d(DType t1, DType t2, Func f)
+{
+	dispatch<TL1>(t1, [&](auto v1){
+		using T1 = decltype(v1);
+		dispatch<TL2>(t2, [&](auto v2){
+			using T2 = decltype(v2);
+			f(T1(), T2());
+		});
+	});
+}
+
+//The type values from T1 and T2 are selected into (ex: by where() and minimum()). Follows the arithmetic
+//ops, except that the type is kept if both are the same
+template <typename T1, typename T2>
+using SelectType = std::conditional_t<std::is_same_v<T1, T2>, T1
+	, std::conditional_t<std::is_same_v<T1, float> || std::is_same_v<T2, float>, float
+	, std::conditional_t<std::is_same_v<T1, half> || std::is_same_v<T2, half>, half, int32_t>>>;
+
+//The type the result of an unary op on T is stored as, ResType being what the op returns. There is no double
+//precision support now, doubles are stored as floats. Ops on halfs keep them as halfs
+template <typename T, typename ResType>
+using UnaryStoreType = std::conditional_t<std::is_same_v<ResType, bool>, bool
+	, std::conditional_t<std::is_same_v<T, half>, half
+	, std::conditional_t<std::is_same_v<ResType, double>, float, ResType>>>;
+
+//The type the result of a binary op is stored as
+template <typename ResType>
+using BinaryStoreType = std::conditional_t<std::is_same_v<ResType, double>, float, ResType>;
+
+}
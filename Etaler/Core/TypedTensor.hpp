@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Tensor.hpp"
+#include "Error.hpp"
+
+#include <array>
+#include <type_traits>
+
+namespace et
+{
+
+// TypedTensor is a view of a Tensor with the type and the number of dimensions known at compile time.
+// The DType and rank are checked once when constructed. Element access then goes straight to memory with
+// fixed size index arithmetic. No dtype dispatching and no Shape allocation is involved.
+// Only works on tensors whose memory is accessible from the host (ex: tensors on CPUBackend). Like Tensor,
+// copying a TypedTensor does not copy the data.
+//
+// Usage:
+//	TypedTensor<float, 2> t = TypedTensor<float, 2>(ones({4, 4}, DType::Float));
+//	for(size_t i=0;i<t.shape(0);i++)
+//		t(i, i) = 0;
+template <typename T, size_t N>
+struct TypedTensor
+{
+	using value_type = T;
+	using index_type = std::array<size_t, N>;
+	static constexpr size_t rank = N;
+	static constexpr DType dtype = typeToDType<T>();
+	static_assert(dtype != DType::Unknown, "TypedTensor cannot hold this type");
+
+	TypedTensor() = default;
+
+	explicit TypedTensor(Tensor t)
+		: tensor_(std::move(t))
+	{
+		et_check(tensor_.has_value(), "Cannot create a TypedTensor from an empty Tensor");
+		et_check(tensor_.dtype() == dtype, "TypedTensor of " + to_ctype_string(dtype) + " cannot hold a Tensor of "
+			+ to_ctype_string(tensor_.dtype()));
+		et_check(tensor_.dimensions() == N, "TypedTensor of rank " + std::to_string(N) + " cannot hold a Tensor of shape "
+			+ to_string(tensor_.shape()));
+
+		const TensorImpl* impl = tensor_.pimpl();
+		et_check(impl->data() != nullptr, "TypedTensor requires the Tensor's memory to be accessible from the host. "
+			"Backend " + tensor_.backend()->name() + " does not allow so");
+
+		ptr_ = (T*)impl->data() + impl->offset();
+		Shape shape = impl->shape();
+		Shape stride = impl->stride();
+		for(size_t i=0;i<N;i++) {
+			shape_[i] = shape[i];
+			stride_[i] = stride[i];
+		}
+		size_ = impl->size();
+		contiguous_ = impl->iscontiguous();
+	}
+
+	explicit TypedTensor(const index_type& shape, Backend* backend=defaultBackend())
+		: TypedTensor(Tensor(toShape(shape), dtype, backend)) {}
+
+	template <typename ... Idx>
+	T& operator() (Idx ... idx) const
+	{
+		static_assert(sizeof...(Idx) == N, "The number of indices must match the rank");
+		return ptr_[offsetOf({size_t(idx)...})];
+	}
+
+	T& operator[] (const index_type& idx) const {return ptr_[offsetOf(idx)];}
+
+	// Offset (in elements) of the element at idx from data()
+	size_t offsetOf(const index_type& idx) const
+	{
+		size_t offset = 0;
+		for(size_t i=0;i<N;i++) {
+			assert(idx[i] < shape_[i]);
+			offset += idx[i]*stride_[i];
+		}
+		return offset;
+	}
+
+	T* data() const {return ptr_;}
+	const index_type& shape() const {return shape_;}
+	size_t shape(size_t dim) const {return shape_[dim];}
+	const index_type& stride() const {return stride_;}
+	size_t size() const {return size_;}
+	bool iscontiguous() const {return contiguous_;}
+	bool has_value() const {return ptr_ != nullptr;}
+
+	const Tensor& tensor() const {return tensor_;}
+
+	// Calls f on each element in row-major order
+	template <typename Func>
+	void forEach(Func f) const
+	{
+		if(contiguous_ || N == 0) {
+			for(size_t i=0;i<size_;i++)
+				f(ptr_[i]);
+		}
+		else
+			forEachImpl<0>(ptr_, f);
+	}
+
+	void fill(const T& value) const {forEach([&](T& v){v = value;});}
+
+	template <typename Acc = std::conditional_t<std::is_same_v<T, bool>, size_t, T>>
+	Acc sum() const
+	{
+		Acc res = Acc(0);
+		forEach([&](const T& v){res += v;});
+		return res;
+	}
+
+protected:
+	static Shape toShape(const index_type& shape)
+	{
+		Shape s;
+		for(auto v : shape)
+			s.push_back(v);
+		return s;
+	}
+
+	template <size_t Dim, typename Func>
+	void forEachImpl(T* ptr, Func& f) const
+	{
+		if constexpr(Dim < N) {
+			for(size_t i=0;i<shape_[Dim];i++) {
+				if constexpr(Dim+1 == N)
+					f(ptr[i*stride_[Dim]]);
+				else
+					forEachImpl<Dim+1>(ptr+i*stride_[Dim], f);
+			}
+		}
+	}
+
+	Tensor tensor_;
+	T* ptr_ = nullptr;
+	index_type shape_ = {};
+	index_type stride_ = {};
+	size_t size_ = 0;
+	bool contiguous_ = true;
+};
+
+template <typename T, size_t N>
+inline TypedTensor<T, N> typed(const Tensor& t)
+{
+	return TypedTensor<T, N>(t);
+}
+
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <Etaler/Core/Tensor.hpp>
+#include <Etaler/Core/Serialize.hpp>
+#include <Etaler/Core/DefaultBackend.hpp>
+#include <Etaler/Core/Compression.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace et
+{
+
+// Number of bytes used by the tensors in a StateDict
+inline size_t stateMemoryUsage(const StateDict& states)
+{
+	size_t bytes = 0;
+	auto tensor_bytes = [](const Tensor& t) -> size_t {
+		return t.has_value() ? t.size()*dtypeToSize(t.dtype()) : 0;
+	};
+	for(const auto& [key, value] : states) {
+		if(value.type() == typeid(Tensor))
+			bytes += tensor_bytes(std::any_cast<const Tensor&>(value));
+		else if(value.type() == typeid(std::vector<Tensor>)) {
+			for(const auto& t : std::any_cast<const std::vector<Tensor>&>(value))
+				bytes += tensor_bytes(t);
+		}
+		else if(value.type() == typeid(StateDict))
+			bytes += stateMemoryUsage(std::any_cast<const StateDict&>(value));
+	}
+	return bytes;
+}
+
+struct ModelCacheStats
+{
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t evictions = 0; // Models removed from the main backend. Including the demoted ones
+	size_t demotions = 0;
+	size_t promotions = 0;
+	size_t compressions = 0;
+	size_t decompressions = 0;
+	double total_load_time = 0; // In seconds
+	double total_decompress_time = 0;
+
+	double averageLoadTime() const {return misses == 0 ? 0 : total_load_time/misses;}
+	double averageDecompressTime() const {return decompressions == 0 ? 0 : total_decompress_time/decompressions;}
+};
+
+// ModelCache keeps a set of models (SpatialPooler, TemporalMemory, SDRClassifer or anything with states(),
+// loadState() and to()) saved by et::save. A model is loaded the first time it is requested. When the tensors
+// of the resident models uses more memory than the budget, the least recently used ones are evicted.
+//
+// Optionally a host backend can be set as a second tier. Models evicted from the main backend (ex: an
+// OpenCLBackend) are then demoted to the host backend instead of being dropped, and promoted back when
+// requested again. The host tier has it's own budget.
+//
+// With compression enabled, models not used for a while, and models that would be dropped for lack of memory,
+// are compressed in host memory instead (see compressState()). They are decompressed when requested again, which
+// is much faster than loading them from disk. Idle models are only compressed when compressIdle() is called, ex:
+// periodically from a maintenance thread. The compressed tier has it's own budget too.
+//
+// Evicted models that are still held by the caller stay alive until released, but are no longer counted.
+// All methods are thread safe. Loading, decompressing and promoting a model is done without holding the cache's
+// lock, so requests for other models are not blocked by it. Concurrent requests for the same model wait for the
+// first one to bring it in.
+//
+// Usage:
+//	ModelCache<SpatialPooler> cache(1024*1024*1024);
+//	cache.add("customer1", "customer1_sp.cereal");
+//	Tensor y = cache.get("customer1")->compute(x);
+template <typename Model>
+struct ModelCache
+{
+	ModelCache(size_t memory_budget, Backend* backend=defaultBackend())
+		: backend_(backend), memory_budget_(memory_budget) {}
+
+	// Registers a model to be loaded from path when requested
+	void add(const std::string& key, const std::string& path)
+	{
+		std::unique_lock lock(mutex_);
+		Entry& entry = waitLoaded(lock, entries_[key]);
+		drop(entry);
+		entry.path = path;
+	}
+
+	// Returns the model. Loads it if it is not resident
+	std::shared_ptr<Model> get(const std::string& key)
+	{
+		std::unique_lock lock(mutex_);
+		auto it = entries_.find(key);
+		et_check(it != entries_.end(), "Model " + key + " is not registered in the cache");
+		Entry& entry = waitLoaded(lock, it->second);
+		entry.last_used = std::chrono::steady_clock::now();
+
+		if(entry.tier == Tier::Main) {
+			stats_.hits++;
+			lru_.splice(lru_.begin(), lru_, entry.lru_pos);
+			return entry.model;
+		}
+
+		// Take the model out of it's tier and bring it in without holding the lock
+		Tier tier = entry.tier;
+		std::shared_ptr<Model> host_model = entry.model;
+		StateDict compressed = std::move(entry.compressed);
+		std::string path = entry.path;
+		drop(entry);
+		entry.loading = true;
+		if(tier == Tier::None)
+			stats_.misses++;
+		else
+			stats_.hits++;
+		if(tier == Tier::Host)
+			stats_.promotions++;
+		else if(tier == Tier::Compressed)
+			stats_.decompressions++;
+		lock.unlock();
+
+		std::shared_ptr<Model> model;
+		double seconds = 0;
+		try {
+			auto t0 = std::chrono::high_resolution_clock::now();
+			if(tier == Tier::Host)
+				model = std::make_shared<Model>(host_model->to(backend_));
+			else if(tier == Tier::Compressed) {
+				model = std::make_shared<Model>();
+				model->loadState(decompressState(compressed, backend_));
+			}
+			else {
+				Model m;
+				m.loadState(load(path));
+				model = std::make_shared<Model>(m.to(backend_));
+			}
+			auto t1 = std::chrono::high_resolution_clock::now();
+			seconds = std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count();
+		}
+		catch(...) {
+			// The model is left unloaded. The next request loads it from disk
+			lock.lock();
+			entry.loading = false;
+			entry.loaded.notify_all();
+			throw;
+		}
+
+		lock.lock();
+		if(tier == Tier::None)
+			stats_.total_load_time += seconds;
+		else if(tier == Tier::Compressed)
+			stats_.total_decompress_time += seconds;
+		entry.loading = false;
+		insert(key, entry, model);
+		entry.loaded.notify_all();
+		return model;
+	}
+
+	// Removes the model from memory. It will be loaded again when requested
+	void evict(const std::string& key)
+	{
+		std::unique_lock lock(mutex_);
+		auto it = entries_.find(key);
+		if(it != entries_.end())
+			drop(waitLoaded(lock, it->second));
+	}
+
+	// Demote models evicted from the main backend to host instead of dropping them
+	void setHostTier(Backend* host, size_t host_memory_budget)
+	{
+		std::lock_guard lock(mutex_);
+		et_check(host != backend_, "The host tier must be on a different backend");
+		host_backend_ = host;
+		host_memory_budget_ = host_memory_budget;
+		evictHost();
+	}
+
+	// Compress models unused for idle_timeout, and models that would be dropped, instead of dropping them
+	void setCompression(std::chrono::milliseconds idle_timeout, CompressionOptions options=CompressionOptions()
+		, size_t compressed_memory_budget=std::numeric_limits<size_t>::max())
+	{
+		std::lock_guard lock(mutex_);
+		compression_ = true;
+		idle_timeout_ = idle_timeout;
+		compression_options_ = options;
+		compressed_memory_budget_ = compressed_memory_budget;
+		evictCompressed();
+	}
+
+	// Compresses the models unused for longer than the idle timeout. The compression runs without holding the
+	// cache's lock, requests for the models being compressed wait for it
+	void compressIdle()
+	{
+		std::unique_lock lock(mutex_);
+		if(compression_ == false)
+			return;
+
+		// The least recently used models are at the back of the lists
+		auto now = std::chrono::steady_clock::now();
+		std::vector<std::pair<std::string, std::shared_ptr<Model>>> idle;
+		for(auto* lru : {&lru_, &host_lru_}) {
+			while(lru->empty() == false) {
+				const std::string key = lru->back();
+				Entry& entry = entries_.at(key);
+				if(now - entry.last_used < idle_timeout_)
+					break;
+				idle.push_back({key, entry.model});
+				drop(entry);
+				entry.loading = true;
+			}
+		}
+		CompressionOptions options = compression_options_;
+		lock.unlock();
+
+		std::vector<StateDict> compressed;
+		std::exception_ptr error;
+		try {
+			for(const auto& [key, model] : idle)
+				compressed.push_back(compressState(model->states(), options));
+		}
+		catch(...) {
+			// The models not compressed are left unloaded
+			error = std::current_exception();
+			compressed.resize(idle.size());
+		}
+
+		lock.lock();
+		for(size_t i=0;i<idle.size();i++) {
+			Entry& entry = entries_.at(idle[i].first);
+			entry.loading = false;
+			if(compressed[i].empty() == false) {
+				stats_.compressions++;
+				storeCompressed(idle[i].first, entry, std::move(compressed[i]));
+			}
+			entry.loaded.notify_all();
+		}
+		evictCompressed();
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+	void setMemoryBudget(size_t memory_budget)
+	{
+		std::lock_guard lock(mutex_);
+		memory_budget_ = memory_budget;
+		evictMain();
+	}
+
+	bool isResident(const std::string& key) const
+	{
+		std::lock_guard lock(mutex_);
+		auto it = entries_.find(key);
+		return it != entries_.end() && it->second.tier == Tier::Main;
+	}
+
+	bool isDemoted(const std::string& key) const
+	{
+		std::lock_guard lock(mutex_);
+		auto it = entries_.find(key);
+		return it != entries_.end() && it->second.tier == Tier::Host;
+	}
+
+	bool isCompressed(const std::string& key) const
+	{
+		std::lock_guard lock(mutex_);
+		auto it = entries_.find(key);
+		return it != entries_.end() && it->second.tier == Tier::Compressed;
+	}
+
+	// Memory used by the model's tensors, compressed or not. 0 if not loaded
+	size_t memoryUsage(const std::string& key) const
+	{
+		std::lock_guard lock(mutex_);
+		auto it = entries_.find(key);
+		return it == entries_.end() ? 0 : it->second.bytes;
+	}
+
+	size_t memoryUsage() const {std::lock_guard lock(mutex_); return memory_usage_;}
+	size_t hostMemoryUsage() const {std::lock_guard lock(mutex_); return host_memory_usage_;}
+	size_t compressedMemoryUsage() const {std::lock_guard lock(mutex_); return compressed_memory_usage_;}
+	size_t memoryBudget() const {std::lock_guard lock(mutex_); return memory_budget_;}
+	size_t numModels() const {std::lock_guard lock(mutex_); return entries_.size();}
+	ModelCacheStats stats() const {std::lock_guard lock(mutex_); return stats_;}
+	void resetStats() {std::lock_guard lock(mutex_); stats_ = ModelCacheStats();}
+
+protected:
+	enum class Tier
+	{
+		None,
+		Main,
+		Host,
+		Compressed
+	};
+
+	struct Entry
+	{
+		std::string path;
+		std::shared_ptr<Model> model;
+		StateDict compressed;
+		size_t bytes = 0;
+		Tier tier = Tier::None;
+		typename std::list<std::string>::iterator lru_pos;
+		std::chrono::steady_clock::time_point last_used;
+		bool loading = false; // Being brought in by get() without the lock held
+		std::condition_variable loaded;
+	};
+
+	Entry& waitLoaded(std::unique_lock<std::mutex>& lock, Entry& entry)
+	{
+		entry.loaded.wait(lock, [&entry]{ return entry.loading == false; });
+		return entry;
+	}
+
+	void insert(const std::string& key, Entry& entry, std::shared_ptr<Model> model)
+	{
+		entry.model = std::move(model);
+		entry.bytes = stateMemoryUsage(entry.model->states());
+		entry.tier = Tier::Main;
+		lru_.push_front(key);
+		entry.lru_pos = lru_.begin();
+		memory_usage_ += entry.bytes;
+
+		// Keep the newly loaded model even if it alone is larger than the budget
+		evictMain(&entry);
+	}
+
+	void drop(Entry& entry)
+	{
+		if(entry.tier == Tier::Main) {
+			memory_usage_ -= entry.bytes;
+			lru_.erase(entry.lru_pos);
+		}
+		else if(entry.tier == Tier::Host) {
+			host_memory_usage_ -= entry.bytes;
+			host_lru_.erase(entry.lru_pos);
+		}
+		else if(entry.tier == Tier::Compressed) {
+			compressed_memory_usage_ -= entry.bytes;
+			compressed_lru_.erase(entry.lru_pos);
+		}
+		entry.model = nullptr;
+		entry.compressed.clear();
+		entry.bytes = 0;
+		entry.tier = Tier::None;
+	}
+
+	void evictMain(const Entry* keep=nullptr)
+	{
+		while(memory_usage_ > memory_budget_ && lru_.empty() == false) {
+			const std::string key = lru_.back();
+			Entry& entry = entries_.at(key);
+			if(&entry == keep)
+				break;
+
+			stats_.evictions++;
+			if(host_backend_ == nullptr || entry.bytes > host_memory_budget_) {
+				compressOrDrop(key, entry);
+				continue;
+			}
+
+			stats_.demotions++;
+			auto model = std::make_shared<Model>(entry.model->to(host_backend_));
+			size_t bytes = entry.bytes;
+			drop(entry);
+			entry.model = std::move(model);
+			entry.bytes = bytes;
+			entry.tier = Tier::Host;
+			host_lru_.push_front(key);
+			entry.lru_pos = host_lru_.begin();
+			host_memory_usage_ += bytes;
+			evictHost();
+		}
+	}
+
+	void evictHost()
+	{
+		while(host_memory_usage_ > host_memory_budget_ && host_lru_.empty() == false) {
+			const std::string key = host_lru_.back();
+			compressOrDrop(key, entries_.at(key));
+		}
+	}
+
+	void evictCompressed()
+	{
+		while(compressed_memory_usage_ > compressed_memory_budget_ && compressed_lru_.empty() == false)
+			drop(entries_.at(compressed_lru_.back()));
+	}
+
+	void compressOrDrop(const std::string& key, Entry& entry)
+	{
+		if(compression_ == false) {
+			drop(entry);
+			return;
+		}
+
+		stats_.compressions++;
+		StateDict compressed = compressState(entry.model->states(), compression_options_);
+		drop(entry);
+		storeCompressed(key, entry, std::move(compressed));
+		evictCompressed();
+	}
+
+	void storeCompressed(const std::string& key, Entry& entry, StateDict compressed)
+	{
+		entry.compressed = std::move(compressed);
+		entry.bytes = et::compressedMemoryUsage(entry.compressed);
+		entry.tier = Tier::Compressed;
+		compressed_lru_.push_front(key);
+		entry.lru_pos = compressed_lru_.begin();
+		compressed_memory_usage_ += entry.bytes;
+	}
+
+	Backend* backend_;
+	Backend* host_backend_ = nullptr;
+	size_t memory_budget_;
+	size_t host_memory_budget_ = 0;
+	size_t memory_usage_ = 0;
+	size_t host_memory_usage_ = 0;
+	bool compression_ = false;
+	std::chrono::milliseconds idle_timeout_{0};
+	CompressionOptions compression_options_;
+	size_t compressed_memory_budget_ = 0;
+	size_t compressed_memory_usage_ = 0;
+
+	std::map<std::string, Entry> entries_;
+	std::list<std::string> lru_;
+	std::list<std::string> host_lru_;
+	std::list<std::string> compressed_lru_;
+	ModelCacheStats stats_;
+	mutable std::mutex mutex_;
+};
+
+}
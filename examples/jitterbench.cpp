@@ -0,0 +1,104 @@
+#include <Etaler/Etaler.hpp>
+#include <Etaler/Backends/CPUBackend.hpp>
+#include <Etaler/Backends/RealtimePool.hpp>
+#include <Etaler/Algorithms/SpatialPooler.hpp>
+#include <Etaler/Algorithms/TemporalMemory.hpp>
+#include <Etaler/Core/MemoryPlanner.hpp>
+#include <Etaler/Encoders/Scalar.hpp>
+using namespace et;
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+// Step latency distribution. p99.99 needs at least 10000 steps to mean anything
+void report(const std::string& name, std::vector<double> latencies)
+{
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double q) {
+		return latencies[std::min((size_t)(q*latencies.size()), latencies.size()-1)]*1000;
+	};
+	std::cout << name << ": p50 " << percentile(0.5) << "ms, p99 " << percentile(0.99) << "ms, p99.9 " << percentile(0.999)
+		<< "ms, p99.99 " << percentile(0.9999) << "ms, max " << latencies.back()*1000 << "ms" << std::endl;
+}
+
+// Runs `step` num_steps times with the temporary tensors planned by a MemoryPlanner and returns the latency of
+// every step. Runs the kernels on pool if it's not null
+template <typename Func>
+std::vector<double> measure(Backend* backend, RealtimePool* pool, size_t num_steps, Func step)
+{
+	std::unique_ptr<RealtimeScope> scope;
+	if(pool != nullptr)
+		scope = std::make_unique<RealtimeScope>(*pool);
+
+	MemoryPlanner planner(backend);
+	std::vector<double> latencies(num_steps);
+	// Warm up. Lets the planner record the step and faults in the memory
+	for(size_t i=0;i<10;i++) {
+		planner.beginStep();
+		step(i);
+		planner.endStep();
+	}
+
+	for(size_t i=0;i<num_steps;i++) {
+		auto t0 = std::chrono::steady_clock::now();
+		planner.beginStep();
+		step(i);
+		planner.endStep();
+		auto t1 = std::chrono::steady_clock::now();
+		latencies[i] = std::chrono::duration<double>(t1-t0).count();
+	}
+	return latencies;
+}
+
+std::vector<Tensor> generateRandomData(size_t input_length, size_t num_data, Backend* backend)
+{
+	std::vector<Tensor> res(num_data);
+	static std::mt19937 rng;
+	std::uniform_real_distribution<float> dist(0, 1);
+
+	for(size_t i=0;i<num_data;i++)
+		res[i] = encoder::scalar(dist(rng), 0, 1, input_length, input_length*0.15).to(backend);
+	return res;
+}
+
+void benchmark(Backend* backend, RealtimePool* pool, size_t num_steps)
+{
+	auto data = generateRandomData(1024, 100, backend);
+
+	SpatialPooler sp({1024}, {2048}, 0.75, 42, 0.1, 0, backend);
+	report("SpatialPooler", measure(backend, pool, num_steps, [&](size_t i) {
+		const Tensor& x = data[i%data.size()];
+		sp.learn(x, sp.compute(x));
+	}));
+
+	TemporalMemory tm({1024}, 16, 64, backend);
+	Tensor last_state = zeros({1024, 16}, DType::Bool, backend);
+	Tensor last_pred = zeros({1024, 16}, DType::Bool, backend);
+	report("TemporalMemory", measure(backend, pool, num_steps, [&](size_t i) {
+		auto [pred, active] = tm.compute(data[i%data.size()], last_pred);
+		tm.learn(active, last_state);
+		last_state = active;
+		last_pred = pred;
+	}));
+}
+
+// Usage: jitterbench [steps] [threads] [--mlock]
+int main(int argc, char** argv)
+{
+	size_t num_steps = argc > 1 ? std::stoul(argv[1]) : 20000;
+	RealtimeOptions options;
+	options.num_threads = argc > 2 ? std::stoul(argv[2]) : 0;
+	options.lock_memory = argc > 3 && strcmp(argv[3], "--mlock") == 0;
+
+	auto backend = std::make_shared<CPUBackend>();
+	std::cout << "Step latency over " << num_steps << " steps\n\nTBB thread pool:\n";
+	benchmark(backend.get(), nullptr, num_steps);
+
+	RealtimePool pool(options);
+	std::cout << "\nReal-time pool with " << pool.size() << " threads" << (options.lock_memory ? ", memory locked" : "") << ":\n";
+	benchmark(backend.get(), &pool, num_steps);
+}
@@ -32,6 +32,24 @@ float benchmarkSpatialPooler(const Shape& out_shape, const std::vector<Tensor>&
 	return std::chrono::duration_cast<std::chrono::duration<float>>(t1-t0).count()/num_epoch;
 }
 
+std::vector<Tensor> generateRandomData(size_t input_length, size_t num_data);
+
+void benchmarkApproximation(size_t input_len, const Shape& out_shape, size_t num_data)
+{
+	auto data = generateRandomData(input_len, num_data);
+	SpatialPooler sp(data[0].shape(), out_shape);
+	sp.shuffleSynapses();
+	for(const auto& d : data)
+		sp.learn(d, sp.compute(d));
+
+	std::cout << "\nApproximate inference with " << out_shape.volume() << " columns and " << input_len << " bits per SDR\n";
+	for(float fraction : {0.5f, 0.25f, 0.1f, 0.05f}) {
+		ApproximationReport report = sp.evaluateApproximation(data, fraction);
+		std::cout << fraction*100 << "% synapses: " << report.approximate_time*1000 << "ms vs exact " << report.exact_time*1000
+			<< "ms, " << report.speedup() << "x faster, average overlap " << report.overlap << ", worst " << report.min_overlap << std::endl;
+	}
+}
+
 std::vector<Tensor> generateRandomData(size_t input_length, size_t num_data)
 {
 	std::vector<Tensor> res(num_data);
@@ -61,4 +79,6 @@ int main()
 		std::cout << input_len << " bits per SDR, " << t/num_data*1000 << "ms per forward" << std::endl;
 		//std::cout << input_len << "," << t/num_data*1000 << std::endl;
 	}
+
+	benchmarkApproximation(2048, {65536}, 20);
 }
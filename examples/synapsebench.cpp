@@ -0,0 +1,63 @@
+#include <Etaler/Etaler.hpp>
+#include <Etaler/Backends/CPUBackend.hpp>
+using namespace et;
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+
+//Compares the CPU synapse kernels specialized for common synapse counts against the generic kernel
+
+float benchmarkKernels(CPUBackend* backend, const Tensor& x, const Tensor& learn, const Tensor& connections, Tensor& permanences, size_t num_iter)
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for(size_t i=0;i<num_iter;i++) {
+		Tensor y = cellActivity(x, connections, permanences, 0.21, 2, false);
+		learnCorrilation(x, learn, connections, permanences, 0.1, 0.1, false);
+	}
+	backend->sync();
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::duration<float>>(t1-t0).count()/num_iter;
+}
+
+int main()
+{
+	auto backend = std::make_shared<CPUBackend>();
+	std::mt19937 rng;
+
+	const size_t input_size = 4096;
+	const size_t num_cells = 2048;
+	const size_t num_iter = 100;
+
+	std::cout << "Benchmarking synapse kernels with " << num_cells << " cells and " << input_size << " inputs\n\n";
+
+	for(size_t width : {16, 32, 64, 128, 256, 1024}) {
+		std::vector<int32_t> conns(num_cells*width);
+		std::vector<float> perms(num_cells*width);
+		for(auto& c : conns)
+			c = rng()%input_size;
+		for(auto& p : perms)
+			p = (rng()%1000)/1000.f;
+		std::vector<uint8_t> in(input_size), learn(num_cells);
+		for(auto& v : in)
+			v = rng()%10 == 0;
+		for(auto& v : learn)
+			v = rng()%50 == 0;
+
+		Shape s = {(intmax_t)num_cells, (intmax_t)width};
+		Tensor c = Tensor(s, conns.data(), backend.get());
+		Tensor p = Tensor(s, perms.data(), backend.get());
+		Tensor x = Tensor({(intmax_t)input_size}, in.data(), backend.get());
+		Tensor l = Tensor({(intmax_t)num_cells}, learn.data(), backend.get());
+
+		backend->setSpecializedKernels(false);
+		float generic = benchmarkKernels(backend.get(), x, l, c, p, num_iter);
+		backend->setSpecializedKernels(true);
+		float specialized = benchmarkKernels(backend.get(), x, l, c, p, num_iter);
+
+		std::cout << width << " synapses per cell: generic " << generic*1000 << "ms, specialized "
+			<< specialized*1000 << "ms, speedup " << generic/specialized << "x" << std::endl;
+	}
+}
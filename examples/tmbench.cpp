@@ -8,6 +8,9 @@ using namespace et;
 #include <vector>
 #include <chrono>
 #include <random>
+#include <thread>
+
+#include <tbb/global_control.h>
 
 float benchmarkTemporalMemory(const std::vector<Tensor>& x, size_t num_epoch)
 {
@@ -41,6 +44,54 @@ float benchmarkTemporalMemory(const std::vector<Tensor>& x, size_t num_epoch)
 	return time_used/num_epoch;
 }
 
+std::vector<Tensor> generateRandomData(size_t input_length, size_t num_data);
+
+//Sequences per second when training on many independent sequences at once, with different number of threads
+void benchmarkSequenceTraining(size_t input_len, size_t num_sequences, size_t sequence_length, size_t batch_size)
+{
+	std::vector<std::vector<Tensor>> sequences(num_sequences);
+	for(auto& s : sequences)
+		s = generateRandomData(input_len, sequence_length);
+
+	std::cout << "\nTraining on " << num_sequences << " sequences of " << sequence_length << " steps, "
+		<< input_len << " bits per SDR, batch size " << batch_size << "\n";
+	{
+		//Baseline: one sequence at a time through compute()/learn()
+		TemporalMemory tm(sequences[0][0].shape(), 16, 64);
+		auto t0 = std::chrono::high_resolution_clock::now();
+		for(const auto& sequence : sequences) {
+			Tensor last_state = zeros(sequence[0].shape() + 16, DType::Bool);
+			Tensor last_predict = zeros(sequence[0].shape() + 16, DType::Bool);
+			for(const auto& d : sequence) {
+				auto [pred, active] = tm.compute(d, last_predict);
+				tm.learn(active, last_state);
+				last_state = active;
+				last_predict = pred;
+			}
+		}
+		defaultBackend()->sync();
+		auto t1 = std::chrono::high_resolution_clock::now();
+		float t = std::chrono::duration_cast<std::chrono::duration<float>>(t1-t0).count();
+		std::cout << "compute()/learn(): " << num_sequences/t << " sequences/s" << std::endl;
+	}
+
+	float single_thread = 0;
+	for(size_t threads=1;threads<=std::thread::hardware_concurrency();threads*=2) {
+		tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads);
+		TemporalMemory tm(sequences[0][0].shape(), 16, 64);
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+		tm.trainSequences(sequences, batch_size);
+		defaultBackend()->sync();
+		auto t1 = std::chrono::high_resolution_clock::now();
+
+		float t = std::chrono::duration_cast<std::chrono::duration<float>>(t1-t0).count();
+		if(threads == 1)
+			single_thread = t;
+		std::cout << threads << " threads: " << num_sequences/t << " sequences/s, " << single_thread/t << "x" << std::endl;
+	}
+}
+
 std::vector<Tensor> generateRandomData(size_t input_length, size_t num_data)
 {
 	std::vector<Tensor> res(num_data);
@@ -70,4 +121,6 @@ int main()
 		std::cout << input_len << " bits per SDR, " << t/num_data*1000 << "ms per forward" << std::endl;
 		//std::cout << input_len << "," << t/num_data*1000 << std::endl;
 	}
+
+	benchmarkSequenceTraining(256, 512, 32, 64);
 }
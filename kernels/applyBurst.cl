@@ -8,14 +8,15 @@
 
 //x: the input SDR
 //y: the output SDR
+//x_view: How x is layed out in the buffer. See view.cl
 //global_size: arbitrary
-kernel void applyBurst(global bool* restrict x, global bool* restrict y)
+kernel void applyBurst(global bool* restrict x, global bool* restrict y, View x_view)
 {
 	int global_size = get_global_size(0);
 	int global_id = get_global_id(0);
-	for(int i=global_id;i<NUM_COLUMNS;i+=global_size) {
+	for(long i=global_id;i<NUM_COLUMNS;i+=global_size) {
 		int fill_value = -1;
-		if(x[i] == 0)
+		if(x[offset_from_index(x_view, i)] == 0)
 			fill_value = 0;
 		else {
 			int sum = 0;
@@ -0,0 +1,136 @@
+#ifndef INPUT_SIZE
+	#error "INPUT_SIZE not defined"
+#endif
+
+#ifndef NUM_CELLS
+	#error "NUM_CELLS not defined"
+#endif
+
+#ifndef MAX_SYNAPSE_PER_CELL
+	#error "MAX_SYNAPSE_PER_CELL not defined"
+#endif
+
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
+#ifndef PERM_TYPE
+	#error "PERM_TYPE not defined"
+#endif
+
+#ifndef NO_UNUSED_SYNAPSE
+	#define NO_UNUSED_SYNAPSE false
+#endif
+
+//global_size: Arbitrary
+//local_size:  Arbitrary
+//x: Contiguous inputs of all batch entries, INPUT_SIZE elements each, starting at input_offset
+//y: Activity of all entries, NUM_CELLS elements each
+kernel void batchCellActivity(global bool* restrict x, global int* restrict synapses
+	, global PERM_TYPE* restrict permeances, global int* restrict y
+	, float connected_perm, int active_threshold, int batch_size, long synapse_offset, long permeance_offset, long input_offset)
+{
+	x += input_offset;
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long idx=global_id;idx<(long)batch_size*NUM_CELLS;idx+=global_size) {
+		long i = idx % NUM_CELLS;
+		global bool* input = x + (idx/NUM_CELLS)*INPUT_SIZE;
+		int sum = 0;
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			int target_cell = synapses[i*ROW_STRIDE+j];
+			if(!NO_UNUSED_SYNAPSE && target_cell == -1)
+				break;
+			if(input[target_cell] == 0)
+				continue;
+			sum += (permeances[i*ROW_STRIDE+j] > connected_perm);
+		}
+		y[idx] = sum >= active_threshold ? sum : 0;
+	}
+}
+
+//Each work item owns whole cells and sums the updates from all entries before clamping. So no atomics are needed
+//and the result is deterministic
+//x, learn: Contiguous inputs and learning masks of all batch entries, starting at input_offset and learn_offset
+kernel void batchLearnCorrilation(global bool* restrict x, global bool* restrict learn
+	, global int* restrict synapses, global PERM_TYPE* restrict permeances
+	, float permeance_inc, float permeance_dec, int batch_size, long synapse_offset, long permeance_offset
+	, long input_offset, long learn_offset)
+{
+	x += input_offset;
+	learn += learn_offset;
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<NUM_CELLS;i+=global_size) {
+		bool any_learning = false;
+		for(int b=0;b<batch_size;b++)
+			any_learning |= learn[(long)b*NUM_CELLS+i];
+		if(any_learning == false)
+			continue;
+
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			long idx = i*ROW_STRIDE+j;
+			int target_cell = synapses[idx];
+			if(!NO_UNUSED_SYNAPSE && target_cell == -1)
+				break;
+
+			float delta = 0;
+			for(int b=0;b<batch_size;b++) {
+				if(learn[(long)b*NUM_CELLS+i] == false)
+					continue;
+				delta += x[(long)b*INPUT_SIZE+target_cell] ? permeance_inc : -permeance_dec;
+			}
+			permeances[idx] = clamp((float)permeances[idx]+delta, 0.f, 1.f);
+		}
+	}
+}
+
+//Each work item owns whole cells and grows them entry by entry in batch order, so the result is the same as growing
+//the entries one after another and no atomics are needed
+//x, learn: Contiguous inputs and learning cells of all batch entries, starting at input_offset and learn_offset
+kernel void batchGrowSynapses(global bool* restrict x, global bool* restrict learn
+	, global int* restrict synapses, global PERM_TYPE* restrict permeances
+	, float initial_perm, int batch_size, long synapse_offset, long permeance_offset
+	, long input_offset, long learn_offset)
+{
+	x += input_offset;
+	learn += learn_offset;
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<NUM_CELLS;i+=global_size) {
+		global int* restrict cell_synapses = synapses+i*ROW_STRIDE;
+		global PERM_TYPE* restrict strengths = permeances+i*ROW_STRIDE;
+
+		int used = 0;
+		while(used < MAX_SYNAPSE_PER_CELL && cell_synapses[used] != -1)
+			used++;
+
+		for(int b=0;b<batch_size && used<MAX_SYNAPSE_PER_CELL;b++) {
+			if(learn[(long)b*NUM_CELLS+i] == false)
+				continue;
+
+			global bool* input = x + (long)b*INPUT_SIZE;
+			for(int j=0;j<INPUT_SIZE && used<MAX_SYNAPSE_PER_CELL;j++) {
+				if(input[j] == false)
+					continue;
+				bool connected = false;
+				for(int k=0;k<used;k++)
+					connected |= cell_synapses[k] == j;
+				if(connected)
+					continue;
+				cell_synapses[used] = j;
+				strengths[used] = initial_perm;
+				used++;
+			}
+		}
+	}
+}
@@ -12,11 +12,12 @@
 
 //InType: Input Type
 //OutType: OutputType
+//x_view: How x is layed out in the buffer. See view.cl
 //global_size: arbitrary
-kernel void cast(global InType* restrict x, global OutType* restrict y, int problem_size)
+kernel void cast(global InType* restrict x, global OutType* restrict y, long problem_size, View x_view)
 {
 	int id = get_global_id(0);
 	int size = get_global_size(0);
-	for(int i=id;i<problem_size;i+=size)
-		y[i] = (OutType)x[i];
+	for(long i=id;i<problem_size;i+=size)
+		y[i] = (OutType)x[offset_from_index(x_view, i)];
 }
\ No newline at end of file
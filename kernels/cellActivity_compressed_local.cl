@@ -6,6 +6,10 @@
 	#error "MAX_SYNAPSE_PER_CELL not defined"
 #endif
 
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
 #ifndef PERM_TYPE
 	#error "PERM_TYPE not defined"
 #endif
@@ -23,10 +27,16 @@ int up_round(int v, int mul)
 //local_size:  Arbitrary, but prefer multipel of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
 //INPUT_SIZE: The size of input SDR, must be smaller then CL_DEVICE_LOCAL_MEMORY_SIZE*8-8
 //NO_UNUSED_SYNAPSE: If there are unised synapses. Useful for sparial pooler, accelerates ~30%
+//ROW_STRIDE: Distance between the synapses of two consecutive cells. Defaults to MAX_SYNAPSE_PER_CELL
+//x_view: How x is layed out in the buffer. See view.cl
 kernel void cellActivity(global bool* restrict x, global int* restrict synapses
 	, global PERM_TYPE* restrict permeances, global int* restrict y
-	, float connected_perm, int active_threshold, int output_size)
+	, float connected_perm, int active_threshold, long output_size
+	, long synapse_offset, long permeance_offset, View x_view)
 {
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
 	//Load input state into local memory for faster access
 	local unsigned char xl[INPUT_SIZE/8+1];
 	int id = get_local_id(0);
@@ -36,7 +46,7 @@ kernel void cellActivity(global bool* restrict x, global int* restrict synapses
 		unsigned char res = 0;
 		#pragma unroll
 		for(int j=0;j<8;j++)
-			res |= x[i*8+j] << j;
+			res |= x[offset_from_index(x_view, i*8+j)] << j;
 		xl[i] = res;
 	}
 
@@ -45,7 +55,7 @@ kernel void cellActivity(global bool* restrict x, global int* restrict synapses
 		unsigned char res = 0;
 		#pragma unroll
 		for(int j=0;j<8 && i+j < INPUT_SIZE;j++)
-			res |= x[i*8+j] << j;
+			res |= x[offset_from_index(x_view, i*8+j)] << j;
 		xl[i] = res;
 	}
 
@@ -55,15 +65,15 @@ kernel void cellActivity(global bool* restrict x, global int* restrict synapses
 	int global_size = get_global_size(0);
 	int global_id = get_global_id(0);
 
-	int step = max(1, INPUT_SIZE/global_size);
+	long step = max(1L, (long)INPUT_SIZE/global_size);
 	if(global_id < output_size) {
-		int start = global_id*step;
-		int end = (global_id+1)*step;
+		long start = (long)global_id*step;
+		long end = (long)(global_id+1)*step;
 
-		for(int i=start;i<end;i++) {
+		for(long i=start;i<end;i++) {
 			int sum = 0;
 			for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
-				int idx = i*MAX_SYNAPSE_PER_CELL+j;
+				long idx = i*ROW_STRIDE+j;
 				int target_cell = synapses[idx];
 
 				if(!NO_UNUSED_SYNAPSE && target_cell == -1)
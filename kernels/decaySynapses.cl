@@ -6,19 +6,27 @@
 	#error "MAX_SYNAPSE_PER_CELL is not defined"
 #endif
 
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
 #ifndef PERM_TYPE
 	#error "PERM_TYPE not defined"
 #endif
 
 
-kernel void decaySynapses(global int* restrict connections, global PERM_TYPE* restrict permeances, float threshold)
+kernel void decaySynapses(global int* restrict connections, global PERM_TYPE* restrict permeances, float threshold
+	, long connection_offset, long permeance_offset)
 {
+	connections += connection_offset;
+	permeances += permeance_offset;
+
 	int global_size = get_global_size(0);
 	int global_id = get_global_id(0);
 
-	for(int i=global_id;i<NUM_CELLS;i+=global_size) {
-		global int* synapses = connections+i*MAX_SYNAPSE_PER_CELL;
-		global float* strengths = permeances+i*MAX_SYNAPSE_PER_CELL;
+	for(long i=global_id;i<NUM_CELLS;i+=global_size) {
+		global int* synapses = connections+i*ROW_STRIDE;
+		global float* strengths = permeances+i*ROW_STRIDE;
 
 		int synapse_end = MAX_SYNAPSE_PER_CELL-1;
 		for(;synapse_end!=0;synapse_end--) {
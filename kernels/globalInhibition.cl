@@ -14,8 +14,9 @@
 //global_size: Arbitrary
 //local_size:  Arbitrary, but prefer multipel of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
 //INPUT_SIZE: The size of input SDR, must be smaller then CL_DEVICE_LOCAL_MEMORY_SIZE
+//x_view: How x is layed out in the buffer. See view.cl
 #pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable
-kernel void fastTopK(global int* restrict x, global int* restrict result, int k)
+kernel void fastTopK(global int* restrict x, global int* restrict result, long k, View x_view)
 {
 	local unsigned int res[MAX_INPUT_VALUE];
 	int size = get_local_size(0);
@@ -26,8 +27,8 @@ kernel void fastTopK(global int* restrict x, global int* restrict result, int k)
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
-	for(int i=id;i<INPUT_SIZE;i+=size) {
-		int v = x[i];
+	for(long i=id;i<INPUT_SIZE;i+=size) {
+		int v = x[offset_from_index(x_view, i)];
 		if(v < MAX_INPUT_VALUE)
 			atomic_inc(res+v);
 	}
@@ -35,8 +36,8 @@ kernel void fastTopK(global int* restrict x, global int* restrict result, int k)
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	if(id == 0) {
-		int n = INPUT_SIZE-k;
-		int occur_sum = res[0];
+		long n = INPUT_SIZE-k;
+		long occur_sum = res[0];
 		int max_val = 0;
 		bool solved = 0;
 		#pragma unroll 4
@@ -58,13 +59,13 @@ kernel void fastTopK(global int* restrict x, global int* restrict result, int k)
 	}
 }
 
-kernel void threshold(global int* restrict x, global bool* restrict y, global int* restrict threshold)
+kernel void threshold(global int* restrict x, global bool* restrict y, global int* restrict threshold, View x_view)
 {
 	int id = get_global_id(0);
 	int size = get_global_size(0);
 	int thr = *threshold;
-	for(int i=id;i<INPUT_SIZE;i+=size) {
-		int v = x[i];
+	for(long i=id;i<INPUT_SIZE;i+=size) {
+		int v = x[offset_from_index(x_view, i)];
 		y[i] = (v >= thr ? 1 : 0);
 	}
 }
@@ -0,0 +1,69 @@
+#ifndef GROUP_SIZE
+	#error "GROUP_SIZE not defined"
+#endif
+
+#ifndef MAX_INPUT_VALUE
+	#error "MAX_INPUT_VALUE not defined"
+#endif
+
+#if MAX_INPUT_VALUE < 1
+	#error "MAX_INPUT_VALUE >= 0: Assertion failed."
+#endif
+
+//fastTopK and threshold in globalInhibition.cl fused, applied to every GROUP_SIZE consecutive elements of x
+//global_size: local_size * the number of groups. Each work group handles one group
+//local_size:  Arbitrary, but prefer multipel of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+//x_view: How x is layed out in the buffer. See view.cl
+#pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable
+kernel void groupTopK(global int* restrict x, global bool* restrict y, long k, View x_view)
+{
+	local unsigned int res[MAX_INPUT_VALUE];
+	local int threshold;
+	int size = get_local_size(0);
+	int id = get_local_id(0);
+	long group_start = (long)get_group_id(0)*GROUP_SIZE;
+
+	for(int i=id;i<MAX_INPUT_VALUE;i+=size)
+		res[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(long i=id;i<GROUP_SIZE;i+=size) {
+		int v = x[offset_from_index(x_view, group_start+i)];
+		if(v < MAX_INPUT_VALUE)
+			atomic_inc(res+v);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(id == 0) {
+		long n = GROUP_SIZE-k;
+		long occur_sum = res[0];
+		int max_val = 0;
+		bool solved = 0;
+		for(int i=1;i<MAX_INPUT_VALUE;i++) {
+			int occur = res[i];
+			occur_sum += occur;
+			if(occur_sum > n) {
+				threshold = i;
+				solved = true;
+				break;
+			}
+
+			if(occur > 0)
+				max_val = i;
+		}
+
+		if(solved == false)
+			threshold = max_val;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int thr = threshold;
+	for(long i=id;i<GROUP_SIZE;i+=size) {
+		long idx = group_start+i;
+		int v = x[offset_from_index(x_view, idx)];
+		y[idx] = (v >= thr ? 1 : 0);
+	}
+}
@@ -10,6 +10,10 @@
 	#error "MAX_SYNAPSE_PER_CELL is not defined"
 #endif
 
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
 #ifndef PERM_TYPE
 	#error "PERM_TYPE not defined"
 #endif
@@ -21,11 +25,17 @@
 //NUM_CELLS: The number of cells in the layer
 //NUM_INPUT_BITS: Number of bits the input SDR has
 //MAX_SYNAPSE_PER_CELL: The max amount of connections a cell can have
+//ROW_STRIDE: Distance between the synapses of two consecutive cells. Defaults to MAX_SYNAPSE_PER_CELL
+//y_view: How y is layed out in the buffer. See view.cl
 //x: The input SDR **IN SPARSE FORMAT**
 //aux: temporary buffer for storage, must be size of NUM_INPUT_BITS*global_size[0]
 kernel void growSynapses(global int* restrict x, global bool* restrict y, global int* restrict connections
-	, global PERM_TYPE* restrict permeances, float initial_perm, int num_input_on_bits, global bool* restrict aux)
+	, global PERM_TYPE* restrict permeances, float initial_perm, int num_input_on_bits, global bool* restrict aux
+	, long connection_offset, long permeance_offset, View y_view)
 {
+	connections += connection_offset;
+	permeances += permeance_offset;
+
 	int global_size = get_global_size(0);
 	int global_id = get_global_id(0);
 	int local_id = get_local_id(0);
@@ -35,13 +45,13 @@ kernel void growSynapses(global int* restrict x, global bool* restrict y, global
 
 	local int write_idx;
 
-	for(int i=group_id;i<NUM_CELLS;i+=group_size) {
-		if(y[i] == 0)
+	for(long i=group_id;i<NUM_CELLS;i+=group_size) {
+		if(y[offset_from_index(y_view, i)] == 0)
 			continue;
-		global int* restrict synapses = connections+i*MAX_SYNAPSE_PER_CELL;
-		global float* restrict strengths = permeances+i*MAX_SYNAPSE_PER_CELL;
+		global int* restrict synapses = connections+i*ROW_STRIDE;
+		global float* restrict strengths = permeances+i*ROW_STRIDE;
 		global int const* restrict end = synapses+MAX_SYNAPSE_PER_CELL;
-		global bool* restrict connection_list = aux+group_id*NUM_INPUT_BITS;
+		global bool* restrict connection_list = aux+(long)group_id*NUM_INPUT_BITS;
 
 		if(*(end-1) != -1) //If the last slot is not empty, we are full and we don't need to dod anything
 			continue;
@@ -50,7 +60,7 @@ kernel void growSynapses(global int* restrict x, global bool* restrict y, global
 			write_idx = MAX_SYNAPSE_PER_CELL;
 		barrier(CLK_LOCAL_MEM_FENCE);
 
-		for(int j=local_id;j<NUM_INPUT_BITS;j+=local_size)
+		for(long j=local_id;j<NUM_INPUT_BITS;j+=local_size)
 			connection_list[j] = false;
 
 		int local_min = MAX_SYNAPSE_PER_CELL;
@@ -6,6 +6,10 @@
 	#error "MAX_SYNAPSE_PER_CELL not defined"
 #endif
 
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
 #ifndef OUTPUT_SIZE
 	#error "OUTPUT_SIZE not defined"
 #endif
@@ -22,26 +26,32 @@
 //local_size:  Arbitrary, but prefer multipel of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
 //INPUT_SIZE: The size of input SDR, must be smaller then CL_DEVICE_LOCAL_MEMORY_SIZE
 //NO_UNUSED_SYNAPSE: If there are unised synapses. Useful for sparial pooler, accelerates ~30%
+//ROW_STRIDE: Distance between the synapses of two consecutive cells. Defaults to MAX_SYNAPSE_PER_CELL
+//x_view, y_view: How x and y are layed out in their buffers. See view.cl
 kernel void learnCorrilation(global bool* restrict x, global bool* restrict y
 	, global int* restrict synapses, global PERM_TYPE* restrict permeances
-	, float permeance_inc, float permeance_dec)
+	, float permeance_inc, float permeance_dec
+	, long synapse_offset, long permeance_offset, View x_view, View y_view)
 {
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
 	local char xl[INPUT_SIZE];
 	size_t id = get_local_id(0);
 	size_t size = get_local_size(0);
 	for(size_t i=id;i<INPUT_SIZE;i+=size)
-		xl[i] = x[i];
+		xl[i] = x[offset_from_index(x_view, i)];
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	int global_size = get_global_size(0);
 	int global_id = get_global_id(0);
-	for(int i=global_id;i<OUTPUT_SIZE;i+=global_size) {
-		if(y[i] == false)
+	for(long i=global_id;i<OUTPUT_SIZE;i+=global_size) {
+		if(y[offset_from_index(y_view, i)] == false)
 			continue;
 
 		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
-			int idx = i*MAX_SYNAPSE_PER_CELL+j;
+			long idx = i*ROW_STRIDE+j;
 			int target_cell = synapses[idx];
 
 			if(!NO_UNUSED_SYNAPSE && target_cell == -1)
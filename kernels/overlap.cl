@@ -0,0 +1,101 @@
+#ifndef NUM_BITS
+	#error "NUM_BITS not defined"
+#endif
+
+#ifndef NUM_A
+	#error "NUM_A not defined"
+#endif
+
+#ifndef NUM_B
+	#error "NUM_B not defined"
+#endif
+
+#define TILE_SIZE 16
+#define WORDS_PER_CHUNK 8
+
+//Packs 32 bits of a row into a word. Rows out of range are empty
+uint packWord(global bool* restrict x, View view, int row, int num_rows, int bit)
+{
+	if(row >= num_rows)
+		return 0;
+	uint res = 0;
+	for(int i=0;i<32 && bit+i<NUM_BITS;i++)
+		res |= (uint)(x[offset_from_index(view, (long)row*NUM_BITS+bit+i)] != 0) << i;
+	return res;
+}
+
+//NUM_BITS: The size of each SDR
+//NUM_A, NUM_B: Number of SDRs in a and b
+//a_view, b_view: How a and b are layed out in their buffers. See view.cl
+//y: (output) y[i*NUM_B+j] is the overlap between a[i] and b[j]
+//local_size: {TILE_SIZE, TILE_SIZE}
+//global_size: {NUM_B, NUM_A} rounded up to multiples of TILE_SIZE
+kernel void overlap(global bool* restrict a, global bool* restrict b, global int* restrict y, View a_view, View b_view)
+{
+	//Each work group computes a TILE_SIZE*TILE_SIZE block of the result. A chunk of bits of the SDRs in
+	//the block is packed into local memory at a time, then shared by the work items
+	local uint a_tile[TILE_SIZE][WORDS_PER_CHUNK];
+	local uint b_tile[TILE_SIZE][WORDS_PER_CHUNK];
+
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int local_id = ly*TILE_SIZE+lx;
+	int a_start = get_group_id(1)*TILE_SIZE;
+	int b_start = get_group_id(0)*TILE_SIZE;
+
+	int sum = 0;
+	for(int chunk=0;chunk<NUM_BITS;chunk+=WORDS_PER_CHUNK*32) {
+		for(int i=local_id;i<TILE_SIZE*WORDS_PER_CHUNK;i+=TILE_SIZE*TILE_SIZE) {
+			int row = i/WORDS_PER_CHUNK;
+			int word = i%WORDS_PER_CHUNK;
+			a_tile[row][word] = packWord(a, a_view, a_start+row, NUM_A, chunk+word*32);
+			b_tile[row][word] = packWord(b, b_view, b_start+row, NUM_B, chunk+word*32);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		#pragma unroll
+		for(int w=0;w<WORDS_PER_CHUNK;w++)
+			sum += popcount(a_tile[ly][w] & b_tile[lx][w]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	int i = a_start+ly;
+	int j = b_start+lx;
+	if(i < NUM_A && j < NUM_B)
+		y[(long)i*NUM_B+j] = sum;
+}
+
+//Selects the k largest overlaps of each row. Overlaps smaller than min_overlap are ignored and empty slots
+//are set to -1 in indices
+//overlaps: The result of overlap()
+//global_size: Arbitrary
+kernel void topK(global int* restrict overlaps, global int* restrict indices, global int* restrict values, int k, int min_overlap)
+{
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<NUM_A;i+=global_size) {
+		global int* idx = indices+i*k;
+		global int* val = values+i*k;
+		for(int j=0;j<k;j++) {
+			idx[j] = -1;
+			val[j] = 0;
+		}
+
+		//Insertion into a sorted list of k elements. SDRs with the same overlap are ordered by their index
+		int found = 0;
+		for(int j=0;j<NUM_B;j++) {
+			int v = overlaps[i*NUM_B+j];
+			if(v < min_overlap || (found == k && v <= val[k-1]))
+				continue;
+
+			int pos = min(found, k-1);
+			for(;pos>0 && val[pos-1]<v;pos--) {
+				idx[pos] = idx[pos-1];
+				val[pos] = val[pos-1];
+			}
+			idx[pos] = j;
+			val[pos] = v;
+			found = min(found+1, k);
+		}
+	}
+}
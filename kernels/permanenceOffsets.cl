@@ -0,0 +1,81 @@
+#ifndef INPUT_SIZE
+	#error "INPUT_SIZE not defined"
+#endif
+
+#ifndef MAX_SYNAPSE_PER_CELL
+	#error "MAX_SYNAPSE_PER_CELL not defined"
+#endif
+
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
+#ifndef PERM_TYPE
+	#error "PERM_TYPE not defined"
+#endif
+
+#ifndef NO_UNUSED_SYNAPSE
+	#define NO_UNUSED_SYNAPSE false
+#endif
+
+//Same as cellActivity_global.cl, but the effective permanence is permeances + offsets[cell]
+//x_view, offsets_view: How x and offsets are layed out in their buffers. See view.cl
+kernel void cellActivity(global bool* restrict x, global int* restrict synapses
+	, global PERM_TYPE* restrict permeances, global float* restrict offsets, global int* restrict y
+	, float connected_perm, int active_threshold, long output_size
+	, long synapse_offset, long permeance_offset, View x_view, View offsets_view)
+{
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<output_size;i+=global_size) {
+		float threshold = connected_perm - offsets[offset_from_index(offsets_view, i)];
+		int sum = 0;
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			long idx = i*ROW_STRIDE+j;
+			int target_cell = synapses[idx];
+
+			if(!NO_UNUSED_SYNAPSE && target_cell == -1)
+				break;
+
+			if(x[offset_from_index(x_view, target_cell)] == 0)
+				continue;
+			sum += (permeances[idx] > threshold);
+		}
+		y[i] = sum >= active_threshold ? sum : 0;
+	}
+}
+
+//Only synapses connected to on bits are written. The uniform decrement goes into the cell's offset
+//OUTPUT_SIZE: Number of cells
+//x_view, y_view: How x and y are layed out in their buffers. See view.cl. offsets must be contiguous
+kernel void learnCorrilation(global bool* restrict x, global bool* restrict y
+	, global int* restrict synapses, global PERM_TYPE* restrict permeances, global float* restrict offsets
+	, float permeance_inc, float permeance_dec
+	, long synapse_offset, long permeance_offset, long offsets_offset, View x_view, View y_view)
+{
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+	offsets += offsets_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<OUTPUT_SIZE;i+=global_size) {
+		if(y[offset_from_index(y_view, i)] == false)
+			continue;
+
+		offsets[i] -= permeance_dec;
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			long idx = i*ROW_STRIDE+j;
+			int target_cell = synapses[idx];
+
+			if(!NO_UNUSED_SYNAPSE && target_cell == -1)
+				break;
+
+			if(x[offset_from_index(x_view, target_cell)] == true)
+				permeances[idx] = (float)permeances[idx] + permeance_inc + permeance_dec;
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef INPUT_SIZE
+	#error "INPUT_SIZE not defined"
+#endif
+
+#ifndef MAX_SYNAPSE_PER_CELL
+	#error "MAX_SYNAPSE_PER_CELL not defined"
+#endif
+
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
+#ifndef PERM_TYPE
+	#error "PERM_TYPE not defined"
+#endif
+
+#ifndef HALF_BITS
+	#error "HALF_BITS not defined"
+#endif
+
+#ifndef SEED
+	#error "SEED not defined"
+#endif
+
+#define MASK ((1u << HALF_BITS) - 1)
+
+//Must match ProceduralPool in Etaler/Core/ProceduralSynapse.hpp
+uint mix(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint cell_key(uint cell)
+{
+	return mix((uint)SEED ^ mix(cell));
+}
+
+uint procedural_connection(uint key, uint synapse)
+{
+	uint v = synapse;
+	do {
+		uint l = v >> HALF_BITS;
+		uint r = v & MASK;
+		for(uint i=0;i<4;i++) {
+			uint t = l ^ (mix(r ^ key ^ ((i+1)*0x9e3779b9u)) & MASK);
+			l = r;
+			r = t;
+		}
+		v = (l << HALF_BITS) | r;
+	} while(v >= INPUT_SIZE);
+	return v;
+}
+
+//global_size: Arbitrary
+//local_size:  Arbitrary
+//HALF_BITS, SEED: The parameters of the ProceduralPool
+//ROW_STRIDE: Distance between the synapses of two consecutive cells. Defaults to MAX_SYNAPSE_PER_CELL
+//x_view: How x is layed out in the buffer. See view.cl
+kernel void cellActivity(global bool* restrict x, global PERM_TYPE* restrict permeances, global int* restrict y
+	, float connected_perm, int active_threshold, long output_size, long permeance_offset, View x_view)
+{
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<output_size;i+=global_size) {
+		uint key = cell_key(i);
+		int sum = 0;
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			if(permeances[i*ROW_STRIDE+j] <= connected_perm)
+				continue;
+			sum += x[offset_from_index(x_view, procedural_connection(key, j))];
+		}
+		y[i] = sum >= active_threshold ? sum : 0;
+	}
+}
+
+//OUTPUT_SIZE: Number of cells
+//x_view, y_view: How x and y are layed out in their buffers. See view.cl
+kernel void learnCorrilation(global bool* restrict x, global bool* restrict y, global PERM_TYPE* restrict permeances
+	, float permeance_inc, float permeance_dec, long permeance_offset, View x_view, View y_view)
+{
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<OUTPUT_SIZE;i+=global_size) {
+		if(y[offset_from_index(y_view, i)] == false)
+			continue;
+
+		uint key = cell_key(i);
+		for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+			long idx = i*ROW_STRIDE+j;
+			float permeance = permeances[idx];
+			if(x[offset_from_index(x_view, procedural_connection(key, j))] == true)
+				permeance += permeance_inc;
+			else
+				permeance -= permeance_dec;
+
+			permeances[idx] = clamp(permeance, 0.f, 1.f);
+		}
+	}
+}
@@ -24,7 +24,7 @@ kernel void reverseBurst(global bool* restrict x, global int* restrict seed1, gl
 	uint s2 = seed2[global_id];
 	uint s1 = seed1[global_id];
 
-	for(int i=global_id;i<NUM_COLUMNS;i+=global_size) {
+	for(long i=global_id;i<NUM_COLUMNS;i+=global_size) {
 		int sum = 0;
 		for(int j=0;j<CELLS_PER_COLUMN;j++)
 			sum += x[i*CELLS_PER_COLUMN+j];
@@ -0,0 +1,57 @@
+#ifndef NUM_CELLS
+	#error "NUM_CELLS not defined"
+#endif
+
+#ifndef CELLS_PER_COLUMN
+	#error "CELLS_PER_COLUMN not defined"
+#endif
+
+#ifndef MAX_SYNAPSE_PER_CELL
+	#error "MAX_SYNAPSE_PER_CELL not defined"
+#endif
+
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
+#ifndef PERM_TYPE
+	#error "PERM_TYPE not defined"
+#endif
+
+//One TemporalMemory inference step for every stream, with the predicted column reduction fused
+//global_size: Arbitrary
+//local_size:  Arbitrary
+//x, next: Contiguous active cells of all streams. next receives the predictive cells
+//y: Predicted columns of all streams, written starting from y_offset
+kernel void rolloutStep(global bool* restrict x, global int* restrict synapses
+	, global PERM_TYPE* restrict permeances, global bool* restrict next, global bool* restrict y
+	, float connected_perm, int active_threshold, long total_columns, long synapse_offset, long permeance_offset, long y_offset)
+{
+	synapses += synapse_offset;
+	permeances += permeance_offset;
+
+	int global_size = get_global_size(0);
+	int global_id = get_global_id(0);
+	for(long i=global_id;i<total_columns;i+=global_size) {
+		long stream = i / (NUM_CELLS/CELLS_PER_COLUMN);
+		long column = i % (NUM_CELLS/CELLS_PER_COLUMN);
+		global bool* input = x + stream*NUM_CELLS;
+		bool predicted = false;
+		for(long cell=column*CELLS_PER_COLUMN;cell<(column+1)*CELLS_PER_COLUMN;cell++) {
+			int sum = 0;
+			for(int j=0;j<MAX_SYNAPSE_PER_CELL;j++) {
+				long idx = cell*ROW_STRIDE+j;
+				int target_cell = synapses[idx];
+				if(target_cell == -1)
+					break;
+				if(input[target_cell] == 0)
+					continue;
+				sum += (permeances[idx] > connected_perm);
+			}
+			bool predictive = sum >= active_threshold;
+			next[stream*NUM_CELLS+cell] = predictive;
+			predicted |= predictive;
+		}
+		y[y_offset+i] = predicted;
+	}
+}
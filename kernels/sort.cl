@@ -3,6 +3,10 @@
 	#error "MAX_SYNAPSE_PER_CELL not defined"
 #endif
 
+#ifndef ROW_STRIDE
+	#define ROW_STRIDE MAX_SYNAPSE_PER_CELL
+#endif
+
 #ifndef PERM_TYPE
 	#error "PERM_TYPE not defined"
 #endif
@@ -74,14 +78,19 @@ void mergeSort(global unsigned int* restrict connections, global PERM_TYPE* rest
 
 //CELLS_PER_COLUMN: number of cells in each column
 //aux_buffer: Buffer for tempory storage when sorting, must be the sizeof(int)*global_size[0]
-kernel void sortSynapse(global unsigned int* restrict connections, global float* restrict permeances, int num_cells
-	, global unsigned int* restrict aux_buffer1, global float* restrict aux_buffer2)
+kernel void sortSynapse(global unsigned int* restrict connections, global float* restrict permeances, long num_cells
+	, global unsigned int* restrict aux_buffer1, global float* restrict aux_buffer2
+	, long connection_offset, long permeance_offset)
 {
+	connections += connection_offset;
+	permeances += permeance_offset;
+
 	int global_id = get_global_id(0);
 	int global_size = get_global_size(0);
 
-	for(int i=global_id;i<num_cells;i+=global_size) {
-		int offset = i*MAX_SYNAPSE_PER_CELL;
-		mergeSort(connections+offset, permeances+offset, MAX_SYNAPSE_PER_CELL, aux_buffer1+offset, aux_buffer2+offset);
+	for(long i=global_id;i<num_cells;i+=global_size) {
+		long offset = i*ROW_STRIDE;
+		long aux_offset = i*MAX_SYNAPSE_PER_CELL;
+		mergeSort(connections+offset, permeances+offset, MAX_SYNAPSE_PER_CELL, aux_buffer1+aux_offset, aux_buffer2+aux_offset);
 	}
 }
\ No newline at end of file
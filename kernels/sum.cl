@@ -18,16 +18,17 @@
 //OutType: Output Data type
 //in_size: number of elements of the input
 //chunk_size: for each chunk_size elements, produce 1 sum
-kernel void sum(global InType* restrict x, global OutType* restrict y, int in_size, int chunk_size)
+//x_view: How x is layed out in the buffer. See view.cl
+kernel void sum(global InType* restrict x, global OutType* restrict y, long in_size, long chunk_size, View x_view)
 {
         int global_size = get_global_size(0);
         int global_id = get_global_id(0);
 
-        int problem_size = in_size/chunk_size;
-        for(int i=global_id;i<problem_size;i+=global_size) {
+        long problem_size = in_size/chunk_size;
+        for(long i=global_id;i<problem_size;i+=global_size) {
                 IntermidType s = 0;
-                for(int j=0;j<chunk_size;j++)
-                        s += x[i*chunk_size+j];
+                for(long j=0;j<chunk_size;j++)
+                        s += x[offset_from_index(x_view, i*chunk_size+j)];
                 y[i] = s;
         }
 }
\ No newline at end of file
@@ -25,7 +25,8 @@
 //chunk_size: for each chunk_size elements, produce 1 sum
 //local_size: must equal to WORKITEM_PER_CU
 //group_size: must equal to in_size/chunk_size
-kernel void sum(global InType* restrict x, global OutType* restrict y, int in_size, int chunk_size)
+//x_view: How x is layed out in the buffer. See view.cl
+kernel void sum(global InType* restrict x, global OutType* restrict y, long in_size, long chunk_size, View x_view)
 {
         local IntermidType local_sum[WORKITEM_PER_CU];
         int group_id = get_group_id(0);
@@ -33,9 +34,9 @@ kernel void sum(global InType* restrict x, global OutType* restrict y, int in_si
         int local_size = get_local_size(0);
         int local_id = get_local_id(0);
         IntermidType private_sum = 0;
-        int start = chunk_size*group_id;
-        for(int i=start+local_id;i<start+chunk_size; i+=local_size)
-                private_sum += x[i];
+        long start = chunk_size*group_id;
+        for(long i=start+local_id;i<start+chunk_size; i+=local_size)
+                private_sum += x[offset_from_index(x_view, i)];
         local_sum[local_id] = private_sum;
         barrier(CLK_LOCAL_MEM_FENCE);
 
@@ -5,8 +5,9 @@
 //INPUT_SIZE: The size of the input SDR
 //x: The input SDR
 //y:(output) How many bits in x in 1
+//x_view: How x is layed out in the buffer. See view.cl
 #pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable
-kernel void onBits(global bool* restrict x, global int* restrict y)
+kernel void onBits(global bool* restrict x, global int* restrict y, View x_view)
 {
 	local int count;
 	int id = get_local_id(0);
@@ -16,8 +17,8 @@ kernel void onBits(global bool* restrict x, global int* restrict y)
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	int local_count = 0;
-	for(int i=id;i<INPUT_SIZE;i+=size)
-		local_count += x[i];
+	for(long i=id;i<INPUT_SIZE;i+=size)
+		local_count += x[offset_from_index(x_view, i)];
 	atomic_add(&count, local_count);
 
 	barrier(CLK_LOCAL_MEM_FENCE);
@@ -28,7 +29,8 @@ kernel void onBits(global bool* restrict x, global int* restrict y)
 //INPUT_SIZE: The size of the input SDR
 //x: The input SDR
 //y: (output) The sparse representation of x
-kernel void toSparse(global bool* restrict x, global int* restrict y)
+//x_view: How x is layed out in the buffer. See view.cl
+kernel void toSparse(global bool* restrict x, global int* restrict y, View x_view)
 {
 	local int count;
 	int id = get_local_id(0);
@@ -37,8 +39,8 @@ kernel void toSparse(global bool* restrict x, global int* restrict y)
 		count = 0;
 	barrier(CLK_LOCAL_MEM_FENCE);
 
-	for(int i=id;i<INPUT_SIZE;i+=size) {
-		if(x[i] == true)
-			y[atomic_inc(&count)] = i;
+	for(long i=id;i<INPUT_SIZE;i+=size) {
+		if(x[offset_from_index(x_view, i)] == true)
+			y[atomic_inc(&count)] = (int)i;
 	}
 }
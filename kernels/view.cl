@@ -0,0 +1,24 @@
+//Describes how the elements of a (possibly strided) tensor are placed in its buffer. Must match
+//OpenCLView in OpenCLBackend.cpp. Prepend this file to kernels taking View arguments
+#define OPENCL_TENSOR_MAX_DIMS 8
+typedef struct __attribute__ ((packed)) _View
+{
+        long stride[OPENCL_TENSOR_MAX_DIMS];
+        long shape_stride[OPENCL_TENSOR_MAX_DIMS];
+        long offset;
+        int dims;
+} View;
+
+//Position in the buffer of the index-th element of the view. 64 bit so tensors can have more than 2^31 elements
+long offset_from_index(View view, long index)
+{
+	long curr_idx = index;
+	long sum = 0;
+	for(int i=0;i<view.dims;i++) {
+		long s = view.shape_stride[i];
+		long ndpos = curr_idx / s;
+		sum += ndpos * view.stride[i];
+		curr_idx %= s;
+	}
+	return sum + view.offset;
+}
@@ -8,8 +8,34 @@
 #include <Etaler/Core/Serialize.hpp>
 #include <Etaler/Algorithms/SDRClassifer.hpp>
 #include <Etaler/Algorithms/Anomaly.hpp>
+#include <Etaler/Algorithms/SpatialPooler.hpp>
+#include <Etaler/Algorithms/TemporalMemory.hpp>
+#include <Etaler/Algorithms/Pruning.hpp>
+#include <Etaler/Core/MemoryPlanner.hpp>
+#include <Etaler/Core/Priority.hpp>
+#include <Etaler/Core/Compression.hpp>
+#include <Etaler/Core/TypedTensor.hpp>
+#include <Etaler/Core/RingBuffer.hpp>
+#include <Etaler/Utils/ModelCache.hpp>
+#if defined(__unix__) || defined(__APPLE__)
+#include <Etaler/Core/SharedMemory.hpp>
+#include <Etaler/Core/StreamStateStore.hpp>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <Etaler/Backends/CPUBackend.hpp>
+#include <Etaler/Backends/SimulationBackend.hpp>
+#include <Etaler/Backends/HybridBackend.hpp>
+#include <Etaler/Backends/RealtimePool.hpp>
 
 #include <numeric>
+#include <random>
+#include <thread>
 
 using namespace et;
 
@@ -51,6 +77,19 @@ TEST_CASE("Testing Shape", "[Shape]")
 		CHECK(foldIndex(7, s) == Shape({1,2}));
 	}
 
+	SECTION("Large shapes") {
+		// More than 2^31 elements. Only the index math is tested, nothing is allocated
+		Shape s = {65536, 65536, 4};
+		CHECK(s.volume() == (intmax_t(1) << 34));
+		CHECK(shapeToStride(s) == Shape({262144, 4, 1}));
+
+		Shape loc = {65535, 65535, 3};
+		size_t idx = unfoldIndex(loc, s);
+		CHECK(idx == (size_t(1) << 34) - 1);
+		CHECK(foldIndex(idx, s) == loc);
+		CHECK(foldIndex(size_t(1) << 33, s) == Shape({32768, 0, 0}));
+	}
+
 	SECTION("leftpad") {
 		Shape s = {1,2,3};
 		Shape t = leftpad(s, 4, 1);
@@ -150,6 +189,11 @@ TEST_CASE("Testing Tensor", "[Tensor]")
 
 		Tensor r = Tensor({1, 5}, data);
 		CHECK_FALSE(t.isSame(r));
+
+		data[4] = 6;
+		CHECK_FALSE(t.isSame(Tensor({5}, data)));
+		int every_other[] = {1,3,5};
+		CHECK(t[{range(0, 5, 2)}].isSame(Tensor({3}, every_other)));
 	}
 
 	SECTION("Data Transfer") {
@@ -377,6 +421,24 @@ TEST_CASE("Testing Tensor", "[Tensor]")
 			CHECK((ones({7}) == zeros({7})).any() == false);
 			CHECK((ones({4,4}) == t).any() == true);
 			CHECK((ones({4,4}) == t).all() == false);
+
+			// Non zero values count as true whatever the type
+			float data[] = {0.5, -2, 3};
+			CHECK(Tensor({3}, data).all() == true);
+			data[1] = 0;
+			CHECK(Tensor({3}, data).all() == false);
+
+			// Also on 0D tensors
+			CHECK(ones({2,2})[{1, 1}].all() == true);
+			CHECK(zeros({2,2})[{1, 1}].any() == false);
+		}
+
+		SECTION("sum of 0D tensors") {
+			Tensor s = ones({2,2}, DType::Bool)[{0, 1}];
+			CHECK(s.sum().dtype() == DType::Int32);
+			CHECK(s.sum().item<int32_t>() == 1);
+			CHECK(s.sum(std::nullopt, DType::Float).dtype() == DType::Float);
+			CHECK(s.sum(std::nullopt, DType::Bool).item<uint8_t>() == 1);
 		}
 
 		SECTION("xtensor style views") {
@@ -594,6 +656,156 @@ TEST_CASE("Backend functions", "[Backend]")
 		CHECK(res[1] == 1);
 	}
 
+	SECTION("Specialized synapse kernels") {
+		auto backend = std::make_shared<CPUBackend>();
+		std::mt19937 rng(42);
+		const size_t input_size = 256;
+		const size_t num_cells = 64;
+
+		for(size_t width : {16, 32, 64, 20}) {
+			std::vector<int32_t> conns(num_cells*width, -1);
+			std::vector<float> perms(num_cells*width, 0);
+			for(size_t i=0;i<num_cells;i++) {
+				size_t num_used = rng()%(width+1);
+				for(size_t j=0;j<num_used;j++) {
+					conns[i*width+j] = rng()%input_size;
+					perms[i*width+j] = (rng()%100)/100.f;
+				}
+			}
+			std::vector<uint8_t> in(input_size), learn(num_cells);
+			for(auto& v : in) v = rng()%2;
+			for(auto& v : learn) v = rng()%2;
+
+			Shape s = {(intmax_t)num_cells, (intmax_t)width};
+			Tensor c = Tensor(s, conns.data(), backend.get());
+			Tensor p1 = Tensor(s, perms.data(), backend.get());
+			Tensor p2 = p1.copy();
+			Tensor x = Tensor({(intmax_t)input_size}, in.data(), backend.get());
+			Tensor l = Tensor({(intmax_t)num_cells}, learn.data(), backend.get());
+
+			backend->setSpecializedKernels(true);
+			Tensor y1 = cellActivity(x, c, p1, 0.3, 2);
+			learnCorrilation(x, l, c, p1, 0.1, 0.05);
+
+			backend->setSpecializedKernels(false);
+			Tensor y2 = cellActivity(x, c, p2, 0.3, 2);
+			learnCorrilation(x, l, c, p2, 0.1, 0.05);
+
+			CHECK(y1.isSame(y2));
+			CHECK(p1.isSame(p2));
+		}
+	}
+
+	SECTION("Synapse kernels on views") {
+		int32_t conns[] = {0,1,2,3, 1,2,-1,-1, 3,2,1,0, 0,-1,-1,-1, 2,3,-1,-1, 1,3,0,-1};
+		float perms[] = {0.1,0.5,0.9,0.3, 0.8,0.2,0,0, 0.4,0.6,0.7,0.1, 0.9,0,0,0, 0.05,0.35,0,0, 0.6,0.15,0.5,0};
+		uint8_t in[] = {1,0,1,1};
+		uint8_t learn[] = {1,0,1};
+
+		Tensor c = Tensor({6,4}, conns);
+		Tensor p = Tensor({6,4}, perms);
+		Tensor x = Tensor({4}, in);
+		Tensor l = Tensor({3}, learn);
+
+		// Run on cells 2~4 through a view and on a copy of them
+		Tensor cv = c.view({range(2, 5)});
+		Tensor pv = p.view({range(2, 5)});
+		Tensor cc = cv.copy();
+		Tensor pc = pv.copy();
+
+		CHECK(cellActivity(x, cv, pv, 0.3, 1).isSame(cellActivity(x, cc, pc, 0.3, 1)));
+
+		learnCorrilation(x, l, cv, pv, 0.1, 0.05);
+		learnCorrilation(x, l, cc, pc, 0.1, 0.05);
+		CHECK(pv.isSame(pc));
+
+		decaySynapses(cv, pv, 0.2);
+		decaySynapses(cc, pc, 0.2);
+		CHECK(cv.isSame(cc));
+
+		// The parent tensors are updated in place and the rows outside the view are untouched
+		CHECK(c.view({range(2, 5)}).isSame(cc));
+		CHECK(c.view({range(2)}).isSame(Tensor({2,4}, conns)));
+		CHECK(p.view({range(5, 6)}).isSame(Tensor({1,4}, perms+20)));
+	}
+
+	SECTION("Ops on views") {
+		std::vector<int> v(24);
+		std::iota(v.begin(), v.end(), 0);
+		Tensor t = Tensor({4,6}, v.data());
+
+		// Offsetted, strided and transposed views
+		for(Tensor q : {t.view({range(1,3)}), t.view({all(), range(1,5)}), t.view({range(0,4,2), range(0,6,3)}), t.swapaxis(0, 1)}) {
+			Tensor r = q.realize();
+			CHECK(sum(q).isSame(sum(r)));
+			CHECK(sum(q, 0).isSame(sum(r, 0)));
+			CHECK(sum(q, 1).isSame(sum(r, 1)));
+			CHECK(q.cast(DType::Float).isSame(r.cast(DType::Float)));
+			CHECK(globalInhibition(q, 0.5).isSame(globalInhibition(r, 0.5)));
+
+			Tensor b = (q > 10);
+			Tensor state = zeros({q.shape()[0], q.shape()[1], 3}, DType::Bool);
+			CHECK(burst(b, state).isSame(burst(b.realize(), state)));
+		}
+
+		uint8_t in[] = {1,0,0,1, 0,1,1,0};
+		Tensor x = Tensor({2,4}, in).view({all(), 1}); // {0, 1}, strided
+		int32_t conns[] = {0,1, 1,-1};
+		float perms[] = {0.5,0.5, 0.5,0};
+		Tensor c = Tensor({2,2}, conns);
+		Tensor p = Tensor({2,2}, perms);
+		CHECK(cellActivity(x, c, p, 0.3, 1).isSame(cellActivity(x.realize(), c, p, 0.3, 1)));
+	}
+
+	SECTION("Overlap") {
+		std::mt19937 rng(42);
+		const size_t num_bits = 150; // Not a multiple of the word size
+		std::vector<uint8_t> a_data(5*num_bits), b_data(20*num_bits);
+		for(auto& v : a_data) v = rng()%4 == 0;
+		for(auto& v : b_data) v = rng()%4 == 0;
+		Tensor a = Tensor({5, (intmax_t)num_bits}, a_data.data());
+		Tensor b = Tensor({4, 5, (intmax_t)num_bits}, b_data.data());
+
+		Tensor y = overlap(a, b);
+		CHECK(y.shape() == Shape({5, 4, 5}));
+		CHECK(y.dtype() == DType::Int32);
+		auto res = y.toHost<int32_t>();
+		for(size_t i=0;i<5;i++) {
+			for(size_t j=0;j<20;j++) {
+				int32_t pred = 0;
+				for(size_t n=0;n<num_bits;n++)
+					pred += a_data[i*num_bits+n] && b_data[j*num_bits+n];
+				CHECK(res[i*20+j] == pred);
+			}
+		}
+
+		// Views are supported
+		Tensor q = a.view({range(1, 3)});
+		CHECK(overlap(q, b).isSame(overlap(q.realize(), b)));
+
+		auto [indices, overlaps] = topKOverlap(a, b.reshape({20, (intmax_t)num_bits}), 3);
+		CHECK(indices.shape() == Shape({5, 3}));
+		auto idx = indices.toHost<int32_t>();
+		auto val = overlaps.toHost<int32_t>();
+		for(size_t i=0;i<5;i++) {
+			std::vector<int32_t> row(res.begin()+i*20, res.begin()+(i+1)*20);
+			std::vector<int32_t> sorted = row;
+			std::sort(sorted.begin(), sorted.end(), std::greater<int32_t>());
+			for(size_t j=0;j<3;j++) {
+				CHECK(val[i*3+j] == sorted[j]);
+				CHECK(row[idx[i*3+j]] == val[i*3+j]);
+			}
+		}
+
+		// Only SDRs passing the threshold are returned
+		uint8_t x1[] = {1,1,1,0}, x2[] = {1,1,0,0, 0,0,0,1, 1,0,0,0};
+		auto [i2, o2] = topKOverlap(Tensor({1, 4}, x1), Tensor({3, 4}, x2), 3, 1);
+		int32_t pred_idx[] = {0, 2, -1};
+		int32_t pred_overlap[] = {2, 1, 0};
+		CHECK(i2.isSame(Tensor({1, 3}, pred_idx)));
+		CHECK(o2.isSame(Tensor({1, 3}, pred_overlap)));
+	}
+
 	SECTION("Global Inhibition") {
 		int32_t in[8] = {0,0,1,2,7,6,5,3};
 		Tensor t = Tensor({8}, in);
@@ -606,6 +818,27 @@ TEST_CASE("Backend functions", "[Backend]")
 		CHECK(y.isSame(should_be));
 	}
 
+	SECTION("Group inhibition") {
+		int32_t in[16] = {0,0,1,2,7,6,5,3, 4,0,4,4,1,0,0,0};
+		Tensor t = Tensor({2,8}, in);
+
+		Tensor y = groupInhibition(t, 8, 0.25);
+		CHECK(y.shape() == t.shape());
+		CHECK(y.dtype() == DType::Bool);
+		uint8_t pred[16] = {0,0,0,0,1,1,0,0, 1,0,1,1,0,0,0,0}; // Ties at the boundary are all accepted
+		CHECK(y.isSame(Tensor({2,8}, pred)));
+
+		// Matches globalInhibition on each group
+		for(intmax_t i=0;i<2;i++)
+			CHECK(y.view({i}).isSame(globalInhibition(t.view({i}), 0.25)));
+
+		// Groups of a strided tensor are taken in the logical order
+		Tensor q = t.reshape({8,2}).view({all(), 1});
+		CHECK(groupInhibition(q, 4, 0.5).isSame(groupInhibition(q.realize(), 4, 0.5)));
+
+		CHECK_THROWS(groupInhibition(t, 5, 0.5));
+	}
+
 	SECTION("Sort synapse") {
 		int a[] = {0,1,2,3, 1,3,2,0, -1,1,2,3, 2,3,1,-1};
 		Tensor t = Tensor({4,4}, a);
@@ -684,6 +917,10 @@ TEST_CASE("Backend functions", "[Backend]")
 
 		CHECK(s.isSame(pred_conn));
 		CHECK(p.isSame(pred_perm));
+
+		// Synapse targets are 32 bit. A broadcasted view of 2^31 cells needs no memory
+		Tensor huge = brodcast_to(x.view({range(0, 1)}), {intmax_t(1) << 31});
+		CHECK_THROWS_WITH(growSynapses(huge, y, s, p, 0.21), Catch::Contains("2^31-1"));
 	}
 
 	SECTION("sum") {
@@ -708,6 +945,11 @@ TEST_CASE("Backend functions", "[Backend]")
 		CHECK(s1.dtype() == DType::Int32);
 		int32_t pred1[] = {6, 22, 38, 54};
 		CHECK(s1.isSame(Tensor({4}, pred1)));
+
+		// 2^31 bools don't fit in the Int32 result. A broadcasted view needs no memory for them
+		Tensor many = brodcast_to(ones({1}, DType::Bool), {intmax_t(1)<<31});
+		CHECK_THROWS(many.sum());
+		CHECK_THROWS(many.sum(0, DType::Int32));
 	}
 
 	SECTION("sum with negative index") {
@@ -838,6 +1080,65 @@ TEST_CASE("Tensor operations")
 			CHECK(b.isSame(p));
 		}
 
+		SECTION("comparisons") {
+			int arr2[] = {2,2,2};
+			Tensor c = Tensor({3}, arr2);
+			bool le[] = {1,1,0};
+			bool ge[] = {0,1,1};
+			bool ne[] = {1,0,1};
+			CHECK((a <= c).isSame(Tensor({3}, le)));
+			CHECK((a >= c).isSame(Tensor({3}, ge)));
+			CHECK((a != c).isSame(Tensor({3}, ne)));
+			CHECK((a <= c).dtype() == DType::Bool);
+		}
+
+		SECTION("logical_xor") {
+			bool arr1[] = {0,0,1,1};
+			bool arr2[] = {0,1,0,1};
+			bool pred[] = {0,1,1,0};
+			Tensor b = logical_xor(Tensor({4}, arr1), Tensor({4}, arr2));
+			CHECK(b.dtype() == DType::Bool);
+			CHECK(b.isSame(Tensor({4}, pred)));
+		}
+
+		SECTION("minimum and maximum") {
+			int arr2[] = {3,2,1};
+			Tensor c = Tensor({3}, arr2);
+			int min_pred[] = {1,2,1};
+			int max_pred[] = {3,2,3};
+			CHECK(minimum(a, c).isSame(Tensor({3}, min_pred)));
+			CHECK(maximum(a, c).isSame(Tensor({3}, max_pred)));
+			CHECK(maximum(a, c.cast(DType::Float)).dtype() == DType::Float);
+		}
+
+		SECTION("where") {
+			bool cond[] = {1,0,1};
+			int arr2[] = {-1,-2,-3};
+			int pred[] = {1,-2,3};
+			Tensor b = where(Tensor({3}, cond), a, Tensor({3}, arr2));
+			CHECK(b.dtype() == DType::Int32);
+			CHECK(b.isSame(Tensor({3}, pred)));
+			//Brodcasting
+			int pred2[] = {1,0,3};
+			CHECK(where(Tensor({3}, cond), a, zeros({1}, DType::Int32)).isSame(Tensor({3}, pred2)));
+		}
+
+		SECTION("clamp") {
+			int pred[] = {2,2,2};
+			int lo[] = {2}, hi[] = {2};
+			CHECK(clamp(a, Tensor({1}, lo), Tensor({1}, hi)).isSame(Tensor({3}, pred)));
+			int hi2[] = {2};
+			int pred2[] = {1,2,2};
+			CHECK(clamp(a, zeros({1}, DType::Int32), Tensor({1}, hi2)).isSame(Tensor({3}, pred2)));
+			// lo > hi gives the same result on every backend. lo wins below it, hi everywhere else
+			int lo3[] = {3}, hi3[] = {1};
+			int pred3[] = {3,3,1};
+			CHECK(clamp(a, Tensor({1}, lo3), Tensor({1}, hi3)).isSame(Tensor({3}, pred3)));
+			float flo[] = {2.5f, 0.f, 3.f}, fhi[] = {1.5f, 1.f, 3.f};
+			float fpred[] = {2.5f, 1.f, 3.f};
+			CHECK(clamp(a.cast(DType::Float), Tensor({3}, flo), Tensor({3}, fhi)).isSame(Tensor({3}, fpred)));
+		}
+
 		SECTION("concat") {
 			Tensor a = ones({2, 2});
 			Tensor b = zeros({2, 2});
@@ -948,6 +1249,274 @@ TEST_CASE("SDRClassifer")
 		CHECK(classifer.compute(encoder::category(i, num_category, num_bits),0) == i);
 }
 
+TEST_CASE("SpatialPooler")
+{
+	SECTION("Incremental overlap") {
+		SpatialPooler sp({64}, {128}, 0.75, 42, 0.1);
+		sp.setActiveThreshold(2);
+		SpatialPooler sp2 = sp.copy();
+		sp2.setIncremental(true);
+
+		for(int i=0;i<12;i++) {
+			Tensor x = encoder::scalar(0.05*i, 0, 1, 64, 16);
+			Tensor y = sp.compute(x);
+			Tensor y2 = sp2.compute(x);
+			CHECK(y.isSame(y2));
+
+			sp.learn(x, y);
+			sp2.learn(x, y2);
+		}
+		CHECK(sp.permanences().isSame(sp2.permanences()));
+
+		// The state is rebuilt when the parameters change
+		sp.setConnectedPermanence(0.3);
+		sp2.setConnectedPermanence(0.3);
+		Tensor x = encoder::scalar(0.5, 0, 1, 64, 16);
+		CHECK(sp.compute(x).isSame(sp2.compute(x)));
+
+		// Learned cells are read back with their per cell offsets under sparse learning
+		SpatialPooler sp3 = sp.copy();
+		sp3.setSparseLearning(true, 4);
+		SpatialPooler sp4 = sp3.copy();
+		sp4.setIncremental(true);
+		for(int i=0;i<12;i++) {
+			Tensor x = encoder::scalar(0.08*i, 0, 1, 64, 16);
+			Tensor y = sp3.compute(x);
+			Tensor y2 = sp4.compute(x);
+			CHECK(y.isSame(y2));
+
+			sp3.learn(x, y);
+			sp4.learn(x, y2);
+		}
+	}
+
+	SECTION("Procedural connections") {
+		Tensor conns = F::proceduralConnections({100}, {8, 60}, 7);
+		for(intmax_t i=0;i<8;i++) {
+			std::vector<int> row = conns.view({i}).toHost<int>();
+			std::sort(row.begin(), row.end());
+			CHECK(std::adjacent_find(row.begin(), row.end()) == row.end());
+			CHECK(row.front() >= 0);
+			CHECK(row.back() < 100);
+		}
+		CHECK(conns.view({0}).isSame(conns.view({1})) == false);
+
+		Tensor x = encoder::scalar(0.3, 0, 1, 100, 20);
+		Tensor perms = F::gusianRandomProceduralSynapse({100}, {8}, 0.6, 0.21, 1, 7);
+		CHECK(perms.shape() == Shape({8, 60}));
+		CHECK(proceduralCellActivity(x, perms, 7, 0.21, 2).isSame(cellActivity(x, conns, perms, 0.21, 2, false)));
+
+		SpatialPooler sp({64}, {128}, 0.75, 42, 0.1, 0, defaultBackend(), true);
+		sp.setActiveThreshold(2);
+		StateDict states = sp.states();
+		CHECK(states.count("connections") == 0);
+		CHECK(stateMemoryUsage(states) < SpatialPooler({64}, {128}).permanences().size()*8);
+
+		// Procedural synapses behave the same as the materialized ones
+		SpatialPooler sp2 = sp.copy();
+		sp2.connections_ = sp.connections();
+		sp2.procedural_ = false;
+		for(int i=0;i<4;i++) {
+			Tensor x = encoder::scalar(0.2*i, 0, 1, 64, 16);
+			Tensor y = sp.compute(x);
+			Tensor y2 = sp2.compute(x);
+			CHECK(y.isSame(y2));
+			sp.learn(x, y);
+			sp2.learn(x, y2);
+		}
+		CHECK(sp.permanences().isSame(sp2.permanences()));
+	}
+
+	SECTION("Sparse learning") {
+		Tensor x = encoder::scalar(0.3, 0, 1, 32, 8);
+		Tensor learn = zeros({4}, DType::Bool);
+		learn[{1}] = true;
+		learn[{3}] = true;
+		auto [conns, perms] = F::gusianRandomSynapse({32}, {4}, 0.75, 0.3, 0.1);
+		Tensor dense_perms = perms.copy();
+		Tensor offsets = zeros({4}, DType::Float);
+
+		learnCorrilation(x, learn, conns, dense_perms, 0.05, 0.02, false);
+		learnCorrilationSparse(x, learn, conns, perms, offsets, 0.05, 0.02, false);
+		CHECK(offsets.toHost<float>() == std::vector<float>{0, -0.02f, 0, -0.02f});
+		CHECK(all(isclose(effectivePermanences(perms, offsets), dense_perms)));
+		CHECK(cellActivityWithOffsets(x, conns, perms, offsets, 0.3, 1, false).isSame(cellActivity(x, conns, dense_perms, 0.3, 1, false)));
+
+		renormalizePermanences(perms, offsets);
+		CHECK(all(isclose(perms, dense_perms)));
+		CHECK(offsets.sum().item<float>() == 0);
+
+		SpatialPooler sp({64}, {128}, 0.75, 42, 0.1);
+		SpatialPooler sp2 = sp.copy();
+		// Renormalizing every step clamps as often as the dense learning does
+		sp2.setSparseLearning(true, 1);
+		for(int i=0;i<8;i++) {
+			Tensor x = encoder::scalar(0.1*i, 0, 1, 64, 16);
+			Tensor y = sp.compute(x);
+			CHECK(y.isSame(sp2.compute(x)));
+			sp.learn(x, y);
+			sp2.learn(x, y);
+		}
+		CHECK(all(isclose(sp.permanences(), sp2.permanences(), 1e-5f, 1e-5f)));
+	}
+
+	SECTION("Pruning") {
+		SpatialPooler sp({64}, {256}, 0.75, 42, 0.05);
+		std::vector<Tensor> samples;
+		for(int i=0;i<10;i++) {
+			// Samples cover bits 0..43. The last 20 bits are never on
+			Tensor x = zeros({64}, DType::Bool);
+			x[{range(i*4, i*4+8)}] = true;
+			samples.push_back(x);
+		}
+		for(const auto& x : samples)
+			sp.learn(x, sp.compute(x));
+
+		SPActivityStats stats = collectActivityStats(sp, samples);
+		CHECK(stats.num_samples == 10);
+		CHECK(stats.numDeadInputs() == 20);
+		CHECK(stats.numDeadColumns() > 0);
+
+		PrunedSpatialPooler pruned = pruneSpatialPooler(sp, stats);
+		CHECK(pruned.input_index.size() == 44);
+		CHECK(pruned.sp.input_shape_ == Shape({64}));
+		CHECK(pruned.sp.output_shape_ == Shape({(intmax_t)(256-stats.numDeadColumns())}));
+		CHECK(pruned.sp.permanences().size() < sp.permanences().size());
+		for(const auto& x : samples) {
+			CHECK(pruned.compute(x).isSame(sp.compute(x)));
+			CHECK(pruned.computeCompact(x).isSame(pruned.compactOutput(sp.compute(x))));
+		}
+
+		std::string path = "pruned_sp_test.cereal";
+		save(pruned.states(), path);
+		PrunedSpatialPooler loaded;
+		loaded.loadState(load(path));
+		std::remove(path.c_str());
+		CHECK(loaded.input_index == pruned.input_index);
+		CHECK(loaded.column_index == pruned.column_index);
+		CHECK(loaded.output_shape == Shape({256}));
+		for(const auto& x : samples)
+			CHECK(loaded.compute(x).isSame(sp.compute(x)));
+	}
+
+	SECTION("Approximate inference") {
+		SpatialPooler sp({128}, {256}, 0.75, 42, 0.1);
+		sp.setActiveThreshold(4);
+		std::vector<Tensor> samples;
+		for(int i=0;i<8;i++)
+			samples.push_back(encoder::scalar(0.1*i, 0, 1, 128, 24));
+
+		CHECK_THROWS(sp.computeApproximate(samples[0], 0.5));
+		Tensor y = sp.compute(samples[0]);
+		sp.shuffleSynapses();
+		CHECK(sp.compute(samples[0]).isSame(y));
+		CHECK(sp.computeApproximate(samples[0], 1).isSame(y));
+
+		ApproximationReport exact = sp.evaluateApproximation(samples, 1);
+		CHECK(exact.overlap == Approx(1));
+		CHECK(exact.min_overlap == Approx(1));
+
+		ApproximationReport approx = sp.evaluateApproximation(samples, 0.5);
+		CHECK(approx.overlap > 0.3);
+		CHECK(approx.overlap <= 1);
+		CHECK(approx.exact_time > 0);
+	}
+}
+
+TEST_CASE("TemporalMemory")
+{
+	SECTION("Rollout") {
+		size_t num_category = 4;
+		intmax_t sdr_size = 5*num_category;
+		intmax_t cells_per_column = 2;
+		TemporalMemory tm({sdr_size}, cells_per_column);
+
+		Tensor last_state = zeros({sdr_size, cells_per_column}, DType::Bool);
+		Tensor last_pred = zeros({sdr_size, cells_per_column}, DType::Bool);
+		for(size_t i=0;i<40;i++) {
+			Tensor x = encoder::category(i%num_category, num_category, 5);
+			auto [pred, active] = tm.compute(x, last_pred);
+			tm.learn(active, last_state);
+			last_state = active;
+			last_pred = pred;
+		}
+
+		// The last input is category 3. The following are 0, 1, 2
+		Tensor forecast = tm.rollout(last_state, 3);
+		CHECK(forecast.shape() == Shape({3, sdr_size}));
+		CHECK(forecast.dtype() == DType::Bool);
+		CHECK(forecast.view({0}).isSame(sum(last_pred, 1, DType::Bool)));
+		for(size_t i=0;i<3;i++)
+			CHECK(decoder::category(forecast.view({(intmax_t)i}), num_category) == std::vector<size_t>{i});
+
+		// Many streams at once. Streams without active cells predict nothing
+		Tensor states = zeros({2, sdr_size, cells_per_column}, DType::Bool);
+		states.view({0}) = last_state;
+		Tensor batched = tm.rollout(states, 3);
+		CHECK(batched.shape() == Shape({3, 2, sdr_size}));
+		CHECK(batched.view({all(), 0}).isSame(forecast));
+		CHECK(batched.view({all(), 1}).any() == false);
+
+		CHECK(last_state.any()); // The input is not modified
+		CHECK_THROWS(tm.rollout(zeros({sdr_size}, DType::Bool), 1));
+	}
+
+	SECTION("Batched training") {
+		int32_t conn_data[] = {0,1,2, 1,3,-1, 4,5,0, 2,-1,-1};
+		float perm_data[] = {0.5,0.5,0.5, 0.5,0.5,0, 0.5,0.5,0.5, 0.5,0,0};
+		Tensor connections = Tensor({4, 3}, conn_data);
+		Tensor permanences = Tensor({4, 3}, perm_data);
+		bool x_data[] = {1,1,0,1,0,0, 0,0,1,0,1,1};
+		bool learn_data[] = {1,1,0,1, 1,0,1,1};
+		Tensor x = Tensor({2, 6}, x_data);
+		Tensor learn = Tensor({2, 4}, learn_data);
+
+		Tensor activity = batchCellActivity(x, connections, permanences, 0.2, 1);
+		CHECK(activity.shape() == Shape({2, 4}));
+		for(intmax_t i=0;i<2;i++)
+			CHECK(activity.view({i}).isSame(cellActivity(x.view({i}), connections, permanences, 0.2, 1)));
+
+		// Away from the clamping bounds the merged update equals applying the entries one after another
+		Tensor sequential = permanences.copy();
+		for(intmax_t i=0;i<2;i++)
+			learnCorrilation(x.view({i}), learn.view({i}), connections, sequential, 0.1, 0.05);
+		batchLearnCorrilation(x, learn, connections, permanences, 0.1, 0.05);
+		CHECK(isclose(permanences, sequential, 1e-5f, 1e-5f).all());
+
+		// Growing in one call gives the same synapses as growing the entries in batch order
+		int32_t grow_conn_data[] = {0,-1,-1,-1, 1,3,-1,-1, 4,5,0,2, -1,-1,-1,-1};
+		Tensor grow_conn = Tensor({4, 4}, grow_conn_data);
+		Tensor grow_perm = zeros({4, 4}, DType::Float);
+		Tensor sequential_conn = grow_conn.copy();
+		Tensor sequential_perm = grow_perm.copy();
+		for(intmax_t i=0;i<2;i++)
+			growSynapses(x.view({i}), learn.view({i}), sequential_conn, sequential_perm, 0.21);
+		batchGrowSynapses(x, learn, grow_conn, grow_perm, 0.21);
+		sortSynapse(grow_conn, grow_perm);
+		sortSynapse(sequential_conn, sequential_perm);
+		CHECK(grow_conn.isSame(sequential_conn));
+		CHECK(grow_perm.isSame(sequential_perm));
+		int32_t expected_conn[] = {0,1,2,3, 0,1,3,-1, 0,2,4,5, 0,1,2,3};
+		CHECK(sequential_conn.isSame(Tensor({4, 4}, expected_conn)));
+
+		size_t num_category = 4;
+		intmax_t sdr_size = 5*num_category;
+		std::vector<std::vector<Tensor>> sequences(6);
+		for(size_t i=0;i<sequences.size();i++) {
+			for(size_t j=0;j<12+i;j++)
+				sequences[i].push_back(encoder::category(j%num_category, num_category, 5));
+		}
+		TemporalMemory tm({sdr_size}, 2);
+		tm.trainSequences(sequences, 4);
+
+		Tensor last_pred;
+		for(size_t i=0;i<num_category;i++)
+			last_pred = tm.compute(encoder::category(i, num_category, 5), last_pred).first;
+		CHECK(decoder::category(sum(last_pred, 1, DType::Bool), num_category) == std::vector<size_t>{0});
+		CHECK_THROWS(tm.computeBatch(zeros({sdr_size}, DType::Bool), Tensor()));
+	}
+}
+
 TEST_CASE("Type system")
 {
 	SECTION("Type sizes") {
@@ -1180,6 +1749,843 @@ TEST_CASE("Complex Tensor operations")
 	}
 }
 
+TEST_CASE("MemoryPlanner")
+{
+	SECTION("Memory layout") {
+		// Block 0 and 2 are never alive at the same time. They can share memory
+		std::vector<MemoryBlock> blocks(3);
+		blocks[0].size = 16; blocks[0].alloc_time = 0; blocks[0].free_time = 2;
+		blocks[1].size = 8; blocks[1].alloc_time = 1; blocks[1].free_time = 3;
+		blocks[2].size = 16; blocks[2].alloc_time = 2; blocks[2].free_time = 4;
+
+		size_t total = planMemoryLayout(blocks, 8);
+		CHECK(total == 24);
+		CHECK(blocks[0].offset == blocks[2].offset);
+		CHECK(blocks[1].offset != blocks[0].offset);
+	}
+
+	SECTION("Planned SpatialPooler steps") {
+		Shape input_shape = {32};
+		SpatialPooler sp(input_shape, {64}, 0.75, 42, 0.1, 0.5);
+		SpatialPooler sp2 = sp.copy();
+		MemoryPlanner planner(defaultBackend());
+
+		for(int i=0;i<4;i++) {
+			Tensor x = encoder::scalar(0.2*i, 0, 1, 32, 12);
+			planner.beginStep();
+			Tensor y = sp.compute(x);
+			sp.learn(x, y);
+			planner.endStep();
+
+			Tensor y2 = sp2.compute(x);
+			sp2.learn(x, y2);
+			CHECK(y.isSame(y2));
+		}
+
+		CHECK(planner.planned());
+		CHECK(planner.numPlannedTensors() > 0);
+		CHECK(planner.plannedMemory() <= planner.requestedMemory());
+		CHECK(sp.permanences().isSame(sp2.permanences()));
+	}
+
+	SECTION("Held tensors are not overwritten") {
+		MemoryPlanner planner(defaultBackend());
+		std::vector<Tensor> held;
+		for(int i=0;i<3;i++) {
+			planner.beginStep();
+			Tensor a = ones({16});
+			Tensor b = a + a;
+			Tensor c = b * b;
+			held.push_back(b);
+			planner.endStep();
+			CHECK(c.sum().item<int>() == 64);
+		}
+		for(const auto& t : held)
+			CHECK(t.isSame(constant({16}, 2)));
+	}
+}
+
+TEST_CASE("TypedTensor")
+{
+	// TypedTensor needs host accessible memory
+	auto backend = std::make_shared<CPUBackend>();
+	std::vector<int> data(16);
+	std::iota(data.begin(), data.end(), 0);
+	Tensor t = Tensor({4, 4}, data.data(), backend.get());
+
+	SECTION("Element access") {
+		TypedTensor<int32_t, 2> a(t);
+		CHECK(a.shape(0) == 4);
+		CHECK(a.shape(1) == 4);
+		CHECK(a(1, 2) == 6);
+		CHECK(a[{3, 3}] == 15);
+		CHECK(a.sum() == 120);
+
+		a(0, 0) = 100;
+		CHECK(t.toHost<int32_t>()[0] == 100);
+	}
+
+	SECTION("Type and rank are checked") {
+		CHECK_THROWS(TypedTensor<float, 2>(t));
+		CHECK_THROWS(TypedTensor<int32_t, 1>(t));
+		CHECK_NOTHROW(typed<int32_t, 1>(t.flatten()));
+	}
+
+	SECTION("Views") {
+		TypedTensor<int32_t, 2> a(t.view({range(1, 3), range(2, 4)}));
+		CHECK(a.iscontiguous() == false);
+		CHECK(a(0, 0) == 6);
+		CHECK(a(1, 1) == 11);
+		CHECK(a.sum() == 6+7+10+11);
+
+		a.fill(0);
+		CHECK(t.sum().item<int>() == 120-34);
+	}
+
+	SECTION("Create") {
+		TypedTensor<bool, 1> a({8}, backend.get());
+		a.fill(false);
+		a(3) = true;
+		CHECK(a.sum() == 1);
+		CHECK(a.tensor().dtype() == DType::Bool);
+	}
+
+	SECTION("Typed kernels") {
+		std::vector<int32_t> conns = {0, 1, 2, 3, 4, 5, 6, 7, 1, 3, 5, 7};
+		std::vector<float> perms = {0.3, 0.1, 0.2, 0.9, 0.5, 0.5, 0.05, 0.4, 0.2, 0.25, 0.8, 0.3};
+		Tensor connections = Tensor({3, 4}, conns.data(), backend.get());
+		Tensor permanences = Tensor({3, 4}, perms.data(), backend.get());
+		Tensor x = Tensor({8}, (const bool*)std::vector<uint8_t>{1, 1, 0, 1, 0, 1, 1, 0}.data(), backend.get());
+
+		// Same results as the dispatched ops
+		Tensor result = Tensor({3}, DType::Int32, backend.get());
+		detail::cellActivity(typed<bool, 1>(x), typed<int32_t, 2>(connections), typed<float, 2>(permanences), typed<int32_t, 1>(result), 0.15, 1);
+		CHECK(result.isSame(cellActivity(x, connections, permanences, 0.15, 1)));
+		Tensor half_perms = permanences.cast(DType::Half);
+		detail::cellActivity(typed<bool, 1>(x), typed<int32_t, 2>(connections), typed<half, 2>(half_perms), typed<int32_t, 1>(result), 0.15, 1);
+		CHECK(result.isSame(cellActivity(x, connections, half_perms, 0.15, 1)));
+
+		Tensor learn = Tensor({3}, (const bool*)std::vector<uint8_t>{1, 0, 1}.data(), backend.get());
+		Tensor expected = permanences.copy();
+		learnCorrilation(x, learn, connections, expected, 0.1, 0.05);
+		detail::learnCorrilation(typed<bool, 1>(x), typed<bool, 1>(learn), typed<int32_t, 2>(connections), typed<float, 2>(permanences), 0.1, 0.05);
+		CHECK(permanences.isSame(expected));
+
+		CHECK_THROWS(detail::cellActivity(typed<bool, 1>(x), typed<int32_t, 2>(connections.view({all(), range(2)}))
+			, typed<float, 2>(permanences), typed<int32_t, 1>(result), 0.15, 1));
+		CHECK_THROWS(detail::cellActivity(typed<bool, 1>(x), typed<int32_t, 2>(connections.view({all(), range(0, 4, 2)}))
+			, typed<float, 2>(permanences.view({all(), range(0, 4, 2)})), typed<int32_t, 1>(result), 0.15, 1));
+	}
+}
+
+TEST_CASE("RingBuffer")
+{
+	// Entry i is all zeros except bit i
+	auto entry = [](size_t i) {
+		Tensor t = zeros({8}, DType::Bool);
+		t.view({i}) = ones({1}, DType::Bool);
+		return t;
+	};
+	RingBuffer history(3, {8});
+	CHECK(history.empty());
+	CHECK(history.capacity() == 3);
+	CHECK(history.dtype() == DType::Bool);
+
+	SECTION("Push") {
+		history.push(entry(0));
+		history.push(entry(1));
+		CHECK(history.size() == 2);
+		CHECK(history.window().shape() == Shape({2, 8}));
+		CHECK(history.window().view({0}).isSame(entry(0)));
+		CHECK(history.latest().isSame(entry(1)));
+
+		for(size_t i=2;i<7;i++)
+			history.push(entry(i));
+		CHECK(history.full());
+		CHECK(history.size() == 3);
+		for(size_t i=0;i<3;i++) {
+			CHECK(history.window().view({i}).isSame(entry(4+i)));
+			CHECK(history.latest(i).isSame(entry(6-i)));
+		}
+		CHECK(history.window(2).view({0}).isSame(entry(5)));
+		CHECK(history.window(10).shape() == Shape({3, 8}));
+		CHECK_THROWS(history.latest(3));
+
+		history.clear();
+		CHECK(history.empty());
+	}
+
+	SECTION("The window is a view") {
+		for(size_t i=0;i<5;i++) {
+			history.push(entry(i));
+			Tensor w = history.window();
+			CHECK(w.iscontiguous());
+		}
+		Tensor w = history.window();
+		history.push(entry(5));
+		// The oldest entry of the old window is overwritten
+		CHECK(w.view({0}).isSame(entry(5)));
+		CHECK(w.view({1}).isSame(entry(3)));
+	}
+
+	SECTION("Inputs are checked") {
+		CHECK_THROWS(history.push(zeros({4}, DType::Bool)));
+		history.push(ones({8}, DType::Int32));
+		CHECK(history.latest().dtype() == DType::Bool);
+		CHECK_THROWS(RingBuffer(0, {8}));
+	}
+
+	SECTION("Batched ops") {
+		for(size_t i=0;i<5;i++)
+			history.push(entry(i));
+		Tensor overlaps = overlap(history.window(), entry(3));
+		CHECK(overlaps.shape() == Shape({3}));
+		CHECK(overlaps.toHost<int32_t>() == std::vector<int32_t>{0, 1, 0});
+
+		int32_t conn_data[] = {2, 3, 4};
+		float perm_data[] = {0.5, 0.5, 0.5};
+		Tensor connections = Tensor({3, 1}, conn_data);
+		Tensor permanences = Tensor({3, 1}, perm_data);
+		Tensor activity = batchCellActivity(history.window(), connections, permanences, 0.2, 1);
+		CHECK(activity.shape() == Shape({3, 3}));
+		for(size_t i=0;i<3;i++)
+			CHECK(activity.view({i}).isSame(cellActivity(history.window().view({i}), connections, permanences, 0.2, 1)));
+	}
+}
+
+TEST_CASE("Compression")
+{
+	SECTION("Synapse indices") {
+		std::vector<int32_t> v = {0, 3, 7, 100000, -1, -1, 5, 2, -7, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(), 0};
+		Tensor t = Tensor({3, 4}, v.data());
+		CompressedTensor c = compressTensor(t);
+		CHECK(c.codec == CompressedTensor::Codec::Delta);
+		CHECK(decompressTensor(c).isSame(t));
+
+		// Sorted indices take a byte each
+		std::vector<int32_t> indices(70000);
+		std::iota(indices.begin(), indices.end(), 0);
+		Tensor sorted = Tensor({700, 100}, indices.data());
+		c = compressTensor(sorted);
+		CHECK(c.data.size() < 80000);
+		CHECK(c.chunk_offsets.size() > 2);
+		CHECK(decompressTensor(c).isSame(sorted));
+	}
+
+	SECTION("Other types") {
+		std::vector<uint8_t> bits(100000);
+		for(size_t i=0;i<bits.size();i++)
+			bits[i] = i%3 == 0;
+		Tensor b = Tensor({10, 10000}, (const bool*)bits.data());
+		CompressedTensor c = compressTensor(b);
+		CHECK(c.data.size() == 100000/8);
+		CHECK(decompressTensor(c).isSame(b));
+
+		std::vector<float> values(1000);
+		for(size_t i=0;i<values.size();i++)
+			values[i] = i/999.f;
+		Tensor f = Tensor({1000}, values.data());
+		CHECK(decompressTensor(compressTensor(f)).isSame(f));
+		CHECK(decompressTensor(compressTensor(f[{range(10, 20)}])).isSame(f[{range(10, 20)}]));
+		for(int bits : {8, 16}) {
+			c = compressTensor(f, bits);
+			CHECK(c.data.size() == size_t(1000*bits/8));
+			Tensor d = decompressTensor(c);
+			CHECK(d.dtype() == DType::Float);
+			std::vector<float> a = f.toHost<float>();
+			std::vector<float> b = d.toHost<float>();
+			for(size_t i=0;i<a.size();i++)
+				CHECK(b[i] == Approx(a[i]).margin(1.f/((1<<bits)-1)));
+		}
+		CHECK(decompressTensor(compressTensor(f.cast(DType::Half), 16)).dtype() == DType::Half);
+
+		// Quantized values stay on their side of the threshold
+		for(DType dtype : {DType::Float, DType::Half}) {
+			Tensor p = f.cast(dtype);
+			for(float threshold : {0.21f, 0.5f, 0.9995f}) {
+				Tensor d = decompressTensor(compressTensor(p, 8, threshold));
+				CHECK((d > threshold).isSame(p > threshold));
+			}
+		}
+
+		CHECK(decompressTensor(compressTensor(Tensor())).has_value() == false);
+		CHECK(decompressTensor(compressTensor(ones({0}))).has_value() == false);
+		CHECK_THROWS(compressTensor(f, 12));
+	}
+
+	SECTION("States") {
+		SpatialPooler sp({256}, {1024});
+		StateDict states = sp.states();
+		states["list"] = std::vector<Tensor>{ones({4}), Tensor()};
+		StateDict compressed = compressState(states);
+		CHECK(compressedMemoryUsage(compressed)*3 < stateMemoryUsage(states));
+
+		StateDict restored = decompressState(compressed);
+		CHECK(std::any_cast<Shape>(restored.at("input_shape")) == Shape{256});
+		CHECK(std::any_cast<Tensor>(restored.at("connections")).isSame(sp.connections()));
+		CHECK(std::any_cast<Tensor>(restored.at("average_activity")).isSame(std::any_cast<Tensor>(states.at("average_activity"))));
+		auto list = std::any_cast<std::vector<Tensor>>(restored.at("list"));
+		CHECK(list[0].isSame(ones({4})));
+		CHECK(list[1].has_value() == false);
+
+		SpatialPooler sp2;
+		sp2.loadState(restored);
+		CHECK(sp2.permanences().shape() == sp.permanences().shape());
+	}
+}
+
+TEST_CASE("ModelCache")
+{
+	std::vector<std::string> paths;
+	for(int i=0;i<3;i++) {
+		SpatialPooler sp({32}, {64});
+		paths.push_back("model_cache_test_" + std::to_string(i) + ".cereal");
+		save(sp.states(), paths.back());
+	}
+	SpatialPooler sp({32}, {64});
+	size_t model_size = stateMemoryUsage(sp.states());
+	CHECK(model_size == sp.permanences().size()*(sizeof(int32_t)+sizeof(float)) + 64*sizeof(float));
+
+	ModelCache<SpatialPooler> cache(2*model_size);
+	for(int i=0;i<3;i++)
+		cache.add("model" + std::to_string(i), paths[i]);
+	CHECK(cache.numModels() == 3);
+	CHECK(cache.memoryUsage() == 0);
+	CHECK_THROWS(cache.get("not_a_model"));
+
+	SECTION("Lazy loading and LRU eviction") {
+		auto m0 = cache.get("model0");
+		CHECK(cache.isResident("model0"));
+		CHECK(cache.memoryUsage() == model_size);
+		cache.get("model1");
+		cache.get("model0");
+		cache.get("model2");
+		CHECK(cache.memoryUsage() == 2*model_size);
+		CHECK(cache.isResident("model0"));
+		CHECK(cache.isResident("model1") == false);
+		CHECK(cache.isResident("model2"));
+
+		auto stats = cache.stats();
+		CHECK(stats.hits == 1);
+		CHECK(stats.misses == 3);
+		CHECK(stats.evictions == 1);
+		CHECK(stats.averageLoadTime() > 0);
+
+		// The model is loaded correctly
+		SpatialPooler sp;
+		sp.loadState(load(paths[0]));
+		CHECK(m0->permanences().isSame(sp.permanences()));
+	}
+
+	SECTION("Concurrent requests") {
+		// Requests for the same model wait for the one loading it. Others go ahead
+		std::vector<std::shared_ptr<SpatialPooler>> models(4);
+		std::vector<std::thread> threads;
+		for(size_t i=0;i<models.size();i++)
+			threads.emplace_back([&, i](){ models[i] = cache.get(i%2 == 0 ? "model0" : "model1"); });
+		for(auto& t : threads)
+			t.join();
+
+		CHECK(models[0] == models[2]);
+		CHECK(models[1] == models[3]);
+		CHECK(models[0] != models[1]);
+		auto stats = cache.stats();
+		CHECK(stats.misses == 2);
+		CHECK(stats.hits == 2);
+		CHECK(cache.memoryUsage() == 2*model_size);
+	}
+
+	SECTION("Demotion to host") {
+		auto host = std::make_shared<CPUBackend>();
+		cache.setHostTier(host.get(), model_size);
+		cache.get("model0");
+		cache.get("model1");
+		cache.get("model2");
+		CHECK(cache.isDemoted("model0"));
+		CHECK(cache.hostMemoryUsage() == model_size);
+
+		auto m0 = cache.get("model0");
+		CHECK(m0->permanences().backend() == defaultBackend());
+		CHECK(cache.isResident("model0"));
+		CHECK(cache.isDemoted("model1"));
+
+		auto stats = cache.stats();
+		CHECK(stats.misses == 3);
+		CHECK(stats.demotions == 2);
+		CHECK(stats.promotions == 1);
+	}
+
+	SECTION("Compression") {
+		cache.setCompression(std::chrono::milliseconds(20));
+		cache.get("model0");
+		cache.get("model1");
+		cache.get("model2");
+		CHECK(cache.isCompressed("model0")); // Compressed instead of dropped
+		CHECK(cache.compressedMemoryUsage() > 0);
+		CHECK(cache.compressedMemoryUsage() < model_size/2);
+		CHECK(cache.memoryUsage("model0") == cache.compressedMemoryUsage());
+
+		auto m0 = cache.get("model0");
+		CHECK(cache.isResident("model0"));
+		CHECK(cache.isCompressed("model1"));
+		SpatialPooler sp;
+		sp.loadState(load(paths[0]));
+		CHECK(m0->connections().isSame(sp.connections()));
+		std::vector<float> p0 = m0->permanences().toHost<float>();
+		std::vector<float> p1 = sp.permanences().toHost<float>();
+		for(size_t i=0;i<p0.size();i++)
+			CHECK(p0[i] == Approx(p1[i]).margin(1.f/255));
+		// The same synapses are connected, so the model computes the same thing
+		CHECK(m0->compute(ones({32})).isSame(sp.compute(ones({32}))));
+
+		// Idle models are compressed too, but only by compressIdle()
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		cache.get("model2");
+		CHECK(cache.isResident("model0"));
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		cache.compressIdle();
+		CHECK(cache.memoryUsage() == 0);
+		for(int i=0;i<3;i++)
+			CHECK(cache.isCompressed("model" + std::to_string(i)));
+
+		auto stats = cache.stats();
+		CHECK(stats.misses == 3);
+		CHECK(stats.compressions == 4);
+		CHECK(stats.decompressions == 1);
+		CHECK(stats.averageDecompressTime() > 0);
+	}
+
+	for(const auto& path : paths)
+		std::remove(path.c_str());
+}
+
+TEST_CASE("SimulationBackend")
+{
+	CostTable costs;
+	costs.ops["cellActivity"].per_synapse = 1e-9;
+	costs.fallback.overhead = 1e-6;
+	auto sim = std::make_shared<SimulationBackend>(costs, 0.25f);
+
+	SECTION("Tensors") {
+		size_t memory = sim->report().memory;
+		{
+			Tensor t = ones({4, 4}, DType::Int32, sim.get());
+			CHECK(t.backend() == sim.get());
+			CHECK(sim->report().memory == memory + 4*4*sizeof(int32_t));
+			Tensor s = (t + t).sum(1);
+			CHECK(s.shape() == Shape({4}));
+			CHECK(s.dtype() == DType::Int32);
+			CHECK((t > s.reshape({4, 1})).dtype() == DType::Bool);
+			CHECK(t.cast(DType::Float).exp().dtype() == DType::Float);
+			CHECK(s.toHost<int32_t>() == std::vector<int32_t>(4, 0)); // There's no data
+		}
+		CHECK(sim->report().memory == memory);
+		CHECK(sim->report().peak_memory >= memory + 4*4*sizeof(int32_t));
+	}
+
+	SECTION("SpatialPooler") {
+		SpatialPooler sp({256}, {128}, 0.75, 42, 0.1, 0, sim.get());
+		sim->resetReport();
+		Tensor x = zeros({256}, DType::Bool, sim.get());
+		Tensor y = sp.compute(x);
+		CHECK(y.shape() == Shape({128}));
+		CHECK(y.dtype() == DType::Bool);
+		sp.learn(x, y);
+
+		SimulationReport report = sim->report();
+		size_t num_synapses = sp.connections().size();
+		CHECK(report.ops["cellActivity"].calls == 1);
+		CHECK(report.ops["cellActivity"].synapses == num_synapses);
+		CHECK(report.ops["cellActivity"].time == Approx(num_synapses*1e-9));
+		CHECK(report.ops["learnCorrilation"].synapses == 32*(size_t)sp.connections().shape().back()); // 25% of the cells learn
+		CHECK(report.ops["globalInhibition"].time == Approx(1e-6));
+		CHECK(report.total().time > 0);
+		CHECK(report.peak_memory >= num_synapses*(sizeof(int32_t)+sizeof(float)));
+	}
+
+	SECTION("TemporalMemory") {
+		TemporalMemory tm({64}, 8, 32, sim.get());
+		Tensor x = zeros({64}, DType::Bool, sim.get());
+		auto [pred, active] = tm.compute(x, Tensor());
+		CHECK(pred.shape() == Shape({64, 8}));
+		CHECK(active.shape() == Shape({64, 8}));
+		tm.learn(active, active);
+		CHECK(tm.rollout(active, 3).shape() == Shape({3, 64}));
+
+		SimulationReport report = sim->report();
+		CHECK(report.ops["growSynapses"].calls == 1);
+		CHECK(report.ops["rollout"].synapses == 3*64*8*32);
+
+		// Half of the synapse slots in use
+		auto half_used = std::make_shared<SimulationBackend>(costs, 0.25f, 0.5f);
+		TemporalMemory tm2({64}, 8, 32, half_used.get());
+		tm2.compute(zeros({64}, DType::Bool, half_used.get()), Tensor());
+		CHECK(half_used->report().ops["cellActivity"].synapses == 64*8*32/2);
+	}
+
+	SECTION("Large inputs") {
+		// The simulation doesn't allocate, so inputs beyond 2^31 cells can be tried out
+		Tensor c = constant<int32_t>({4, 8}, -1, sim.get());
+		Tensor p = zeros({4, 8}, DType::Float, sim.get());
+		Tensor y = ones({4}, DType::Bool, sim.get());
+		const intmax_t max_input = std::numeric_limits<int32_t>::max();
+		CHECK_NOTHROW(growSynapses(zeros({max_input}, DType::Bool, sim.get()), y, c, p, 0.21));
+		CHECK_THROWS_WITH(growSynapses(zeros({max_input+1}, DType::Bool, sim.get()), y, c, p, 0.21), Catch::Contains("2^31-1"));
+	}
+
+	SECTION("Calibration") {
+		CostTable table = CostTable::calibrate(defaultBackend());
+		CHECK(table.ops.count("cellActivity") == 1);
+		for(const auto& [name, cost] : table.ops) {
+			CHECK(cost.overhead >= 0);
+			CHECK(cost.per_byte >= 0);
+			CHECK(cost.per_synapse >= 0);
+		}
+	}
+}
+
+TEST_CASE("HybridBackend")
+{
+	// A second CPU backend stands in for the device
+	auto host = std::make_shared<CPUBackend>();
+	auto device = std::make_shared<CPUBackend>();
+	auto hybrid = std::make_shared<HybridBackend>(host, device);
+	using Placement = HybridBackend::Placement;
+
+	CHECK_THROWS(HybridBackend(host, host));
+
+	SECTION("Placement") {
+		Tensor small = ones({16}, DType::Int32, hybrid.get());
+		Tensor s = small + small;
+		CHECK(hybrid->placementOf(s.pimpl()) == Placement::Host);
+		CHECK(s.sum().item<int32_t>() == 32);
+		CHECK(hybrid->stats().device_ops == 0);
+
+		// Large ops move their inputs to the device. They stay there
+		Tensor large = ones({1<<20}, DType::Int32, hybrid.get());
+		Tensor l = large + large;
+		CHECK(hybrid->placementOf(large.pimpl()) == Placement::Device);
+		CHECK(hybrid->placementOf(l.pimpl()) == Placement::Device);
+		CHECK(hybrid->stats().migrations == 1);
+		CHECK((l*l).sum().item<int32_t>() == 4*(1<<20));
+		CHECK(hybrid->stats().migrations == 1);
+		CHECK(hybrid->stats().device_ops == 3);
+
+		// Views share the buffer
+		large[{range(2)}] = zeros({2}, DType::Int32, hybrid.get());
+		std::vector<int32_t> v = large[{range(4)}].toHost<int32_t>();
+		CHECK(v == std::vector<int32_t>({0, 0, 1, 1}));
+	}
+
+	SECTION("No device") {
+		auto host_only = std::make_shared<HybridBackend>(host, nullptr);
+		Tensor t = ones({1<<20}, DType::Int32, host_only.get());
+		CHECK((t+t).sum().item<int32_t>() == 2*(1<<20));
+		CHECK(host_only->stats().device_ops == 0);
+		CHECK(host_only->stats().host_ops == 2);
+	}
+
+	SECTION("Matches the host") {
+		// Free transfers so the synapse ops run on the device and the rest on the host
+		PlacementCost cost;
+		cost.transfer_latency = 0;
+		cost.transfer_per_byte = 0;
+		auto mixed = std::make_shared<HybridBackend>(host, device, cost);
+
+		SpatialPooler sp1({256}, {128}, 0.75, 42, 0.1, 0, host.get());
+		SpatialPooler sp2({256}, {128}, 0.75, 42, 0.1, 0, mixed.get());
+		std::mt19937 rng(42);
+		for(int i=0;i<4;i++) {
+			std::vector<uint8_t> bits(256);
+			for(auto& b : bits)
+				b = rng()%8 == 0;
+			Tensor x1 = Tensor({256}, (const bool*)bits.data(), host.get());
+			Tensor x2 = x1.to(mixed.get());
+
+			Tensor y1 = sp1.compute(x1);
+			Tensor y2 = sp2.compute(x2);
+			CHECK(y1.isSame(y2.to(host.get())));
+			sp1.learn(x1, y1);
+			sp2.learn(x2, y2);
+		}
+		CHECK(sp1.permanences().isSame(sp2.permanences().to(host.get())));
+		CHECK(mixed->placementOf(sp2.permanences().pimpl()) == Placement::Device);
+		CHECK(mixed->stats().host_ops > 0);
+		CHECK(mixed->stats().device_ops > 0);
+
+		TemporalMemory tm({128}, 4, 16, mixed.get());
+		Tensor last = zeros({128, 4}, DType::Bool, mixed.get());
+		auto [pred, active] = tm.compute(sp2.compute(ones({256}, DType::Bool, mixed.get())), last);
+		tm.learn(active, last);
+		CHECK(active.backend() == mixed.get());
+		CHECK(active.shape() == Shape({128, 4}));
+	}
+}
+
+TEST_CASE("Priority")
+{
+	auto backend = std::make_shared<CPUBackend>();
+	resetLatencyStats();
+
+	SECTION("Scopes") {
+		CHECK(currentPriority() == Priority::Normal);
+		{
+			PriorityScope scope(Priority::Batch);
+			CHECK(currentPriority() == Priority::Batch);
+			{
+				PriorityScope inner(Priority::Latency);
+				CHECK(currentPriority() == Priority::Latency);
+			}
+			CHECK(currentPriority() == Priority::Batch);
+		}
+		CHECK(currentPriority() == Priority::Normal);
+	}
+
+	SECTION("Latency statistics") {
+		SpatialPooler sp({256}, {128}, 0.75, 42, 0.1, 0, backend.get());
+		Tensor x = ones({256}, DType::Bool, backend.get());
+
+		// Background learning while the main thread runs inference
+		std::thread learner([&](){
+			PriorityScope scope(Priority::Batch);
+			SpatialPooler background({256}, {128}, 0.75, 42, 0.1, 0, backend.get());
+			for(int i=0;i<8;i++)
+				background.learn(x, background.compute(x));
+		});
+		{
+			PriorityScope scope(Priority::Latency);
+			for(int i=0;i<8;i++)
+				CHECK(sp.compute(x).isSame(sp.compute(x)));
+		}
+		learner.join();
+
+		LatencyStats latency = latencyStats(Priority::Latency);
+		LatencyStats batch = latencyStats(Priority::Batch);
+		CHECK(latency.count > 0);
+		CHECK(batch.count > 0);
+		CHECK(std::accumulate(latency.histogram.begin(), latency.histogram.end(), size_t(0)) == latency.count);
+		CHECK(latency.mean() <= latency.max);
+		CHECK(latency.percentile(0.5) <= latency.percentile(0.99));
+		CHECK(latency.percentile(1) <= latency.max);
+
+		resetLatencyStats();
+		CHECK(latencyStats(Priority::Latency).count == 0);
+	}
+
+	SECTION("Latencies recorded by many threads are merged") {
+		std::vector<std::thread> threads;
+		for(int t=0;t<4;t++) {
+			threads.emplace_back([t](){
+				for(int i=0;i<1000;i++)
+					recordLatency(Priority::Normal, 3e-6*(t+1));
+			});
+		}
+		recordLatency(Priority::Normal, 1e-3);
+		LatencyStats running = latencyStats(Priority::Normal);
+		CHECK(running.count <= 4001);
+		for(auto& t : threads)
+			t.join();
+
+		// The exited threads are counted too
+		LatencyStats stats = latencyStats(Priority::Normal);
+		CHECK(stats.count == 4001);
+		CHECK(stats.histogram[1] == 1000); // 3us
+		CHECK(stats.histogram[2] == 1000); // 6us
+		CHECK(stats.histogram[3] == 2000); // 9us and 12us
+		CHECK(stats.histogram[9] == 1); // 1ms
+		CHECK(stats.max == Approx(1e-3));
+		CHECK(stats.total == Approx(1e-3 + 1000*3e-6*(1+2+3+4)));
+		CHECK(latencyStats(Priority::Latency).count == 0);
+	}
+}
+
+TEST_CASE("RealtimePool")
+{
+	RealtimeOptions options;
+	options.num_threads = 3;
+	RealtimePool pool(options);
+	REQUIRE(pool.size() == 3);
+
+	SECTION("Run") {
+		std::vector<std::atomic<int>> calls(pool.size());
+		for(int i=0;i<100;i++)
+			pool.run([&](size_t i, size_t n) { calls[i] += (n == pool.size()); });
+		for(const auto& c : calls)
+			CHECK(c == 100);
+
+		CHECK_THROWS_AS(pool.run([](size_t i, size_t n) { if(i == 1) throw EtError("worker failed"); }), EtError);
+		CHECK_NOTHROW(pool.run([](size_t i, size_t n) {}));
+	}
+
+	SECTION("Kernels") {
+		auto backend = std::make_shared<CPUBackend>();
+		SpatialPooler sp1({256}, {128}, 0.75, 42, 0.1, 0, backend.get());
+		SpatialPooler sp2({256}, {128}, 0.75, 42, 0.1, 0, backend.get());
+		MemoryPlanner planner(backend.get());
+
+		CHECK(currentRealtimePool() == nullptr);
+		for(int i=0;i<4;i++) {
+			Tensor x = encoder::scalar(0.2*i, 0, 1, 256, 32).to(backend.get());
+			Tensor y1 = sp1.compute(x);
+			sp1.learn(x, y1);
+
+			RealtimeScope scope(pool);
+			CHECK(currentRealtimePool() == &pool);
+			planner.beginStep();
+			Tensor y2 = sp2.compute(x);
+			sp2.learn(x, y2);
+			planner.endStep();
+			CHECK(y1.isSame(y2));
+			CHECK(y2.sum().item<int>() == y1.sum().item<int>());
+		}
+		CHECK(currentRealtimePool() == nullptr);
+		CHECK(sp1.permanences().isSame(sp2.permanences()));
+	}
+
+#if defined(__linux__)
+	SECTION("Pinning") {
+		CHECK_THROWS(RealtimePool({3, {0}}));
+		RealtimePool pinned({2, {0, 0}});
+		CHECK(pinned.size() == 2);
+		CHECK(RealtimePool({0, {0, 0, 0}}).size() == 3);
+
+		cpu_set_t before;
+		pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+		{
+			// The calling thread is thread 0, pinned to cpus[0]
+			RealtimeScope scope(pinned);
+			cpu_set_t set;
+			pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+			CHECK(CPU_COUNT(&set) == 1);
+			CHECK(CPU_ISSET(0, &set));
+			CHECK(sched_getcpu() == 0);
+		}
+		cpu_set_t after;
+		pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+		CHECK(CPU_EQUAL(&before, &after));
+	}
+#endif
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("Shared states")
+{
+	auto backend = std::make_shared<CPUBackend>();
+	std::string name = "etaler_test_" + std::to_string(getpid());
+
+	SpatialPooler sp({32}, {64});
+	StateDict states = sp.states();
+	states["tensor_list"] = std::vector<Tensor>{ones({4}), Tensor()};
+	std::vector<float> perms = sp.permanences().toHost<float>();
+
+	CHECK(latestSharedGeneration(name) == 0);
+	CHECK_THROWS(attachShared(name, nullptr, backend.get()));
+	CHECK(publishShared(states, name) == 1);
+	CHECK(latestSharedGeneration(name) == 1);
+
+	uint64_t generation = 0;
+	StateDict shared = attachShared(name, &generation, backend.get());
+	CHECK(generation == 1);
+	CHECK(std::any_cast<float>(shared.at("permanence_inc")) == std::any_cast<float>(states.at("permanence_inc")));
+	CHECK(std::any_cast<Shape>(shared.at("input_shape")) == Shape{32});
+
+	Tensor p = std::any_cast<Tensor>(shared.at("permanences"));
+	CHECK(p.backend() == backend.get());
+	CHECK(p.toHost<float>() == perms);
+	auto list = std::any_cast<std::vector<Tensor>>(shared.at("tensor_list"));
+	REQUIRE(list.size() == 2);
+	CHECK(list[0].toHost<int>() == std::vector<int>{1, 1, 1, 1});
+	CHECK(list[1].has_value() == false);
+
+	SECTION("Writes are private to the process") {
+		float* ptr = (float*)p.data();
+		ptr[0] = 42;
+		StateDict shared2 = attachShared(name, nullptr, backend.get());
+		CHECK(std::any_cast<Tensor>(shared2.at("permanences")).toHost<float>() == perms);
+	}
+
+	SECTION("New generations") {
+		states["permanence_inc"] = 0.5f;
+		CHECK(publishShared(states, name) == 2);
+		CHECK(latestSharedGeneration(name) == 2);
+		StateDict shared2 = attachShared(name, &generation, backend.get());
+		CHECK(generation == 2);
+		CHECK(std::any_cast<float>(shared2.at("permanence_inc")) == 0.5f);
+
+		// Tensors attached to the old generation are still usable
+		CHECK(p.toHost<float>() == perms);
+	}
+
+	SECTION("Segments left by a crashed publish are replaced") {
+		// A publisher died after creating generation 2 but before making it visible
+		std::string orphan = "/" + name + ".2";
+		int fd = shm_open(orphan.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+		REQUIRE(fd != -1);
+		CHECK(ftruncate(fd, 16) == 0);
+		close(fd);
+		CHECK(latestSharedGeneration(name) == 1);
+
+		states["permanence_inc"] = 0.25f;
+		CHECK(publishShared(states, name) == 2);
+		StateDict shared2 = attachShared(name, &generation, backend.get());
+		CHECK(generation == 2);
+		CHECK(std::any_cast<float>(shared2.at("permanence_inc")) == 0.25f);
+		CHECK(std::any_cast<Tensor>(shared2.at("permanences")).toHost<float>() == perms);
+	}
+
+	removeShared(name);
+	CHECK(latestSharedGeneration(name) == 0);
+}
+
+TEST_CASE("StreamStateStore")
+{
+	std::string path = "/tmp/etaler_test_streams_" + std::to_string(getpid());
+	unlink(path.c_str());
+	Shape state_shape = {8, 4};
+
+	Tensor active = zeros({2, 8, 4}, DType::Bool);
+	Tensor pred = zeros({2, 8, 4}, DType::Bool);
+	active.view({0, 1}) = ones({4}, DType::Bool);
+	active.view({1, 3, 2}) = ones({1}, DType::Bool);
+	pred.view({1, 7, 0}) = ones({1}, DType::Bool);
+
+	{
+		StreamStateStore store(path, 1000, state_shape, 8);
+		CHECK(store.maxActiveCells() == 8);
+
+		// Streams never stored are empty
+		auto [a, p] = store.load({5, 999});
+		CHECK(a.shape() == Shape({2, 8, 4}));
+		CHECK(a.any() == false);
+		CHECK(p.any() == false);
+
+		store.store({999, 3}, active, pred);
+		// Pending writes are visible before they reach the file
+		auto [a2, p2] = store.load({3, 999});
+		CHECK(a2.view({0}).isSame(active.view({1})));
+		CHECK(a2.view({1}).isSame(active.view({0})));
+		CHECK(p2.view({0}).isSame(pred.view({1})));
+
+		CHECK_THROWS(store.store({1000, 0}, active, pred));
+		CHECK_THROWS(store.store({0, 1}, ones({2, 8, 4}, DType::Bool), pred));
+		CHECK_THROWS(store.load({1000}));
+		store.flush();
+		CHECK(store.pendingWrites() == 0);
+	}
+
+	CHECK_THROWS(StreamStateStore(path, 1000, {8, 2}, 8));
+	{
+		StreamStateStore store(path, 1000, state_shape, 8);
+		store.prefetch({3, 999});
+		auto [a, p] = store.load({999, 3, 4});
+		CHECK(a.view({range(2)}).isSame(active));
+		CHECK(p.view({range(2)}).isSame(pred));
+		CHECK(a.view({2}).any() == false);
+	}
+	unlink(path.c_str());
+}
+#endif
+
 // TEST_CASE("Serealize")
 // {
 // 	using namespace et;